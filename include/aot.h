@@ -0,0 +1,213 @@
+#ifndef MCSCRIPT_V3_AOT_H
+#define MCSCRIPT_V3_AOT_H
+
+#include <object.h>
+#include <evaluator.h>
+#include <environment.h>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AotRuntime;
+
+using AotEnv = std::shared_ptr<Environment<Object*>>;
+
+// a translated function body (or the top level), run with its parameters bound in env
+using AotBody = Object* (*)(AotRuntime& rt, const AotEnv& env);
+
+// a function literal translated to C++: the runtime counterpart of Function
+class AotFunction : public Object {
+  public:
+    AotFunction(const std::vector<std::string>* params, AotBody body, AotEnv env, const char* source)
+      : params_(params), body_(body), env_(env), source_(source) {
+      // empty
+    }
+
+    inline const std::vector<std::string>& GetParams() const {
+      return *params_;
+    }
+
+    inline AotBody GetBody() const {
+      return body_;
+    }
+
+    inline const AotEnv& GetEnv() const {
+      return env_;
+    }
+
+    inline ObjectType Type() const override {
+      return ObjectType::FUNCTION_OBJ;
+    }
+
+    // the same text Function::Inspect gives for the literal
+    inline std::string Inspect() const override {
+      return source_;
+    }
+
+  private:
+    const std::vector<std::string>* params_;
+    AotBody body_;
+    AotEnv env_;
+    const char* source_;
+};
+
+/*
+ * what programs translated by --emit-cpp link against. Every statement and
+ * expression becomes a call in here, and every operation is handed to an
+ * Evaluator, so a translated program prints, collects garbage and fails
+ * exactly like the interpreter running the same source
+ */
+class AotRuntime {
+  public:
+    AotRuntime();
+    ~AotRuntime();
+
+    AotRuntime(const AotRuntime&) = delete;
+    AotRuntime& operator=(const AotRuntime&) = delete;
+
+    // runs the translated top level, reporting an error it ends with like bin/main
+    int Main(AotBody program);
+
+    /* values */
+    inline Object* NewInteger(long value) {
+      return Track_(new Integer(value));
+    }
+
+    inline Object* NewString(const char* value) {
+      return Track_(new String(value));
+    }
+
+    inline Object* NewError(const char* message) {
+      return Track_(new Error(message));
+    }
+
+    inline Object* Bool(bool value) {
+      return value ? evaluator_->TRUE() : evaluator_->FALSE();
+    }
+
+    inline Object* True() {
+      return evaluator_->TRUE();
+    }
+
+    inline Object* Null() {
+      return evaluator_->NULL_T();
+    }
+
+    Object* NewArray(std::initializer_list<Object*> elements);
+    // keys and values alternating, an error if a key cannot be one
+    Object* NewHash(std::initializer_list<Object*> pairs);
+    // a record of shape with values[i] in slot offsets[i]
+    inline Object* NewRecord(const Shape* shape, const std::vector<int>& offsets,
+        std::initializer_list<Object*> values) {
+      return evaluator_->NewRecord(shape, offsets, values);
+    }
+    Object* NewFunction(const std::vector<std::string>* params, AotBody body, const AotEnv& env,
+        const char* source);
+
+    /* names */
+    inline Object* Name(const AotEnv& env, const char* name) {
+      return evaluator_->EvalName(name, env);
+    }
+
+    inline Object* Assign(const AotEnv& env, const char* name, Object* value) {
+      return evaluator_->EvalAssign(name, value, env);
+    }
+
+    void Var(const AotEnv& env, const char* name, Object* value);
+    // a hoisted loop invariant is bound even when it failed
+    void Hoist(const AotEnv& env, const char* name, Object* value);
+    // drops what a for loop's scope holds when the loop is done
+    void ReleaseLoop(const AotEnv& env);
+
+    /* operations */
+    inline Object* Infix(const char* op, Object* left, Object* right) {
+      return evaluator_->EvalInfix(op, left, right);
+    }
+
+    inline Object* Prefix(const char* op, Object* right) {
+      return evaluator_->EvalPrefix(op, right);
+    }
+
+    inline Object* CheckIndex(Object* idx) {
+      return evaluator_->CheckIndex(idx);
+    }
+
+    inline Object* Index(Object* idx, Object* left) {
+      return evaluator_->EvalIndex(idx, left);
+    }
+
+    inline Object* Field(Object* obj, const char* name, FieldCache& cache) {
+      return evaluator_->EvalField(obj, name, cache);
+    }
+
+    inline bool Truthy(Object* obj) {
+      return evaluator_->IsTruthy(obj);
+    }
+
+    inline bool IsError(Object* obj) {
+      return evaluator_->IsError(obj);
+    }
+
+    // whether a block stops after a statement that produced obj
+    inline bool Stops(Object* obj) {
+      return obj != nullptr && (obj->Type() == ObjectType::RETURN_VALUE_OBJ
+          || obj->Type() == ObjectType::ERROR_OBJ);
+    }
+
+    // whether the top level stops after a statement; collects garbage when it does not
+    bool EndStatement(Object*& result);
+
+    /* calls */
+    inline Object* Return(Object* value) {
+      return Track_(new ReturnValue(value));
+    }
+
+    inline Object* TailCall() const {
+      return TAIL_CALL_;
+    }
+
+    // a tail call hands the callee back to the caller's Call loop through TailCall()
+    Object* Call(Object* callee, std::vector<Object*> args, bool tail = false);
+
+    /*
+     * typed bodies (plain long arithmetic for integer only functions) give
+     * up when they run out of stack: the call is then run again untyped,
+     * which reports the overflow the way the interpreter does
+     */
+    inline bool StackExhausted() const {
+      return evaluator_->StackExhausted();
+    }
+
+    inline void Bail() {
+      bailed_ = true;
+    }
+
+    inline bool Bailed() const {
+      return bailed_;
+    }
+
+    inline void ResetBail() {
+      bailed_ = false;
+    }
+
+    // whether every name is bound in the global scope above env
+    bool Bound(const AotEnv& env, std::initializer_list<const char*> names) const;
+
+  private:
+    inline Object* Track_(Object* obj) {
+      evaluator_->TrackObject(obj);
+      return obj;
+    }
+
+    Object* Invoke_(AotFunction* function, std::vector<Object*> args);
+
+    std::shared_ptr<Evaluator> evaluator_;
+    ReturnValue* TAIL_CALL_;
+    AotFunction* tailCallFn_;
+    std::vector<Object*> tailCallArgs_;
+    bool bailed_;
+};
+
+
+#endif // MCSCRIPT_V3_AOT_H
@@ -4,7 +4,51 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <stdint.h>
 #include <token.h>
+#include <environment.h>
+
+class Object;
+class Shape;
+class JitCode;
+class VmChunk;
+
+/*
+ * state of a self-specializing InfixExpression: it starts out UNINITIALIZED,
+ * rewrites itself to an integer-only kind once it has seen integer operands
+ * a few times, and falls back to GENERIC for good when a guard fails
+ */
+enum class InfixKind : int {
+  UNINITIALIZED,
+  GENERIC,
+  INT_ADD,
+  INT_SUB,
+  INT_MUL,
+  INT_DIV,
+  INT_LT,
+  INT_GT,
+  INT_EQ,
+  INT_NOT_EQ
+};
+
+/*
+ * what escape analysis found out about a scope: it ESCAPES when a closure
+ * may keep its environment alive, otherwise it is LOCAL (a function body or
+ * for loop can then live in the evaluating frame, a closure copies only the
+ * variables it uses)
+ */
+enum class ScopeEscape : int {
+  UNKNOWN,
+  ESCAPES,
+  LOCAL
+};
+
+// call counter and machine code the JIT keeps for one function body
+struct JitState {
+  int calls = 0;
+  bool failed = false;
+  std::shared_ptr<JitCode> code;
+};
 
 // Node interface
 class Node {
@@ -46,8 +90,22 @@ class Program : public Node {
       statements_.push_back(stmt);
     }
 
+    // whether the Resolver has annotated the function literals in it
+    inline bool IsResolved() const {
+      return resolved_;
+    }
+
+    inline void SetResolved() {
+      resolved_ = true;
+    }
+
+    inline void SetStatements(std::vector<std::shared_ptr<Statement>> stmts) {
+      statements_ = stmts;
+    }
+
   private:
     std::vector<std::shared_ptr<Statement>> statements_;
+    bool resolved_ = false;
 };
 
 class Identifier : public Expression {
@@ -61,7 +119,7 @@ class Identifier : public Expression {
       return token_->GetLiteral();
     }
 
-    inline std::string GetValue() const {
+    inline const std::string& GetValue() const {
       return value_;
     }
 
@@ -69,6 +127,31 @@ class Identifier : public Expression {
       return token_;
     }
 
+    /*
+     * slot this identifier resolved to when last evaluated in env, nullptr
+     * when it was evaluated elsewhere since or a scope on the way gained a
+     * binding (and so might now shadow the one found)
+     */
+    inline Object** GetCachedSlot(const Environment<Object*>* env) const {
+      if (env->GetId() != cacheEnv_ || env->GetVersion(cacheDepth_) != cacheVersion_) {
+        return nullptr;
+      }
+
+      return cacheSlot_;
+    }
+
+    // depth is how many scopes out of env the slot is
+    inline void SetCachedSlot(const Environment<Object*>* env, Object** slot, size_t depth) {
+      cacheEnv_ = env->GetId();
+      cacheDepth_ = depth;
+      cacheVersion_ = env->GetVersion(depth);
+      cacheSlot_ = slot;
+    }
+
+    inline size_t GetCachedDepth() const {
+      return cacheDepth_;
+    }
+
     std::string String() const override;
   
   protected:
@@ -77,6 +160,10 @@ class Identifier : public Expression {
   private:
     std::string value_;
     std::shared_ptr<Token> token_;
+    uint64_t cacheEnv_ = 0;
+    size_t cacheDepth_ = 0;
+    uint64_t cacheVersion_ = 0;
+    Object** cacheSlot_ = nullptr;
 
 };
 
@@ -165,6 +252,15 @@ class ReturnStatement : public Statement {
     inline void SetReturnVal(std::shared_ptr<Expression> exp) {
       return_value_ = exp;
     }
+
+    // true when this returns a call in tail position of a function body
+    inline bool IsTailCall() const {
+      return tailCall_;
+    }
+
+    inline void SetTailCall(bool tailCall) {
+      tailCall_ = tailCall;
+    }
   
   protected:
     inline void StatementNode_() const override {}
@@ -173,6 +269,7 @@ class ReturnStatement : public Statement {
   private:
     std::shared_ptr<Token> token_;
     std::shared_ptr<Expression> return_value_;
+    bool tailCall_ = false;
 };
 
 class IntegerLiteral : public Expression {
@@ -191,8 +288,12 @@ class IntegerLiteral : public Expression {
       return value_;
     }
 
-    inline void SetValue(long value) {
-      value_ = value;
+    // also makes the constant for value
+    void SetValue(long value);
+
+    // the Integer every evaluation of this literal gives
+    inline Object* GetConstant() const {
+      return constant_;
     }
 
   protected:
@@ -201,7 +302,7 @@ class IntegerLiteral : public Expression {
   private:
     std::shared_ptr<Token> token_;
     long value_;
-  
+    Object* constant_ = nullptr;
     
 };
 
@@ -215,6 +316,10 @@ class PrefixExpression : public Expression {
 
     std::string String() const override;
 
+    inline std::shared_ptr<Token> GetToken() const {
+      return token_;
+    }
+
     inline std::shared_ptr<Expression> GetRight() const {
       return right_;
     }
@@ -244,6 +349,10 @@ class InfixExpression : public Expression {
       return token_->GetLiteral();
     }
 
+    inline std::shared_ptr<Token> GetToken() const {
+      return token_;
+    }
+
     inline std::shared_ptr<Expression> GetLeft() const {
       return left_;
     }
@@ -256,11 +365,27 @@ class InfixExpression : public Expression {
       return op_;
     }
 
+    inline void SetLeft(std::shared_ptr<Expression> left) {
+      left_ = left;
+    }
 
     inline void SetRight(std::shared_ptr<Expression> right) {
       right_ = right;
     }
 
+    inline InfixKind GetKind() const {
+      return kind_;
+    }
+
+    inline void SetKind(InfixKind kind) {
+      kind_ = kind;
+    }
+
+    // number of times this node has seen two integer operands while UNINITIALIZED
+    inline int CountIntegerHit() {
+      return ++integerHits_;
+    }
+
     std::string String() const override;
 
   protected:
@@ -271,6 +396,8 @@ class InfixExpression : public Expression {
     std::shared_ptr<Expression> left_;
     std::string op_;
     std::shared_ptr<Expression> right_;
+    InfixKind kind_ = InfixKind::UNINITIALIZED;
+    int integerHits_ = 0;
 };
 
 class BooleanExpression : public Expression {
@@ -317,6 +444,32 @@ class BlockStatement : public Statement {
       return statements_;
     }
 
+    inline void SetStatements(std::vector<std::shared_ptr<Statement>> stmts) {
+      statements_ = stmts;
+    }
+
+    // escape analysis of the scope this block runs in as a function body
+    inline ScopeEscape GetEscape() const {
+      return escape_;
+    }
+
+    inline void SetEscape(ScopeEscape escape) {
+      escape_ = escape;
+    }
+
+    inline JitState& GetJit() {
+      return jit_;
+    }
+
+    // the body flattened for the VM, compiled on its first call
+    inline const std::shared_ptr<VmChunk>& GetChunk() const {
+      return chunk_;
+    }
+
+    inline void SetChunk(std::shared_ptr<VmChunk> chunk) {
+      chunk_ = chunk;
+    }
+
     std::string String() const override;
 
   protected:
@@ -325,6 +478,9 @@ class BlockStatement : public Statement {
   private:
     std::shared_ptr<Token> token_;
     std::vector<std::shared_ptr<Statement>> statements_;
+    ScopeEscape escape_ = ScopeEscape::UNKNOWN;
+    JitState jit_;
+    std::shared_ptr<VmChunk> chunk_;
 };
 
 class ForStatement : public Statement {
@@ -360,6 +516,41 @@ class ForStatement : public Statement {
       return block_;
     }
 
+    inline void SetCondition(std::shared_ptr<Expression> condition) {
+      condition_ = condition;
+    }
+
+    inline void SetAfterAction(std::shared_ptr<Expression> afterAction) {
+      afterAction_ = afterAction;
+    }
+
+    // loop invariant values bound once in the loop's scope before it starts
+    inline const std::vector<std::shared_ptr<VarStatement>>& GetHoisted() const {
+      return hoisted_;
+    }
+
+    inline void AddHoisted(std::shared_ptr<VarStatement> stmt) {
+      hoisted_.push_back(stmt);
+    }
+
+    // escape analysis of the scope the loop runs in
+    inline ScopeEscape GetEscape() const {
+      return escape_;
+    }
+
+    inline void SetEscape(ScopeEscape escape) {
+      escape_ = escape;
+    }
+
+    // the loop flattened for the VM, when the tree walker reaches it
+    inline const std::shared_ptr<VmChunk>& GetChunk() const {
+      return chunk_;
+    }
+
+    inline void SetChunk(std::shared_ptr<VmChunk> chunk) {
+      chunk_ = chunk;
+    }
+
     std::string String() const override;
 
   protected:
@@ -371,6 +562,9 @@ class ForStatement : public Statement {
     std::shared_ptr<Expression> condition_;
     std::shared_ptr<Expression> afterAction_;
     std::shared_ptr<BlockStatement> block_;
+    std::vector<std::shared_ptr<VarStatement>> hoisted_;
+    ScopeEscape escape_ = ScopeEscape::UNKNOWN;
+    std::shared_ptr<VmChunk> chunk_;
 };
 
 
@@ -446,6 +640,25 @@ class FunctionLiteral : public Expression {
       body_ = block;
     }
 
+    /*
+     * LOCAL once the Resolver has proven a closure can copy its free
+     * variables when it is created; otherwise (ESCAPES, or UNKNOWN when
+     * unresolved) it keeps the whole scope it was created in
+     */
+    inline ScopeEscape GetCapture() const {
+      return capture_;
+    }
+
+    // free variables a flat closure copies out of its defining scopes
+    inline const std::vector<std::string>& GetCaptures() const {
+      return captures_;
+    }
+
+    inline void SetCapture(ScopeEscape capture, std::vector<std::string> captures) {
+      capture_ = capture;
+      captures_ = captures;
+    }
+
     std::string String() const override;
 
   protected:
@@ -455,6 +668,21 @@ class FunctionLiteral : public Expression {
     std::shared_ptr<Token> token_;
     std::vector<std::shared_ptr<Identifier>> parameters_;
     std::shared_ptr<BlockStatement> body_;
+    ScopeEscape capture_ = ScopeEscape::UNKNOWN;
+    std::vector<std::string> captures_;
+};
+
+/*
+ * monomorphic inline cache a CallExpression keeps for the last callee it
+ * invoked; the entry is trusted only for that callee pointer and only until
+ * the garbage collector next frees objects
+ */
+struct CallSiteCache {
+  Object* callee = nullptr;
+  uint64_t gcEpoch = 0;
+  bool builtIn = false;
+  const std::vector<std::shared_ptr<Identifier>>* params = nullptr;
+  std::shared_ptr<BlockStatement> body;
 };
 
 class CallExpression : public Expression {
@@ -469,11 +697,15 @@ class CallExpression : public Expression {
 
     std::string String() const;
 
+    inline std::shared_ptr<Token> GetToken() const {
+      return token_;
+    }
+
     inline void SetArgs(std::vector<std::shared_ptr<Expression>> args) {
       args_ = args;
     }
 
-    inline std::vector<std::shared_ptr<Expression>> GetArgs() const {
+    inline const std::vector<std::shared_ptr<Expression>>& GetArgs() const {
       return args_;
     }
 
@@ -481,6 +713,14 @@ class CallExpression : public Expression {
       return func_;
     }
 
+    inline void SetFunc(std::shared_ptr<Expression> func) {
+      func_ = func;
+    }
+
+    inline CallSiteCache& GetCache() {
+      return cache_;
+    }
+
   protected:
     void ExpressionNode_() const override {}
 
@@ -488,13 +728,12 @@ class CallExpression : public Expression {
     std::shared_ptr<Token> token_;
     std::shared_ptr<Expression> func_;
     std::vector<std::shared_ptr<Expression>> args_;
+    CallSiteCache cache_;
 };
 
 class StringLiteral : public Expression {
   public:
-    StringLiteral(std::shared_ptr<Token> tok, std::string literal) : tok_(tok), literal_(literal) {
-      // empty
-    }
+    StringLiteral(std::shared_ptr<Token> tok, std::string literal);
 
     inline std::string TokenLiteral() const override {
       return literal_;
@@ -504,12 +743,18 @@ class StringLiteral : public Expression {
       return literal_;
     }
 
+    // the String every evaluation of this literal gives
+    inline Object* GetConstant() const {
+      return constant_;
+    }
+
   protected:
     void ExpressionNode_() const override {}
   
   private:
     std::shared_ptr<Token> tok_;
     std::string literal_;
+    Object* constant_;
 };
 
 class ArrayLiteral : public Expression {
@@ -531,6 +776,10 @@ class ArrayLiteral : public Expression {
       return exps_;
     }
 
+    inline std::shared_ptr<Token> GetToken() const {
+      return tok_;
+    }
+
     std::string String() const override;
 
   protected:
@@ -543,6 +792,167 @@ class ArrayLiteral : public Expression {
     std::vector<std::shared_ptr<Expression>> exps_;
 };
 
+// {key: value, ...}
+class HashLiteral : public Expression {
+  public:
+    HashLiteral(std::shared_ptr<Token> tok) :
+      tok_(tok) {
+        // empty
+      }
+
+    inline void AddPair(std::shared_ptr<Expression> key, std::shared_ptr<Expression> value) {
+      keys_.push_back(key);
+      values_.push_back(value);
+    }
+
+    inline void SetKeys(std::vector<std::shared_ptr<Expression>> keys) {
+      keys_ = keys;
+    }
+
+    inline void SetValues(std::vector<std::shared_ptr<Expression>> values) {
+      values_ = values;
+    }
+
+    inline std::string TokenLiteral() const override {
+      return tok_->GetLiteral();
+    }
+
+    // keys and values in source order, the value of keys_[i] being values_[i]
+    inline const std::vector<std::shared_ptr<Expression>>& GetKeys() const {
+      return keys_;
+    }
+
+    inline const std::vector<std::shared_ptr<Expression>>& GetValues() const {
+      return values_;
+    }
+
+    inline std::shared_ptr<Token> GetToken() const {
+      return tok_;
+    }
+
+    std::string String() const override;
+
+  protected:
+    void ExpressionNode_() const override {}
+
+  private:
+    std::shared_ptr<Token> tok_;
+    std::vector<std::shared_ptr<Expression>> keys_;
+    std::vector<std::shared_ptr<Expression>> values_;
+};
+
+// {name: value, ...}, every key being a bare field name
+class RecordLiteral : public Expression {
+  public:
+    RecordLiteral(std::shared_ptr<Token> tok);
+
+    // adds a field after the others; a name given twice keeps its first slot
+    // and the last value
+    void AddField(const std::string& name, std::shared_ptr<Expression> value);
+
+    inline void SetValues(std::vector<std::shared_ptr<Expression>> values) {
+      values_ = values;
+    }
+
+    inline std::string TokenLiteral() const override {
+      return tok_->GetLiteral();
+    }
+
+    // names and values in source order, the value of names_[i] being values_[i]
+    inline const std::vector<std::string>& GetNames() const {
+      return names_;
+    }
+
+    inline const std::vector<std::shared_ptr<Expression>>& GetValues() const {
+      return values_;
+    }
+
+    // the shape of the records this literal builds, shared with every
+    // literal naming the same fields in the same order
+    inline const Shape* GetShape() const {
+      return shape_;
+    }
+
+    // the slot values_[i] goes in
+    inline const std::vector<int>& GetOffsets() const {
+      return offsets_;
+    }
+
+    inline std::shared_ptr<Token> GetToken() const {
+      return tok_;
+    }
+
+    std::string String() const override;
+
+  protected:
+    void ExpressionNode_() const override {}
+
+  private:
+    std::shared_ptr<Token> tok_;
+    std::vector<std::string> names_;
+    std::vector<std::shared_ptr<Expression>> values_;
+    const Shape* shape_;
+    std::vector<int> offsets_;
+};
+
+/*
+ * monomorphic inline cache a FieldExpression keeps: the slot its field had
+ * in the shape of the last record it read. Shapes are kept until exit, so
+ * the entry needs no guard beyond comparing shape pointers
+ */
+struct FieldCache {
+  const Shape* shape = nullptr;
+  int offset = -1;
+};
+
+// exp.name
+class FieldExpression : public Expression {
+  public:
+    FieldExpression(std::shared_ptr<Token> tok, std::shared_ptr<Expression> exp) :
+      tok_(tok), exp_(exp) {
+        // empty
+      }
+
+    inline std::shared_ptr<Expression> GetExp() const {
+      return exp_;
+    }
+
+    inline void SetExp(std::shared_ptr<Expression> exp) {
+      exp_ = exp;
+    }
+
+    inline const std::string& GetName() const {
+      return name_;
+    }
+
+    inline void SetName(const std::string& name) {
+      name_ = name;
+    }
+
+    inline FieldCache& GetCache() {
+      return cache_;
+    }
+
+    inline std::shared_ptr<Token> GetToken() const {
+      return tok_;
+    }
+
+    inline std::string TokenLiteral() const override {
+      return tok_->GetLiteral();
+    }
+
+    std::string String() const override;
+
+  protected:
+    void ExpressionNode_() const override {}
+
+  private:
+    std::shared_ptr<Token> tok_;
+    std::shared_ptr<Expression> exp_;
+    std::string name_;
+    FieldCache cache_;
+};
+
 class IndexExpression : public Expression {
   public:
     IndexExpression(std::shared_ptr<Expression> exp) : exp_(exp) {
@@ -561,6 +971,10 @@ class IndexExpression : public Expression {
       return exp_;
     }
 
+    inline void SetExp(std::shared_ptr<Expression> exp) {
+      exp_ = exp;
+    }
+
     inline std::string TokenLiteral() const override {
       return tok_->GetLiteral();
     }
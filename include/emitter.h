@@ -0,0 +1,155 @@
+#ifndef MCSCRIPT_V3_EMITTER_H
+#define MCSCRIPT_V3_EMITTER_H
+
+#include <ast.h>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// what a typed C++ expression evaluates to: NONE never completes (it
+// returned), VOID completes without a value
+enum class CppType : int {
+  INT,
+  BOOL,
+  VOID,
+  NONE
+};
+
+// a function bound once by a top level var, and its typed translation if it has one
+struct CppTyped {
+  std::string name;
+  std::shared_ptr<FunctionLiteral> fn;
+  int id;
+  bool done = false;
+  bool failed = false;
+  CppType type = CppType::NONE;
+  // globals it (or anything it calls) calls, itself included
+  std::set<std::string> callees;
+  std::string code;
+};
+
+// a typed local: its C++ variable and type
+struct CppLocal {
+  std::string var;
+  CppType type;
+};
+
+class CppEmitter;
+
+/*
+ * translates a function that only uses integers and booleans into a C++
+ * function over longs, assuming its calls to itself return selfType
+ */
+class CppTypedCompiler {
+  public:
+    CppTypedCompiler(CppEmitter& emitter, const CppTyped& typed, CppType selfType);
+    bool Compile();
+
+    inline const std::string& GetCode() const {
+      return code_;
+    }
+
+    inline CppType GetType() const {
+      return type_;
+    }
+
+    inline bool UsedSelf() const {
+      return usedSelf_;
+    }
+
+    inline const std::set<std::string>& GetCallees() const {
+      return callees_;
+    }
+
+  private:
+    bool EmitBlock_(std::shared_ptr<BlockStatement> block, bool wantValue, bool allowReturn,
+        const std::string& target, CppType& type);
+    bool EmitStatement_(std::shared_ptr<Statement> stmt, bool wantValue, bool allowReturn,
+        const std::string& target, CppType& type);
+    bool EmitReturn_(std::shared_ptr<ReturnStatement> rs);
+    bool EmitIf_(std::shared_ptr<IfExpression> ie, bool wantValue, bool allowReturn,
+        const std::string& target, CppType& type);
+    bool EmitExpression_(std::shared_ptr<Expression> exp, std::string& value, CppType& type);
+    bool EmitInfix_(std::shared_ptr<InfixExpression> ie, std::string& value, CppType& type);
+    bool EmitCall_(std::shared_ptr<CallExpression> call, std::string& value, CppType& type,
+        bool selfTail);
+    void Line_(const std::string& line);
+    std::string Temp_();
+
+    CppEmitter& emitter_;
+    const CppTyped& typed_;
+    CppType selfType_;
+    bool usedSelf_;
+    bool usedTop_;
+    std::unordered_map<std::string, CppLocal> locals_;
+    std::vector<std::string> params_;
+    std::vector<CppType> returns_;
+    std::set<std::string> callees_;
+    int ifDepth_;
+    int temps_;
+    int indent_;
+    std::string body_;
+    std::string code_;
+    CppType type_;
+};
+
+/*
+ * ahead of time translation of a Program into C++ source that links against
+ * the runtime in aot.h (bin/main --emit-cpp). Statements and expressions
+ * become runtime calls in the order Evaluator::Eval would make them, each
+ * block becoming a lambda so errors and returns leave it the same way; top
+ * level functions that only use integers and booleans also get a typed
+ * version over plain longs, used whenever they are called with integers
+ */
+class CppEmitter {
+  public:
+    CppEmitter();
+    std::string Emit(std::shared_ptr<Program> program);
+
+    // the typed translation of the global function name, nullptr if it has none
+    const CppTyped* GetTyped(const std::string& name);
+
+    static std::string Quote(const std::string& str);
+
+  private:
+    /* typed functions */
+    void FindTyped_(std::shared_ptr<Program> program);
+    void CountGlobalBindings_(std::shared_ptr<Node> node,
+        std::unordered_map<std::string, int>& counts) const;
+
+    /* untyped, mirroring Evaluator::Eval */
+    void EmitStatement_(std::shared_ptr<Statement> stmt, const std::string& result);
+    void EmitFor_(std::shared_ptr<ForStatement> fs, const std::string& result);
+    void EmitBlock_(std::shared_ptr<BlockStatement> block, const std::string& target);
+    void EmitScoped_(const std::string& assign, std::function<void(const std::string& result)> body);
+    std::string EmitExpression_(std::shared_ptr<Expression> exp);
+    std::string EmitValue_(std::shared_ptr<Expression> exp);
+    std::string EmitCall_(std::shared_ptr<CallExpression> call, bool tail);
+    std::string EmitFunction_(std::shared_ptr<FunctionLiteral> fn);
+    void EmitTypedEntry_(const CppTyped& typed);
+    void CheckError_(const std::string& value);
+
+    /* output */
+    void Line_(const std::string& line);
+    std::string Temp_();
+
+    std::string out_;
+    int indent_;
+    std::string env_;
+    int temps_;
+    int functions_;
+    int envs_;
+    std::string decls_;
+    std::string defs_;
+    std::unordered_map<std::string, CppTyped> typed_;
+    // candidate names in program order
+    std::vector<std::string> typedNames_;
+    std::unordered_map<const FunctionLiteral*, std::string> typedLiterals_;
+    std::set<std::string> compiling_;
+};
+
+
+#endif // MCSCRIPT_V3_EMITTER_H
@@ -4,17 +4,20 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <stdint.h>
 
 template <typename T>
 class Environment {
   public:
     // constructor
-    Environment() : outer_(nullptr) {}
-    Environment(const std::shared_ptr<Environment> outer) : outer_(outer) {
+    Environment() : outer_(nullptr), id_(++lastId_) {
+      // empty
+    }
+    Environment(const std::shared_ptr<Environment> outer) : outer_(outer), id_(++lastId_) {
       // empty
     }
 
-    inline T Get(std::string name) {
+    inline T Get(const std::string& name) {
       if (store_.count(name) == 0) {
         if (outer_ != nullptr) {
           return outer_->Get(name);
@@ -27,19 +30,94 @@ class Environment {
       return store_.at(name);
     }
 
-    inline void Set(std::string name, T val) {
-      store_[name] = val;
+    // what name is bound to in this scope itself, ignoring the outer ones
+    inline T GetLocal(const std::string& name) const {
+      auto it = store_.find(name);
+      return it != store_.end() ? it->second : nullptr;
+    }
+
+    // address of the binding name resolves to, or nullptr when unbound
+    inline T* Lookup(const std::string& name) {
+      auto it = store_.find(name);
+      if (it != store_.end()) {
+        return &it->second;
+      }
+
+      return outer_ != nullptr ? outer_->Lookup(name) : nullptr;
+    }
+
+    // like Lookup, and depth is how many scopes out the binding is
+    inline T* Lookup(const std::string& name, size_t& depth) {
+      depth = 0;
+      for (Environment* env = this; env != nullptr; env = env->outer_.get(), depth++) {
+        auto it = env->store_.find(name);
+        if (it != env->store_.end()) {
+          return &it->second;
+        }
+      }
+
+      return nullptr;
+    }
+
+    // address of name's binding in this scope itself, nullptr when it has none here
+    inline T* LookupLocal(const std::string& name) {
+      auto it = store_.find(name);
+      return it != store_.end() ? &it->second : nullptr;
+    }
+
+    inline void Set(const std::string& name, T val) {
+      auto it = store_.find(name);
+      if (it != store_.end()) {
+        it->second = val;
+        return;
+      }
+
+      store_.emplace(name, val);
+      version_++;
     }
 
     inline std::unordered_map<std::string, T> GetStore() const {
       return store_;
     }
 
+    // drops every local binding so the scope can be reused
+    inline void Clear() {
+      store_.clear();
+      version_++;
+    }
+
+    // tells this scope apart from every other, even one later built at its address
+    inline uint64_t GetId() const {
+      return id_;
+    }
+
+    /*
+     * changes whenever this scope or one of the depth scopes around it gains
+     * a binding or is cleared; while it and GetId() are unchanged, a name that
+     * Lookup found no more than depth scopes out still resolves to that slot
+     */
+    inline uint64_t GetVersion(size_t depth) const {
+      uint64_t version = version_;
+      for (const Environment* env = this; depth > 0; depth--) {
+        env = env->outer_.get();
+        version += env->version_;
+      }
+
+      return version;
+    }
+
+    inline std::shared_ptr<Environment> GetOuter() const {
+      return outer_;
+    }
+
 
 
   private:
     std::unordered_map<std::string, T> store_;
     const std::shared_ptr<Environment> outer_;
+    const uint64_t id_;
+    uint64_t version_ = 0;
+    static inline uint64_t lastId_ = 0;
 };
 
 
@@ -4,8 +4,24 @@
 #include <object.h>
 #include <ast.h>
 #include <memory>
+#include <optional>
 #include <gcollector.h>
 #include <environment.h>
+#include <kernels.h>
+#include <jit.h>
+#include <vm.h>
+
+// default cap for the stack Run() evaluates on (reserved lazily, not committed)
+static const size_t DEFAULT_MAX_STACK_SIZE = 1024UL * 1024UL * 1024UL;
+
+// head room kept free below the deepest Eval frame for the helpers it calls
+static const size_t STACK_RESERVE = 128UL * 1024UL;
+
+// integer operand pairs an InfixExpression must see before it specializes
+static const int QUICKEN_THRESHOLD = 2;
+
+// arguments a builtin call evaluates on the stack instead of into a vector
+static const size_t BUILTIN_STACK_ARGS = 8;
 
 
 class Evaluator {
@@ -19,12 +35,53 @@ class Evaluator {
        bool testing = false)
      : gCollector_(gCollector), TRUE_(TRUE), FALSE_(FALSE), NULL_T_(NULL_T), testing_(testing) {
       builtInFuncs_ = builtInFuncs;
+      TAIL_CALL_ = new ReturnValue(nullptr);
+      tailCallFn_ = nullptr;
+      tailCallSite_ = nullptr;
+      maxStackSize_ = DEFAULT_MAX_STACK_SIZE;
+      runStack_ = nullptr;
+      runStackSize_ = 0;
+      running_ = false;
+      stackLimit_ = NativeStackLimit_();
+      jitEnabled_ = true;
+      jitFloor_ = nullptr;
+      vmEnabled_ = true;
+      slotMisses_ = 0;
+      callFunction_ = [this](Object* fn, std::vector<Object*> args) {
+        return CallFunction(fn, std::move(args));
+      };
+      // so builtins can give back TRUE and FALSE themselves
+      ShareBooleans(TRUE, FALSE);
     }
 
     ~Evaluator();
 
     ::Object* Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environment<Object*>> env);
 
+    /*
+     * evaluates node on a heap allocated stack of up to GetMaxStackSize() bytes;
+     * running out of that stack yields an Error object instead of a crash
+     */
+    ::Object* Run(std::shared_ptr<::Node> node, std::shared_ptr<Environment<Object*>> env);
+
+    inline void SetMaxStackSize(size_t bytes) {
+      maxStackSize_ = bytes;
+    }
+
+    inline size_t GetMaxStackSize() const {
+      return maxStackSize_;
+    }
+
+    // hot functions run as native code unless this is turned off
+    inline void SetJitEnabled(bool enabled) {
+      jitEnabled_ = enabled;
+    }
+
+    // function bodies and for loops run as VmChunks unless this is turned off
+    inline void SetVmEnabled(bool enabled) {
+      vmEnabled_ = enabled;
+    }
+
     inline void TrackObject(Object* obj) {
       gCollector_.TrackObject(obj);
     }
@@ -53,6 +110,66 @@ class Evaluator {
       return gCollector_.GetNumObjects();
     }
 
+    // identifiers looked up by name because their slot cache did not hold
+    inline size_t GetSlotMisses() const {
+      return slotMisses_;
+    }
+
+    /*
+     * single operations with the tree walker's semantics and error messages,
+     * for programs translated to C++ by --emit-cpp (see aot.h)
+     */
+    inline Object* EvalInfix(const std::string& op, Object* left, Object* right) {
+      return EvalInfixExpression_(op, left, right);
+    }
+
+    inline Object* EvalPrefix(const std::string& op, Object* right) {
+      return EvalPrefixExpression_(op, right);
+    }
+
+    inline Object* EvalBuiltIn(BuiltIn* function, BuiltInArgs args) {
+      return EvalBuiltInFuncCall_(function, args);
+    }
+
+    // calls fn, a function or a builtin, with args as a call expression would
+    Object* CallFunction(Object* fn, std::vector<Object*> args);
+
+    // how builtins taking a callback call functions back, CallFunction unless
+    // the functions are not the tree walker's own (translated programs)
+    inline void SetFunctionCaller(BuiltInCallback caller) {
+      callFunction_ = std::move(caller);
+    }
+
+    // an error when obj can index neither an array nor a hash, nullptr when it can
+    Object* CheckIndex(Object* obj);
+    // obj has passed CheckIndex; obj2 is what is being indexed
+    Object* EvalIndex(Object* obj, Object* obj2);
+    // a Hash of the evaluated keys and values of a literal, key first in each pair
+    Object* NewHash(const std::vector<Object*>& pairs);
+    // a Record of shape with values[i] in slot offsets[i]
+    Object* NewRecord(const Shape* shape, const std::vector<int>& offsets,
+        const std::vector<Object*>& values);
+    // field name of obj, read through the reading node's cache
+    Object* EvalField(Object* obj, const std::string& name, FieldCache& cache);
+    Object* EvalName(const std::string& name, std::shared_ptr<Environment<Object*>> env);
+    Object* EvalAssign(const std::string& name, Object* newVal, std::shared_ptr<Environment<Object*>> env);
+
+    inline bool IsTruthy(Object* obj) {
+      return IsTruthy_(obj);
+    }
+
+    inline bool IsError(Object* obj) {
+      return IsError_(obj);
+    }
+
+    inline void ReleaseScope(std::shared_ptr<Environment<Object*>> env) {
+      ReleaseScope_(env);
+    }
+
+    inline bool StackExhausted() const {
+      return StackExhausted_();
+    }
+
   
   private:
     // garbage collector
@@ -63,18 +180,63 @@ class Evaluator {
     std::unordered_map<std::string, BuiltIn*> builtInFuncs_;
     bool testing_;
 
+    // a pending tail call is handed back to EvalFunctionCall_ through TAIL_CALL_
+    ReturnValue* TAIL_CALL_;
+    Function* tailCallFn_;
+    const CallSiteCache* tailCallSite_;
+    std::vector<Object*> tailCallArgs_;
+
+    // stack used by Run() and the lowest address Eval may recurse down to
+    size_t maxStackSize_;
+    char* runStack_;
+    size_t runStackSize_;
+    bool running_;
+    char* stackLimit_;
+    std::shared_ptr<::Node> runNode_;
+    std::shared_ptr<Environment<Object*>> runEnv_;
+    Object* runResult_;
+
+    Jit jit_;
+    bool jitEnabled_;
+    // while the interpreter redoes a call whose native code ran out of stack,
+    // the calls it makes below this frame stay interpreted
+    char* jitFloor_;
+    bool vmEnabled_;
+    size_t slotMisses_;
+
+    BuiltInCallback callFunction_;
+
     // methods
     
     // helpers
+    static void RunTrampoline_(unsigned int high, unsigned int low);
+    static char* NativeStackLimit_();
+    bool AllocRunStack_();
+    inline bool StackExhausted_() const {
+      return stackLimit_ != nullptr &&
+        static_cast<char*>(__builtin_frame_address(0)) < stackLimit_;
+    }
     std::string GetTypeName_(std::shared_ptr<::Node> node);
     Boolean* NativeBooleanToBooleanObj_(bool input);
     bool IsTruthy_(Object* condition);
     Error* NewError_(std::string message);
     std::string GetInfixErrorMsg_(const char* format, Object* left, std::string op, Object* right);
     std::string GetPrefixErrorMsg_(const char* format, std::string op, Object* right);
+    static std::string GetArityErrorMsg_(const BuiltIn* function, size_t numArgs);
     bool IsError_(Object* obj);
     Object* NewObject_(Object* obj);
     void SubtractRefsInArray_(Object* obj);
+    void ReleaseScope_(std::shared_ptr<Environment<Object*>> env);
+
+    // escape analysis
+    static bool CreatesClosure_(std::shared_ptr<::Node> node);
+    bool ScopeEscapes_(std::shared_ptr<BlockStatement> body);
+    static bool LoopCreatesClosure_(const ForStatement& fs);
+    bool ScopeEscapes_(ForStatement* fs);
+    std::shared_ptr<Environment<Object*>> CaptureScope_(std::shared_ptr<FunctionLiteral> fn,
+        std::shared_ptr<Environment<Object*>> env);
+    std::shared_ptr<Environment<Object*>> NewScope_(std::shared_ptr<Environment<Object*>> outer,
+        bool escapes, std::optional<Environment<Object*>>& frame);
     Object* AssignNewVal_(std::shared_ptr<AssignExpression>, Object* newVal, std::shared_ptr<Environment<Object*>> env);
 
     // evals
@@ -82,18 +244,35 @@ class Evaluator {
     Object* EvalBangExpression_(Object* right);
     Object* EvalMinusExpression_(Object* right);
     Object* EvalInfixExpression_(std::string op, Object* left, Object* right);
+    Object* EvalQuickenedInfix_(InfixExpression* exp, Object* left, Object* right);
+    InfixKind SelectInfixKind_(const std::string& op);
     Object* EvalIntegerInfixExpression_(std::string op, Object* left, Object* right);
     Object* EvalStringInfixExpression_(std::string op, Object* left, Object* right);
+    Object* EvalArrayInfix_(KernelOp kernelOp, const std::string& op, Object* left, Object* right);
     Object* EvalIfExpression_(std::shared_ptr<IfExpression> ie, std::shared_ptr<Environment<Object*>> env);
     Object* EvalProgram_(std::shared_ptr<Program> program, std::shared_ptr<Environment<Object*>> env);
     Object* EvalBlockStatement_(std::shared_ptr<BlockStatement> block, std::shared_ptr<Environment<Object*>> env);
-    Object* EvalIdentifier_(std::string name, std::shared_ptr<Environment<Object*>> env);
-    std::vector<Object*> EvalParameters_(std::shared_ptr<Environment<Object*>> env, std::vector<std::shared_ptr<Expression>> params);
-    Object* EvalFunctionCall_(Object* function, std::vector<Object*> args, std::shared_ptr<Environment<Object*>> outerEnv);
+    Object* EvalIdentifier_(Identifier* ident, Environment<Object*>* env);
+    Object* EvalUnbound_(const std::string& name);
+    std::vector<Object*> EvalParameters_(std::shared_ptr<Environment<Object*>> env, const std::vector<std::shared_ptr<Expression>>& params);
+    Object* EvalCallExpression_(std::shared_ptr<CallExpression> call, std::shared_ptr<Environment<Object*>> env, bool tailCall = false);
+    Object* ApplyCall_(CallSiteCache& site, Object* obj, std::vector<Object*> args, bool tailCall);
+    Object* EvalFunctionLiteral_(std::shared_ptr<FunctionLiteral> fn, std::shared_ptr<Environment<Object*>> env);
+    Object* EvalFunctionCall_(Function* function, const CallSiteCache& site, std::vector<Object*> args);
+    bool RunCompiled_(Function* function, const std::vector<Object*>& args, Object*& result);
 
     Object* EvalForStatement_(std::shared_ptr<ForStatement> fs, std::shared_ptr<Environment<Object*>> env);
-    Object* EvalBuiltInFuncCall_(BuiltIn* function, std::vector<Object*> args);
+    Object* EvalBuiltInFuncCall_(BuiltIn* function, BuiltInArgs args);
     Object* EvalIndexExpression_(std::shared_ptr<IndexExpression> exp, std::shared_ptr<Environment<Object*>> env);
+
+    // linear VM
+    Object* Execute_(VmChunk& chunk, std::shared_ptr<Environment<Object*>> env);
+    Object* LookupIdentifier_(Identifier* ident, Environment<Object*>* env);
+    Object** LocalSlot_(Identifier* ident, const std::string& name, Environment<Object*>* env);
+    Object* FusedInt_(InfixKind kind, long left, long right);
+    static bool FusedCompare_(InfixKind kind, long left, long right);
+    Object* FusedGeneric_(const VmInstr& instr, Object* left, Identifier* right,
+        Environment<Object*>* env);
 };
 
 
@@ -22,15 +22,36 @@ class GCollector {
     // this cleans up all objects that are not null regardless of how many references (called when program terminates)
     void CollectAll();
     void TrackObject(Object* obj);
+
+    /*
+     * frees, in bulk, the unreferenced objects tracked since mark by a scope
+     * that has just exited, sparing keep (the value the scope produced);
+     * nothing is freed when a container or a function was tracked since mark,
+     * since those can reference other objects without counting it.
+     * only objects no cache can hold on to are freed, so the epoch is kept
+     */
+    void CollectScope(size_t mark, const Object* keep);
     inline size_t GetNumObjects() const {
       return objects_.size();
     }
 
+    // incremented every time objects may have been freed
+    inline uint64_t GetEpoch() const {
+      return epoch_;
+    }
+
+    // whether CollectAll is freeing everything, so no reference needs dropping
+    inline bool IsCollectingAll() const {
+      return collectingAll_;
+    }
+
 
 
   private:
-    GCollector() {}
+    GCollector() : epoch_(0), collectingAll_(false) {}
     std::vector<::Object*> objects_;
+    uint64_t epoch_;
+    bool collectingAll_;
 };
 
 
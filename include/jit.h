@@ -0,0 +1,211 @@
+#ifndef MCSCRIPT_V3_JIT_H
+#define MCSCRIPT_V3_JIT_H
+
+#include <ast.h>
+#include <object.h>
+#include <environment.h>
+#include <initializer_list>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// calls a function body must see before the JIT compiles it
+#ifdef MCSCRIPT_FORCE_JIT
+static const int JIT_CALL_THRESHOLD = 1;
+#else
+static const int JIT_CALL_THRESHOLD = 100;
+#endif
+
+// what a compiled expression leaves in rax: NONE never completes (it
+// returned or jumped), VOID completes without a value
+enum class JitType : int {
+  INT,
+  BOOL,
+  VOID,
+  NONE
+};
+
+// why a native run gave up, in JitContext::bailed
+static const uint8_t JIT_BAIL = 1;        // met something it cannot handle
+static const uint8_t JIT_BAIL_STACK = 2;  // ran out of stack
+
+// shared by every frame of one native run; compiled code addresses it directly
+struct JitContext {
+  // 0, or why the code gave up; the result is garbage then
+  uint8_t bailed;
+  // the native stack must stay above this
+  char* stackLimit;
+};
+
+using JitEntry = int64_t (*)(JitContext* ctx, const int64_t* args);
+
+// executable code for one function body, unmapped when the last user drops it
+class JitCode {
+  public:
+    JitCode(void* mem, size_t size, JitType type, std::shared_ptr<Environment<Object*>> env);
+    ~JitCode();
+
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    inline int64_t Run(JitContext* ctx, const int64_t* args) const {
+      return reinterpret_cast<JitEntry>(mem_)(ctx, args);
+    }
+
+    inline const void* GetEntry() const {
+      return mem_;
+    }
+
+    // INT or BOOL
+    inline JitType GetType() const {
+      return type_;
+    }
+
+    // the global scope the function was defined in
+    inline const std::shared_ptr<Environment<Object*>>& GetEnv() const {
+      return env_;
+    }
+
+    // global slots that must still hold these functions for the code to be valid
+    inline const std::vector<std::pair<Object**, Object*>>& GetCallees() const {
+      return callees_;
+    }
+
+    inline void AddCallee(Object** slot, Object* fn) {
+      callees_.emplace_back(slot, fn);
+    }
+
+  private:
+    void* mem_;
+    size_t size_;
+    JitType type_;
+    std::shared_ptr<Environment<Object*>> env_;
+    std::vector<std::pair<Object**, Object*>> callees_;
+};
+
+// appends x86-64 machine code, with rel32 jumps to labels bound later
+class JitAssembler {
+  public:
+    void Byte(uint8_t b);
+    void Bytes(std::initializer_list<uint8_t> bytes);
+    void Imm32(int32_t imm);
+    void Imm64(int64_t imm);
+    void Patch32(size_t at, int32_t imm);
+
+    int NewLabel();
+    void Bind(int label);
+    // a rel32 operand to label
+    void Rel32(int label);
+    // fills in every Rel32, false if a label was never bound
+    bool Resolve();
+
+    inline const std::vector<uint8_t>& GetCode() const {
+      return code_;
+    }
+
+    inline size_t Size() const {
+      return code_.size();
+    }
+
+  private:
+    std::vector<uint8_t> code_;
+    std::vector<long> labels_;
+    // (operand offset, label)
+    std::vector<std::pair<size_t, int>> fixups_;
+};
+
+// a variable living in a frame slot
+struct JitVar {
+  int slot;
+  JitType type;
+};
+
+// the function body or a for loop, as the evaluator scopes them
+struct JitScope {
+  // bound at the point being compiled
+  std::unordered_map<std::string, JitVar> visible;
+  // slots of every name the scope binds anywhere
+  std::unordered_map<std::string, int> reserved;
+  int ifDepth = 0;
+  // where a return in a loop body goes, -1 for the function body
+  int continueLabel = -1;
+};
+
+/*
+ * template JIT for hot functions defined in the global scope whose bodies
+ * only use integers, booleans, arithmetic, comparisons, if, for, locals and
+ * calls to such functions. Each AST node is expanded into a fixed x86-64
+ * sequence over frame slots; anything else makes the compile fail and the
+ * function stays interpreted
+ */
+class Jit {
+  public:
+    // code for fn's body, compiling it (and what it calls) if needed
+    std::shared_ptr<JitCode> Compile(Function* fn);
+
+  private:
+    // bodies being compiled right now
+    std::unordered_set<const BlockStatement*> compiling_;
+};
+
+// compiles one function body, assuming its own calls return selfType
+class JitCompiler {
+  public:
+    JitCompiler(Jit& jit, Function* fn, JitType selfType);
+    std::shared_ptr<JitCode> Compile();
+
+    // whether the body called itself, relying on selfType
+    inline bool UsedSelf() const {
+      return usedSelf_;
+    }
+
+  private:
+    /* statements */
+    bool EmitBlock_(std::shared_ptr<BlockStatement> block, bool wantValue, JitType& type);
+    bool EmitStatement_(std::shared_ptr<Statement> stmt, bool wantValue, JitType& type);
+    bool EmitVar_(std::shared_ptr<VarStatement> stmt);
+    bool EmitReturn_(std::shared_ptr<ReturnStatement> rs, JitType& type);
+    bool EmitFor_(std::shared_ptr<ForStatement> fs);
+    void ScanLoopBindings_(std::shared_ptr<Node> node, std::unordered_set<std::string>& names) const;
+
+    /* expressions */
+    bool EmitExpression_(std::shared_ptr<Expression> exp, JitType& type);
+    bool EmitInfix_(std::shared_ptr<InfixExpression> ie, JitType& type);
+    bool EmitIf_(std::shared_ptr<IfExpression> ie, bool wantValue, JitType& type);
+    bool EmitCall_(std::shared_ptr<CallExpression> call, JitType& type, bool selfTail);
+    bool EmitArgs_(const std::vector<std::shared_ptr<Expression>>& args, int& last);
+    bool EmitAssign_(std::shared_ptr<AssignExpression> ae, JitType& type);
+
+    /* frame */
+    const JitVar* Lookup_(const std::string& name) const;
+    int NewSlot_();
+    int32_t Disp_(int slot) const;
+    void Load_(int slot);
+    void Store_(int slot);
+    void CheckBail_();
+    static bool Merge_(JitType& into, JitType type);
+
+    Jit& jit_;
+    Function* fn_;
+    JitType selfType_;
+    bool usedSelf_;
+    JitAssembler asm_;
+    std::vector<JitScope> scopes_;
+    std::vector<int> paramSlots_;
+    std::vector<JitType> returns_;
+    int slots_;
+    int loopDepth_;
+    int entryLabel_;
+    int bodyLabel_;
+    int bailLabel_;
+    int stackLabel_;
+    int exitLabel_;
+    std::vector<std::pair<Object**, Object*>> callees_;
+};
+
+
+#endif // MCSCRIPT_V3_JIT_H
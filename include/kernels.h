@@ -0,0 +1,47 @@
+#ifndef MCSCRIPT_V3_KERNELS_H
+#define MCSCRIPT_V3_KERNELS_H
+
+#include <stddef.h>
+
+// SSE2 and AVX2 loops where the compiler targets x86-64, scalar ones elsewhere
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(MCSCRIPT_NO_SIMD)
+#define MCSCRIPT_SIMD_X86
+#endif
+
+// element-wise operations on packed integers; comparisons give 1 or 0
+enum class KernelOp : int {
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  LT,
+  GT
+};
+
+// the widest instructions the kernels use, at most what the CPU has
+enum class KernelLevel : int {
+  SCALAR,
+  SSE2,
+  AVX2
+};
+
+// picked once from the CPU; lowering it is for comparing levels in tests
+KernelLevel GetKernelLevel();
+void SetKernelLevel(KernelLevel level);
+
+/*
+ * out[i] = a[i * aStep] op b[i * bStep] for i below n, a step being 1 to
+ * walk an array or 0 to repeat a scalar. Integers wrap around like the
+ * scalar operators do; a DIV caller has made sure no divisor is 0
+ */
+void KernelBinary(KernelOp op, const long* a, size_t aStep, const long* b, size_t bStep,
+    long* out, size_t n);
+
+/* reductions; min and max take at least one element */
+long KernelSum(const long* a, size_t n);
+long KernelMin(const long* a, size_t n);
+long KernelMax(const long* a, size_t n);
+long KernelDot(const long* a, const long* b, size_t n);
+
+
+#endif // MCSCRIPT_V3_KERNELS_H
@@ -1,7 +1,9 @@
 #ifndef MCSCRIPT_V3_OBJECT_H
 #define MCSCRIPT_V3_OBJECT_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <ast.h>
@@ -18,11 +20,18 @@ enum class ObjectType : int {
   FUNCTION_OBJ,
   STRING_OBJ,
   BUILT_IN_OBJ,
-  ARRAY_OBJ
+  ARRAY_OBJ,
+  HASH_OBJ,
+  RECORD_OBJ,
+  VECTOR_OBJ,
+  MAP_OBJ,
+  PQUEUE_OBJ,
+  DEQUE_OBJ
 };
 
 class Object {
   public:
+    Object() : refCount_(0) {}
     virtual std::string Inspect() const = 0;
     virtual ObjectType Type() const = 0;
     virtual ~Object() {}
@@ -45,7 +54,51 @@ class Object {
     size_t refCount_;
 };
 
-using BuiltInFunction = std::function<Object*(std::vector<Object*>)>;
+/*
+ * the arguments of a builtin call, read in place from wherever the caller
+ * evaluated them (registers, a buffer on its stack or a vector)
+ */
+class BuiltInArgs {
+  public:
+    BuiltInArgs(Object* const* data, size_t size) : data_(data), size_(size) {}
+    BuiltInArgs(const std::vector<Object*>& args) : data_(args.data()), size_(args.size()) {}
+
+    inline size_t size() const {
+      return size_;
+    }
+
+    inline bool empty() const {
+      return size_ == 0;
+    }
+
+    inline Object* operator[](size_t i) const {
+      return data_[i];
+    }
+
+    inline Object* const* begin() const {
+      return data_;
+    }
+
+    inline Object* const* end() const {
+      return data_ + size_;
+    }
+
+  private:
+    Object* const* data_;
+    size_t size_;
+};
+
+using BuiltInFunction = Object* (*)(BuiltInArgs args);
+
+// calls a function value from inside a builtin the way a call expression would
+using BuiltInCallback = std::function<Object*(Object* fn, std::vector<Object*> args)>;
+
+/*
+ * a builtin that may call the functions it is given back or return objects
+ * it holds: any new object it returns it has tracked itself, so its result
+ * is never tracked again, and nullptr stands for null
+ */
+using CallingBuiltInFunction = Object* (*)(BuiltInArgs args, const BuiltInCallback& call);
 
 
 class Null : public Object {
@@ -74,10 +127,6 @@ class Integer : public Object {
       return ObjectType::INTEGER_OBJ;
     }
 
-    inline void SetValue(long value) {
-      value_ = value;
-    }
-
     inline long GetValue() const {
       return value_;
     }
@@ -164,15 +213,15 @@ class Function : public Object {
         refCount_ = 0;
       }
     
-    inline std::vector<std::shared_ptr<::Identifier>> GetParams() const {
+    inline const std::vector<std::shared_ptr<::Identifier>>& GetParams() const {
       return params_;
     }
 
-    inline std::shared_ptr<BlockStatement> GetBody() const {
+    inline const std::shared_ptr<BlockStatement>& GetBody() const {
       return body_;
     }
 
-    inline std::shared_ptr<Environment<Object*>> GetEnv() const {
+    inline const std::shared_ptr<Environment<Object*>>& GetEnv() const {
       return env_;
     }
 
@@ -188,31 +237,168 @@ class Function : public Object {
       std::shared_ptr<Environment<Object*>> env_;
 };
 
+// shorter concatenations are copied right away rather than made into a rope
+static const size_t ROPE_MIN_LENGTH = 64;
+// strings up to this long are always interned, literals of any length are
+static const size_t INTERN_MAX_LENGTH = 32;
+// a slice is copied rather than shared when this many times shorter than
+// storage of at least SLICE_COPY_MIN elements (or bytes)
+static const size_t SLICE_COPY_RATIO = 8;
+static const size_t SLICE_COPY_MIN = 1024;
+
+/*
+ * the text of a String: flat, the concatenation of two other pieces that
+ * is copied into one buffer the first time the text is read, or a slice
+ * of a flat piece read in place. Pieces are shared between Strings and
+ * never change what they spell, so appending to a string in a loop costs
+ * one node per step plus one final copy
+ */
+class StringRope : public std::enable_shared_from_this<StringRope> {
+  public:
+    StringRope(std::string flat) : flat_(std::move(flat)), length_(flat_.size()) {}
+    StringRope(std::shared_ptr<StringRope> left, std::shared_ptr<StringRope> right) :
+        left_(left), right_(right), length_(left->length_ + right->length_) {}
+    StringRope(std::shared_ptr<StringRope> base, size_t offset, size_t length) :
+        base_(base), offset_(offset), length_(length) {}
+    ~StringRope();
+
+    /*
+     * the one flat rope spelling text while any String holds it: two
+     * interned ropes are equal exactly when they are the same rope
+     */
+    static std::shared_ptr<StringRope> Intern(std::string text);
+
+    inline bool IsInterned() const {
+      return interned_;
+    }
+
+    inline size_t Length() const {
+      return length_;
+    }
+
+    // of the text, computed once
+    inline size_t Hash() {
+      if (!hashed_) {
+        hash_ = std::hash<std::string_view>()(View());
+        hashed_ = true;
+      }
+      return hash_;
+    }
+
+    inline const std::string& Flat() {
+      if (left_ != nullptr || base_ != nullptr) {
+        Flatten_();
+      }
+      return flat_;
+    }
+
+    // the text, left in place if this is a slice
+    inline std::string_view View() {
+      if (left_ != nullptr) {
+        Flatten_();
+      }
+      return Leaf_();
+    }
+
+    // length characters of the text from start on
+    std::shared_ptr<StringRope> Slice(size_t start, size_t length);
+
+  private:
+    inline std::string_view Leaf_() const {
+      return base_ != nullptr ? std::string_view(base_->flat_).substr(offset_, length_)
+        : std::string_view(flat_);
+    }
+
+    void Flatten_();
+    void Unlink_();
+
+    std::string flat_;
+    std::shared_ptr<StringRope> left_;
+    std::shared_ptr<StringRope> right_;
+    // the flat rope a slice reads from, and where
+    std::shared_ptr<StringRope> base_;
+    size_t offset_ = 0;
+    size_t length_;
+    size_t hash_ = 0;
+    bool hashed_ = false;
+    bool interned_ = false;
+};
+
 class String : public Object {
   public:
-    String(std::string value) : value_(value) {
+    // short values are interned, and so is any value when intern is set
+    String(std::string value, bool intern = false) :
+        rope_(intern || value.size() <= INTERN_MAX_LENGTH ? StringRope::Intern(std::move(value))
+            : std::make_shared<StringRope>(std::move(value))) {
       // empty
     }
+
+    // left followed by right
+    String(const String& left, const String& right);
+
+    String(std::shared_ptr<StringRope> rope) : rope_(std::move(rope)) {}
     
     inline ObjectType Type() const override {
       return ObjectType::STRING_OBJ;
     }
 
     inline std::string Inspect() const override {
-      return value_;
+      return rope_->Flat();
     }
 
-    inline std::string GetValue() const {
-      return value_;
+    inline const std::string& GetValue() const {
+      return rope_->Flat();
+    }
+
+    // without copying a slice out
+    inline std::string_view View() const {
+      return rope_->View();
+    }
+
+    // without flattening
+    inline size_t Length() const {
+      return rope_->Length();
     }
 
+    inline size_t Hash() const {
+      return rope_->Hash();
+    }
+
+    inline bool IsInterned() const {
+      return rope_->IsInterned();
+    }
+
+    // the characters from start up to end, sharing this string's text
+    inline String* Slice(size_t start, size_t end) const {
+      return new String(rope_->Slice(start, end - start));
+    }
+
+    bool Equals(const String& other) const;
+    // <0, 0 or >0 as this sorts before, with or after other (bytewise)
+    int Compare(const String& other) const;
+
   private:
-    std::string value_;
+    std::shared_ptr<StringRope> rope_;
 };
 
+/*
+ * a native function with the number of arguments it takes, which the
+ * evaluator checks before calling it, so the function itself never has to.
+ * A pure builtin changes nothing a script can see and calls no function
+ * back (printing is not pure: its output must not be dropped or reordered)
+ */
 class BuiltIn : public Object {
   public:
-    BuiltIn(BuiltInFunction fn) : fn_(fn) {
+    // maxArgs of a builtin taking any number of arguments from minArgs on
+    static const int VARIADIC = -1;
+
+    BuiltIn(const char* name, BuiltInFunction fn, int minArgs, int maxArgs, bool pure) :
+      name_(name), fn_(fn), callingFn_(nullptr), minArgs_(minArgs), maxArgs_(maxArgs), pure_(pure) {
+      refCount_ = 0;
+    }
+
+    BuiltIn(const char* name, CallingBuiltInFunction fn, int minArgs, int maxArgs, bool pure) :
+      name_(name), fn_(nullptr), callingFn_(fn), minArgs_(minArgs), maxArgs_(maxArgs), pure_(pure) {
       refCount_ = 0;
     }
 
@@ -224,36 +410,445 @@ class BuiltIn : public Object {
       return std::string("builtin function");
     }
 
+    inline const char* GetName() const {
+      return name_;
+    }
+
     inline BuiltInFunction GetFunc() const {
       return fn_;
     }
 
+    // whether this is a CallingBuiltInFunction
+    inline bool TakesCallback() const {
+      return callingFn_ != nullptr;
+    }
+
+    inline CallingBuiltInFunction GetCallingFunc() const {
+      return callingFn_;
+    }
+
+    inline int GetMinArgs() const {
+      return minArgs_;
+    }
+
+    inline int GetMaxArgs() const {
+      return maxArgs_;
+    }
+
+    inline bool Accepts(size_t numArgs) const {
+      return numArgs >= static_cast<size_t>(minArgs_)
+        && (maxArgs_ == VARIADIC || numArgs <= static_cast<size_t>(maxArgs_));
+    }
+
+    inline bool IsPure() const {
+      return pure_;
+    }
+
   private:
+    const char* name_;
     BuiltInFunction fn_;
+    CallingBuiltInFunction callingFn_;
+    int minArgs_;
+    int maxArgs_;
+    bool pure_;
 };
 
+/*
+ * elements stored unboxed as longs while they are all integers (packed) and
+ * as objects from the first push of anything else (boxed). A view of
+ * length elements from offset on shares the storage of the array it was
+ * sliced from, copying it out first when pushed to; a boxed view also
+ * references the array that holds its elements' references until the view
+ * is released or collected
+ */
 class Array : public Object {
   public:
     Array() {
-      objs_ = std::make_shared<std::vector<Object*>>();
+      ints_ = std::make_shared<std::vector<long>>();
     }
-    inline void AddObj(Object* obj) {
-      objs_->push_back(obj);
+    // a packed array of ints
+    explicit Array(std::vector<long> ints) {
+      ints_ = std::make_shared<std::vector<long>>(std::move(ints));
     }
+    Array(Array* source, size_t offset, size_t length);
+
+    // appends obj, adding the reference the array holds on it when boxed
+    void AddObj(Object* obj);
 
     inline ObjectType Type() const override {
       return ObjectType::ARRAY_OBJ;
     }
 
-    inline std::shared_ptr<std::vector<Object*>> GetElements() const {
-      return objs_;
+    inline size_t Size() const {
+      if (view_) {
+        return length_;
+      }
+      return ints_ != nullptr ? ints_->size() : objs_->size();
+    }
+
+    inline bool IsPacked() const {
+      return ints_ != nullptr;
+    }
+
+    // element i of a packed array
+    inline long GetInt(size_t i) const {
+      return (*ints_)[offset_ + i];
     }
 
+    // the elements of a packed array, contiguous
+    inline const long* Ints() const {
+      return ints_->data() + offset_;
+    }
+
+    // element i of a boxed array
+    inline Object* Get(size_t i) const {
+      return (*objs_)[offset_ + i];
+    }
+
+    inline bool IsView() const {
+      return view_;
+    }
+
+    // the elements from start up to end, a view unless that is short or
+    // much shorter than the storage it would keep alive
+    Array* Slice(size_t start, size_t end);
+
+    // drops the references this array holds, its elements' or its owner's
+    void ReleaseElements();
+    // drops only the reference a view holds on its owner
+    void ReleaseOwner();
+
     std::string Inspect() const override;
 
 
   private:
+    void CopyOut_();
+    void Box_();
+
+    std::shared_ptr<std::vector<long>> ints_;
     std::shared_ptr<std::vector<Object*>> objs_;
+    Array* owner_ = nullptr;
+    size_t offset_ = 0;
+    size_t length_ = 0;
+    bool view_ = false;
+};
+
+/*
+ * a map from integers, booleans and strings to objects, holding a reference
+ * on every key and value in it. Entries are kept in insertion order and
+ * found through an open addressing table of entry numbers probed Robin Hood
+ * style, so a lookup inspects a few slots at most whatever the size
+ */
+class Hash : public Object {
+  public:
+    Hash() : index_(HASH_MIN_SLOTS, 0), size_(0) {}
+
+    inline ObjectType Type() const override {
+      return ObjectType::HASH_OBJ;
+    }
+
+    // whether obj can be a key
+    static bool IsHashable(const Object* obj);
+
+    // the value of key, nullptr if it has none
+    Object* Get(const Object* key) const;
+    // binds key, which must be hashable, to value
+    void Set(Object* key, Object* value);
+    // unbinds key, false if it was not bound
+    bool Delete(const Object* key);
+
+    inline size_t Size() const {
+      return size_;
+    }
+
+    // in insertion order
+    std::vector<Object*> Keys() const;
+    std::vector<Object*> Values() const;
+
+    // drops the references this hash holds on its keys and values
+    void ReleaseElements();
+
+    std::string Inspect() const override;
+
+  private:
+    // a deleted entry keeps its place with key set to nullptr
+    struct Entry {
+      Object* key;
+      Object* value;
+      size_t hash;
+    };
+
+    static const size_t HASH_MIN_SLOTS = 8;
+
+    // the slot holding key's entry number, -1 if none does
+    long Find_(const Object* key, size_t hash) const;
+    void Place_(uint32_t entry);
+    void Rebuild_(size_t slots);
+
+    std::vector<Entry> entries_;
+    // entry number + 1 per slot, 0 for an empty slot
+    std::vector<uint32_t> index_;
+    size_t size_;
+};
+
+/*
+ * the layout records built the same way share: field names in the order
+ * they were first given, each stored at the slot of its position. Shapes
+ * form a tree from the empty root, adding a field to a shape always giving
+ * the same child, and are kept until exit, so a shape pointer identifies a
+ * layout for good
+ */
+class Shape {
+  public:
+    static const Shape* Root();
+    // the shape with names added to the root in order
+    static const Shape* Of(const std::vector<std::string>& names);
+
+    // this shape plus name, itself if it already has name
+    const Shape* With(const std::string& name) const;
+    // slot of name, -1 if the shape has no such field
+    int Offset(const std::string& name) const;
+
+    inline size_t NumFields() const {
+      return fields_.size();
+    }
+
+    inline const std::string& GetField(size_t i) const {
+      return fields_[i];
+    }
+
+  private:
+    Shape() = default;
+
+    std::vector<std::string> fields_;
+    mutable std::unordered_map<std::string, std::unique_ptr<Shape>> transitions_;
+};
+
+/*
+ * a fixed set of named fields: a shape plus one slot per field, holding a
+ * reference on every value in it. Records cannot be changed once built
+ */
+class Record : public Object {
+  public:
+    Record(const Shape* shape) : shape_(shape), slots_(shape->NumFields(), nullptr) {}
+
+    inline ObjectType Type() const override {
+      return ObjectType::RECORD_OBJ;
+    }
+
+    inline const Shape* GetShape() const {
+      return shape_;
+    }
+
+    // puts value in slot offset while building the record
+    void SetSlot(int offset, Object* value);
+
+    inline Object* GetSlot(int offset) const {
+      return slots_[offset];
+    }
+
+    // the value of field name, nullptr if the record has none; cache is the
+    // reading node's, so a read of a shape it saw last is a compare and a load
+    inline Object* Field(const std::string& name, FieldCache& cache) const {
+      if (cache.shape != shape_) {
+        int offset = shape_->Offset(name);
+        if (offset < 0) {
+          return nullptr;
+        }
+        cache.shape = shape_;
+        cache.offset = offset;
+      }
+      return slots_[cache.offset];
+    }
+
+    // drops the references this record holds on its values
+    void ReleaseElements();
+
+    std::string Inspect() const override;
+
+  private:
+    const Shape* shape_;
+    std::vector<Object*> slots_;
+};
+
+// nodes of the persistent collections, shared between their versions
+struct VectorNode;
+struct MapNode;
+
+// bits of an index or a hash each level of a persistent collection consumes
+static const int TRIE_BITS = 5;
+static const size_t TRIE_WIDTH = 1 << TRIE_BITS;
+
+/*
+ * an immutable vector: elements sit in the leaves of a trie 32 wide, so any
+ * element is a few hops from the root. Conj and Assoc give a new vector that
+ * copies only the path to the element they change and shares every other
+ * node with this one; a leaf holds a reference on each element in it for as
+ * long as any version uses the leaf
+ */
+class PersistentVector : public Object {
+  public:
+    PersistentVector();
+
+    inline ObjectType Type() const override {
+      return ObjectType::VECTOR_OBJ;
+    }
+
+    inline size_t Size() const {
+      return size_;
+    }
+
+    Object* Get(size_t i) const;
+    // this vector with element i, i being at most Size(), set to obj
+    PersistentVector* Assoc(size_t i, Object* obj) const;
+    // this vector with obj appended
+    PersistentVector* Conj(Object* obj) const;
+
+    std::string Inspect() const override;
+
+  private:
+    PersistentVector(std::shared_ptr<const VectorNode> root, int shift, size_t size) :
+      root_(root), shift_(shift), size_(size) {}
+
+    std::shared_ptr<const VectorNode> root_;
+    // bits of an index the levels above the leaves consume
+    int shift_;
+    size_t size_;
+};
+
+/*
+ * an immutable map over the keys a Hash takes, kept as a hash array mapped
+ * trie: each level consumes 5 bits of a key's hash and stores only the slots
+ * in use, found through a bitmap. Assoc and Dissoc give a new map that
+ * copies the path to the key and shares the rest with this one. Keys come
+ * out in hash order
+ */
+class PersistentMap : public Object {
+  public:
+    PersistentMap() : size_(0) {}
+
+    inline ObjectType Type() const override {
+      return ObjectType::MAP_OBJ;
+    }
+
+    inline size_t Size() const {
+      return size_;
+    }
+
+    // the value of key, nullptr if it has none
+    Object* Get(const Object* key) const;
+    // this map with key, which must be hashable, bound to value
+    PersistentMap* Assoc(Object* key, Object* value) const;
+    // this map without key
+    PersistentMap* Dissoc(const Object* key) const;
+
+    std::vector<Object*> Keys() const;
+    std::vector<Object*> Values() const;
+
+    std::string Inspect() const override;
+
+  private:
+    PersistentMap(std::shared_ptr<const MapNode> root, size_t size) :
+      root_(root), size_(size) {}
+
+    // nullptr while empty
+    std::shared_ptr<const MapNode> root_;
+    size_t size_;
+};
+
+/*
+ * a binary heap whose Pop gives the least element first: by a comparator
+ * function, which says whether its first argument goes before its second,
+ * or by the order of integers and strings without one. Holds a reference on
+ * every element and on the comparator
+ */
+class PriorityQueue : public Object {
+  public:
+    // cmp is nullptr for the default order
+    PriorityQueue(Object* cmp);
+
+    inline ObjectType Type() const override {
+      return ObjectType::PQUEUE_OBJ;
+    }
+
+    inline size_t Size() const {
+      return heap_.size();
+    }
+
+    // the least element, nullptr when empty
+    inline Object* Peek() const {
+      return heap_.empty() ? nullptr : heap_[0];
+    }
+
+    /*
+     * both return the error ordering two elements gave, nullptr if none did;
+     * an error leaves every element queued, though maybe out of order.
+     * Pop sets top to the least element, nullptr when empty, and drops the
+     * reference the queue held on it
+     */
+    Object* Push(Object* obj, const BuiltInCallback& call);
+    Object* Pop(Object*& top, const BuiltInCallback& call);
+
+    // drops the references this queue holds on its elements and comparator
+    void ReleaseElements();
+
+    // in heap order
+    std::string Inspect() const override;
+
+  private:
+    // whether a goes before b, err being set when they cannot be ordered
+    bool Before_(Object* a, Object* b, const BuiltInCallback& call, Object*& err);
+    Object* SiftUp_(size_t i, const BuiltInCallback& call);
+    Object* SiftDown_(size_t i, const BuiltInCallback& call);
+
+    std::vector<Object*> heap_;
+    Object* cmp_;
+    // set while the comparator runs, which must leave the queue alone
+    bool busy_;
+};
+
+/*
+ * a double ended queue in a ring buffer of a power of two slots, doubled
+ * when full, so pushing and popping at either end never moves the other
+ * elements. Holds a reference on every element
+ */
+class Deque : public Object {
+  public:
+    Deque() : slots_(DEQUE_MIN_SLOTS, nullptr), head_(0), size_(0) {}
+
+    inline ObjectType Type() const override {
+      return ObjectType::DEQUE_OBJ;
+    }
+
+    inline size_t Size() const {
+      return size_;
+    }
+
+    // element i from the front, i being less than Size()
+    inline Object* Get(size_t i) const {
+      return slots_[(head_ + i) & (slots_.size() - 1)];
+    }
+
+    void PushFront(Object* obj);
+    void PushBack(Object* obj);
+    // the element taken off, nullptr when empty; the deque no longer
+    // references it
+    Object* PopFront();
+    Object* PopBack();
+
+    // drops the references this deque holds on its elements
+    void ReleaseElements();
+
+    std::string Inspect() const override;
+
+  private:
+    static const size_t DEQUE_MIN_SLOTS = 8;
+
+    void Grow_();
+
+    std::vector<Object*> slots_;
+    size_t head_;
+    size_t size_;
 };
 
 /*
@@ -263,22 +858,157 @@ BUILT IN FUNCTIONS
 */
 
 /*
- * Finds the length of a string or an array
+ * results a builtin can give back without allocating: the evaluator's true
+ * and false, which it shares when it is made, and the integers from 0 below
+ * SHARED_INTEGERS, kept until exit. The evaluator neither tracks nor frees
+ * a shared result
+ */
+static const long SHARED_INTEGERS = 1024;
+void ShareBooleans(Boolean* TRUE, Boolean* FALSE);
+// a new Boolean while no evaluator has shared any
+Object* SharedBoolean(bool value);
+// shared when value is small enough, new otherwise
+Object* NewInteger(long value);
+bool IsShared(const Object* obj);
+
+/*
+ * Finds the length of a string, an array, a vector, a map, a pqueue or a deque
  * returns an integer object
  */
-Object* Length(std::vector<Object*> args);
+Object* Length(BuiltInArgs args);
 
 /*
  * Adds an element to the end of an array
  * returns null
  */
-Object* Push(std::vector<Object*> args);  
+Object* Push(BuiltInArgs args);  
+
+/*
+ * The part of a string or an array from a start up to an end index, both
+ * clamped to its length; shares the storage of the original
+ * returns a string or an array object
+ */
+Object* Slice(BuiltInArgs args);
+
+/*
+ * The keys or values of a hash, in the order they were added, or of a map
+ * returns an array object
+ */
+Object* Keys(BuiltInArgs args);
+Object* Values(BuiltInArgs args);
+
+/*
+ * Whether a hash or a map has a key
+ * returns a boolean object
+ */
+Object* Has(BuiltInArgs args);
+
+/*
+ * Binds a key of a hash to a value
+ * returns null
+ */
+Object* Set(BuiltInArgs args);
+
+/*
+ * Removes a key from a hash
+ * returns a boolean object, true if the key was there
+ */
+Object* Delete(BuiltInArgs args);
+
+/*
+ * A persistent vector of the arguments, or a persistent map of its
+ * arguments taken as keys and values in turn
+ * returns a vector or a map object
+ */
+Object* Vec(BuiltInArgs args);
+Object* Map(BuiltInArgs args);
+
+/*
+ * A vector with an element appended
+ * returns a vector object; the argument is left as it was
+ */
+Object* Conj(BuiltInArgs args);
+
+/*
+ * A vector with the element at an index (at most its length) replaced, or a
+ * map with a key bound to a value
+ * returns a vector or a map object; the argument is left as it was
+ */
+Object* Assoc(BuiltInArgs args);
+
+/*
+ * A map without a key
+ * returns a map object; the argument is left as it was
+ */
+Object* Dissoc(BuiltInArgs args);
+
+/*
+ * A priority queue, ordered by a comparator function of two elements that
+ * says whether the first goes before the second, or without one by the
+ * order of integers and strings
+ * returns a pqueue object
+ */
+Object* PQueue(BuiltInArgs args);
+
+/*
+ * Adds an element to a priority queue
+ * returns null, or the error the comparator gave
+ */
+Object* PQPush(BuiltInArgs args, const BuiltInCallback& call);
+
+/*
+ * Removes the least element of a priority queue, or only looks at it
+ * returns the element, null when the queue is empty
+ */
+Object* PQPop(BuiltInArgs args, const BuiltInCallback& call);
+Object* PQPeek(BuiltInArgs args, const BuiltInCallback& call);
+
+/*
+ * An empty double ended queue
+ * returns a deque object
+ */
+Object* MakeDeque(BuiltInArgs args);
+
+/*
+ * Adds an element to the front or the back of a deque
+ * returns null
+ */
+Object* DQPushFront(BuiltInArgs args);
+Object* DQPushBack(BuiltInArgs args);
+
+/*
+ * Removes the element at the front or the back of a deque, or only looks at it
+ * returns the element, null when the deque is empty
+ */
+Object* DQPopFront(BuiltInArgs args, const BuiltInCallback& call);
+Object* DQPopBack(BuiltInArgs args, const BuiltInCallback& call);
+Object* DQPeekFront(BuiltInArgs args, const BuiltInCallback& call);
+Object* DQPeekBack(BuiltInArgs args, const BuiltInCallback& call);
+
+/*
+ * The sum, the least or the greatest of an array of integers; the sum of
+ * an empty array is 0 and it has no least or greatest
+ * returns an integer object
+ */
+Object* Sum(BuiltInArgs args);
+Object* Min(BuiltInArgs args);
+Object* Max(BuiltInArgs args);
+
+/*
+ * The sum of the products of two arrays of integers of the same length
+ * returns an integer object
+ */
+Object* Dot(BuiltInArgs args);
 
 /*
  * Print to stdout
  */
-Object* Print(std::vector<Object*> args);
+Object* Print(BuiltInArgs args);
 
 std::unordered_map<std::string, BuiltIn*> GetBuiltIns();
 
+// the builtin called name, nullptr if there is none; for reading what it
+// declares, not for calling (every evaluator has builtins of its own)
+const BuiltIn* FindBuiltIn(const std::string& name);
+
 #endif // MCSCRIPT_V3_OBJECT_H
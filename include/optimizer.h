@@ -0,0 +1,150 @@
+#ifndef MCSCRIPT_V3_OPTIMIZER_H
+#define MCSCRIPT_V3_OPTIMIZER_H
+
+#include <ast.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// largest body expression, in AST nodes, a function may have to be inlined
+static const int INLINE_MAX_BODY_NODES = 16;
+
+// what one lexical scope has bound so far, in source order
+struct OptimizerScope {
+  std::unordered_set<std::string> declared;
+  std::unordered_map<std::string, std::shared_ptr<Expression>> constants;
+  std::unordered_map<std::string, std::shared_ptr<FunctionLiteral>> inlinable;
+};
+
+// names and state a loop or a statement may change while it runs
+struct SideEffects {
+  std::unordered_set<std::string> declared;
+  std::unordered_set<std::string> assigned;
+  bool callsUserCode = false;
+  // push to an array, set or delete on a hash, or change a pqueue or deque
+  bool mutatesArrays = false;
+};
+
+/*
+ * rewrites a parsed Program in place before it is evaluated:
+ *  - folds prefix/infix expressions over integer, string and boolean literals
+ *  - propagates literal values of vars that are declared once and never assigned
+ *  - prunes if branches whose condition is a literal
+ *  - drops statements that follow an unconditional return
+ *  - hoists pure, loop invariant expressions out of for loops
+ *  - inlines calls to small, non recursive functions bound by a var
+ *  - evaluates pure subexpressions repeated within a statement only once
+ *
+ * Everything it knows about names comes from the one program it is given. In
+ * incremental mode (the REPL), later programs run in the same environment and
+ * may rebind any name, so no name counts as constant and none as a builtin
+ */
+class Optimizer {
+  public:
+    Optimizer();
+    std::shared_ptr<Program> Optimize(std::shared_ptr<Program> program);
+
+    inline void SetIncremental(bool incremental) {
+      incremental_ = incremental;
+    }
+
+    // one line per call site that was inlined by the last Optimize()
+    inline const std::vector<std::string>& GetInlineReport() const {
+      return inlineReport_;
+    }
+
+  private:
+    /* binding analysis */
+    void CollectBindings_(std::shared_ptr<Node> node);
+    bool IsConstantName_(const std::string& name) const;
+
+    /* statements */
+    std::vector<std::shared_ptr<Statement>> OptimizeStatements_(
+        const std::vector<std::shared_ptr<Statement>>& stmts);
+    bool OptimizeStatement_(std::shared_ptr<Statement> stmt, bool last,
+        std::vector<std::shared_ptr<Statement>>& out);
+    void OptimizeBlock_(std::shared_ptr<BlockStatement> block);
+    void OptimizeVarStatement_(std::shared_ptr<VarStatement> stmt);
+    void OptimizeForStatement_(std::shared_ptr<ForStatement> fs);
+
+    /* expressions */
+    std::shared_ptr<Expression> Fold_(std::shared_ptr<Expression> exp);
+    std::shared_ptr<Expression> FoldPrefix_(std::shared_ptr<PrefixExpression> exp);
+    std::shared_ptr<Expression> FoldInfix_(std::shared_ptr<InfixExpression> exp);
+    std::shared_ptr<Expression> LookupConstant_(std::shared_ptr<Identifier> ident) const;
+    void DeclareFunction_(std::shared_ptr<FunctionLiteral> fn);
+    bool IsVisible_(const std::string& name) const;
+
+    /* inlining */
+    std::shared_ptr<Expression> InlineBody_(std::shared_ptr<FunctionLiteral> fn) const;
+    bool IsInlinable_(const std::string& name, std::shared_ptr<FunctionLiteral> fn) const;
+    std::shared_ptr<FunctionLiteral> LookupInlinable_(std::shared_ptr<Expression> callee) const;
+    std::shared_ptr<Expression> Inline_(std::shared_ptr<CallExpression> call);
+    bool CollectInlineNames_(std::shared_ptr<Expression> exp, std::vector<std::string>& names,
+        int& nodes) const;
+    std::shared_ptr<Expression> Substitute_(std::shared_ptr<Expression> exp,
+        std::unordered_map<std::string, std::shared_ptr<Expression>>& args,
+        std::unordered_map<std::string, int>& uses) const;
+    bool IsEffectFree_(std::shared_ptr<Expression> exp) const;
+
+    /* loop invariant code motion */
+    void HoistInvariants_(std::shared_ptr<ForStatement> fs);
+    void ScanEffects_(std::shared_ptr<Node> node, SideEffects& effects) const;
+    bool IsInvariant_(std::shared_ptr<Expression> exp, const SideEffects& effects) const;
+    bool IsBuiltInName_(std::shared_ptr<Expression> exp, const std::string& name) const;
+    bool IsPureBuiltIn_(std::shared_ptr<Expression> exp) const;
+    void HoistStatements_(std::shared_ptr<BlockStatement> block, const SideEffects& effects,
+        std::shared_ptr<ForStatement> fs);
+    void HoistStatement_(std::shared_ptr<Statement> stmt, const SideEffects& effects,
+        std::shared_ptr<ForStatement> fs);
+    std::shared_ptr<Expression> Hoist_(std::shared_ptr<Expression> exp,
+        const SideEffects& effects, std::shared_ptr<ForStatement> fs);
+
+    /* common subexpression elimination */
+    void EliminateCommonIn_(std::shared_ptr<Node> node);
+    std::vector<std::shared_ptr<Statement>> EliminateCommon_(std::shared_ptr<Statement> stmt);
+    std::string Key_(std::shared_ptr<Expression> exp) const;
+    void CountCommon_(std::shared_ptr<Expression> exp, const SideEffects& effects,
+        std::unordered_map<std::string, int>& counts, bool& clean,
+        std::unordered_set<std::string>& movable) const;
+    bool CannotFail_(std::shared_ptr<Expression> exp) const;
+    static bool IsSafeInteger_(std::shared_ptr<Expression> exp);
+    std::shared_ptr<Expression> ReplaceCommon_(std::shared_ptr<Expression> exp,
+        const SideEffects& effects, const std::unordered_map<std::string, int>& counts,
+        std::unordered_map<std::string, std::string>& temps,
+        std::vector<std::shared_ptr<Statement>>& out);
+
+    /* literal helpers */
+    static bool IsLiteral_(std::shared_ptr<Expression> exp);
+    static bool IsTruthyLiteral_(std::shared_ptr<Expression> exp);
+    static std::shared_ptr<Expression> CopyLiteral_(std::shared_ptr<Expression> exp);
+    static std::shared_ptr<Expression> NewInteger_(long value);
+    static std::shared_ptr<Expression> NewString_(const std::string& value);
+    static std::shared_ptr<Expression> NewBoolean_(bool value);
+
+    // whether more programs may follow in the same environment
+    bool incremental_;
+    // how often each name is bound by a var statement or a parameter list
+    std::unordered_map<std::string, int> declCounts_;
+    // names that appear on the left of an assignment anywhere
+    std::unordered_set<std::string> assigned_;
+    // enclosing lexical scopes, innermost last
+    std::vector<OptimizerScope> scopes_;
+    // hoisted and common subexpression temporaries created so far
+    int hoistCount_;
+    int cseCount_;
+    // temporaries of the loop being hoisted from, by structural key
+    std::unordered_map<std::string, std::string> hoisted_;
+    // names certainly bound where common subexpressions are being eliminated
+    // (parameters are not: a call may pass fewer arguments)
+    std::unordered_set<std::string> bound_;
+    // functions whose inlined bodies are being folded right now; expanding
+    // one of them again would recurse through its parameters forever
+    std::unordered_set<const FunctionLiteral*> expanding_;
+    std::vector<std::string> inlineReport_;
+};
+
+
+#endif // MCSCRIPT_V3_OPTIMIZER_H
@@ -63,16 +63,21 @@ class Parser {
     std::shared_ptr<IfExpression> ParseIfExpression_();
     std::shared_ptr<BlockStatement> ParseBlockStatement_();
     std::shared_ptr<FunctionLiteral> ParseFunctionLiteral_();
+    void MarkTailCalls_(std::shared_ptr<BlockStatement> block);
     std::shared_ptr<CallExpression> ParseCallExpression_(std::shared_ptr<Expression> func);
     std::vector<std::shared_ptr<Expression>> ParseCallParameters_();
     std::shared_ptr<StringLiteral> ParseStringLiteral_();
     std::shared_ptr<ArrayLiteral> ParseArrayLiteral_();
+    std::shared_ptr<Expression> ParseHashLiteral_();
     std::vector<std::shared_ptr<Expression>> ParseExpressionList_(TokenType type);
     std::shared_ptr<IndexExpression> ParseIndexExpression_(std::shared_ptr<Expression> idx);
+    std::shared_ptr<FieldExpression> ParseFieldExpression_(std::shared_ptr<Expression> left);
     std::shared_ptr<AssignExpression> ParseAssignExpression_(std::shared_ptr<Expression> left);
     infixParseFn GetParseAssignExpressionFn_();
     infixParseFn GetParseIndexExpression_();
+    infixParseFn GetParseFieldExpressionFn_();
     prefixParseFn GetParseArrayLiteralFn_();
+    prefixParseFn GetParseHashLiteralFn_();
     prefixParseFn GetParseStringLiteralFn_();
     infixParseFn GetParseCallExpressionFn_();
     prefixParseFn GetParseFunctionLiteralFn_();
@@ -104,6 +109,7 @@ static const std::unordered_map<TokenType, Precedence> prMap = {
   {TokenType::GT, Precedence::LESSGREATER},
   {TokenType::LPAREN, Precedence::CALL},
   {TokenType::LBRACKET, Precedence::INDEX},
+  {TokenType::DOT, Precedence::INDEX},
   {TokenType::ASSIGN, Precedence::ASSIGN}
 };
 
@@ -0,0 +1,69 @@
+#ifndef MCSCRIPT_V3_RESOLVER_H
+#define MCSCRIPT_V3_RESOLVER_H
+
+#include <ast.h>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// one place a name gets bound in a scope, numbered in evaluation order
+struct ResolverBinding {
+  int index;
+  // inside an if branch: the binding may not have happened yet
+  bool conditional;
+  // inside a for loop's condition, body or after action: it happens again
+  bool repeated;
+};
+
+// a function body, a for loop or the program, as the evaluator scopes them
+struct ResolverScope {
+  std::unordered_map<std::string, std::vector<ResolverBinding>> bindings;
+  // the closure this scope is the body of, -1 for loops and the program
+  int closure = -1;
+  bool global = false;
+  int conditional = 0;
+  bool inLoop = false;
+};
+
+// a function literal and the names it reads from outside its own body
+struct ResolverClosure {
+  std::shared_ptr<FunctionLiteral> fn;
+  int index;
+  // enclosing scopes below the global one, innermost first
+  std::vector<ResolverScope*> chain;
+  std::set<std::string> free;
+};
+
+/*
+ * free variable analysis run once over a Program before it is evaluated:
+ * a FunctionLiteral whose free variables are all bound before it and never
+ * rebound afterwards in the scopes around it is marked LOCAL, so the closure
+ * copies just those variables instead of keeping its defining scopes alive
+ */
+class Resolver {
+  public:
+    Resolver();
+    void Resolve(std::shared_ptr<Program> program);
+
+  private:
+    void Resolve_(std::shared_ptr<Node> node);
+    void ResolveFunction_(std::shared_ptr<FunctionLiteral> fn);
+    void ResolveFor_(std::shared_ptr<ForStatement> fs);
+    void Reference_(const std::string& name);
+    void Bind_(const std::string& name);
+    ResolverScope* PushScope_();
+    bool IsShared_(const ResolverClosure& closure, const std::string& name) const;
+
+    // every scope seen so far; a deque keeps their addresses stable
+    std::deque<ResolverScope> scopes_;
+    // scopes enclosing the node being resolved, innermost last
+    std::vector<ResolverScope*> stack_;
+    std::vector<ResolverClosure> closures_;
+    int index_;
+};
+
+
+#endif // MCSCRIPT_V3_RESOLVER_H
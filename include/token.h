@@ -31,6 +31,8 @@ enum class TokenType : int {
   RBRACKET,
   COMMA,
   SEMICOLON,
+  COLON,
+  DOT,
 
   // special
   EOI,
@@ -69,6 +71,8 @@ static const std::vector<std::string> tokenStrs = {
   "RBRACKET",
   "COMMA",
   "SEMICOLON",
+  "COLON",
+  "DOT",
   "EOI",
   "ILLEGAL",
   "VAR",
@@ -0,0 +1,190 @@
+#ifndef MCSCRIPT_V3_VM_H
+#define MCSCRIPT_V3_VM_H
+
+#include <ast.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// labels-as-values dispatch where the compiler has it, a switch elsewhere
+#if defined(__GNUC__) && !defined(MCSCRIPT_VM_SWITCH)
+#define MCSCRIPT_VM_THREADED
+#endif
+
+// for loops a chunk nests before an inner one gets a chunk of its own
+static const int VM_MAX_LOOP_DEPTH = 4;
+
+/*
+ * operations of the linear format; dst, a and b are register numbers, fail
+ * is where an instruction that produced an error jumps to after storing the
+ * error in failReg (the statement, loop part or argument it interrupts)
+ */
+enum class VmOp : int {
+  NIL,          // dst = nullptr
+  NULL_T,       // dst = NULL
+  INT,          // dst = constant, the literal's Integer (imm is its value)
+  STRING,       // dst = constant, the literal's String
+  BOOL,         // dst = TRUE or FALSE by imm
+  NAME,         // dst = value of the Identifier node
+  FUNCTION,     // dst = closure over the FunctionLiteral node
+  BANG,         // dst = !a
+  MINUS,        // dst = -a
+  PREFIX,       // dst = a under the PrefixExpression node's operator
+  INFIX,        // dst = a op b, quickened through the InfixExpression node
+  ARRAY,        // dst = [a, ..., a + count - 1]
+  HASH,         // dst = {a: a + 1, ..., a + 2 * count - 2: a + 2 * count - 1}
+  RECORD,       // dst = the RecordLiteral node's record of a, ..., a + count - 1
+  CHECK_INDEX,  // fails unless a can index an array
+  INDEX,        // dst = b[a]
+  FIELD,        // dst = a.name through the FieldExpression node's cache
+  CALL,         // dst = a(b, ..., b + count - 1) through the CallExpression node
+  TAIL_CALL,    // CALL in tail position: hands TAIL_CALL_ back to the caller
+  SET_VAR,      // binds name to a in the current scope
+  ASSIGN,       // dst = (name = a)
+  JUMP,         // continue at target
+  JUMP_FALSE,   // continue at target unless a is truthy
+  JUMP_NOT_TRUE,// continue at target unless a is TRUE (for loop conditions)
+  LOOP_ENTER,   // opens the scope of loop at loop depth imm
+  HOIST,        // binds name to a in the loop scope, NULL when a is nullptr
+  LOOP_EXIT,    // closes the scope at loop depth imm, dst = NULL
+  EVAL,         // dst = the node, evaluated by the tree walker
+  RETURN,       // leaves the chunk with a
+  /*
+   * superinstructions for integer idioms: they read ident (and ident2)
+   * straight from their slots and take literals as imm, so a comparison
+   * allocates nothing and a step only its result; an operand that is not an
+   * Integer sends them down the path of the instructions they replace
+   */
+  NAME_INT,     // dst = ident kind imm
+  NAME_NAME,    // dst = ident kind ident2
+  BRANCH_NAME_INT,  // continue at target unless ident kind imm
+  BRANCH_NAME_NAME, // continue at target unless ident kind ident2
+  INC_NAME,     // dst = (name = ident kind imm), ident being name
+  INC_BRANCH,   // INC_NAME, then continue at target if name cmp limit (or
+                // ident2), fall through if not, and at alt to test it generically
+  NUM_OPS
+};
+
+struct VmInstr {
+  VmOp op;
+  // label address of op once the chunk is threaded
+  const void* handler = nullptr;
+  int dst = 0;
+  int a = 0;
+  int b = 0;
+  int count = 0;
+  int target = -1;
+  int fail = -1;
+  int failReg = 0;
+  long imm = 0;
+  std::string name;
+  std::shared_ptr<Node> node;
+  // LOOP_ENTER's loop, not owned: a loop's own chunk is kept by the loop
+  ForStatement* loop = nullptr;
+  // pinned constant of a literal operand
+  Object* constant = nullptr;
+  // operands of the superinstructions, not owned either (the nodes keeping
+  // the chunk keep them)
+  Identifier* ident = nullptr;
+  Identifier* ident2 = nullptr;
+  InfixKind kind = InfixKind::GENERIC;
+  InfixKind cmp = InfixKind::GENERIC;
+  long limit = 0;
+  int alt = -1;
+  // BRANCH_NAME_*'s condition is a for loop's: only TRUE goes on, as for
+  // JUMP_NOT_TRUE, where an if goes on for anything truthy
+  bool loopCond = false;
+};
+
+// a function body or for loop flattened into instructions over registers
+class VmChunk {
+  public:
+    inline std::vector<VmInstr>& GetCode() {
+      return code_;
+    }
+
+    inline int GetNumRegs() const {
+      return numRegs_;
+    }
+
+    inline void SetNumRegs(int numRegs) {
+      numRegs_ = numRegs;
+    }
+
+    // whether every handler has been filled in
+    inline bool IsThreaded() const {
+      return threaded_;
+    }
+
+    inline void SetThreaded() {
+      threaded_ = true;
+    }
+
+    // one line per instruction, for debugging
+    std::string String() const;
+
+  private:
+    std::vector<VmInstr> code_;
+    int numRegs_ = 0;
+    bool threaded_ = false;
+};
+
+/*
+ * lowers a function body or a for loop to a VmChunk, preserving the tree
+ * walker's order of evaluation and where its errors and returns stop: a
+ * statement, a for loop part, a call argument and the array of an index
+ * expression each catch what fails inside them. Anything the format has no
+ * instruction for (an if in value position holding a return, loops nested
+ * too deep) is left to the tree walker through EVAL
+ */
+class VmCompiler {
+  public:
+    std::shared_ptr<VmChunk> CompileBody(std::shared_ptr<BlockStatement> body);
+    std::shared_ptr<VmChunk> CompileFor(std::shared_ptr<ForStatement> fs);
+
+  private:
+    // where an error goes: the label to jump to and the register it is left in
+    struct Boundary {
+      int label;
+      int reg;
+    };
+
+    /* statements */
+    void Block_(std::shared_ptr<BlockStatement> block, int dst);
+    void Statement_(std::shared_ptr<Statement> stmt, int dst, bool last);
+    void Return_(std::shared_ptr<ReturnStatement> rs);
+    void For_(std::shared_ptr<ForStatement> fs, int dst);
+
+    /* expressions */
+    void Expression_(std::shared_ptr<Expression> exp, int dst, bool stmtPos = false);
+    void If_(std::shared_ptr<IfExpression> ie, int dst, bool stmtPos);
+    void Call_(std::shared_ptr<CallExpression> call, int dst, bool tail);
+    void Caught_(std::shared_ptr<Expression> exp, int reg);
+    static bool HasReturn_(std::shared_ptr<BlockStatement> block);
+
+    /* superinstructions */
+    bool FusedInfix_(std::shared_ptr<InfixExpression> ie, int dst);
+    bool FusedBranch_(std::shared_ptr<Expression> cond, int target, bool loop);
+    bool FusedIncrement_(std::shared_ptr<Expression> exp, int dst);
+    bool FusedLatch_(std::shared_ptr<Expression> after, std::shared_ptr<Expression> cond,
+        int body, int top, int dst);
+
+    /* output */
+    VmInstr& Emit_(VmOp op, int dst = 0, int a = 0, int b = 0);
+    int NewLabel_();
+    void Bind_(int label);
+    int NewReg_();
+    std::shared_ptr<VmChunk> Finish_(int result);
+
+    std::shared_ptr<VmChunk> chunk_;
+    std::vector<int> labels_;
+    std::vector<Boundary> boundaries_;
+    // where a return in a loop body goes, innermost last
+    std::vector<int> continues_;
+    int regs_ = 0;
+    int maxRegs_ = 0;
+    int loopDepth_ = 0;
+};
+
+
+#endif // MCSCRIPT_V3_VM_H
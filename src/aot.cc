@@ -0,0 +1,186 @@
+#include <aot.h>
+#include <gcollector.h>
+#include <iostream>
+#include <stdio.h>
+
+AotRuntime::AotRuntime() : tailCallFn_(nullptr), bailed_(false) {
+  evaluator_ = std::make_shared<Evaluator>(GCollector::getGCollector(), new Boolean(true),
+      new Boolean(false), new ::Null(), GetBuiltIns());
+  TAIL_CALL_ = new ReturnValue(nullptr);
+  // builtins call translated functions back through this runtime
+  evaluator_->SetFunctionCaller([this](Object* fn, std::vector<Object*> args) {
+    return Call(fn, std::move(args));
+  });
+}
+
+AotRuntime::~AotRuntime() {
+  delete TAIL_CALL_;
+}
+
+int AotRuntime::Main(AotBody program) {
+  auto env = std::make_shared<Environment<Object*>>();
+  Object* obj = program(*this, env);
+  if (obj != nullptr && obj->Type() == ObjectType::ERROR_OBJ) {
+    std::cerr << obj->Inspect() << "\n";
+  }
+
+  evaluator_->FinalCleanup();
+  return 0;
+}
+
+/*
+  values
+*/
+
+Object* AotRuntime::NewArray(std::initializer_list<Object*> elements) {
+  Array* arr = new Array();
+  for (Object* obj : elements) {
+    arr->AddObj(obj);
+  }
+
+  return Track_(arr);
+}
+
+Object* AotRuntime::NewHash(std::initializer_list<Object*> pairs) {
+  return evaluator_->NewHash(pairs);
+}
+
+Object* AotRuntime::NewFunction(const std::vector<std::string>* params, AotBody body,
+    const AotEnv& env, const char* source) {
+  return Track_(new AotFunction(params, body, env, source));
+}
+
+/*
+  names
+*/
+
+void AotRuntime::Var(const AotEnv& env, const char* name, Object* value) {
+  value->AddRef(); // for garbage collection
+  env->Set(name, value);
+}
+
+void AotRuntime::Hoist(const AotEnv& env, const char* name, Object* value) {
+  if (value == nullptr) {
+    value = Null();
+  }
+  Var(env, name, value);
+}
+
+void AotRuntime::ReleaseLoop(const AotEnv& env) {
+  if (env.use_count() > 1) {
+    return;
+  }
+
+  std::unordered_map<std::string, Object*> store = env->GetStore();
+  for (const auto& pair : store) {
+    pair.second->SubtractRef();
+  }
+}
+
+bool AotRuntime::EndStatement(Object*& result) {
+  if (result == nullptr) {
+    return false;
+  }
+
+  auto returnValue = dynamic_cast<ReturnValue*>(result);
+  if (returnValue != nullptr) {
+    result = returnValue->GetValue();
+    return true;
+  }
+
+  if (result->Type() == ObjectType::ERROR_OBJ) {
+    return true;
+  }
+  if (evaluator_->GetNumObjects() > 10) {
+    evaluator_->CollectGarbage();
+  }
+
+  return false;
+}
+
+bool AotRuntime::Bound(const AotEnv& env, std::initializer_list<const char*> names) const {
+  AotEnv global = env;
+  while (global->GetOuter() != nullptr) {
+    global = global->GetOuter();
+  }
+
+  for (const char* name : names) {
+    if (global->Get(name) == nullptr) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+  calls
+*/
+
+Object* AotRuntime::Call(Object* callee, std::vector<Object*> args, bool tail) {
+  if (callee->Type() == ObjectType::BUILT_IN_OBJ) {
+    return evaluator_->EvalBuiltIn(static_cast<BuiltIn*>(callee), args);
+  }
+
+  auto function = dynamic_cast<AotFunction*>(callee);
+  if (function == nullptr) {
+    char buff[128];
+    snprintf(buff, sizeof(buff), "%s is not a function", callee->Inspect().c_str());
+    return NewError(buff);
+  }
+
+  if (tail) {
+    tailCallFn_ = function;
+    tailCallArgs_ = std::move(args);
+    return TAIL_CALL_;
+  }
+
+  return Invoke_(function, std::move(args));
+}
+
+// EvalFunctionCall_ for translated bodies
+Object* AotRuntime::Invoke_(AotFunction* function, std::vector<Object*> args) {
+  if (StackExhausted()) {
+    return NewError("stack overflow: maximum recursion depth exceeded");
+  }
+
+  AotEnv outerEnv = function->GetEnv();
+  auto env = std::make_shared<Environment<Object*>>(outerEnv);
+  Object* result = nullptr;
+
+  while (true) {
+    const std::vector<std::string>& params = function->GetParams();
+    for (size_t i = 0; i < args.size() && i < params.size(); i++) {
+      args[i]->AddRef(); // for garbage collection
+      env->Set(params[i], args[i]);
+    }
+
+    result = function->GetBody()(*this, env);
+    // translated closures hold on to the whole scope, not copies
+    if (env.use_count() == 1) {
+      evaluator_->ReleaseScope(env);
+    }
+
+    if (result != TAIL_CALL_) {
+      break;
+    }
+
+    // proper tail call: loop instead of recursing, and reuse the scope
+    // unless a closure created during this iteration still holds on to it
+    function = tailCallFn_;
+    args = std::move(tailCallArgs_);
+    tailCallArgs_.clear();
+    if (function->GetEnv() == outerEnv && env.use_count() == 1) {
+      env->Clear();
+    } else {
+      outerEnv = function->GetEnv();
+      env = std::make_shared<Environment<Object*>>(outerEnv);
+    }
+  }
+
+  if (result != nullptr && result->Type() == ObjectType::RETURN_VALUE_OBJ) {
+    result = static_cast<ReturnValue*>(result)->GetValue();
+  }
+
+  return result;
+}
@@ -1,4 +1,27 @@
 #include <ast.h>
+#include <object.h>
+
+/*
+ * literal constants: made once per node when its value is known, never
+ * tracked by the garbage collector nor changed, and kept until exit, since
+ * values bound from a literal outlive the tree it was parsed from (a REPL
+ * line, a folded subtree)
+ */
+static Object* PinConstant(Object* obj) {
+  static std::vector<std::unique_ptr<Object>> pool;
+  pool.emplace_back(obj);
+  return obj;
+}
+
+void IntegerLiteral::SetValue(long value) {
+  value_ = value;
+  constant_ = PinConstant(new Integer(value));
+}
+
+StringLiteral::StringLiteral(std::shared_ptr<Token> tok, std::string literal)
+    : tok_(tok), literal_(literal), constant_(PinConstant(new ::String(literal, true))) {
+  // empty
+}
 
 std::string Program::String() const {
   std::string result = "";
@@ -147,6 +170,56 @@ std::string ArrayLiteral::String() const {
 }
 
 
+std::string HashLiteral::String() const {
+  std::string result = "{";
+
+  for (size_t i = 0; i < keys_.size(); i++) {
+    // a bare name would read back as a record field
+    bool name = std::dynamic_pointer_cast<Identifier>(keys_[i]) != nullptr;
+    result.append(name ? "(" + keys_[i]->String() + ")" : keys_[i]->String());
+    result.append(":" + values_[i]->String());
+    if (i < keys_.size() - 1) {
+      result.append(",");
+    }
+  }
+
+  result.append("}");
+
+  return result;
+}
+
+
+RecordLiteral::RecordLiteral(std::shared_ptr<Token> tok) :
+  tok_(tok), shape_(Shape::Root()) {
+    // empty
+  }
+
+void RecordLiteral::AddField(const std::string& name, std::shared_ptr<Expression> value) {
+  shape_ = shape_->With(name);
+  names_.push_back(name);
+  values_.push_back(value);
+  offsets_.push_back(shape_->Offset(name));
+}
+
+std::string RecordLiteral::String() const {
+  std::string result = "{";
+
+  for (size_t i = 0; i < names_.size(); i++) {
+    result.append(names_[i] + ":" + values_[i]->String());
+    if (i < names_.size() - 1) {
+      result.append(",");
+    }
+  }
+
+  result.append("}");
+
+  return result;
+}
+
+std::string FieldExpression::String() const {
+  return exp_->String() + "." + name_;
+}
+
 std::string IndexExpression::String() const {
   std::string result = exp_->String();
   result += '[';
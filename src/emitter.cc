@@ -0,0 +1,1015 @@
+#include <emitter.h>
+#include <stdio.h>
+
+/*
+================================================
+EMITTER
+================================================
+*/
+
+CppEmitter::CppEmitter() : indent_(0), temps_(0), functions_(0), envs_(0) {
+  // empty
+}
+
+std::string CppEmitter::Emit(std::shared_ptr<Program> program) {
+  FindTyped_(program);
+
+  out_.clear();
+  indent_ = 1;
+  env_ = "env";
+  Line_("Object* result = nullptr;");
+  for (const auto& stmt : program->GetStatements()) {
+    EmitStatement_(stmt, "result");
+    Line_("if (rt.EndStatement(result)) {");
+    Line_("  return result;");
+    Line_("}");
+  }
+  Line_("return result;");
+  std::string top = out_;
+
+  std::string typed;
+  for (const auto& name : typedNames_) {
+    if (!typed_.at(name).failed) {
+      typed.append(typed_.at(name).code).append("\n");
+    }
+  }
+
+  std::string result = "// translated from McScript by bin/main --emit-cpp\n";
+  result.append("#include <aot.h>\n\n");
+  result.append(decls_).append("\n");
+  result.append(typed);
+  result.append(defs_);
+  result.append("static Object* Program(AotRuntime& rt, const AotEnv& env) {\n");
+  result.append(top);
+  result.append("}\n\n");
+  result.append("int main() {\n");
+  result.append("  AotRuntime rt;\n");
+  result.append("  return rt.Main(Program);\n");
+  result.append("}\n");
+
+  return result;
+}
+
+std::string CppEmitter::Quote(const std::string& str) {
+  std::string result = "\"";
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+      result.push_back(c);
+    } else if (c == '\n') {
+      result.append("\\n");
+    } else if (c < 0x20 || c >= 0x7f) {
+      char buff[8];
+      snprintf(buff, sizeof(buff), "\\%03o", c);
+      result.append(buff);
+    } else {
+      result.push_back(c);
+    }
+  }
+  result.push_back('"');
+
+  return result;
+}
+
+/*
+  typed functions
+*/
+
+/*
+ * candidates are functions bound by a top level var to a name nothing else
+ * at the top level binds: once bound, every call through that name from a
+ * function in the global scope reaches that literal
+ */
+void CppEmitter::FindTyped_(std::shared_ptr<Program> program) {
+  std::unordered_map<std::string, int> counts;
+  for (const auto& stmt : program->GetStatements()) {
+    CountGlobalBindings_(stmt, counts);
+  }
+
+  int id = 0;
+  for (const auto& stmt : program->GetStatements()) {
+    auto vs = std::dynamic_pointer_cast<VarStatement>(stmt);
+    auto fn = vs != nullptr ? std::dynamic_pointer_cast<FunctionLiteral>(vs->GetValue()) : nullptr;
+    if (fn == nullptr || vs->GetName() == nullptr || counts[vs->GetName()->GetValue()] != 1) {
+      continue;
+    }
+
+    CppTyped typed;
+    typed.name = vs->GetName()->GetValue();
+    typed.fn = fn;
+    typed.id = id++;
+    typed_.emplace(typed.name, typed);
+    typedNames_.push_back(typed.name);
+  }
+
+  for (const auto& name : typedNames_) {
+    if (GetTyped(name) != nullptr) {
+      typedLiterals_[typed_.at(name).fn.get()] = name;
+    }
+  }
+}
+
+// bindings made in the global scope: the top level and its if blocks
+void CppEmitter::CountGlobalBindings_(std::shared_ptr<Node> node,
+    std::unordered_map<std::string, int>& counts) const {
+  if (node == nullptr) {
+    return;
+  }
+
+  if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      CountGlobalBindings_(stmt, counts);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    CountGlobalBindings_(es->GetExpression(), counts);
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    if (vs->GetName() != nullptr) {
+      counts[vs->GetName()->GetValue()]++;
+    }
+    CountGlobalBindings_(vs->GetValue(), counts);
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    CountGlobalBindings_(rs->GetReturnVal(), counts);
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    CountGlobalBindings_(pe->GetRight(), counts);
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    CountGlobalBindings_(ie->GetLeft(), counts);
+    CountGlobalBindings_(ie->GetRight(), counts);
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    CountGlobalBindings_(ifExp->GetCondition(), counts);
+    CountGlobalBindings_(ifExp->GetConsequence(), counts);
+    CountGlobalBindings_(ifExp->GetAlternative(), counts);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    CountGlobalBindings_(call->GetFunc(), counts);
+    for (const auto& arg : call->GetArgs()) {
+      CountGlobalBindings_(arg, counts);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& exp : al->GetExps()) {
+      CountGlobalBindings_(exp, counts);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      CountGlobalBindings_(hl->GetKeys()[i], counts);
+      CountGlobalBindings_(hl->GetValues()[i], counts);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& exp : rl->GetValues()) {
+      CountGlobalBindings_(exp, counts);
+    }
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    CountGlobalBindings_(fe->GetExp(), counts);
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    CountGlobalBindings_(idx->GetExp(), counts);
+    CountGlobalBindings_(idx->GetIdx(), counts);
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    if (auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent())) {
+      counts[ident->GetValue()]++;
+    }
+    CountGlobalBindings_(ae->GetNewVal(), counts);
+  }
+  // function bodies and for loops bind in scopes of their own
+}
+
+const CppTyped* CppEmitter::GetTyped(const std::string& name) {
+  auto it = typed_.find(name);
+  if (it == typed_.end()) {
+    return nullptr;
+  }
+
+  CppTyped& typed = it->second;
+  if (typed.done) {
+    return typed.failed ? nullptr : &typed;
+  }
+  if (compiling_.count(name) > 0) {
+    return nullptr;
+  }
+
+  // calls to itself are assumed to return integers first, and booleans
+  // when that turns out to be wrong
+  compiling_.insert(name);
+  typed.failed = true;
+  for (CppType selfType : {CppType::INT, CppType::BOOL}) {
+    CppTypedCompiler compiler(*this, typed, selfType);
+    if (!compiler.Compile()) {
+      break;
+    }
+    if (!compiler.UsedSelf() || compiler.GetType() == selfType) {
+      typed.failed = false;
+      typed.type = compiler.GetType();
+      typed.code = compiler.GetCode();
+      typed.callees = compiler.GetCallees();
+      break;
+    }
+  }
+  compiling_.erase(name);
+  typed.done = true;
+
+  if (typed.failed) {
+    return nullptr;
+  }
+
+  std::string params;
+  for (size_t i = 0; i < typed.fn->GetParameters().size(); i++) {
+    params.append(", long p").append(std::to_string(i));
+  }
+  decls_.append("static long typed_" + std::to_string(typed.id) + "(AotRuntime& rt" + params + ");\n");
+  decls_.append("static bool typed_ok_" + std::to_string(typed.id) + " = true;\n");
+  return &typed;
+}
+
+/*
+  untyped
+*/
+
+void CppEmitter::EmitStatement_(std::shared_ptr<Statement> stmt, const std::string& result) {
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    std::string value = EmitExpression_(es->GetExpression());
+    Line_(result + " = " + value + ";");
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    std::string value = EmitExpression_(vs->GetValue());
+    CheckError_(value);
+    Line_("rt.Var(" + env_ + ", " + Quote(vs->GetName()->GetValue()) + ", " + value + ");");
+    Line_(result + " = nullptr;");
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    auto call = std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal());
+    std::string value = rs->IsTailCall() && call != nullptr
+      ? EmitCall_(call, true) : EmitExpression_(rs->GetReturnVal());
+    Line_(result + " = " + value + " == rt.TailCall() || rt.IsError(" + value + ") ? "
+        + value + " : rt.Return(" + value + ");");
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(stmt)) {
+    EmitFor_(fs, result);
+  }
+  else {
+    Line_(result + " = nullptr;");
+  }
+}
+
+// EvalForStatement_: every part runs on its own, its result only ever compared to true
+void CppEmitter::EmitFor_(std::shared_ptr<ForStatement> fs, const std::string& result) {
+  std::string outer = env_;
+  std::string env = "env" + std::to_string(envs_++);
+
+  Line_("{");
+  indent_++;
+  Line_("AotEnv " + env + " = std::make_shared<Environment<Object*>>(" + outer + ");");
+  env_ = env;
+
+  EmitScoped_("", [&](const std::string& r) {
+    EmitStatement_(fs->GetVarStmt(), r);
+  });
+  for (const auto& stmt : fs->GetHoisted()) {
+    std::string value = Temp_();
+    EmitScoped_("Object* " + value + " = ", [&](const std::string& r) {
+      Line_(r + " = " + EmitExpression_(stmt->GetValue()) + ";");
+    });
+    Line_("rt.Hoist(" + env + ", " + Quote(stmt->GetName()->GetValue()) + ", " + value + ");");
+  }
+
+  Line_("while (true) {");
+  indent_++;
+  std::string condition = Temp_();
+  EmitScoped_("Object* " + condition + " = ", [&](const std::string& r) {
+    Line_(r + " = " + EmitExpression_(fs->GetCondition()) + ";");
+  });
+  Line_("if (" + condition + " != rt.True()) {");
+  Line_("  break;");
+  Line_("}");
+  EmitBlock_(fs->GetBlock(), "");
+  EmitScoped_("", [&](const std::string& r) {
+    Line_(r + " = " + EmitExpression_(fs->GetAfterAction()) + ";");
+  });
+  indent_--;
+  Line_("}");
+
+  Line_("rt.ReleaseLoop(" + env + ");");
+  env_ = outer;
+  indent_--;
+  Line_("}");
+  Line_(result + " = rt.Null();");
+}
+
+// EvalBlockStatement_
+void CppEmitter::EmitBlock_(std::shared_ptr<BlockStatement> block, const std::string& target) {
+  EmitScoped_(target.empty() ? "" : target + " = ", [&](const std::string& r) {
+    for (const auto& stmt : block->GetStatements()) {
+      EmitStatement_(stmt, r);
+      Line_("if (rt.Stops(" + r + ")) {");
+      Line_("  return " + r + ";");
+      Line_("}");
+    }
+  });
+}
+
+/*
+ * a lambda run in place: an error met inside it (or a block's return)
+ * leaves just the lambda, the way it leaves just that Eval call
+ */
+void CppEmitter::EmitScoped_(const std::string& assign,
+    std::function<void(const std::string& result)> body) {
+  std::string result = Temp_();
+  Line_(assign + "[&]() -> Object* {");
+  indent_++;
+  Line_("Object* " + result + " = nullptr;");
+  body(result);
+  Line_("return " + result + ";");
+  indent_--;
+  Line_("}();");
+}
+
+std::string CppEmitter::EmitExpression_(std::shared_ptr<Expression> exp) {
+  std::string t = Temp_();
+  std::string decl = "Object* " + t + " = ";
+
+  if (exp == nullptr) {
+    Line_(decl + "nullptr;");
+  }
+  // literals are constants made once, outside the collector, like the interpreter's
+  else if (auto il = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    Line_("static ::Integer " + t + "c(" + std::to_string(il->GetValue()) + "L);");
+    Line_(decl + "&" + t + "c;");
+  }
+  else if (auto sl = std::dynamic_pointer_cast<StringLiteral>(exp)) {
+    Line_("static ::String " + t + "c(" + Quote(sl->TokenLiteral()) + ", true);");
+    Line_(decl + "&" + t + "c;");
+  }
+  else if (auto be = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    Line_(decl + "rt.Bool(" + (be->GetValue() ? "true" : "false") + ");");
+  }
+  else if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    Line_(decl + "rt.Name(" + env_ + ", " + Quote(ident->GetValue()) + ");");
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    std::string right = EmitExpression_(pe->GetRight());
+    CheckError_(right);
+    Line_(decl + "rt.Prefix(" + Quote(pe->TokenLiteral()) + ", " + right + ");");
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    std::string left = EmitExpression_(ie->GetLeft());
+    CheckError_(left);
+    std::string right = EmitExpression_(ie->GetRight());
+    CheckError_(right);
+    Line_(decl + "rt.Infix(" + Quote(ie->GetOp()) + ", " + left + ", " + right + ");");
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    std::string condition = EmitExpression_(ifExp->GetCondition());
+    CheckError_(condition);
+    Line_("Object* " + t + ";");
+    Line_("if (rt.Truthy(" + condition + ")) {");
+    indent_++;
+    EmitBlock_(ifExp->GetConsequence(), t);
+    indent_--;
+    Line_("} else {");
+    indent_++;
+    if (ifExp->GetAlternative() != nullptr) {
+      EmitBlock_(ifExp->GetAlternative(), t);
+    } else {
+      Line_(t + " = rt.Null();");
+    }
+    indent_--;
+    Line_("}");
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(exp)) {
+    std::string id = EmitFunction_(fn);
+    Line_(decl + "rt.NewFunction(&params_" + id + ", fn_" + id + ", " + env_
+        + ", source_" + id + ");");
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    return EmitCall_(call, false);
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    std::string elements;
+    for (const auto& element : al->GetExps()) {
+      std::string value = EmitExpression_(element);
+      CheckError_(value);
+      elements.append(elements.empty() ? "" : ", ").append(value);
+    }
+    Line_(decl + "rt.NewArray({" + elements + "});");
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    std::string pairs;
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      for (const auto& part : {hl->GetKeys()[i], hl->GetValues()[i]}) {
+        std::string value = EmitExpression_(part);
+        CheckError_(value);
+        pairs.append(pairs.empty() ? "" : ", ").append(value);
+      }
+    }
+    Line_(decl + "rt.NewHash({" + pairs + "});");
+  }
+  // shapes and caches live as long as the program, like the nodes holding them
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    std::string names;
+    std::string offsets;
+    for (size_t i = 0; i < rl->GetNames().size(); i++) {
+      names.append(names.empty() ? "" : ", ").append(Quote(rl->GetNames()[i]));
+      offsets.append(offsets.empty() ? "" : ", ").append(std::to_string(rl->GetOffsets()[i]));
+    }
+    std::string values;
+    for (const auto& value : rl->GetValues()) {
+      std::string v = EmitExpression_(value);
+      CheckError_(v);
+      values.append(values.empty() ? "" : ", ").append(v);
+    }
+    Line_("static const Shape* " + t + "s = Shape::Of({" + names + "});");
+    Line_("static const std::vector<int> " + t + "o = {" + offsets + "};");
+    Line_(decl + "rt.NewRecord(" + t + "s, " + t + "o, {" + values + "});");
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    std::string left = EmitExpression_(fe->GetExp());
+    CheckError_(left);
+    Line_("static FieldCache " + t + "c;");
+    Line_(decl + "rt.Field(" + left + ", " + Quote(fe->GetName()) + ", " + t + "c);");
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    // the index is checked before the array is evaluated
+    std::string index = EmitExpression_(idx->GetIdx());
+    CheckError_(index);
+    Line_(decl + "rt.CheckIndex(" + index + ");");
+    Line_("if (" + t + " == nullptr) {");
+    indent_++;
+    std::string left = EmitValue_(idx->GetExp());
+    Line_(t + " = rt.Index(" + index + ", " + left + ");");
+    indent_--;
+    Line_("}");
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    std::string value = EmitExpression_(ae->GetNewVal());
+    CheckError_(value);
+    auto target = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+    if (target != nullptr) {
+      Line_(decl + "rt.Assign(" + env_ + ", " + Quote(target->GetValue()) + ", " + value + ");");
+    } else {
+      Line_(decl + "rt.NewError(" + Quote(ae->GetIdent()->String() + " not an identifier") + ");");
+    }
+  }
+  else {
+    Line_(decl + "nullptr;");
+  }
+
+  return t;
+}
+
+// exp's value even when it fails part way: the error is the value
+std::string CppEmitter::EmitValue_(std::shared_ptr<Expression> exp) {
+  if (exp == nullptr || std::dynamic_pointer_cast<IntegerLiteral>(exp) != nullptr
+      || std::dynamic_pointer_cast<StringLiteral>(exp) != nullptr
+      || std::dynamic_pointer_cast<BooleanExpression>(exp) != nullptr
+      || std::dynamic_pointer_cast<Identifier>(exp) != nullptr
+      || std::dynamic_pointer_cast<FunctionLiteral>(exp) != nullptr) {
+    return EmitExpression_(exp);
+  }
+
+  std::string t = Temp_();
+  EmitScoped_("Object* " + t + " = ", [&](const std::string& r) {
+    Line_(r + " = " + EmitExpression_(exp) + ";");
+  });
+  return t;
+}
+
+// EvalCallExpression_: every argument is evaluated before any is checked
+std::string CppEmitter::EmitCall_(std::shared_ptr<CallExpression> call, bool tail) {
+  std::string callee = EmitExpression_(call->GetFunc());
+  CheckError_(callee);
+
+  std::vector<std::string> args;
+  for (const auto& arg : call->GetArgs()) {
+    args.push_back(EmitValue_(arg));
+  }
+
+  std::string list;
+  for (const auto& arg : args) {
+    CheckError_(arg);
+    list.append(list.empty() ? "" : ", ").append(arg);
+  }
+
+  std::string t = Temp_();
+  Line_("Object* " + t + " = rt.Call(" + callee + ", {" + list + "}" + (tail ? ", true" : "") + ");");
+  return t;
+}
+
+std::string CppEmitter::EmitFunction_(std::shared_ptr<FunctionLiteral> fn) {
+  std::string id = std::to_string(functions_++);
+
+  // the text Function::Inspect shows
+  std::string params;
+  std::string source = "function(";
+  const auto& parameters = fn->GetParameters();
+  for (size_t i = 0; i < parameters.size(); i++) {
+    params.append(i > 0 ? ", " : "").append(Quote(parameters[i]->GetValue()));
+    source.append(parameters[i]->String());
+    if (i < parameters.size() - 1) {
+      source.append(", ");
+    }
+  }
+  source.append(") {\n").append(fn->GetBody()->String()).append("\n}");
+
+  decls_.append("static const std::vector<std::string> params_" + id + " = {" + params + "};\n");
+  decls_.append("static const char source_" + id + "[] = " + Quote(source) + ";\n");
+  decls_.append("static Object* fn_" + id + "(AotRuntime& rt, const AotEnv& env);\n");
+
+  std::string out = out_;
+  int indent = indent_;
+  std::string env = env_;
+  out_.clear();
+  indent_ = 1;
+  env_ = "env";
+
+  auto typed = typedLiterals_.find(fn.get());
+  if (typed != typedLiterals_.end()) {
+    EmitTypedEntry_(typed_.at(typed->second));
+  }
+
+  Line_("Object* result = nullptr;");
+  for (const auto& stmt : fn->GetBody()->GetStatements()) {
+    EmitStatement_(stmt, "result");
+    Line_("if (rt.Stops(result)) {");
+    Line_("  return result;");
+    Line_("}");
+  }
+  Line_("return result;");
+
+  defs_.append("static Object* fn_" + id + "(AotRuntime& rt, const AotEnv& env) {\n");
+  defs_.append(out_);
+  defs_.append("}\n\n");
+
+  out_ = out;
+  indent_ = indent;
+  env_ = env;
+  return id;
+}
+
+// runs the typed version when every argument is an integer
+void CppEmitter::EmitTypedEntry_(const CppTyped& typed) {
+  std::string id = std::to_string(typed.id);
+  std::string names;
+  for (const auto& callee : typed.callees) {
+    names.append(names.empty() ? "" : ", ").append(Quote(callee));
+  }
+
+  Line_("if (typed_ok_" + id + " && rt.Bound(env, {" + names + "})) {");
+  indent_++;
+  std::string guard;
+  std::string args;
+  const auto& params = typed.fn->GetParameters();
+  for (size_t i = 0; i < params.size(); i++) {
+    std::string arg = "arg" + std::to_string(i);
+    Line_("Object* " + arg + " = env->GetLocal(" + Quote(params[i]->GetValue()) + ");");
+    guard.append(i > 0 ? " && " : "")
+      .append(arg + " != nullptr && " + arg + "->Type() == ObjectType::INTEGER_OBJ");
+    args.append(", static_cast<Integer*>(" + arg + ")->GetValue()");
+  }
+
+  Line_("if (" + (guard.empty() ? std::string("true") : guard) + ") {");
+  indent_++;
+  Line_("rt.ResetBail();");
+  Line_("long value = typed_" + id + "(rt" + args + ");");
+  Line_("if (!rt.Bailed()) {");
+  Line_(std::string("  return ") + (typed.type == CppType::BOOL
+        ? "rt.Bool(value != 0);" : "rt.NewInteger(value);"));
+  Line_("}");
+  // out of stack: this run goes on untyped, and so does every later one
+  Line_("typed_ok_" + id + " = false;");
+  indent_--;
+  Line_("}");
+  indent_--;
+  Line_("}");
+}
+
+void CppEmitter::CheckError_(const std::string& value) {
+  Line_("if (rt.IsError(" + value + ")) {");
+  Line_("  return " + value + ";");
+  Line_("}");
+}
+
+/*
+  output
+*/
+
+void CppEmitter::Line_(const std::string& line) {
+  out_.append(2 * indent_, ' ').append(line).append("\n");
+}
+
+std::string CppEmitter::Temp_() {
+  return "t" + std::to_string(temps_++);
+}
+
+/*
+================================================
+TYPED COMPILER
+================================================
+*/
+
+CppTypedCompiler::CppTypedCompiler(CppEmitter& emitter, const CppTyped& typed, CppType selfType)
+  : emitter_(emitter), typed_(typed), selfType_(selfType), usedSelf_(false), usedTop_(false),
+    ifDepth_(0), temps_(0), indent_(1), type_(CppType::NONE) {
+  // empty
+}
+
+bool CppTypedCompiler::Compile() {
+  std::string signature = "static long typed_" + std::to_string(typed_.id) + "(AotRuntime& rt";
+  const auto& params = typed_.fn->GetParameters();
+  for (size_t i = 0; i < params.size(); i++) {
+    std::string var = "p" + std::to_string(i);
+    params_.push_back(var);
+    locals_[params[i]->GetValue()] = (CppLocal){.var = var, .type = CppType::INT};
+    signature.append(", long " + var);
+  }
+  signature.append(") {\n");
+  callees_.insert(typed_.name);
+
+  CppType type;
+  if (!EmitBlock_(typed_.fn->GetBody(), true, true, "value", type)) {
+    return false;
+  }
+
+  type_ = type;
+  for (CppType returned : returns_) {
+    if (type_ == CppType::NONE) {
+      type_ = returned;
+    } else if (returned != type_) {
+      return false;
+    }
+  }
+  if (type_ != CppType::INT && type_ != CppType::BOOL) {
+    return false;
+  }
+
+  code_ = signature;
+  code_.append("  if (rt.StackExhausted()) {\n    rt.Bail();\n    return 0;\n  }\n");
+  code_.append("  long value = 0;\n");
+  std::set<std::string> declared(params_.begin(), params_.end());
+  for (const auto& pair : locals_) {
+    if (declared.insert(pair.second.var).second) {
+      code_.append("  long " + pair.second.var + " = 0;\n");
+    }
+  }
+  if (usedTop_) {
+    code_.append("top:\n");
+  }
+  code_.append(body_);
+  code_.append("  return value;\n}\n");
+  return true;
+}
+
+bool CppTypedCompiler::EmitBlock_(std::shared_ptr<BlockStatement> block, bool wantValue,
+    bool allowReturn, const std::string& target, CppType& type) {
+  type = CppType::VOID;
+  std::vector<std::shared_ptr<Statement>> stmts = block->GetStatements();
+  for (size_t i = 0; i < stmts.size(); i++) {
+    bool last = i + 1 == stmts.size();
+    if (!EmitStatement_(stmts[i], wantValue && last, allowReturn, target, type)) {
+      return false;
+    }
+    if (type == CppType::NONE) {
+      // nothing after a return runs
+      return true;
+    }
+  }
+
+  return !wantValue || type != CppType::VOID;
+}
+
+/*
+ * allowReturn: a return here leaves the function. It does not inside an if
+ * in the middle of an expression, where the block's ReturnValue is just
+ * the if's value
+ */
+bool CppTypedCompiler::EmitStatement_(std::shared_ptr<Statement> stmt, bool wantValue,
+    bool allowReturn, const std::string& target, CppType& type) {
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    if (auto ie = std::dynamic_pointer_cast<IfExpression>(es->GetExpression())) {
+      return EmitIf_(ie, wantValue, allowReturn, target, type);
+    }
+
+    std::string value;
+    if (!EmitExpression_(es->GetExpression(), value, type)) {
+      return false;
+    }
+    Line_(wantValue ? target + " = " + value + ";" : "(void)(" + value + ");");
+    return true;
+  }
+
+  if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    // a var in an if binds on some paths only
+    std::string value;
+    if (ifDepth_ > 0 || vs->GetName() == nullptr || !EmitExpression_(vs->GetValue(), value, type)
+        || (type != CppType::INT && type != CppType::BOOL)) {
+      return false;
+    }
+
+    const std::string& name = vs->GetName()->GetValue();
+    auto it = locals_.find(name);
+    if (it != locals_.end() && it->second.type != type) {
+      return false;
+    }
+    if (it == locals_.end()) {
+      it = locals_.emplace(name,
+          (CppLocal){.var = "l" + std::to_string(locals_.size()), .type = type}).first;
+    }
+
+    Line_(it->second.var + " = " + value + ";");
+    type = CppType::VOID;
+    return true;
+  }
+
+  if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    type = CppType::NONE;
+    return allowReturn && EmitReturn_(rs);
+  }
+
+  return false;
+}
+
+bool CppTypedCompiler::EmitReturn_(std::shared_ptr<ReturnStatement> rs) {
+  std::string value;
+  CppType type;
+
+  auto call = std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal());
+  if (rs->IsTailCall() && call != nullptr) {
+    if (!EmitCall_(call, value, type, true)) {
+      return false;
+    }
+    if (type == CppType::NONE) {
+      // became a jump back to the top
+      return true;
+    }
+  } else if (rs->GetReturnVal() == nullptr || !EmitExpression_(rs->GetReturnVal(), value, type)) {
+    return false;
+  }
+
+  if (type != CppType::INT && type != CppType::BOOL) {
+    return false;
+  }
+  returns_.push_back(type);
+  Line_("return " + value + ";");
+  return true;
+}
+
+bool CppTypedCompiler::EmitIf_(std::shared_ptr<IfExpression> ie, bool wantValue, bool allowReturn,
+    const std::string& target, CppType& type) {
+  std::string condition;
+  CppType conditionType;
+  if (!EmitExpression_(ie->GetCondition(), condition, conditionType)) {
+    return false;
+  }
+
+  if (conditionType == CppType::INT) {
+    // integers are always truthy
+    ifDepth_++;
+    bool ok = EmitBlock_(ie->GetConsequence(), wantValue, allowReturn, target, type);
+    ifDepth_--;
+    return ok;
+  }
+  if (conditionType != CppType::BOOL) {
+    return false;
+  }
+
+  CppType consequence;
+  CppType alternative = CppType::VOID;
+  ifDepth_++;
+  Line_("if (" + condition + ") {");
+  indent_++;
+  if (!EmitBlock_(ie->GetConsequence(), wantValue, allowReturn, target, consequence)) {
+    return false;
+  }
+  indent_--;
+  Line_("} else {");
+  indent_++;
+  if (ie->GetAlternative() != nullptr) {
+    if (!EmitBlock_(ie->GetAlternative(), wantValue, allowReturn, target, alternative)) {
+      return false;
+    }
+  } else if (wantValue) {
+    // null when the condition is false
+    return false;
+  }
+  indent_--;
+  Line_("}");
+  ifDepth_--;
+
+  if (!wantValue) {
+    bool diverges = consequence == CppType::NONE && alternative == CppType::NONE;
+    type = diverges ? CppType::NONE : CppType::VOID;
+    return true;
+  }
+
+  if (consequence == CppType::NONE) {
+    type = alternative;
+  } else if (alternative == CppType::NONE || alternative == consequence) {
+    type = consequence;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool CppTypedCompiler::EmitExpression_(std::shared_ptr<Expression> exp, std::string& value,
+    CppType& type) {
+  if (exp == nullptr) {
+    return false;
+  }
+
+  if (auto il = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    value = std::to_string(il->GetValue()) + "L";
+    type = CppType::INT;
+    return true;
+  }
+  if (auto be = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    value = be->GetValue() ? "1L" : "0L";
+    type = CppType::BOOL;
+    return true;
+  }
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    auto it = locals_.find(ident->GetValue());
+    if (it == locals_.end()) {
+      return false;
+    }
+    value = it->second.var;
+    type = it->second.type;
+    return true;
+  }
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    std::string right;
+    if (pe->TokenLiteral() == "-") {
+      if (!EmitExpression_(pe->GetRight(), right, type) || type != CppType::INT) {
+        return false;
+      }
+      // wraps like the interpreter, where signed overflow would be undefined
+      value = "static_cast<long>(0UL - static_cast<unsigned long>(" + right + "))";
+      return true;
+    }
+    if (pe->TokenLiteral() == "!") {
+      if (!EmitExpression_(pe->GetRight(), right, type)) {
+        return false;
+      }
+      if (type == CppType::BOOL) {
+        value = "(1L - " + right + ")";
+      } else if (type == CppType::INT) {
+        // !integer is always false
+        value = "0L";
+      } else {
+        return false;
+      }
+      type = CppType::BOOL;
+      return true;
+    }
+    return false;
+  }
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    return EmitInfix_(ie, value, type);
+  }
+  if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    value = Temp_();
+    Line_("long " + value + " = 0;");
+    return EmitIf_(ifExp, true, false, value, type);
+  }
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    return EmitCall_(call, value, type, false);
+  }
+  if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    // binds in the function's scope, where the name must already be
+    auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+    std::string newVal;
+    if (ident == nullptr || !EmitExpression_(ae->GetNewVal(), newVal, type)) {
+      return false;
+    }
+    auto it = locals_.find(ident->GetValue());
+    if (it == locals_.end() || it->second.type != type) {
+      return false;
+    }
+    Line_(it->second.var + " = " + newVal + ";");
+    value = it->second.var;
+    return true;
+  }
+
+  return false;
+}
+
+bool CppTypedCompiler::EmitInfix_(std::shared_ptr<InfixExpression> ie, std::string& value,
+    CppType& type) {
+  std::string left;
+  std::string right;
+  CppType leftType;
+  CppType rightType;
+  if (!EmitExpression_(ie->GetLeft(), left, leftType)) {
+    return false;
+  }
+  // read before the right side can assign to it
+  std::string leftTemp = Temp_();
+  Line_("long " + leftTemp + " = " + left + ";");
+  if (!EmitExpression_(ie->GetRight(), right, rightType)) {
+    return false;
+  }
+
+  const std::string op = ie->GetOp();
+  bool comparison = op == "==" || op == "!=" || op == "<" || op == ">";
+  if (leftType != rightType || (leftType != CppType::INT && leftType != CppType::BOOL)
+      || (leftType == CppType::BOOL && op != "==" && op != "!=")) {
+    return false;
+  }
+  if (!comparison && op != "+" && op != "-" && op != "*" && op != "/") {
+    return false;
+  }
+
+  value = "(" + leftTemp + " " + op + " " + right + ")";
+  if (op == "+" || op == "-" || op == "*") {
+    // through unsigned longs, so g++ cannot assume the result does not overflow
+    value = "static_cast<long>(static_cast<unsigned long>(" + leftTemp + ") " + op
+      + " static_cast<unsigned long>(" + right + "))";
+  }
+  if (comparison) {
+    value = "static_cast<long>" + value;
+    type = CppType::BOOL;
+  } else {
+    type = CppType::INT;
+  }
+  return true;
+}
+
+bool CppTypedCompiler::EmitCall_(std::shared_ptr<CallExpression> call, std::string& value,
+    CppType& type, bool selfTail) {
+  auto ident = std::dynamic_pointer_cast<Identifier>(call->GetFunc());
+  if (ident == nullptr || locals_.count(ident->GetValue()) > 0) {
+    return false;
+  }
+
+  const std::string& name = ident->GetValue();
+  bool self = name == typed_.name;
+  int id;
+  size_t arity;
+  if (self) {
+    type = selfType_;
+    usedSelf_ = true;
+    id = typed_.id;
+    arity = typed_.fn->GetParameters().size();
+  } else {
+    const CppTyped* callee = emitter_.GetTyped(name);
+    if (callee == nullptr) {
+      return false;
+    }
+    type = callee->type;
+    id = callee->id;
+    arity = callee->fn->GetParameters().size();
+    callees_.insert(callee->callees.begin(), callee->callees.end());
+  }
+  if (arity != call->GetArgs().size()) {
+    return false;
+  }
+
+  std::vector<std::string> args;
+  for (const auto& arg : call->GetArgs()) {
+    std::string argValue;
+    CppType argType;
+    if (!EmitExpression_(arg, argValue, argType) || argType != CppType::INT) {
+      return false;
+    }
+    args.push_back(Temp_());
+    Line_("long " + args.back() + " = " + argValue + ";");
+  }
+
+  if (self && selfTail) {
+    // the arguments become the parameters and the body starts over
+    for (size_t i = 0; i < args.size(); i++) {
+      Line_(params_[i] + " = " + args[i] + ";");
+    }
+    Line_("goto top;");
+    usedTop_ = true;
+    type = CppType::NONE;
+    return true;
+  }
+
+  std::string list;
+  for (const auto& arg : args) {
+    list.append(", ").append(arg);
+  }
+  value = Temp_();
+  Line_("long " + value + " = typed_" + std::to_string(id) + "(rt" + list + ");");
+  Line_("if (rt.Bailed()) {");
+  Line_("  return 0;");
+  Line_("}");
+  return true;
+}
+
+void CppTypedCompiler::Line_(const std::string& line) {
+  body_.append(2 * indent_, ' ').append(line).append("\n");
+}
+
+std::string CppTypedCompiler::Temp_() {
+  return "t" + std::to_string(temps_++);
+}
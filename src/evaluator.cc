@@ -1,16 +1,32 @@
 #include "ast.h"
 #include "environment.h"
 #include <evaluator.h>
+#include <resolver.h>
 #include <memory>
 #include <typeinfo>
 #include <cxxabi.h>
+#include <alloca.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 // destructor
 Evaluator::~Evaluator() {
+  // builtins must not give back the booleans freed here
+  if (IsShared(TRUE_)) {
+    ShareBooleans(nullptr, nullptr);
+  }
   delete TRUE_;
   delete FALSE_;
   delete NULL_T_;
+  delete TAIL_CALL_;
+
+  if (runStack_ != nullptr) {
+    munmap(runStack_, runStackSize_);
+  }
 
   for (auto& pair : builtInFuncs_) {
     Object* obj = pair.second;
@@ -20,7 +36,101 @@ Evaluator::~Evaluator() {
   }
 }
 
+Object* Evaluator::Run(std::shared_ptr<::Node> node, std::shared_ptr<Environment<Object*>> env) {
+  if (running_ || !AllocRunStack_()) {
+    return Eval(node, env);
+  }
+
+  ucontext_t caller;
+  ucontext_t callee;
+  if (getcontext(&callee) == -1) {
+    return Eval(node, env);
+  }
+
+  callee.uc_stack.ss_sp = runStack_;
+  callee.uc_stack.ss_size = runStackSize_;
+  callee.uc_link = &caller;
+
+  uintptr_t self = reinterpret_cast<uintptr_t>(this);
+  makecontext(&callee, reinterpret_cast<void (*)()>(RunTrampoline_), 2,
+      static_cast<unsigned int>(self >> 32), static_cast<unsigned int>(self & 0xffffffff));
+
+  char* nativeLimit = stackLimit_;
+  stackLimit_ = runStack_ + STACK_RESERVE;
+  jitFloor_ = nullptr;
+  runNode_ = node;
+  runEnv_ = env;
+  runResult_ = nullptr;
+  running_ = true;
+
+  swapcontext(&caller, &callee);
+
+  running_ = false;
+  runNode_ = nullptr;
+  runEnv_ = nullptr;
+  stackLimit_ = nativeLimit;
+  jitFloor_ = nullptr;
+
+  return runResult_;
+}
+
+void Evaluator::RunTrampoline_(unsigned int high, unsigned int low) {
+  uintptr_t self = (static_cast<uintptr_t>(high) << 32) | static_cast<uintptr_t>(low);
+  auto evaluator = reinterpret_cast<Evaluator*>(self);
+  evaluator->runResult_ = evaluator->Eval(evaluator->runNode_, evaluator->runEnv_);
+}
+
+bool Evaluator::AllocRunStack_() {
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t size = (maxStackSize_ + pageSize - 1) / pageSize * pageSize;
+  if (size < STACK_RESERVE + pageSize) {
+    size = (STACK_RESERVE / pageSize + 1) * pageSize;
+  }
+
+  if (runStack_ != nullptr && runStackSize_ == size) {
+    return true;
+  }
+
+  if (runStack_ != nullptr) {
+    munmap(runStack_, runStackSize_);
+    runStack_ = nullptr;
+  }
+
+  // pages are only committed as deep recursion touches them
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+
+  // guard page at the bottom in case a native helper overshoots the reserve
+  mprotect(mem, pageSize, PROT_NONE);
+
+  runStack_ = static_cast<char*>(mem);
+  runStackSize_ = size;
+  return true;
+}
+
+char* Evaluator::NativeStackLimit_() {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_STACK, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY) {
+    return nullptr;
+  }
+
+  // the evaluator is built close to the base of the native stack
+  char* base = static_cast<char*>(__builtin_frame_address(0));
+  if (rl.rlim_cur <= 2 * STACK_RESERVE) {
+    return nullptr;
+  }
+
+  return base - rl.rlim_cur + 2 * STACK_RESERVE;
+}
+
 Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environment<Object*>> env) {
+  if (StackExhausted_()) {
+    return NewObject_(NewError_("stack overflow: maximum recursion depth exceeded"));
+  }
+
   const std::string typeName = GetTypeName_(node);
   if (typeName.size() == 0) {
     return nullptr;
@@ -54,7 +164,17 @@ Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environmen
 
   else if (typeName.compare("ReturnStatement") == 0) {
     auto rs = std::dynamic_pointer_cast<ReturnStatement>(node);
-    Object* value = Eval(rs->GetReturnVal(), env);
+    Object* value = nullptr;
+    if (rs->IsTailCall()) {
+      auto call = std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal());
+      value = EvalCallExpression_(call, env, true);
+      if (value == TAIL_CALL_) {
+        return value;
+      }
+    } else {
+      value = Eval(rs->GetReturnVal(), env);
+    }
+
     if (IsError_(value)) {
       return value;
     }
@@ -64,13 +184,19 @@ Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environmen
 
   else if (typeName.compare("ForStatement") == 0) {
     auto fs = std::dynamic_pointer_cast<ForStatement>(node);
+    if (vmEnabled_) {
+      if (fs->GetChunk() == nullptr) {
+        fs->SetChunk(VmCompiler().CompileFor(fs));
+      }
+      return Execute_(*fs->GetChunk(), env);
+    }
     return EvalForStatement_(fs, env);
   }
 
   // evaluate expressions
   else if (typeName.compare("Identifier") == 0) {
     auto i = std::dynamic_pointer_cast<Identifier>(node);
-    return EvalIdentifier_(i->GetValue(), env);
+    return EvalIdentifier_(i.get(), env.get());
   }
   else if (typeName.compare("AssignExpression") == 0) {
     auto ae = std::dynamic_pointer_cast<AssignExpression>(node);
@@ -83,30 +209,15 @@ Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environmen
   }
   else if (typeName.compare("StringLiteral") == 0) {
     auto sl = std::dynamic_pointer_cast<StringLiteral>(node);
-    return NewObject_(new String(sl->TokenLiteral()));
+    return sl->GetConstant();
   }
   else if (typeName.compare("FunctionLiteral") == 0) {
     auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node);
-    return NewObject_(new Function(fn->GetParameters(), fn->GetBody(), env));
+    return EvalFunctionLiteral_(fn, env);
   }
   else if (typeName.compare("CallExpression") == 0) {
     auto call = std::dynamic_pointer_cast<CallExpression>(node);
-    Object* obj = Eval(call->GetFunc(), env);
-    std::vector<Object*> args = EvalParameters_(env, call->GetArgs());
-    if (obj->Type() == ObjectType::BUILT_IN_OBJ) {
-      auto builtIn = dynamic_cast<BuiltIn*>(obj);
-      return EvalBuiltInFuncCall_(builtIn, args);
-    }
-
-    auto func = dynamic_cast<Function*>(obj);
-    if (func == nullptr) {
-      char buff[128];
-      snprintf(buff, sizeof(buff), "%s is not a function", obj->Inspect().c_str());
-      return NewObject_(NewError_(std::string(buff)));
-    }
-
-    return EvalFunctionCall_(func, args, func->GetEnv());
-
+    return EvalCallExpression_(call, env);
   }
   else if (typeName.compare("ArrayLiteral") == 0) {
     auto al = std::dynamic_pointer_cast<ArrayLiteral>(node);
@@ -116,20 +227,58 @@ Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environmen
       if (IsError_(obj)) {
         return obj;
       }
-      obj->AddRef();
       arr->AddObj(obj);
     }
     
     return NewObject_(arr);
   }
+  else if (typeName.compare("HashLiteral") == 0) {
+    auto hl = std::dynamic_pointer_cast<HashLiteral>(node);
+    const std::vector<std::shared_ptr<Expression>>& keys = hl->GetKeys();
+    const std::vector<std::shared_ptr<Expression>>& values = hl->GetValues();
+    std::vector<Object*> pairs;
+    pairs.reserve(keys.size() * 2);
+    for (size_t i = 0; i < keys.size(); i++) {
+      for (const auto& exp : {keys[i], values[i]}) {
+        Object* obj = Eval(exp, env);
+        if (IsError_(obj)) {
+          return obj;
+        }
+        pairs.push_back(obj);
+      }
+    }
+
+    return NewHash(pairs);
+  }
+  else if (typeName.compare("RecordLiteral") == 0) {
+    auto rl = std::dynamic_pointer_cast<RecordLiteral>(node);
+    std::vector<Object*> values;
+    values.reserve(rl->GetValues().size());
+    for (const auto& exp : rl->GetValues()) {
+      Object* obj = Eval(exp, env);
+      if (IsError_(obj)) {
+        return obj;
+      }
+      values.push_back(obj);
+    }
+
+    return NewRecord(rl->GetShape(), rl->GetOffsets(), values);
+  }
+  else if (typeName.compare("FieldExpression") == 0) {
+    auto fe = std::dynamic_pointer_cast<FieldExpression>(node);
+    Object* obj = Eval(fe->GetExp(), env);
+    if (IsError_(obj)) {
+      return obj;
+    }
+    return EvalField(obj, fe->GetName(), fe->GetCache());
+  }
   else if (typeName.compare("IndexExpression") == 0) {
     auto exp = std::dynamic_pointer_cast<::IndexExpression>(node);
     return EvalIndexExpression_(exp, env);
   }
   else if (typeName.compare("IntegerLiteral") == 0) {
     auto exp = std::dynamic_pointer_cast<::IntegerLiteral>(node);
-    Object* obj = NewObject_(new Integer(exp->GetValue()));
-    return obj;
+    return exp->GetConstant();
   }
 
   else if (typeName.compare("BooleanExpression") == 0) {
@@ -158,7 +307,7 @@ Object* Evaluator::Eval(std::shared_ptr<::Node> node, std::shared_ptr<Environmen
     if (IsError_(right)) {
       return right;
     }
-    return EvalInfixExpression_(exp->GetOp(), left, right);
+    return EvalQuickenedInfix_(exp.get(), left, right);
   }
 
   else if (typeName.compare("IfExpression") == 0) {
@@ -175,38 +324,165 @@ Object* Evaluator::EvalIndexExpression_(std::shared_ptr<IndexExpression> exp, st
     return obj;
   }
 
-  Integer* idx = dynamic_cast<Integer*>(obj);
-  if (idx == nullptr) {
+  Object* err = CheckIndex(obj);
+  if (err != nullptr) {
+    return err;
+  }
+
+  return EvalIndex(obj, Eval(exp->GetExp(), env));
+}
+
+Object* Evaluator::CheckIndex(Object* obj) {
+  if (!Hash::IsHashable(obj)) {
     char buff[256];
     snprintf(buff, sizeof(buff), "object %s is not an integer", obj->Inspect().c_str());
     return NewObject_(NewError_(std::string(buff)));
   }
 
-  Object* obj2 = Eval(exp->GetExp(), env);
-  Array* arr = dynamic_cast<Array*>(obj2);
+  return nullptr;
+}
+
+Object* Evaluator::EvalIndex(Object* obj, Object* obj2) {
   if (IsError_(obj2)) {
-    return arr;
+    return nullptr;
   }
 
-  if (arr == nullptr) {
+  if (obj2->Type() == ObjectType::HASH_OBJ) {
+    Object* val = static_cast<Hash*>(obj2)->Get(obj);
+    return val != nullptr ? val : NULL_T();
+  }
+  if (obj2->Type() == ObjectType::MAP_OBJ) {
+    Object* val = static_cast<PersistentMap*>(obj2)->Get(obj);
+    return val != nullptr ? val : NULL_T();
+  }
+
+  Array* arr = dynamic_cast<Array*>(obj2);
+  auto vec = dynamic_cast<PersistentVector*>(obj2);
+  auto deque = dynamic_cast<Deque*>(obj2);
+  if (arr == nullptr && vec == nullptr && deque == nullptr) {
     char buff[256];
     snprintf(buff, sizeof(buff), "object %s is not an array", obj2->Inspect().c_str());
     return NewObject_(NewError_(std::string(buff)));
   }
 
+  Integer* idx = dynamic_cast<Integer*>(obj);
+  if (idx == nullptr) {
+    char buff[256];
+    snprintf(buff, sizeof(buff), "object %s is not an integer", obj->Inspect().c_str());
+    return NewObject_(NewError_(std::string(buff)));
+  }
+
   long i = idx->GetValue();
-  std::shared_ptr<std::vector<Object*>> arrVal = arr->GetElements();
-  if (i < 0 || static_cast<size_t>(i) > arrVal->size() - 1) {
+  size_t size = arr != nullptr ? arr->Size() : vec != nullptr ? vec->Size() : deque->Size();
+  if (i < 0 || static_cast<size_t>(i) >= size) {
     return NULL_T();
   }
 
-  return (*arrVal)[i];
+  if (vec != nullptr) {
+    return vec->Get(i);
+  }
+  if (deque != nullptr) {
+    return deque->Get(i);
+  }
+
+  if (arr->IsPacked()) {
+    return NewObject_(new Integer(arr->GetInt(i)));
+  }
+  return arr->Get(i);
+}
+
+
+Object* Evaluator::NewHash(const std::vector<Object*>& pairs) {
+  for (size_t i = 0; i < pairs.size(); i += 2) {
+    if (pairs[i] == nullptr || !Hash::IsHashable(pairs[i])) {
+      char buff[128];
+      snprintf(buff, sizeof(buff), "unusable as hash key: %s",
+          Object::ObjectTypeStr(pairs[i] != nullptr ? pairs[i]->Type() : ObjectType::NULL_OBJ).c_str());
+      return NewObject_(NewError_(std::string(buff)));
+    }
+  }
+
+  Hash* hash = new Hash();
+  for (size_t i = 0; i < pairs.size(); i += 2) {
+    hash->Set(pairs[i], pairs[i + 1] != nullptr ? pairs[i + 1] : NULL_T_);
+  }
+
+  return NewObject_(hash);
+}
+
+Object* Evaluator::NewRecord(const Shape* shape, const std::vector<int>& offsets,
+    const std::vector<Object*>& values) {
+  Record* record = new Record(shape);
+  for (size_t i = 0; i < values.size(); i++) {
+    record->SetSlot(offsets[i], values[i] != nullptr ? values[i] : NULL_T_);
+  }
+
+  return NewObject_(record);
+}
+
+Object* Evaluator::EvalField(Object* obj, const std::string& name, FieldCache& cache) {
+  if (obj == nullptr || obj->Type() != ObjectType::RECORD_OBJ) {
+    char buff[256];
+    snprintf(buff, sizeof(buff), "object %s is not a record",
+        obj != nullptr ? obj->Inspect().c_str() : "null");
+    return NewObject_(NewError_(std::string(buff)));
+  }
+
+  Object* val = static_cast<Record*>(obj)->Field(name, cache);
+  if (val == nullptr) {
+    char buff[256];
+    snprintf(buff, sizeof(buff), "record has no field %s", name.c_str());
+    return NewObject_(NewError_(std::string(buff)));
+  }
+
+  return val;
 }
 
+Object* Evaluator::EvalBuiltInFuncCall_(BuiltIn* function, BuiltInArgs args) {
+  if (!function->Accepts(args.size())) {
+    return NewObject_(NewError_(GetArityErrorMsg_(function, args.size())));
+  }
+
+  if (function->TakesCallback()) {
+    Object* result = function->GetCallingFunc()(args, callFunction_);
+    return result != nullptr ? result : NULL_T();
+  }
 
-Object* Evaluator::EvalBuiltInFuncCall_(BuiltIn* function, std::vector<Object*> args) {
-  return NewObject_(function->GetFunc()(args));
+  // nothing to give back is null, as for a calling builtin
+  Object* result = function->GetFunc()(args);
+  if (result == nullptr) {
+    return NULL_T();
+  }
+  // true, false and small integers, made once and never collected
+  if (IsShared(result)) {
+    return result;
+  }
+  // conditions compare against TRUE and FALSE, not any Boolean
+  if (result->Type() == ObjectType::BOOLEAN_OBJ) {
+    bool value = static_cast<Boolean*>(result)->GetValue();
+    delete result;
+    return value ? TRUE_ : FALSE_;
+  }
 
+  return NewObject_(result);
+}
+
+std::string Evaluator::GetArityErrorMsg_(const BuiltIn* function, size_t numArgs) {
+  int min = function->GetMinArgs();
+  int max = function->GetMaxArgs();
+  char want[64];
+  if (max == BuiltIn::VARIADIC) {
+    snprintf(want, sizeof(want), "at least %d", min);
+  } else if (min == max) {
+    snprintf(want, sizeof(want), "%d", min);
+  } else {
+    snprintf(want, sizeof(want), "%d to %d", min, max);
+  }
+
+  char buff[128];
+  snprintf(buff, sizeof(buff), "wrong number of arguments to %s: want %s, got %zu",
+      function->GetName(), want, numArgs);
+  return std::string(buff);
 }
 
 Object* Evaluator::EvalIfExpression_(std::shared_ptr<IfExpression> ie, std::shared_ptr<Environment<Object*>> env) {
@@ -255,6 +531,26 @@ std::string Evaluator::GetPrefixErrorMsg_(const char* format, std::string op, Ob
 }
 
 
+// the operators arrays apply element by element; == and != still compare
+// arrays by identity
+static bool ElementWiseOp(const std::string& op, KernelOp& kernelOp) {
+  static const std::unordered_map<std::string, KernelOp> ops = {
+    {"+", KernelOp::ADD},
+    {"-", KernelOp::SUB},
+    {"*", KernelOp::MUL},
+    {"/", KernelOp::DIV},
+    {"<", KernelOp::LT},
+    {">", KernelOp::GT}
+  };
+
+  auto it = ops.find(op);
+  if (it == ops.end()) {
+    return false;
+  }
+  kernelOp = it->second;
+  return true;
+}
+
 Object* Evaluator::EvalInfixExpression_(std::string op, Object* left, Object* right) {
   if (left->Type() == ObjectType::INTEGER_OBJ && right->Type() == ObjectType::INTEGER_OBJ) {
     return EvalIntegerInfixExpression_(op, left, right);
@@ -264,6 +560,12 @@ Object* Evaluator::EvalInfixExpression_(std::string op, Object* left, Object* ri
     return EvalStringInfixExpression_(op, left, right);
   }
 
+  KernelOp kernelOp;
+  if ((left->Type() == ObjectType::ARRAY_OBJ || right->Type() == ObjectType::ARRAY_OBJ)
+      && ElementWiseOp(op, kernelOp)) {
+    return EvalArrayInfix_(kernelOp, op, left, right);
+  }
+
   if (op.compare("==") == 0) {
     return NativeBooleanToBooleanObj_(left == right);
   }
@@ -275,6 +577,149 @@ Object* Evaluator::EvalInfixExpression_(std::string op, Object* left, Object* ri
   return NewObject_(NewError_(errMsg));
 }
 
+/*
+ * an array against an array of the same length or against a scalar, giving
+ * a new array. Packed integers go through the kernels in one pass; anything
+ * else is applied element by element, an element that is an array in turn
+ * included
+ */
+Object* Evaluator::EvalArrayInfix_(KernelOp kernelOp, const std::string& op, Object* left,
+    Object* right) {
+  Array* leftArr = left->Type() == ObjectType::ARRAY_OBJ ? static_cast<Array*>(left) : nullptr;
+  Array* rightArr = right->Type() == ObjectType::ARRAY_OBJ ? static_cast<Array*>(right) : nullptr;
+  size_t size = leftArr != nullptr ? leftArr->Size() : rightArr->Size();
+  if (leftArr != nullptr && rightArr != nullptr && rightArr->Size() != size) {
+    char buff[128];
+    snprintf(buff, sizeof(buff), "array lengths differ: %zu %s %zu", size, op.c_str(),
+        rightArr->Size());
+    return NewObject_(NewError_(std::string(buff)));
+  }
+
+  bool leftInts = leftArr != nullptr ? leftArr->IsPacked() : left->Type() == ObjectType::INTEGER_OBJ;
+  bool rightInts = rightArr != nullptr ? rightArr->IsPacked() : right->Type() == ObjectType::INTEGER_OBJ;
+  if (leftInts && rightInts) {
+    long leftVal = leftArr == nullptr ? static_cast<Integer*>(left)->GetValue() : 0;
+    long rightVal = rightArr == nullptr ? static_cast<Integer*>(right)->GetValue() : 0;
+    const long* a = leftArr != nullptr ? leftArr->Ints() : &leftVal;
+    const long* b = rightArr != nullptr ? rightArr->Ints() : &rightVal;
+    size_t bStep = rightArr != nullptr ? 1 : 0;
+    if (kernelOp == KernelOp::DIV) {
+      for (size_t i = 0; i < size; i++) {
+        if (b[i * bStep] == 0) {
+          return NewObject_(NewError_(std::string("division by zero")));
+        }
+      }
+    }
+
+    std::vector<long> out(size);
+    KernelBinary(kernelOp, a, leftArr != nullptr ? 1 : 0, b, bStep, out.data(), size);
+    if (kernelOp != KernelOp::LT && kernelOp != KernelOp::GT) {
+      return NewObject_(new Array(std::move(out)));
+    }
+
+    Array* result = new Array();
+    for (long value : out) {
+      result->AddObj(NativeBooleanToBooleanObj_(value != 0));
+    }
+    return NewObject_(result);
+  }
+
+  // stands in for a packed element on the generic path, for the one operation
+  Integer box(0);
+  auto element = [&box](Array* arr, Object* scalar, size_t i) -> Object* {
+    if (arr == nullptr) {
+      return scalar;
+    }
+    if (!arr->IsPacked()) {
+      return arr->Get(i);
+    }
+    box = Integer(arr->GetInt(i));
+    return &box;
+  };
+
+  Array* result = new Array();
+  for (size_t i = 0; i < size; i++) {
+    Object* leftElem = element(leftArr, left, i);
+    Object* rightElem = element(rightArr, right, i);
+    Object* value = EvalInfixExpression_(op, leftElem, rightElem);
+    if (IsError_(value)) {
+      result->ReleaseElements();
+      delete result;
+      return value;
+    }
+    result->AddObj(value);
+  }
+  return NewObject_(result);
+}
+
+Object* Evaluator::EvalQuickenedInfix_(InfixExpression* exp, Object* left, Object* right) {
+  InfixKind kind = exp->GetKind();
+  bool integers = left->Type() == ObjectType::INTEGER_OBJ && right->Type() == ObjectType::INTEGER_OBJ;
+
+  if (kind == InfixKind::GENERIC) {
+    return EvalInfixExpression_(exp->GetOp(), left, right);
+  }
+
+  if (kind == InfixKind::UNINITIALIZED) {
+    if (!integers) {
+      exp->SetKind(InfixKind::GENERIC);
+    } else if (exp->CountIntegerHit() >= QUICKEN_THRESHOLD) {
+      exp->SetKind(SelectInfixKind_(exp->GetOp()));
+    }
+    return EvalInfixExpression_(exp->GetOp(), left, right);
+  }
+
+  if (!integers) {
+    // guard failed: deoptimize this node back to the generic path for good
+    exp->SetKind(InfixKind::GENERIC);
+    return EvalInfixExpression_(exp->GetOp(), left, right);
+  }
+
+  long leftVal = static_cast<Integer*>(left)->GetValue();
+  long rightVal = static_cast<Integer*>(right)->GetValue();
+
+  switch (kind) {
+    case InfixKind::INT_ADD:
+      return NewObject_(new Integer(leftVal + rightVal));
+    case InfixKind::INT_SUB:
+      return NewObject_(new Integer(leftVal - rightVal));
+    case InfixKind::INT_MUL:
+      return NewObject_(new Integer(leftVal * rightVal));
+    case InfixKind::INT_DIV:
+      return NewObject_(new Integer(leftVal / rightVal));
+    case InfixKind::INT_LT:
+      return NativeBooleanToBooleanObj_(leftVal < rightVal);
+    case InfixKind::INT_GT:
+      return NativeBooleanToBooleanObj_(leftVal > rightVal);
+    case InfixKind::INT_EQ:
+      return NativeBooleanToBooleanObj_(leftVal == rightVal);
+    case InfixKind::INT_NOT_EQ:
+      return NativeBooleanToBooleanObj_(leftVal != rightVal);
+    default:
+      return EvalInfixExpression_(exp->GetOp(), left, right);
+  }
+}
+
+InfixKind Evaluator::SelectInfixKind_(const std::string& op) {
+  static const std::unordered_map<std::string, InfixKind> kinds = {
+    {"+", InfixKind::INT_ADD},
+    {"-", InfixKind::INT_SUB},
+    {"*", InfixKind::INT_MUL},
+    {"/", InfixKind::INT_DIV},
+    {"<", InfixKind::INT_LT},
+    {">", InfixKind::INT_GT},
+    {"==", InfixKind::INT_EQ},
+    {"!=", InfixKind::INT_NOT_EQ}
+  };
+
+  auto it = kinds.find(op);
+  if (it == kinds.end()) {
+    return InfixKind::GENERIC;
+  }
+
+  return it->second;
+}
+
 Object* Evaluator::EvalIntegerInfixExpression_(std::string op, Object* left, Object* right) {
   long leftVal = dynamic_cast<Integer*>(left)->GetValue();
   long rightVal = dynamic_cast<Integer*>(right)->GetValue();
@@ -328,10 +773,8 @@ Object* Evaluator::EvalMinusExpression_(Object* right) {
     return NewObject_(NewError_(errMsg));
   }
 
-  auto obj = dynamic_cast<Integer*>(right);
-  obj->SetValue(obj->GetValue() * -1);
-
-  return obj;
+  // values are never changed: a literal's Integer is shared by every use
+  return NewObject_(new Integer(-static_cast<Integer*>(right)->GetValue()));
 }
 
 ::Object* Evaluator::EvalBangExpression_(::Object* right) {
@@ -365,6 +808,11 @@ std::string Evaluator::GetTypeName_(std::shared_ptr<::Node> node) {
 }
 
 Object* Evaluator::EvalProgram_(std::shared_ptr<Program> program, std::shared_ptr<Environment<Object*>> env) {
+  if (!program->IsResolved()) {
+    Resolver resolver;
+    resolver.Resolve(program);
+  }
+
   Object* result = nullptr;
   for (const auto& stmt : program->GetStatements()) {
     result = Eval(stmt, env);
@@ -423,24 +871,54 @@ bool Evaluator::IsError_(Object* obj) {
   return false;
 }
 
-Object* Evaluator::EvalIdentifier_(std::string name, std::shared_ptr<Environment<Object*>> env) {
-  Object* obj = env->Get(name);
+Object* Evaluator::EvalIdentifier_(Identifier* ident, Environment<Object*>* env) {
+  Object* obj = LookupIdentifier_(ident, env);
   if (obj == nullptr) {
-    if (builtInFuncs_.count(name) > 0) {
-      return builtInFuncs_.at(name);
+    return EvalUnbound_(ident->GetValue());
+  }
+
+  return obj;
+}
+
+// what ident is bound to through its slot cache, nullptr when nothing binds it
+Object* Evaluator::LookupIdentifier_(Identifier* ident, Environment<Object*>* env) {
+  Object** slot = ident->GetCachedSlot(env);
+  if (slot == nullptr) {
+    slotMisses_++;
+    size_t depth;
+    slot = env->Lookup(ident->GetValue(), depth);
+    if (slot != nullptr) {
+      ident->SetCachedSlot(env, slot, depth);
     }
-    std::string errMsg = "unexpected identifier: ";
-    errMsg.append(name);
-    return NewObject_(NewError_(errMsg));
+  }
+
+  return slot != nullptr ? *slot : nullptr;
+}
+
+Object* Evaluator::EvalName(const std::string& name, std::shared_ptr<Environment<Object*>> env) {
+  Object* obj = env->Get(name);
+  if (obj == nullptr) {
+    return EvalUnbound_(name);
   }
 
   return obj;
 }
 
+// a name no scope binds is a builtin or an error
+Object* Evaluator::EvalUnbound_(const std::string& name) {
+  if (builtInFuncs_.count(name) > 0) {
+    return builtInFuncs_.at(name);
+  }
+  std::string errMsg = "unexpected identifier: ";
+  errMsg.append(name);
+  return NewObject_(NewError_(errMsg));
+}
+
 
-std::vector<Object*> Evaluator::EvalParameters_(std::shared_ptr<Environment<Object*>> env, std::vector<std::shared_ptr<Expression>> params) {
+std::vector<Object*> Evaluator::EvalParameters_(std::shared_ptr<Environment<Object*>> env, const std::vector<std::shared_ptr<Expression>>& params) {
   std::vector<Object*> result;
-  
+  result.reserve(params.size());
+
   for (const auto& param : params) {
     result.push_back(Eval(param, env));
   }
@@ -449,52 +927,414 @@ std::vector<Object*> Evaluator::EvalParameters_(std::shared_ptr<Environment<Obje
 }
 
 void Evaluator::SubtractRefsInArray_(Object* obj) {
-  auto arr = dynamic_cast<Array*>(obj);
-  for (const auto& obj : *arr->GetElements()) {
-    obj->SubtractRef();
+  static_cast<Array*>(obj)->ReleaseElements();
+}
+
+Object* Evaluator::EvalCallExpression_(std::shared_ptr<CallExpression> call, std::shared_ptr<Environment<Object*>> env, bool tailCall) {
+  Object* obj = Eval(call->GetFunc(), env);
+  if (IsError_(obj)) {
+    return obj;
+  }
+
+  // a builtin reads its arguments where they were evaluated
+  const std::vector<std::shared_ptr<Expression>>& params = call->GetArgs();
+  if (obj->Type() == ObjectType::BUILT_IN_OBJ && params.size() <= BUILTIN_STACK_ARGS) {
+    Object* argv[BUILTIN_STACK_ARGS];
+    for (size_t i = 0; i < params.size(); i++) {
+      argv[i] = Eval(params[i], env);
+    }
+    for (size_t i = 0; i < params.size(); i++) {
+      if (IsError_(argv[i])) {
+        return argv[i];
+      }
+    }
+    return EvalBuiltInFuncCall_(static_cast<BuiltIn*>(obj), BuiltInArgs(argv, params.size()));
+  }
+
+  std::vector<Object*> args = EvalParameters_(env, params);
+  for (const auto& arg : args) {
+    if (IsError_(arg)) {
+      return arg;
+    }
   }
+
+  return ApplyCall_(call->GetCache(), obj, std::move(args), tailCall);
 }
 
-Object* Evaluator::EvalFunctionCall_(Object* obj, std::vector<Object*> args, std::shared_ptr<Environment<Object*>> outerEnv) {
-  auto env = std::make_shared<Environment<Object*>>(outerEnv);
-  auto function = dynamic_cast<Function*>(obj);
-  std::vector<std::shared_ptr<Identifier>> params = function->GetParams();
-  
-  // add args to inner scope
-  for (size_t i = 0; i < args.size(); i++) {
-    args[i]->AddRef(); // for garbage collection
-    env->Set(params[i]->GetValue(), args[i]);
+// calls obj, already checked not to be an error, through the cache of its call site
+Object* Evaluator::ApplyCall_(CallSiteCache& site, Object* obj, std::vector<Object*> args, bool tailCall) {
+  uint64_t gcEpoch = gCollector_.GetEpoch();
+  if (site.callee != obj || site.gcEpoch != gcEpoch) {
+    // first call through this site, or a different callee: resolve it once
+    auto func = dynamic_cast<Function*>(obj);
+    if (obj->Type() != ObjectType::BUILT_IN_OBJ && func == nullptr) {
+      char buff[128];
+      snprintf(buff, sizeof(buff), "%s is not a function", obj->Inspect().c_str());
+      return NewObject_(NewError_(std::string(buff)));
+    }
+
+    site.callee = obj;
+    site.gcEpoch = gcEpoch;
+    site.builtIn = func == nullptr;
+    site.params = func != nullptr ? &func->GetParams() : nullptr;
+    site.body = func != nullptr ? func->GetBody() : nullptr;
   }
 
-  Object* result = Eval(function->GetBody(), env);
+  if (site.builtIn) {
+    return EvalBuiltInFuncCall_(static_cast<BuiltIn*>(obj), args);
+  }
+
+  auto func = static_cast<Function*>(obj);
+
+  if (tailCall) {
+    // let the caller's EvalFunctionCall_ run this call in its own frame
+    tailCallFn_ = func;
+    tailCallSite_ = &site;
+    tailCallArgs_ = std::move(args);
+    return TAIL_CALL_;
+  }
+
+  return EvalFunctionCall_(func, site, std::move(args));
+}
+
+Object* Evaluator::CallFunction(Object* fn, std::vector<Object*> args) {
+  // no call site to cache the callee in, so it is resolved every time
+  CallSiteCache site;
+  return ApplyCall_(site, fn, std::move(args), false);
+}
+
+void Evaluator::ReleaseScope_(std::shared_ptr<Environment<Object*>> env) {
   std::unordered_map<std::string, Object*> store = env->GetStore();
   for (const auto& pair : store) {
     // can safely clean up local scope once function body has been evaluated
     pair.second->SubtractRef();
-    if (pair.second->Type() == ObjectType::ARRAY_OBJ) {
+    if (pair.second->Type() == ObjectType::ARRAY_OBJ && pair.second->IsNotReferenced()) {
       // objects referenced by array are no longer referenced when array falls out of scope
       SubtractRefsInArray_(pair.second);
+    } else if (pair.second->Type() == ObjectType::HASH_OBJ && pair.second->IsNotReferenced()) {
+      static_cast<Hash*>(pair.second)->ReleaseElements();
+    } else if (pair.second->Type() == ObjectType::RECORD_OBJ && pair.second->IsNotReferenced()) {
+      static_cast<Record*>(pair.second)->ReleaseElements();
+    } else if (pair.second->Type() == ObjectType::PQUEUE_OBJ && pair.second->IsNotReferenced()) {
+      static_cast<PriorityQueue*>(pair.second)->ReleaseElements();
+    } else if (pair.second->Type() == ObjectType::DEQUE_OBJ && pair.second->IsNotReferenced()) {
+      static_cast<Deque*>(pair.second)->ReleaseElements();
+    }
+  }
+}
+
+/*
+ * a scope escapes when a FunctionLiteral evaluated in it (or in a loop or
+ * branch nested in it) could capture its environment in a closure; flat
+ * closures copy what they need and capture nothing
+ */
+bool Evaluator::CreatesClosure_(std::shared_ptr<Node> node) {
+  if (node == nullptr) {
+    return false;
+  }
+
+  if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node)) {
+    return fn->GetCapture() != ScopeEscape::LOCAL;
+  }
+  if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      if (CreatesClosure_(stmt)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    return CreatesClosure_(es->GetExpression());
+  }
+  if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    return CreatesClosure_(vs->GetValue());
+  }
+  if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    return CreatesClosure_(rs->GetReturnVal());
+  }
+  if (auto fs = std::dynamic_pointer_cast<ForStatement>(node)) {
+    return LoopCreatesClosure_(*fs);
+  }
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    return CreatesClosure_(pe->GetRight());
+  }
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    return CreatesClosure_(ie->GetLeft()) || CreatesClosure_(ie->GetRight());
+  }
+  if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    return CreatesClosure_(ifExp->GetCondition()) || CreatesClosure_(ifExp->GetConsequence())
+      || CreatesClosure_(ifExp->GetAlternative());
+  }
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    for (const auto& arg : call->GetArgs()) {
+      if (CreatesClosure_(arg)) {
+        return true;
+      }
+    }
+    return CreatesClosure_(call->GetFunc());
+  }
+  if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& exp : al->GetExps()) {
+      if (CreatesClosure_(exp)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      if (CreatesClosure_(hl->GetKeys()[i]) || CreatesClosure_(hl->GetValues()[i])) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& exp : rl->GetValues()) {
+      if (CreatesClosure_(exp)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    return CreatesClosure_(fe->GetExp());
+  }
+  if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    return CreatesClosure_(idx->GetExp()) || CreatesClosure_(idx->GetIdx());
+  }
+  if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    return CreatesClosure_(ae->GetIdent()) || CreatesClosure_(ae->GetNewVal());
+  }
+
+  return false;
+}
+
+bool Evaluator::LoopCreatesClosure_(const ForStatement& fs) {
+  for (const auto& stmt : fs.GetHoisted()) {
+    if (CreatesClosure_(stmt)) {
+      return true;
+    }
+  }
+  return CreatesClosure_(fs.GetVarStmt()) || CreatesClosure_(fs.GetCondition())
+    || CreatesClosure_(fs.GetAfterAction()) || CreatesClosure_(fs.GetBlock());
+}
+
+bool Evaluator::ScopeEscapes_(std::shared_ptr<BlockStatement> body) {
+  if (body->GetEscape() == ScopeEscape::UNKNOWN) {
+    body->SetEscape(CreatesClosure_(body) ? ScopeEscape::ESCAPES : ScopeEscape::LOCAL);
+  }
+
+  return body->GetEscape() == ScopeEscape::ESCAPES;
+}
+
+bool Evaluator::ScopeEscapes_(ForStatement* fs) {
+  if (fs->GetEscape() == ScopeEscape::UNKNOWN) {
+    fs->SetEscape(LoopCreatesClosure_(*fs) ? ScopeEscape::ESCAPES : ScopeEscape::LOCAL);
+  }
+
+  return fs->GetEscape() == ScopeEscape::ESCAPES;
+}
+
+Object* Evaluator::EvalFunctionLiteral_(std::shared_ptr<FunctionLiteral> fn,
+    std::shared_ptr<Environment<Object*>> env) {
+  if (fn->GetCapture() == ScopeEscape::LOCAL) {
+    return NewObject_(new Function(fn->GetParameters(), fn->GetBody(), CaptureScope_(fn, env)));
+  }
+  return NewObject_(new Function(fn->GetParameters(), fn->GetBody(), env));
+}
+
+/*
+ * scope of a flat closure: the variables it reads copied out of the scopes
+ * it is created in, in front of the global scope, which stays shared
+ */
+std::shared_ptr<Environment<Object*>> Evaluator::CaptureScope_(
+    std::shared_ptr<FunctionLiteral> fn, std::shared_ptr<Environment<Object*>> env) {
+  std::shared_ptr<Environment<Object*>> global = env;
+  while (global->GetOuter() != nullptr) {
+    global = global->GetOuter();
+  }
+
+  std::shared_ptr<Environment<Object*>> captured = global;
+  for (const auto& name : fn->GetCaptures()) {
+    Object** slot = env->Lookup(name);
+    if (slot == nullptr || slot == global->Lookup(name)) {
+      continue;
+    }
+
+    if (captured == global) {
+      captured = std::make_shared<Environment<Object*>>(global);
+    }
+    (*slot)->AddRef(); // the closure holds on to it for as long as it lives
+    captured->Set(name, *slot);
+  }
+
+  return captured;
+}
+
+/*
+ * a scope nothing can capture lives in frame, storage owned by the caller's
+ * C++ frame; the returned pointer aliases it without owning it
+ */
+std::shared_ptr<Environment<Object*>> Evaluator::NewScope_(
+    std::shared_ptr<Environment<Object*>> outer, bool escapes,
+    std::optional<Environment<Object*>>& frame) {
+  if (escapes) {
+    return std::make_shared<Environment<Object*>>(outer);
+  }
+
+  frame.emplace(outer);
+  return std::shared_ptr<Environment<Object*>>(std::shared_ptr<Environment<Object*>>(), &*frame);
+}
+
+/*
+ * runs function as native code once its body is hot; false leaves the call
+ * to the interpreter (not compiled, arguments that are not all integers, a
+ * global it calls was rebound, or the code bailed out). Code that ran out of
+ * stack is not entered again until the interpreter has redone the call: its
+ * recursion would only run out again, one level higher each time
+ */
+bool Evaluator::RunCompiled_(Function* function, const std::vector<Object*>& args, Object*& result) {
+  char* frame = static_cast<char*>(__builtin_frame_address(0));
+  if (jitFloor_ != nullptr) {
+    if (frame < jitFloor_) {
+      return false;
+    }
+    jitFloor_ = nullptr;
+  }
+
+  JitState& state = function->GetBody()->GetJit();
+  if (state.code == nullptr) {
+    if (state.failed || ++state.calls < JIT_CALL_THRESHOLD || jit_.Compile(function) == nullptr) {
+      return false;
+    }
+  }
+
+  const JitCode& code = *state.code;
+  if (code.GetEnv() != function->GetEnv() || args.size() != function->GetParams().size()) {
+    return false;
+  }
+  for (const auto& callee : code.GetCallees()) {
+    if (*callee.first != callee.second) {
+      return false;
+    }
+  }
+
+  std::vector<int64_t> values;
+  values.reserve(args.size());
+  for (Object* arg : args) {
+    if (arg->Type() != ObjectType::INTEGER_OBJ) {
+      return false;
+    }
+    values.push_back(static_cast<Integer*>(arg)->GetValue());
+  }
+
+  JitContext ctx = {.bailed = 0, .stackLimit = stackLimit_};
+  int64_t value = code.Run(&ctx, values.data());
+  if (ctx.bailed == JIT_BAIL_STACK) {
+    jitFloor_ = frame;
+  }
+  if (ctx.bailed) {
+    return false;
+  }
+
+  result = code.GetType() == JitType::BOOL
+    ? NativeBooleanToBooleanObj_(value != 0)
+    : NewObject_(new Integer(value));
+  return true;
+}
+
+Object* Evaluator::EvalFunctionCall_(Function* function, const CallSiteCache& site, std::vector<Object*> args) {
+  Object* compiled;
+  if (jitEnabled_ && RunCompiled_(function, args, compiled)) {
+    return compiled;
+  }
+
+  std::shared_ptr<Environment<Object*>> outerEnv = function->GetEnv();
+  const CallSiteCache* callSite = &site;
+  std::optional<Environment<Object*>> frame;
+  auto env = NewScope_(outerEnv, ScopeEscapes_(callSite->body), frame);
+  size_t mark = gCollector_.GetNumObjects();
+  uint64_t gcEpoch = gCollector_.GetEpoch();
+  Object* result = nullptr;
+
+  while (true) {
+    // params and body come straight from the call site's cache
+    const std::vector<std::shared_ptr<Identifier>>& params = *callSite->params;
+    std::shared_ptr<BlockStatement> body = callSite->body;
+
+    // add args to inner scope
+    for (size_t i = 0; i < args.size() && i < params.size(); i++) {
+      args[i]->AddRef(); // for garbage collection
+      env->Set(params[i]->GetValue(), args[i]);
+    }
+
+    if (vmEnabled_) {
+      if (body->GetChunk() == nullptr) {
+        body->SetChunk(VmCompiler().CompileBody(body));
+      }
+      result = Execute_(*body->GetChunk(), env);
+    } else {
+      result = Eval(body, env);
+    }
+    ReleaseScope_(env);
+
+    if (result != TAIL_CALL_) {
+      break;
+    }
+
+    // proper tail call: loop instead of recursing, and reuse the scope
+    // unless a closure created during this iteration still holds on to it
+    // (a scope in frame is never captured, but the next body may need one
+    // that can be)
+    function = tailCallFn_;
+    callSite = tailCallSite_;
+    args = std::move(tailCallArgs_);
+    tailCallArgs_.clear();
+    bool escapes = ScopeEscapes_(callSite->body);
+    bool inFrame = frame.has_value() && env.get() == &*frame;
+    if (function->GetEnv() == outerEnv && (inFrame ? !escapes : env.use_count() == 1)) {
+      env->Clear();
+    } else {
+      outerEnv = function->GetEnv();
+      env = NewScope_(outerEnv, escapes, frame);
     }
   }
 
   if (result != nullptr && result->Type() == ObjectType::RETURN_VALUE_OBJ) {
     auto returnVal = dynamic_cast<ReturnValue*>(result);
-    return returnVal->GetValue();
+    result = returnVal->GetValue();
+  }
+
+  // temporaries of this call that nothing kept are freed right away
+  // instead of lingering until the next collection
+  if (gCollector_.GetEpoch() == gcEpoch) {
+    gCollector_.CollectScope(mark, result);
   }
 
- return result;
+  return result;
 }
 
 Object* Evaluator::EvalStringInfixExpression_(std::string op, Object* left, Object* right) {
-  if (op.compare("+") != 0) {
-    std::string msg = GetInfixErrorMsg_("unknown operator: %s %s %s", left, op, right);
-    return NewObject_(NewError_(msg));
-  }
+  const String& leftStr = *static_cast<String*>(left);
+  const String& rightStr = *static_cast<String*>(right);
 
-  std::string leftVal = dynamic_cast<String*>(left)->GetValue();
-  std::string rightVal = dynamic_cast<String*>(right)->GetValue();
+  if (op.compare("+") == 0) {
+    // a rope over both: nothing is copied until the result is read
+    return NewObject_(new String(leftStr, rightStr));
+  } else if (op.compare("==") == 0) {
+    return NativeBooleanToBooleanObj_(leftStr.Equals(rightStr));
+  } else if (op.compare("!=") == 0) {
+    return NativeBooleanToBooleanObj_(!leftStr.Equals(rightStr));
+  } else if (op.compare("<") == 0) {
+    return NativeBooleanToBooleanObj_(leftStr.Compare(rightStr) < 0);
+  } else if (op.compare(">") == 0) {
+    return NativeBooleanToBooleanObj_(leftStr.Compare(rightStr) > 0);
+  }
 
-  return NewObject_(new String(leftVal + rightVal));
+  std::string msg = GetInfixErrorMsg_("unknown operator: %s %s %s", left, op, right);
+  return NewObject_(NewError_(msg));
 }
 
 
@@ -510,17 +1350,21 @@ Object* Evaluator::AssignNewVal_(std::shared_ptr<AssignExpression> ae, Object* n
     return NewObject_(NewError_(msg));
   }
 
-  Object* oldVal = env->Get(ident->GetValue());
+  return EvalAssign(ident->GetValue(), newVal, env);
+}
+
+Object* Evaluator::EvalAssign(const std::string& name, Object* newVal, std::shared_ptr<Environment<Object*>> env) {
+  Object* oldVal = env->Get(name);
 
   if (oldVal == nullptr) {
-    std::string msg = "unexpected identifier: " + ident->GetValue();
+    std::string msg = "unexpected identifier: " + name;
     return NewObject_(NewError_(msg));
   }
 
   oldVal->SubtractRef(); // for garbage collection
 
   newVal->AddRef(); // for garbage collection
-  env->Set(ident->GetValue(), newVal);
+  env->Set(name, newVal);
 
   return newVal;
 }
@@ -532,10 +1376,24 @@ Object* Evaluator::EvalForStatement_(std::shared_ptr<ForStatement> fs, std::shar
   std::shared_ptr<Expression> condition = fs->GetCondition();
   std::shared_ptr<Expression> afterAction = fs->GetAfterAction();
 
-  auto env = std::make_shared<Environment<Object*>>(outerEnv);
+  std::optional<Environment<Object*>> frame;
+  auto env = NewScope_(outerEnv, ScopeEscapes_(fs.get()), frame);
+  size_t mark = gCollector_.GetNumObjects();
+  uint64_t gcEpoch = gCollector_.GetEpoch();
 
   Eval(fs->GetVarStmt(), env);
 
+  // bind hoisted invariants even when they fail: every use sees the same
+  // value the original expression would have produced there
+  for (const auto& stmt : fs->GetHoisted()) {
+    Object* val = Eval(stmt->GetValue(), env);
+    if (val == nullptr) {
+      val = NULL_T_;
+    }
+    val->AddRef(); // for garbage collection
+    env->Set(stmt->GetName()->GetValue(), val);
+  }
+
   while (Eval(condition, env) == TRUE_) {
     Eval(block, env);
     Eval(afterAction, env);
@@ -546,6 +1404,493 @@ Object* Evaluator::EvalForStatement_(std::shared_ptr<ForStatement> fs, std::shar
     pair.second->SubtractRef();
   }
 
+  if (gCollector_.GetEpoch() == gcEpoch) {
+    gCollector_.CollectScope(mark, nullptr);
+  }
 
   return NULL_T_;
 }
+
+/*
+================================================
+LINEAR VM
+================================================
+*/
+
+#ifdef MCSCRIPT_VM_THREADED
+#define VM_CASE(op) op_##op:
+#define VM_DISPATCH() goto *pc->handler
+#else
+#define VM_CASE(op) case VmOp::op:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+#define VM_NEXT() do { pc++; VM_DISPATCH(); } while (0)
+#define VM_JUMP(to) do { pc = code + (to); VM_DISPATCH(); } while (0)
+// hands an error to the statement, loop part or argument the instruction is in
+#define VM_CHECK(obj) do { \
+    Object* checked_ = (obj); \
+    if (checked_ != nullptr && checked_->Type() == ObjectType::ERROR_OBJ) { \
+      regs[pc->failReg] = checked_; \
+      VM_JUMP(pc->fail); \
+    } \
+  } while (0)
+
+/*
+ * runs a chunk in env: every instruction is a label, and each one ends by
+ * jumping straight to the handler of the next (direct threading), so there
+ * is no central dispatch branch and no call per node
+ */
+Object* Evaluator::Execute_(VmChunk& chunk, std::shared_ptr<Environment<Object*>> env) {
+  if (StackExhausted_()) {
+    return NewObject_(NewError_("stack overflow: maximum recursion depth exceeded"));
+  }
+
+#ifdef MCSCRIPT_VM_THREADED
+  static const void* const handlers[] = {
+    &&op_NIL, &&op_NULL_T, &&op_INT, &&op_STRING, &&op_BOOL, &&op_NAME, &&op_FUNCTION,
+    &&op_BANG, &&op_MINUS, &&op_PREFIX, &&op_INFIX, &&op_ARRAY, &&op_HASH, &&op_RECORD,
+    &&op_CHECK_INDEX, &&op_INDEX, &&op_FIELD, &&op_CALL, &&op_TAIL_CALL, &&op_SET_VAR, &&op_ASSIGN, &&op_JUMP,
+    &&op_JUMP_FALSE, &&op_JUMP_NOT_TRUE, &&op_LOOP_ENTER, &&op_HOIST, &&op_LOOP_EXIT,
+    &&op_EVAL, &&op_RETURN, &&op_NAME_INT, &&op_NAME_NAME, &&op_BRANCH_NAME_INT,
+    &&op_BRANCH_NAME_NAME, &&op_INC_NAME, &&op_INC_BRANCH
+  };
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(VmOp::NUM_OPS),
+      "every VmOp needs a handler");
+
+  if (!chunk.IsThreaded()) {
+    for (VmInstr& instr : chunk.GetCode()) {
+      instr.handler = handlers[static_cast<int>(instr.op)];
+    }
+    chunk.SetThreaded();
+  }
+#endif
+
+  const VmInstr* code = chunk.GetCode().data();
+  const VmInstr* pc = code;
+  Object** regs = static_cast<Object**>(alloca(chunk.GetNumRegs() * sizeof(Object*)));
+  for (int i = 0; i < chunk.GetNumRegs(); i++) {
+    regs[i] = nullptr;
+  }
+
+  // scopes of the for loops being run, by depth (see EvalForStatement_)
+  std::optional<Environment<Object*>> frames[VM_MAX_LOOP_DEPTH];
+  std::shared_ptr<Environment<Object*>> outers[VM_MAX_LOOP_DEPTH];
+  size_t marks[VM_MAX_LOOP_DEPTH];
+  uint64_t gcEpochs[VM_MAX_LOOP_DEPTH];
+
+#ifdef MCSCRIPT_VM_THREADED
+  VM_DISPATCH();
+#else
+dispatch:
+  switch (pc->op) {
+#endif
+
+  VM_CASE(NIL) {
+    regs[pc->dst] = nullptr;
+    VM_NEXT();
+  }
+
+  VM_CASE(NULL_T) {
+    regs[pc->dst] = NULL_T_;
+    VM_NEXT();
+  }
+
+  VM_CASE(INT) {
+    regs[pc->dst] = pc->constant;
+    VM_NEXT();
+  }
+
+  VM_CASE(STRING) {
+    regs[pc->dst] = pc->constant;
+    VM_NEXT();
+  }
+
+  VM_CASE(BOOL) {
+    regs[pc->dst] = NativeBooleanToBooleanObj_(pc->imm != 0);
+    VM_NEXT();
+  }
+
+  VM_CASE(NAME) {
+    Object* obj = EvalIdentifier_(static_cast<Identifier*>(pc->node.get()), env.get());
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(FUNCTION) {
+    regs[pc->dst] = EvalFunctionLiteral_(std::static_pointer_cast<FunctionLiteral>(pc->node), env);
+    VM_NEXT();
+  }
+
+  VM_CASE(BANG) {
+    regs[pc->dst] = EvalBangExpression_(regs[pc->a]);
+    VM_NEXT();
+  }
+
+  VM_CASE(MINUS) {
+    Object* obj = EvalMinusExpression_(regs[pc->a]);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(PREFIX) {
+    Object* obj = EvalPrefixExpression_(pc->node->TokenLiteral(), regs[pc->a]);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(INFIX) {
+    Object* obj = EvalQuickenedInfix_(static_cast<InfixExpression*>(pc->node.get()),
+        regs[pc->a], regs[pc->b]);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(ARRAY) {
+    Array* arr = new Array();
+    for (int i = 0; i < pc->count; i++) {
+      arr->AddObj(regs[pc->a + i]);
+    }
+    regs[pc->dst] = NewObject_(arr);
+    VM_NEXT();
+  }
+
+  VM_CASE(HASH) {
+    Object* obj = NewHash(std::vector<Object*>(regs + pc->a, regs + pc->a + 2 * pc->count));
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(RECORD) {
+    auto rl = static_cast<RecordLiteral*>(pc->node.get());
+    regs[pc->dst] = NewRecord(rl->GetShape(), rl->GetOffsets(),
+        std::vector<Object*>(regs + pc->a, regs + pc->a + pc->count));
+    VM_NEXT();
+  }
+
+  VM_CASE(CHECK_INDEX) {
+    VM_CHECK(CheckIndex(regs[pc->a]));
+    VM_NEXT();
+  }
+
+  VM_CASE(INDEX) {
+    Object* obj = EvalIndex(regs[pc->a], regs[pc->b]);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(FIELD) {
+    auto fe = static_cast<FieldExpression*>(pc->node.get());
+    Object* obj = EvalField(regs[pc->a], fe->GetName(), fe->GetCache());
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(CALL) {
+    for (int i = 0; i < pc->count; i++) {
+      VM_CHECK(regs[pc->b + i]);
+    }
+    if (regs[pc->a]->Type() == ObjectType::BUILT_IN_OBJ) {
+      // straight from the registers
+      Object* obj = EvalBuiltInFuncCall_(static_cast<BuiltIn*>(regs[pc->a]),
+          BuiltInArgs(regs + pc->b, pc->count));
+      VM_CHECK(obj);
+      regs[pc->dst] = obj;
+      VM_NEXT();
+    }
+    std::vector<Object*> args(regs + pc->b, regs + pc->b + pc->count);
+    auto call = static_cast<CallExpression*>(pc->node.get());
+    Object* obj = ApplyCall_(call->GetCache(), regs[pc->a], std::move(args), false);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(TAIL_CALL) {
+    for (int i = 0; i < pc->count; i++) {
+      VM_CHECK(regs[pc->b + i]);
+    }
+    std::vector<Object*> args(regs + pc->b, regs + pc->b + pc->count);
+    auto call = static_cast<CallExpression*>(pc->node.get());
+    Object* obj = ApplyCall_(call->GetCache(), regs[pc->a], std::move(args), true);
+    if (obj == TAIL_CALL_) {
+      return obj;
+    }
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(SET_VAR) {
+    regs[pc->a]->AddRef(); // for garbage collection
+    env->Set(pc->name, regs[pc->a]);
+    VM_NEXT();
+  }
+
+  VM_CASE(ASSIGN) {
+    Object* obj = EvalAssign(pc->name, regs[pc->a], env);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(JUMP) {
+    VM_JUMP(pc->target);
+  }
+
+  VM_CASE(JUMP_FALSE) {
+    if (!IsTruthy_(regs[pc->a])) {
+      VM_JUMP(pc->target);
+    }
+    VM_NEXT();
+  }
+
+  VM_CASE(JUMP_NOT_TRUE) {
+    if (regs[pc->a] != TRUE_) {
+      VM_JUMP(pc->target);
+    }
+    VM_NEXT();
+  }
+
+  VM_CASE(LOOP_ENTER) {
+    int depth = pc->imm;
+    outers[depth] = std::move(env);
+    env = NewScope_(outers[depth], ScopeEscapes_(pc->loop), frames[depth]);
+    marks[depth] = gCollector_.GetNumObjects();
+    gcEpochs[depth] = gCollector_.GetEpoch();
+    VM_NEXT();
+  }
+
+  VM_CASE(HOIST) {
+    // bound even when it failed, like EvalForStatement_ does
+    Object* val = regs[pc->a] != nullptr ? regs[pc->a] : NULL_T_;
+    val->AddRef(); // for garbage collection
+    env->Set(pc->name, val);
+    VM_NEXT();
+  }
+
+  VM_CASE(LOOP_EXIT) {
+    int depth = pc->imm;
+    std::unordered_map<std::string, Object*> store = env->GetStore();
+    for (const auto& pair : store) {
+      pair.second->SubtractRef();
+    }
+    if (gCollector_.GetEpoch() == gcEpochs[depth]) {
+      gCollector_.CollectScope(marks[depth], nullptr);
+    }
+
+    env = std::move(outers[depth]);
+    frames[depth].reset();
+    regs[pc->dst] = NULL_T_;
+    VM_NEXT();
+  }
+
+  VM_CASE(EVAL) {
+    Object* obj = Eval(pc->node, env);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(RETURN) {
+    return regs[pc->a];
+  }
+
+  /* superinstructions */
+
+  VM_CASE(NAME_INT) {
+    Object* left = LookupIdentifier_(pc->ident, env.get());
+    if (left != nullptr && left->Type() == ObjectType::INTEGER_OBJ) {
+      regs[pc->dst] = FusedInt_(pc->kind, static_cast<Integer*>(left)->GetValue(), pc->imm);
+      VM_NEXT();
+    }
+    Object* obj = FusedGeneric_(*pc, left, nullptr, env.get());
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(NAME_NAME) {
+    Object* left = LookupIdentifier_(pc->ident, env.get());
+    Object* right = LookupIdentifier_(pc->ident2, env.get());
+    if (left != nullptr && right != nullptr && left->Type() == ObjectType::INTEGER_OBJ
+        && right->Type() == ObjectType::INTEGER_OBJ) {
+      regs[pc->dst] = FusedInt_(pc->kind, static_cast<Integer*>(left)->GetValue(),
+          static_cast<Integer*>(right)->GetValue());
+      VM_NEXT();
+    }
+    Object* obj = FusedGeneric_(*pc, left, pc->ident2, env.get());
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(BRANCH_NAME_INT) {
+    Object* left = LookupIdentifier_(pc->ident, env.get());
+    if (left != nullptr && left->Type() == ObjectType::INTEGER_OBJ) {
+      if (!FusedCompare_(pc->kind, static_cast<Integer*>(left)->GetValue(), pc->imm)) {
+        VM_JUMP(pc->target);
+      }
+      VM_NEXT();
+    }
+    Object* obj = FusedGeneric_(*pc, left, nullptr, env.get());
+    VM_CHECK(obj);
+    if (pc->loopCond ? obj != TRUE_ : !IsTruthy_(obj)) {
+      VM_JUMP(pc->target);
+    }
+    VM_NEXT();
+  }
+
+  VM_CASE(BRANCH_NAME_NAME) {
+    Object* left = LookupIdentifier_(pc->ident, env.get());
+    Object* right = LookupIdentifier_(pc->ident2, env.get());
+    if (left != nullptr && right != nullptr && left->Type() == ObjectType::INTEGER_OBJ
+        && right->Type() == ObjectType::INTEGER_OBJ) {
+      if (!FusedCompare_(pc->kind, static_cast<Integer*>(left)->GetValue(),
+          static_cast<Integer*>(right)->GetValue())) {
+        VM_JUMP(pc->target);
+      }
+      VM_NEXT();
+    }
+    Object* obj = FusedGeneric_(*pc, left, pc->ident2, env.get());
+    VM_CHECK(obj);
+    if (pc->loopCond ? obj != TRUE_ : !IsTruthy_(obj)) {
+      VM_JUMP(pc->target);
+    }
+    VM_NEXT();
+  }
+
+  /*
+   * an Integer bound in the current scope is stepped through its slot, which
+   * is what EvalAssign's Get and Set come down to when the name is local
+   */
+  VM_CASE(INC_NAME) {
+    Object** slot = LocalSlot_(pc->ident, pc->name, env.get());
+    if (slot != nullptr && *slot != nullptr && (*slot)->Type() == ObjectType::INTEGER_OBJ) {
+      Object* obj = FusedInt_(pc->kind, static_cast<Integer*>(*slot)->GetValue(), pc->imm);
+      (*slot)->SubtractRef(); // for garbage collection
+      obj->AddRef();
+      *slot = obj;
+      regs[pc->dst] = obj;
+      VM_NEXT();
+    }
+    Object* obj = FusedGeneric_(*pc, LookupIdentifier_(pc->ident, env.get()), nullptr,
+        env.get());
+    VM_CHECK(obj);
+    obj = EvalAssign(pc->name, obj, env);
+    VM_CHECK(obj);
+    regs[pc->dst] = obj;
+    VM_NEXT();
+  }
+
+  VM_CASE(INC_BRANCH) {
+    Object** slot = LocalSlot_(pc->ident, pc->name, env.get());
+    if (slot == nullptr || *slot == nullptr || (*slot)->Type() != ObjectType::INTEGER_OBJ) {
+      Object* obj = FusedGeneric_(*pc, LookupIdentifier_(pc->ident, env.get()), nullptr,
+        env.get());
+      VM_CHECK(obj);
+      VM_CHECK(EvalAssign(pc->name, obj, env));
+      VM_JUMP(pc->alt);
+    }
+
+    Object* obj = FusedInt_(pc->kind, static_cast<Integer*>(*slot)->GetValue(), pc->imm);
+    long value = static_cast<Integer*>(obj)->GetValue();
+    (*slot)->SubtractRef(); // for garbage collection
+    obj->AddRef();
+    *slot = obj;
+
+    long limit = pc->limit;
+    if (pc->ident2 != nullptr) {
+      Object* bound = LookupIdentifier_(pc->ident2, env.get());
+      if (bound == nullptr || bound->Type() != ObjectType::INTEGER_OBJ) {
+        VM_JUMP(pc->alt);
+      }
+      limit = static_cast<Integer*>(bound)->GetValue();
+    }
+    if (FusedCompare_(pc->cmp, value, limit)) {
+      VM_JUMP(pc->target);
+    }
+    VM_NEXT();
+  }
+
+#ifndef MCSCRIPT_VM_THREADED
+  default:
+    break;
+  }
+#endif
+
+  return nullptr;
+}
+
+// the slot of name in env itself, cached on ident; nullptr when env does not bind it
+Object** Evaluator::LocalSlot_(Identifier* ident, const std::string& name,
+    Environment<Object*>* env) {
+  Object** slot = ident->GetCachedSlot(env);
+  if (slot != nullptr && ident->GetCachedDepth() == 0) {
+    return slot;
+  }
+
+  slotMisses_++;
+  slot = env->LookupLocal(name);
+  if (slot != nullptr) {
+    ident->SetCachedSlot(env, slot, 0);
+  }
+
+  return slot;
+}
+
+Object* Evaluator::FusedInt_(InfixKind kind, long left, long right) {
+  switch (kind) {
+    case InfixKind::INT_ADD:
+      return NewObject_(new Integer(left + right));
+    case InfixKind::INT_SUB:
+      return NewObject_(new Integer(left - right));
+    case InfixKind::INT_MUL:
+      return NewObject_(new Integer(left * right));
+    default:
+      return NativeBooleanToBooleanObj_(FusedCompare_(kind, left, right));
+  }
+}
+
+bool Evaluator::FusedCompare_(InfixKind kind, long left, long right) {
+  switch (kind) {
+    case InfixKind::INT_LT:
+      return left < right;
+    case InfixKind::INT_GT:
+      return left > right;
+    case InfixKind::INT_EQ:
+      return left == right;
+    default:
+      return left != right;
+  }
+}
+
+/*
+ * a superinstruction's operation the way INFIX would have done it, given
+ * the value of ident (nullptr when it is unbound) and the right operand,
+ * right or the literal's constant: the operands in order, the first error, then the quickened
+ * infix node
+ */
+Object* Evaluator::FusedGeneric_(const VmInstr& instr, Object* left, Identifier* right,
+    Environment<Object*>* env) {
+  if (left == nullptr) {
+    left = EvalUnbound_(instr.ident->GetValue());
+  }
+  if (IsError_(left)) {
+    return left;
+  }
+
+  Object* rightVal = right != nullptr ? EvalIdentifier_(right, env) : instr.constant;
+  if (IsError_(rightVal)) {
+    return rightVal;
+  }
+
+  return EvalQuickenedInfix_(static_cast<InfixExpression*>(instr.node.get()), left, rightVal);
+}
@@ -2,11 +2,16 @@
 #include <algorithm>
 
 void GCollector::Collect() {
+  epoch_++;
   for (auto& obj : objects_) {
     if (obj == nullptr) {
       continue;
     }
     if (obj->IsNotReferenced()) {
+      // a view lets go of the array it reads from
+      if (obj->Type() == ObjectType::ARRAY_OBJ) {
+        static_cast<Array*>(obj)->ReleaseOwner();
+      }
       delete obj;
       obj = nullptr;
     }
@@ -16,6 +21,8 @@ void GCollector::Collect() {
 }
 
 void GCollector::CollectAll() {
+  epoch_++;
+  collectingAll_ = true;
   for (auto& obj : objects_) {
     if (obj == nullptr) {
       continue;
@@ -25,6 +32,34 @@ void GCollector::CollectAll() {
   }
 
   objects_.clear();
+  collectingAll_ = false;
+}
+
+void GCollector::CollectScope(size_t mark, const ::Object* keep) {
+  if (mark >= objects_.size()) {
+    return;
+  }
+
+  for (size_t i = mark; i < objects_.size(); i++) {
+    ::Object* obj = objects_[i];
+    if (obj != nullptr && (obj->Type() == ObjectType::ARRAY_OBJ
+        || obj->Type() == ObjectType::HASH_OBJ || obj->Type() == ObjectType::RECORD_OBJ
+        || obj->Type() == ObjectType::VECTOR_OBJ || obj->Type() == ObjectType::MAP_OBJ
+        || obj->Type() == ObjectType::PQUEUE_OBJ || obj->Type() == ObjectType::DEQUE_OBJ
+        || obj->Type() == ObjectType::FUNCTION_OBJ)) {
+      return;
+    }
+  }
+
+  for (size_t i = mark; i < objects_.size(); i++) {
+    ::Object*& obj = objects_[i];
+    if (obj != nullptr && obj != keep && obj->IsNotReferenced()) {
+      delete obj;
+      obj = nullptr;
+    }
+  }
+
+  objects_.erase(std::remove(objects_.begin() + mark, objects_.end(), nullptr), objects_.end());
 }
 
 void GCollector::TrackObject(::Object* obj) {
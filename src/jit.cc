@@ -0,0 +1,823 @@
+#include <jit.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// the emitted code addresses these fields directly through r12
+static_assert(offsetof(JitContext, bailed) == 0, "JitContext::bailed must be at offset 0");
+static_assert(offsetof(JitContext, stackLimit) == 8, "JitContext::stackLimit must be at offset 8");
+
+// bytes the prologue pushes below rbp (r12 and rbx) before the first slot
+static const int32_t SAVED_REGS_SIZE = 16;
+
+/*
+================================================
+JIT CODE
+================================================
+*/
+
+JitCode::JitCode(void* mem, size_t size, JitType type, std::shared_ptr<Environment<Object*>> env)
+  : mem_(mem), size_(size), type_(type), env_(env) {
+  // empty
+}
+
+JitCode::~JitCode() {
+  munmap(mem_, size_);
+}
+
+/*
+================================================
+ASSEMBLER
+================================================
+*/
+
+void JitAssembler::Byte(uint8_t b) {
+  code_.push_back(b);
+}
+
+void JitAssembler::Bytes(std::initializer_list<uint8_t> bytes) {
+  code_.insert(code_.end(), bytes);
+}
+
+void JitAssembler::Imm32(int32_t imm) {
+  for (int i = 0; i < 4; i++) {
+    code_.push_back(static_cast<uint8_t>(static_cast<uint32_t>(imm) >> (8 * i)));
+  }
+}
+
+void JitAssembler::Imm64(int64_t imm) {
+  for (int i = 0; i < 8; i++) {
+    code_.push_back(static_cast<uint8_t>(static_cast<uint64_t>(imm) >> (8 * i)));
+  }
+}
+
+void JitAssembler::Patch32(size_t at, int32_t imm) {
+  for (int i = 0; i < 4; i++) {
+    code_[at + i] = static_cast<uint8_t>(static_cast<uint32_t>(imm) >> (8 * i));
+  }
+}
+
+int JitAssembler::NewLabel() {
+  labels_.push_back(-1);
+  return static_cast<int>(labels_.size()) - 1;
+}
+
+void JitAssembler::Bind(int label) {
+  labels_[label] = static_cast<long>(code_.size());
+}
+
+void JitAssembler::Rel32(int label) {
+  fixups_.emplace_back(code_.size(), label);
+  Imm32(0);
+}
+
+bool JitAssembler::Resolve() {
+  for (const auto& fixup : fixups_) {
+    long target = labels_[fixup.second];
+    if (target < 0) {
+      return false;
+    }
+    Patch32(fixup.first, static_cast<int32_t>(target - static_cast<long>(fixup.first + 4)));
+  }
+
+  return true;
+}
+
+/*
+================================================
+JIT
+================================================
+*/
+
+std::shared_ptr<JitCode> Jit::Compile(Function* fn) {
+  const BlockStatement* body = fn->GetBody().get();
+  JitState& state = fn->GetBody()->GetJit();
+  if (state.code != nullptr) {
+    return state.code->GetEnv() == fn->GetEnv() ? state.code : nullptr;
+  }
+  if (state.failed || compiling_.count(body) > 0) {
+    return nullptr;
+  }
+
+  // calls a body makes to itself are assumed to return integers first, and
+  // booleans when that assumption turns out to be wrong
+  compiling_.insert(body);
+  std::shared_ptr<JitCode> code;
+  for (JitType selfType : {JitType::INT, JitType::BOOL}) {
+    JitCompiler compiler(*this, fn, selfType);
+    code = compiler.Compile();
+    if (code == nullptr || !compiler.UsedSelf() || code->GetType() == selfType) {
+      break;
+    }
+    code = nullptr;
+  }
+  compiling_.erase(body);
+
+  if (code == nullptr) {
+    state.failed = true;
+  } else {
+    state.code = code;
+  }
+  return code;
+}
+
+/*
+================================================
+COMPILER
+================================================
+*/
+
+JitCompiler::JitCompiler(Jit& jit, Function* fn, JitType selfType)
+  : jit_(jit), fn_(fn), selfType_(selfType), usedSelf_(false), slots_(0), loopDepth_(0) {
+  entryLabel_ = asm_.NewLabel();
+  bodyLabel_ = asm_.NewLabel();
+  bailLabel_ = asm_.NewLabel();
+  stackLabel_ = asm_.NewLabel();
+  exitLabel_ = asm_.NewLabel();
+}
+
+std::shared_ptr<JitCode> JitCompiler::Compile() {
+  // globals are only trusted to hold the same functions while code runs
+  if (fn_->GetEnv() == nullptr || fn_->GetEnv()->GetOuter() != nullptr) {
+    return nullptr;
+  }
+
+  asm_.Bind(entryLabel_);
+  // prologue: push rbp; mov rbp, rsp; push r12; push rbx; sub rsp, frame
+  asm_.Bytes({0x55, 0x48, 0x89, 0xE5, 0x41, 0x54, 0x53, 0x48, 0x81, 0xEC});
+  size_t frameSize = asm_.Size();
+  asm_.Imm32(0);
+  // mov r12, rdi (the JitContext)
+  asm_.Bytes({0x49, 0x89, 0xFC});
+  // cmp rsp, [r12 + 8]; jb stack: out of stack, let the interpreter report it
+  asm_.Bytes({0x49, 0x3B, 0x64, 0x24, 0x08, 0x0F, 0x82});
+  asm_.Rel32(stackLabel_);
+
+  scopes_.emplace_back();
+  const auto& params = fn_->GetParams();
+  for (size_t i = 0; i < params.size(); i++) {
+    int slot = NewSlot_();
+    paramSlots_.push_back(slot);
+    // mov rax, [rsi + 8 * i]
+    asm_.Bytes({0x48, 0x8B, 0x86});
+    asm_.Imm32(static_cast<int32_t>(8 * i));
+    Store_(slot);
+    scopes_.back().visible[params[i]->GetValue()] = (JitVar){.slot = slot, .type = JitType::INT};
+  }
+
+  asm_.Bind(bodyLabel_);
+  JitType type;
+  if (!EmitBlock_(fn_->GetBody(), true, type)) {
+    return nullptr;
+  }
+
+  JitType result = JitType::NONE;
+  if (!Merge_(result, type)) {
+    return nullptr;
+  }
+  for (JitType returned : returns_) {
+    if (!Merge_(result, returned)) {
+      return nullptr;
+    }
+  }
+  if (result != JitType::INT && result != JitType::BOOL) {
+    return nullptr;
+  }
+
+  // epilogue: lea rsp, [rbp - 16]; pop rbx; pop r12; pop rbp; ret
+  asm_.Bind(exitLabel_);
+  asm_.Bytes({0x48, 0x8D, 0x65, 0xF0, 0x5B, 0x41, 0x5C, 0x5D, 0xC3});
+  // bail: mov byte [r12], JIT_BAIL; jmp exit
+  asm_.Bind(bailLabel_);
+  asm_.Bytes({0x41, 0xC6, 0x04, 0x24, JIT_BAIL, 0xE9});
+  asm_.Rel32(exitLabel_);
+  // stack: mov byte [r12], JIT_BAIL_STACK; jmp exit
+  asm_.Bind(stackLabel_);
+  asm_.Bytes({0x41, 0xC6, 0x04, 0x24, JIT_BAIL_STACK, 0xE9});
+  asm_.Rel32(exitLabel_);
+
+  // keeps rsp 16 byte aligned at every call
+  asm_.Patch32(frameSize, (slots_ * 8 + 15) / 16 * 16);
+  if (!asm_.Resolve()) {
+    return nullptr;
+  }
+
+  long pageSize = sysconf(_SC_PAGESIZE);
+  size_t size = (asm_.Size() + pageSize - 1) / pageSize * pageSize;
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return nullptr;
+  }
+  memcpy(mem, asm_.GetCode().data(), asm_.Size());
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    return nullptr;
+  }
+
+  auto code = std::make_shared<JitCode>(mem, size, result, fn_->GetEnv());
+  for (const auto& callee : callees_) {
+    code->AddCallee(callee.first, callee.second);
+  }
+  return code;
+}
+
+/*
+  statements
+*/
+
+bool JitCompiler::EmitBlock_(std::shared_ptr<BlockStatement> block, bool wantValue, JitType& type) {
+  type = JitType::VOID;
+  std::vector<std::shared_ptr<Statement>> stmts = block->GetStatements();
+  for (size_t i = 0; i < stmts.size(); i++) {
+    if (!EmitStatement_(stmts[i], wantValue && i + 1 == stmts.size(), type)) {
+      return false;
+    }
+    if (type == JitType::NONE) {
+      // nothing after a return runs
+      return true;
+    }
+  }
+
+  return !wantValue || type != JitType::VOID;
+}
+
+bool JitCompiler::EmitStatement_(std::shared_ptr<Statement> stmt, bool wantValue, JitType& type) {
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    if (auto ie = std::dynamic_pointer_cast<IfExpression>(es->GetExpression())) {
+      return EmitIf_(ie, wantValue, type);
+    }
+    return EmitExpression_(es->GetExpression(), type);
+  }
+  if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    type = JitType::VOID;
+    return EmitVar_(vs);
+  }
+  if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    return EmitReturn_(rs, type);
+  }
+  if (auto fs = std::dynamic_pointer_cast<ForStatement>(stmt)) {
+    type = JitType::VOID;
+    return EmitFor_(fs);
+  }
+
+  return false;
+}
+
+bool JitCompiler::EmitVar_(std::shared_ptr<VarStatement> stmt) {
+  JitType type;
+  if (stmt->GetName() == nullptr || !EmitExpression_(stmt->GetValue(), type)
+      || (type != JitType::INT && type != JitType::BOOL)) {
+    return false;
+  }
+
+  // a var inside an if binds only on some paths: later reads could not know
+  // which scope they resolve to
+  JitScope& scope = scopes_.back();
+  if (scope.ifDepth > 0) {
+    return false;
+  }
+
+  const std::string& name = stmt->GetName()->GetValue();
+  int slot;
+  auto it = scope.visible.find(name);
+  if (it != scope.visible.end()) {
+    if (it->second.type != type) {
+      return false;
+    }
+    slot = it->second.slot;
+  } else if (scope.reserved.count(name) > 0) {
+    slot = scope.reserved.at(name);
+  } else {
+    slot = NewSlot_();
+  }
+
+  Store_(slot);
+  scope.visible[name] = (JitVar){.slot = slot, .type = type};
+  return true;
+}
+
+bool JitCompiler::EmitReturn_(std::shared_ptr<ReturnStatement> rs, JitType& type) {
+  type = JitType::NONE;
+
+  auto call = std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal());
+  if (rs->IsTailCall() && loopDepth_ == 0 && call != nullptr) {
+    JitType value;
+    if (!EmitCall_(call, value, true)) {
+      return false;
+    }
+    if (value == JitType::NONE) {
+      // became a jump back to the top of the body
+      return true;
+    }
+    returns_.push_back(value);
+    asm_.Byte(0xE9);
+    asm_.Rel32(exitLabel_);
+    return true;
+  }
+
+  JitType value;
+  if (rs->GetReturnVal() == nullptr || !EmitExpression_(rs->GetReturnVal(), value)) {
+    return false;
+  }
+
+  if (loopDepth_ > 0) {
+    // a return in a for body only ends the iteration
+    asm_.Byte(0xE9);
+    asm_.Rel32(scopes_.back().continueLabel);
+    return true;
+  }
+
+  returns_.push_back(value);
+  asm_.Byte(0xE9);
+  asm_.Rel32(exitLabel_);
+  return true;
+}
+
+/*
+ * a loop runs in a scope of its own that every assignment in it binds in;
+ * names it binds get their slot on entry, holding a copy of what they
+ * resolved to outside (which cannot change while the loop runs)
+ */
+bool JitCompiler::EmitFor_(std::shared_ptr<ForStatement> fs) {
+  std::unordered_set<std::string> names;
+  for (const auto& stmt : fs->GetHoisted()) {
+    ScanLoopBindings_(stmt->GetValue(), names);
+  }
+  ScanLoopBindings_(fs->GetVarStmt()->GetValue(), names);
+  ScanLoopBindings_(fs->GetCondition(), names);
+  ScanLoopBindings_(fs->GetAfterAction(), names);
+  ScanLoopBindings_(fs->GetBlock(), names);
+
+  JitScope scope;
+  scope.continueLabel = asm_.NewLabel();
+  for (const auto& name : names) {
+    int slot = NewSlot_();
+    scope.reserved[name] = slot;
+    if (const JitVar* outer = Lookup_(name)) {
+      Load_(outer->slot);
+      Store_(slot);
+      scope.visible[name] = (JitVar){.slot = slot, .type = outer->type};
+    }
+  }
+
+  scopes_.push_back(scope);
+  loopDepth_++;
+
+  if (!EmitVar_(fs->GetVarStmt())) {
+    return false;
+  }
+  for (const auto& stmt : fs->GetHoisted()) {
+    if (!EmitVar_(stmt)) {
+      return false;
+    }
+  }
+
+  // condition and after action only see what is bound before the first
+  // iteration: what the body binds may not be bound yet when they run
+  std::unordered_map<std::string, JitVar> entry = scopes_.back().visible;
+  int bodyLabel = asm_.NewLabel();
+  int condLabel = asm_.NewLabel();
+
+  asm_.Byte(0xE9);
+  asm_.Rel32(condLabel);
+  asm_.Bind(bodyLabel);
+
+  JitType type;
+  if (!EmitBlock_(fs->GetBlock(), false, type)) {
+    return false;
+  }
+
+  asm_.Bind(scopes_.back().continueLabel);
+  scopes_.back().visible = entry;
+  if (!EmitExpression_(fs->GetAfterAction(), type)) {
+    return false;
+  }
+
+  asm_.Bind(condLabel);
+  if (!EmitExpression_(fs->GetCondition(), type) || type != JitType::BOOL) {
+    return false;
+  }
+  // test rax, rax; jnz body
+  asm_.Bytes({0x48, 0x85, 0xC0, 0x0F, 0x85});
+  asm_.Rel32(bodyLabel);
+
+  loopDepth_--;
+  scopes_.pop_back();
+  return true;
+}
+
+// names bound directly in a loop's scope: nested loops bind in their own
+void JitCompiler::ScanLoopBindings_(std::shared_ptr<Node> node,
+    std::unordered_set<std::string>& names) const {
+  if (node == nullptr) {
+    return;
+  }
+
+  if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      ScanLoopBindings_(stmt, names);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    ScanLoopBindings_(es->GetExpression(), names);
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    if (vs->GetName() != nullptr) {
+      names.insert(vs->GetName()->GetValue());
+    }
+    ScanLoopBindings_(vs->GetValue(), names);
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    ScanLoopBindings_(rs->GetReturnVal(), names);
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    ScanLoopBindings_(pe->GetRight(), names);
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    ScanLoopBindings_(ie->GetLeft(), names);
+    ScanLoopBindings_(ie->GetRight(), names);
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    ScanLoopBindings_(ifExp->GetCondition(), names);
+    ScanLoopBindings_(ifExp->GetConsequence(), names);
+    ScanLoopBindings_(ifExp->GetAlternative(), names);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    ScanLoopBindings_(call->GetFunc(), names);
+    for (const auto& arg : call->GetArgs()) {
+      ScanLoopBindings_(arg, names);
+    }
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    if (auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent())) {
+      names.insert(ident->GetValue());
+    }
+    ScanLoopBindings_(ae->GetNewVal(), names);
+  }
+}
+
+/*
+  expressions
+*/
+
+bool JitCompiler::EmitExpression_(std::shared_ptr<Expression> exp, JitType& type) {
+  if (exp == nullptr) {
+    return false;
+  }
+
+  if (auto il = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    // mov rax, imm64
+    asm_.Bytes({0x48, 0xB8});
+    asm_.Imm64(il->GetValue());
+    type = JitType::INT;
+    return true;
+  }
+  if (auto be = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    asm_.Bytes({0x48, 0xB8});
+    asm_.Imm64(be->GetValue() ? 1 : 0);
+    type = JitType::BOOL;
+    return true;
+  }
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    const JitVar* var = Lookup_(ident->GetValue());
+    if (var == nullptr) {
+      return false;
+    }
+    Load_(var->slot);
+    type = var->type;
+    return true;
+  }
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    if (pe->TokenLiteral() == "-") {
+      if (!EmitExpression_(pe->GetRight(), type) || type != JitType::INT) {
+        return false;
+      }
+      // neg rax
+      asm_.Bytes({0x48, 0xF7, 0xD8});
+      return true;
+    }
+    if (pe->TokenLiteral() == "!") {
+      if (!EmitExpression_(pe->GetRight(), type)) {
+        return false;
+      }
+      if (type == JitType::BOOL) {
+        // xor rax, 1
+        asm_.Bytes({0x48, 0x83, 0xF0, 0x01});
+      } else if (type == JitType::INT) {
+        // !integer is always false
+        asm_.Bytes({0x48, 0xB8});
+        asm_.Imm64(0);
+      } else {
+        return false;
+      }
+      type = JitType::BOOL;
+      return true;
+    }
+    return false;
+  }
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    return EmitInfix_(ie, type);
+  }
+  if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    return EmitIf_(ifExp, true, type);
+  }
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    return EmitCall_(call, type, false);
+  }
+  if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    return EmitAssign_(ae, type);
+  }
+
+  return false;
+}
+
+bool JitCompiler::EmitInfix_(std::shared_ptr<InfixExpression> ie, JitType& type) {
+  JitType left;
+  JitType right;
+  if (!EmitExpression_(ie->GetLeft(), left)
+      || (left != JitType::INT && left != JitType::BOOL)) {
+    return false;
+  }
+  int tmp = NewSlot_();
+  Store_(tmp);
+  if (!EmitExpression_(ie->GetRight(), right)
+      || (right != JitType::INT && right != JitType::BOOL)) {
+    return false;
+  }
+  // mov rcx, rax
+  asm_.Bytes({0x48, 0x89, 0xC1});
+  Load_(tmp);
+
+  const std::string op = ie->GetOp();
+  uint8_t setcc;
+  if (op == "==") {
+    setcc = 0x94;
+  } else if (op == "!=") {
+    setcc = 0x95;
+  } else if (op == "<") {
+    setcc = 0x9C;
+  } else if (op == ">") {
+    setcc = 0x9F;
+  } else {
+    setcc = 0;
+  }
+
+  if (left != right || (left == JitType::BOOL && op != "==" && op != "!=")) {
+    return false;
+  }
+
+  if (setcc != 0) {
+    // cmp rax, rcx; setcc al; movzx eax, al
+    asm_.Bytes({0x48, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0});
+    type = JitType::BOOL;
+    return true;
+  }
+
+  type = JitType::INT;
+  if (op == "+") {
+    asm_.Bytes({0x48, 0x01, 0xC8});
+  } else if (op == "-") {
+    asm_.Bytes({0x48, 0x29, 0xC8});
+  } else if (op == "*") {
+    asm_.Bytes({0x48, 0x0F, 0xAF, 0xC1});
+  } else if (op == "/") {
+    // the interpreter traps on these; leave it to do so
+    int divide = asm_.NewLabel();
+    // test rcx, rcx; je bail
+    asm_.Bytes({0x48, 0x85, 0xC9, 0x0F, 0x84});
+    asm_.Rel32(bailLabel_);
+    // cmp rcx, -1; jne divide; mov rdx, LONG_MIN; cmp rax, rdx; je bail
+    asm_.Bytes({0x48, 0x83, 0xF9, 0xFF, 0x0F, 0x85});
+    asm_.Rel32(divide);
+    asm_.Bytes({0x48, 0xBA});
+    asm_.Imm64(LONG_MIN);
+    asm_.Bytes({0x48, 0x39, 0xD0, 0x0F, 0x84});
+    asm_.Rel32(bailLabel_);
+    asm_.Bind(divide);
+    // cqo; idiv rcx
+    asm_.Bytes({0x48, 0x99, 0x48, 0xF7, 0xF9});
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool JitCompiler::EmitIf_(std::shared_ptr<IfExpression> ie, bool wantValue, JitType& type) {
+  JitType cond;
+  if (!EmitExpression_(ie->GetCondition(), cond)) {
+    return false;
+  }
+
+  JitScope& scope = scopes_.back();
+  if (cond == JitType::INT) {
+    // integers are always truthy
+    scope.ifDepth++;
+    bool ok = EmitBlock_(ie->GetConsequence(), wantValue, type);
+    scopes_.back().ifDepth--;
+    return ok;
+  }
+  if (cond != JitType::BOOL) {
+    return false;
+  }
+
+  int elseLabel = asm_.NewLabel();
+  int endLabel = asm_.NewLabel();
+  // test rax, rax; jz else
+  asm_.Bytes({0x48, 0x85, 0xC0, 0x0F, 0x84});
+  asm_.Rel32(elseLabel);
+
+  scope.ifDepth++;
+  JitType consequence;
+  JitType alternative = JitType::VOID;
+  if (!EmitBlock_(ie->GetConsequence(), wantValue, consequence)) {
+    return false;
+  }
+  asm_.Byte(0xE9);
+  asm_.Rel32(endLabel);
+  asm_.Bind(elseLabel);
+  if (ie->GetAlternative() != nullptr) {
+    if (!EmitBlock_(ie->GetAlternative(), wantValue, alternative)) {
+      return false;
+    }
+  } else if (wantValue) {
+    // would be null when the condition is false
+    return false;
+  }
+  scopes_.back().ifDepth--;
+  asm_.Bind(endLabel);
+
+  if (!wantValue) {
+    bool diverges = consequence == JitType::NONE && alternative == JitType::NONE;
+    type = diverges ? JitType::NONE : JitType::VOID;
+    return true;
+  }
+
+  type = JitType::NONE;
+  return Merge_(type, consequence) && Merge_(type, alternative);
+}
+
+bool JitCompiler::EmitCall_(std::shared_ptr<CallExpression> call, JitType& type, bool selfTail) {
+  auto ident = std::dynamic_pointer_cast<Identifier>(call->GetFunc());
+  if (ident == nullptr || Lookup_(ident->GetValue()) != nullptr) {
+    return false;
+  }
+
+  Object** slot = fn_->GetEnv()->Lookup(ident->GetValue());
+  Function* callee = slot != nullptr ? dynamic_cast<Function*>(*slot) : nullptr;
+  if (callee == nullptr || callee->GetParams().size() != call->GetArgs().size()) {
+    return false;
+  }
+
+  bool self = callee->GetBody() == fn_->GetBody() && callee->GetEnv() == fn_->GetEnv();
+  std::shared_ptr<JitCode> code;
+  if (self) {
+    type = selfType_;
+    usedSelf_ = true;
+  } else {
+    code = jit_.Compile(callee);
+    if (code == nullptr) {
+      return false;
+    }
+    type = code->GetType();
+    callees_.insert(callees_.end(), code->GetCallees().begin(), code->GetCallees().end());
+  }
+  // kept alive so no other function can take its address while code runs
+  callee->AddRef();
+  callees_.emplace_back(slot, callee);
+
+  int last;
+  if (!EmitArgs_(call->GetArgs(), last)) {
+    return false;
+  }
+
+  if (self && selfTail) {
+    // reuse this frame: the arguments become the parameters and the body starts over
+    for (size_t i = 0; i < paramSlots_.size(); i++) {
+      Load_(last - static_cast<int>(i));
+      Store_(paramSlots_[i]);
+    }
+    asm_.Byte(0xE9);
+    asm_.Rel32(bodyLabel_);
+    type = JitType::NONE;
+    return true;
+  }
+
+  // mov rdi, r12
+  asm_.Bytes({0x4C, 0x89, 0xE7});
+  if (call->GetArgs().empty()) {
+    // xor esi, esi
+    asm_.Bytes({0x31, 0xF6});
+  } else {
+    // lea rsi, [rbp + disp32]
+    asm_.Bytes({0x48, 0x8D, 0xB5});
+    asm_.Imm32(Disp_(last));
+  }
+
+  if (self) {
+    // call rel32 to the start of this code
+    asm_.Byte(0xE8);
+    asm_.Rel32(entryLabel_);
+  } else {
+    // mov rax, imm64; call rax
+    asm_.Bytes({0x48, 0xB8});
+    asm_.Imm64(reinterpret_cast<int64_t>(code->GetEntry()));
+    asm_.Bytes({0xFF, 0xD0});
+  }
+
+  CheckBail_();
+  return true;
+}
+
+// arguments go to consecutive slots, the first at the lowest address
+bool JitCompiler::EmitArgs_(const std::vector<std::shared_ptr<Expression>>& args, int& last) {
+  int first = slots_;
+  for (size_t i = 0; i < args.size(); i++) {
+    NewSlot_();
+  }
+  last = first + static_cast<int>(args.size()) - 1;
+
+  for (size_t i = 0; i < args.size(); i++) {
+    JitType type;
+    if (!EmitExpression_(args[i], type) || type != JitType::INT) {
+      return false;
+    }
+    Store_(last - static_cast<int>(i));
+  }
+
+  return true;
+}
+
+// an assignment always binds in the innermost scope, like AssignNewVal_
+bool JitCompiler::EmitAssign_(std::shared_ptr<AssignExpression> ae, JitType& type) {
+  auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+  if (ident == nullptr || !EmitExpression_(ae->GetNewVal(), type)
+      || (type != JitType::INT && type != JitType::BOOL)) {
+    return false;
+  }
+
+  const JitScope& scope = scopes_.back();
+  auto it = scope.visible.find(ident->GetValue());
+  if (it == scope.visible.end() || it->second.type != type) {
+    return false;
+  }
+
+  Store_(it->second.slot);
+  return true;
+}
+
+/*
+  frame
+*/
+
+const JitVar* JitCompiler::Lookup_(const std::string& name) const {
+  for (auto it = scopes_.rbegin(); it != scopes_.rend(); it++) {
+    auto found = it->visible.find(name);
+    if (found != it->visible.end()) {
+      return &found->second;
+    }
+  }
+
+  return nullptr;
+}
+
+int JitCompiler::NewSlot_() {
+  return slots_++;
+}
+
+int32_t JitCompiler::Disp_(int slot) const {
+  return -SAVED_REGS_SIZE - 8 * (slot + 1);
+}
+
+void JitCompiler::Load_(int slot) {
+  // mov rax, [rbp + disp32]
+  asm_.Bytes({0x48, 0x8B, 0x85});
+  asm_.Imm32(Disp_(slot));
+}
+
+void JitCompiler::Store_(int slot) {
+  // mov [rbp + disp32], rax
+  asm_.Bytes({0x48, 0x89, 0x85});
+  asm_.Imm32(Disp_(slot));
+}
+
+// a callee that bailed already flagged it: just unwind
+void JitCompiler::CheckBail_() {
+  // cmp byte [r12], 0; jne exit
+  asm_.Bytes({0x41, 0x80, 0x3C, 0x24, 0x00, 0x0F, 0x85});
+  asm_.Rel32(exitLabel_);
+}
+
+bool JitCompiler::Merge_(JitType& into, JitType type) {
+  if (type == JitType::NONE) {
+    return true;
+  }
+  if (into == JitType::NONE) {
+    into = type;
+    return true;
+  }
+
+  return into == type;
+}
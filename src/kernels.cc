@@ -0,0 +1,320 @@
+#include <kernels.h>
+
+#ifdef MCSCRIPT_SIMD_X86
+#include <immintrin.h>
+#endif
+
+static KernelLevel DetectLevel() {
+#ifdef MCSCRIPT_SIMD_X86
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? KernelLevel::AVX2 : KernelLevel::SSE2;
+#else
+  return KernelLevel::SCALAR;
+#endif
+}
+
+static KernelLevel& Level() {
+  static KernelLevel level = DetectLevel();
+  return level;
+}
+
+KernelLevel GetKernelLevel() {
+  return Level();
+}
+
+void SetKernelLevel(KernelLevel level) {
+  static const KernelLevel best = DetectLevel();
+  Level() = level < best ? level : best;
+}
+
+/*
+  scalar
+*/
+
+// through unsigned longs, so overflow wraps as it does in the vector lanes
+static inline long Apply(KernelOp op, long x, long y) {
+  unsigned long ux = static_cast<unsigned long>(x);
+  unsigned long uy = static_cast<unsigned long>(y);
+  switch (op) {
+    case KernelOp::ADD:
+      return static_cast<long>(ux + uy);
+    case KernelOp::SUB:
+      return static_cast<long>(ux - uy);
+    case KernelOp::MUL:
+      return static_cast<long>(ux * uy);
+    case KernelOp::DIV:
+      // LONG_MIN / -1 would trap
+      return y == -1 ? static_cast<long>(0UL - ux) : x / y;
+    case KernelOp::LT:
+      return x < y;
+    case KernelOp::GT:
+      return x > y;
+  }
+  return 0;
+}
+
+static void BinaryScalar(KernelOp op, const long* a, size_t aStep, const long* b, size_t bStep,
+    long* out, size_t from, size_t n) {
+  for (size_t i = from; i < n; i++) {
+    out[i] = Apply(op, a[i * aStep], b[i * bStep]);
+  }
+}
+
+#ifdef MCSCRIPT_SIMD_X86
+
+/*
+  SSE2: two lanes, adds, subtracts and multiplies (it has no 64 bit compare)
+*/
+
+// the low 64 bits of each product, from 32 bit halves
+static inline __m128i Mul64(__m128i a, __m128i b) {
+  __m128i lo = _mm_mul_epu32(a, b);
+  __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+      _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+  return _mm_add_epi64(lo, _mm_slli_epi64(cross, 32));
+}
+
+template <KernelOp OP>
+static size_t BinarySse2(const long* a, size_t aStep, const long* b, size_t bStep, long* out,
+    size_t n) {
+  __m128i aAll = _mm_set1_epi64x(aStep == 0 && n > 0 ? a[0] : 0);
+  __m128i bAll = _mm_set1_epi64x(bStep == 0 && n > 0 ? b[0] : 0);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i x = aStep != 0 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)) : aAll;
+    __m128i y = bStep != 0 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)) : bAll;
+    __m128i r;
+    if constexpr (OP == KernelOp::ADD) {
+      r = _mm_add_epi64(x, y);
+    } else if constexpr (OP == KernelOp::SUB) {
+      r = _mm_sub_epi64(x, y);
+    } else {
+      r = Mul64(x, y);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+  }
+  return i;
+}
+
+static long SumSse2(const long* a, size_t n, size_t& i) {
+  __m128i acc = _mm_setzero_si128();
+  for (i = 0; i + 2 <= n; i += 2) {
+    acc = _mm_add_epi64(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+  }
+  long lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return static_cast<long>(static_cast<unsigned long>(lanes[0]) + lanes[1]);
+}
+
+static long DotSse2(const long* a, const long* b, size_t n, size_t& i) {
+  __m128i acc = _mm_setzero_si128();
+  for (i = 0; i + 2 <= n; i += 2) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    acc = _mm_add_epi64(acc, Mul64(x, y));
+  }
+  long lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  return static_cast<long>(static_cast<unsigned long>(lanes[0]) + lanes[1]);
+}
+
+/*
+  AVX2: four lanes, everything but division
+*/
+
+__attribute__((target("avx2")))
+static inline __m256i Mul64Avx2(__m256i a, __m256i b) {
+  __m256i lo = _mm256_mul_epu32(a, b);
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+      _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+template <KernelOp OP>
+__attribute__((target("avx2")))
+static size_t BinaryAvx2(const long* a, size_t aStep, const long* b, size_t bStep, long* out,
+    size_t n) {
+  __m256i aAll = _mm256_set1_epi64x(aStep == 0 && n > 0 ? a[0] : 0);
+  __m256i bAll = _mm256_set1_epi64x(bStep == 0 && n > 0 ? b[0] : 0);
+  __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = aStep != 0 ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)) : aAll;
+    __m256i y = bStep != 0 ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)) : bAll;
+    __m256i r;
+    if constexpr (OP == KernelOp::ADD) {
+      r = _mm256_add_epi64(x, y);
+    } else if constexpr (OP == KernelOp::SUB) {
+      r = _mm256_sub_epi64(x, y);
+    } else if constexpr (OP == KernelOp::MUL) {
+      r = Mul64Avx2(x, y);
+    } else if constexpr (OP == KernelOp::LT) {
+      r = _mm256_and_si256(_mm256_cmpgt_epi64(y, x), one);
+    } else {
+      r = _mm256_and_si256(_mm256_cmpgt_epi64(x, y), one);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), r);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static long SumAvx2(const long* a, size_t n, size_t& i) {
+  __m256i acc = _mm256_setzero_si256();
+  for (i = 0; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+  }
+  long lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  unsigned long total = 0;
+  for (long lane : lanes) {
+    total += static_cast<unsigned long>(lane);
+  }
+  return static_cast<long>(total);
+}
+
+__attribute__((target("avx2")))
+static long DotAvx2(const long* a, const long* b, size_t n, size_t& i) {
+  __m256i acc = _mm256_setzero_si256();
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    acc = _mm256_add_epi64(acc, Mul64Avx2(x, y));
+  }
+  long lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  unsigned long total = 0;
+  for (long lane : lanes) {
+    total += static_cast<unsigned long>(lane);
+  }
+  return static_cast<long>(total);
+}
+
+// the least (or, with MAX, the greatest) of a[0] and the first whole groups
+// of four, i being where they end; n is at least 1
+template <bool MAX>
+__attribute__((target("avx2")))
+static long ExtremeAvx2(const long* a, size_t n, size_t& i) {
+  __m256i best = _mm256_set1_epi64x(a[0]);
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i take = MAX ? _mm256_cmpgt_epi64(x, best) : _mm256_cmpgt_epi64(best, x);
+    best = _mm256_blendv_epi8(best, x, take);
+  }
+  long lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), best);
+  long result = lanes[0];
+  for (long lane : lanes) {
+    result = MAX ? (lane > result ? lane : result) : (lane < result ? lane : result);
+  }
+  return result;
+}
+
+#endif // MCSCRIPT_SIMD_X86
+
+/*
+  entry points: the widest loop the level allows, then scalar for the rest
+*/
+
+void KernelBinary(KernelOp op, const long* a, size_t aStep, const long* b, size_t bStep,
+    long* out, size_t n) {
+  size_t done = 0;
+#ifdef MCSCRIPT_SIMD_X86
+  if (Level() == KernelLevel::AVX2) {
+    switch (op) {
+      case KernelOp::ADD:
+        done = BinaryAvx2<KernelOp::ADD>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::SUB:
+        done = BinaryAvx2<KernelOp::SUB>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::MUL:
+        done = BinaryAvx2<KernelOp::MUL>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::LT:
+        done = BinaryAvx2<KernelOp::LT>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::GT:
+        done = BinaryAvx2<KernelOp::GT>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::DIV:
+        break;
+    }
+  } else if (Level() == KernelLevel::SSE2) {
+    switch (op) {
+      case KernelOp::ADD:
+        done = BinarySse2<KernelOp::ADD>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::SUB:
+        done = BinarySse2<KernelOp::SUB>(a, aStep, b, bStep, out, n);
+        break;
+      case KernelOp::MUL:
+        done = BinarySse2<KernelOp::MUL>(a, aStep, b, bStep, out, n);
+        break;
+      default:
+        break;
+    }
+  }
+#endif
+  BinaryScalar(op, a, aStep, b, bStep, out, done, n);
+}
+
+long KernelSum(const long* a, size_t n) {
+  size_t i = 0;
+  unsigned long total = 0;
+#ifdef MCSCRIPT_SIMD_X86
+  if (Level() == KernelLevel::AVX2) {
+    total = static_cast<unsigned long>(SumAvx2(a, n, i));
+  } else if (Level() == KernelLevel::SSE2) {
+    total = static_cast<unsigned long>(SumSse2(a, n, i));
+  }
+#endif
+  for (; i < n; i++) {
+    total += static_cast<unsigned long>(a[i]);
+  }
+  return static_cast<long>(total);
+}
+
+long KernelMin(const long* a, size_t n) {
+  size_t i = 0;
+  long result = a[0];
+#ifdef MCSCRIPT_SIMD_X86
+  if (Level() == KernelLevel::AVX2) {
+    result = ExtremeAvx2<false>(a, n, i);
+  }
+#endif
+  for (; i < n; i++) {
+    result = a[i] < result ? a[i] : result;
+  }
+  return result;
+}
+
+long KernelMax(const long* a, size_t n) {
+  size_t i = 0;
+  long result = a[0];
+#ifdef MCSCRIPT_SIMD_X86
+  if (Level() == KernelLevel::AVX2) {
+    result = ExtremeAvx2<true>(a, n, i);
+  }
+#endif
+  for (; i < n; i++) {
+    result = a[i] > result ? a[i] : result;
+  }
+  return result;
+}
+
+long KernelDot(const long* a, const long* b, size_t n) {
+  size_t i = 0;
+  unsigned long total = 0;
+#ifdef MCSCRIPT_SIMD_X86
+  if (Level() == KernelLevel::AVX2) {
+    total = static_cast<unsigned long>(DotAvx2(a, b, n, i));
+  } else if (Level() == KernelLevel::SSE2) {
+    total = static_cast<unsigned long>(DotSse2(a, b, n, i));
+  }
+#endif
+  for (; i < n; i++) {
+    total += static_cast<unsigned long>(a[i]) * static_cast<unsigned long>(b[i]);
+  }
+  return static_cast<long>(total);
+}
@@ -145,6 +145,12 @@ std::shared_ptr<Token> Lexer::NextToken()  {
     case ';':
       tok = NewToken_(TokenType::SEMICOLON, ch_);
       break;
+    case ':':
+      tok = NewToken_(TokenType::COLON, ch_);
+      break;
+    case '.':
+      tok = NewToken_(TokenType::DOT, ch_);
+      break;
     case '\0':
       tok = std::make_shared<Token>(TokenType::EOI, "");
       break;
@@ -3,6 +3,8 @@
 #include <memory>
 #include <parser.h>
 #include <evaluator.h>
+#include <emitter.h>
+#include <optimizer.h>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -62,7 +64,20 @@ FileData ReadFile(char* fileName) {
   return (FileData){.sourceCode = mapped, .fileSize = fileSize};
 }
 
-void RunRepl(std::shared_ptr<Evaluator> evaluator, std::shared_ptr<Environment<Object*>> env) {
+void Optimize(std::shared_ptr<Program> program, bool reportInlining, bool incremental) {
+  Optimizer optimizer;
+  optimizer.SetIncremental(incremental);
+  optimizer.Optimize(program);
+
+  if (reportInlining) {
+    for (const std::string& line : optimizer.GetInlineReport()) {
+      std::cerr << "inlined " << line << "\n";
+    }
+  }
+}
+
+void RunRepl(std::shared_ptr<Evaluator> evaluator, std::shared_ptr<Environment<Object*>> env,
+    bool optimize, bool reportInlining) {
   std::cout << "McScript v3.0 Programming Language\n";
   std::cout << "Enter commands: (type 'exit' to terminate)\n";
 
@@ -82,9 +97,13 @@ void RunRepl(std::shared_ptr<Evaluator> evaluator, std::shared_ptr<Environment<O
     if (p->GetErrors().size() > 0) {
       PrintParserErrors(p->GetErrors());
     }
-    
 
-    Object* obj = evaluator->Eval(program, env);
+    if (optimize) {
+      // a later line may rebind any name this one uses
+      Optimize(program, reportInlining, true);
+    }
+
+    Object* obj = evaluator->Run(program, env);
     if (obj != nullptr && obj->Type() == ObjectType::ERROR_OBJ) {
       std::cout << obj->Inspect() << "\n";
     }
@@ -95,17 +114,57 @@ void RunRepl(std::shared_ptr<Evaluator> evaluator, std::shared_ptr<Environment<O
 int main(int argc, char** argv) {
   auto env = std::make_shared<Environment<Object*>>();
   std::shared_ptr<Evaluator> evaluator = NewEval();
-
-  if (argc == 1) {
-    RunRepl(evaluator, env);
+  char* fileName = nullptr;
+  bool optimize = true;
+  bool reportInlining = false;
+  bool emitCpp = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.compare("--max-stack") == 0) {
+      // size in megabytes of the stack evaluation is allowed to recurse into
+      long megabytes = i + 1 < argc ? atol(argv[++i]) : 0;
+      if (megabytes <= 0) {
+        std::cerr << "ERROR: --max-stack expects a size in megabytes\n";
+        return -1;
+      }
+      evaluator->SetMaxStackSize(static_cast<size_t>(megabytes) * 1024 * 1024);
+    }
+    else if (arg.compare("--no-opt") == 0) {
+      optimize = false;
+    }
+    else if (arg.compare("--no-jit") == 0) {
+      evaluator->SetJitEnabled(false);
+    }
+    else if (arg.compare("--no-vm") == 0) {
+      evaluator->SetVmEnabled(false);
+    }
+    else if (arg.compare("--emit-cpp") == 0) {
+      // print the program translated to C++ instead of running it (see aot.h)
+      emitCpp = true;
+    }
+    else if (arg.compare("--report-inlining") == 0) {
+      reportInlining = true;
+    }
+    else if (fileName == nullptr) {
+      fileName = argv[i];
+    }
+    else {
+      std::cerr << "ERROR: too many arguments\n";
+      return -1;
+    }
   }
 
-  else if (argc > 2) {
-    std::cerr << "ERROR: too many arguments\n";
+  if (fileName == nullptr && emitCpp) {
+    std::cerr << "ERROR: --emit-cpp expects a file\n";
     return -1;
   }
+
+  if (fileName == nullptr) {
+    RunRepl(evaluator, env, optimize, reportInlining);
+  }
   else {
-    FileData fileData = ReadFile(argv[1]);
+    FileData fileData = ReadFile(fileName);
     if (fileData.sourceCode == nullptr) {
       return 1;
     }
@@ -114,9 +173,22 @@ int main(int argc, char** argv) {
     auto p = std::make_shared<Parser>(l);
     std::shared_ptr<Program> program = p->ParseProgram();
 
-    Object* obj = evaluator->Eval(program, env);
-    if (obj != nullptr && obj->Type() == ObjectType::ERROR_OBJ) {
-      std::cerr << obj->Inspect() << "\n";
+    if (optimize) {
+      Optimize(program, reportInlining, false);
+    }
+
+    if (emitCpp) {
+      if (p->GetErrors().size() > 0) {
+        PrintParserErrors(p->GetErrors());
+        return 1;
+      }
+      std::cout << CppEmitter().Emit(program);
+    }
+    else {
+      Object* obj = evaluator->Run(program, env);
+      if (obj != nullptr && obj->Type() == ObjectType::ERROR_OBJ) {
+        std::cerr << obj->Inspect() << "\n";
+      }
     }
 
     if (munmap(fileData.sourceCode, fileData.fileSize) == -1) {
@@ -1,5 +1,9 @@
 #include <object.h>
+#include <gcollector.h>
+#include <kernels.h>
+#include <algorithm>
 #include <iostream>
+#include <string_view>
 
 
 std::string Object::ObjectTypeStr(ObjectType type) {
@@ -16,12 +20,161 @@ std::string Object::ObjectTypeStr(ObjectType type) {
       return "ERROR";
     case ObjectType::STRING_OBJ:
       return "STRING";
+    case ObjectType::FUNCTION_OBJ:
+      return "FUNCTION";
+    case ObjectType::BUILT_IN_OBJ:
+      return "BUILTIN";
+    case ObjectType::ARRAY_OBJ:
+      return "ARRAY";
+    case ObjectType::HASH_OBJ:
+      return "HASH";
+    case ObjectType::RECORD_OBJ:
+      return "RECORD";
+    case ObjectType::VECTOR_OBJ:
+      return "VECTOR";
+    case ObjectType::MAP_OBJ:
+      return "MAP";
+    case ObjectType::PQUEUE_OBJ:
+      return "PQUEUE";
+    case ObjectType::DEQUE_OBJ:
+      return "DEQUE";
     default:
       return "UNRECOGNIZED TYPE";
   }
 }
 
 
+/*
+  strings
+*/
+
+String::String(const String& left, const String& right) {
+  size_t length = left.Length() + right.Length();
+  if (length < ROPE_MIN_LENGTH) {
+    std::string value;
+    value.reserve(length);
+    value.append(left.View()).append(right.View());
+    rope_ = length <= INTERN_MAX_LENGTH ? StringRope::Intern(std::move(value))
+      : std::make_shared<StringRope>(std::move(value));
+  } else {
+    rope_ = std::make_shared<StringRope>(left.rope_, right.rope_);
+  }
+}
+
+bool String::Equals(const String& other) const {
+  if (rope_ == other.rope_) {
+    return true;
+  }
+  if ((IsInterned() && other.IsInterned()) || Length() != other.Length()) {
+    return false;
+  }
+
+  // compares the texts with glibc's vectorized memcmp
+  return Hash() == other.Hash() && View() == other.View();
+}
+
+int String::Compare(const String& other) const {
+  if (rope_ == other.rope_) {
+    return 0;
+  }
+
+  return View().compare(other.View());
+}
+
+// views of the text of every interned rope, never destroyed: ropes in
+// static storage may outlive any other static
+static std::unordered_map<std::string_view, StringRope*>& InternTable() {
+  static auto* table = new std::unordered_map<std::string_view, StringRope*>();
+  return *table;
+}
+
+std::shared_ptr<StringRope> StringRope::Intern(std::string text) {
+  auto& table = InternTable();
+  auto it = table.find(text);
+  if (it != table.end()) {
+    return it->second->shared_from_this();
+  }
+
+  auto rope = std::make_shared<StringRope>(std::move(text));
+  rope->interned_ = true;
+  table.emplace(rope->flat_, rope.get());
+  return rope;
+}
+
+StringRope::~StringRope() {
+  if (interned_) {
+    InternTable().erase(flat_);
+  }
+  Unlink_();
+}
+
+std::shared_ptr<StringRope> StringRope::Slice(size_t start, size_t length) {
+  if (start == 0 && length == length_) {
+    return shared_from_this();
+  }
+
+  // a slice of a slice reads from the same base
+  std::shared_ptr<StringRope> base = shared_from_this();
+  std::string_view text = View().substr(start, length);
+  if (base_ != nullptr) {
+    base = base_;
+    start += offset_;
+  }
+
+  if (length <= INTERN_MAX_LENGTH) {
+    return Intern(std::string(text));
+  }
+  if (base->length_ >= SLICE_COPY_MIN && length * SLICE_COPY_RATIO < base->length_) {
+    return std::make_shared<StringRope>(std::string(text));
+  }
+
+  return std::make_shared<StringRope>(base, start, length);
+}
+
+// walks the pieces with an explicit stack: a rope built in a loop is as deep
+// as the loop was long
+void StringRope::Flatten_() {
+  if (base_ != nullptr) {
+    flat_ = std::string(Leaf_());
+    base_.reset();
+    return;
+  }
+
+  std::string flat;
+  flat.reserve(length_);
+
+  std::vector<const StringRope*> pending = {this};
+  while (!pending.empty()) {
+    const StringRope* rope = pending.back();
+    pending.pop_back();
+    if (rope->left_ == nullptr) {
+      flat.append(rope->Leaf_());
+    } else {
+      pending.push_back(rope->right_.get());
+      pending.push_back(rope->left_.get());
+    }
+  }
+
+  flat_ = std::move(flat);
+  Unlink_();
+}
+
+// drops the pieces one node at a time instead of through nested destructors
+void StringRope::Unlink_() {
+  std::vector<std::shared_ptr<StringRope>> pending;
+  pending.push_back(std::move(left_));
+  pending.push_back(std::move(right_));
+
+  while (!pending.empty()) {
+    std::shared_ptr<StringRope> rope = std::move(pending.back());
+    pending.pop_back();
+    if (rope != nullptr && rope.use_count() == 1) {
+      pending.push_back(std::move(rope->left_));
+      pending.push_back(std::move(rope->right_));
+    }
+  }
+}
+
 std::string Function::Inspect() const {
   std::string result = "function(";
 
@@ -39,20 +192,72 @@ std::string Function::Inspect() const {
   return result;
 }
 
-Object* Length(std::vector<Object*> args) {
-  if (args.size() != 1) {
-    return new Error("len function only takes one argument");
+static Boolean* sharedTrue = nullptr;
+static Boolean* sharedFalse = nullptr;
+
+static const std::vector<Integer>& SharedIntegers() {
+  static const std::vector<Integer> pool = [] {
+    std::vector<Integer> ints;
+    ints.reserve(SHARED_INTEGERS);
+    for (long i = 0; i < SHARED_INTEGERS; i++) {
+      ints.emplace_back(i);
+    }
+    return ints;
+  }();
+  return pool;
+}
+
+void ShareBooleans(Boolean* TRUE, Boolean* FALSE) {
+  sharedTrue = TRUE;
+  sharedFalse = FALSE;
+}
+
+Object* SharedBoolean(bool value) {
+  Boolean* shared = value ? sharedTrue : sharedFalse;
+  return shared != nullptr ? shared : new Boolean(value);
+}
+
+Object* NewInteger(long value) {
+  if (value >= 0 && value < SHARED_INTEGERS) {
+    // nothing changes an Integer once made, so every holder can have this one
+    return const_cast<Integer*>(&SharedIntegers()[value]);
+  }
+  return new Integer(value);
+}
+
+bool IsShared(const Object* obj) {
+  if (obj == nullptr) {
+    return false;
+  }
+  if (obj == sharedTrue || obj == sharedFalse) {
+    return true;
   }
+  if (obj->Type() != ObjectType::INTEGER_OBJ) {
+    return false;
+  }
+  long value = static_cast<const Integer*>(obj)->GetValue();
+  return value >= 0 && value < SHARED_INTEGERS && obj == &SharedIntegers()[value];
+}
+
+Object* Length(BuiltInArgs args) {
   Object* obj = args[0];
   switch(obj->Type()) {
     case ObjectType::STRING_OBJ: {
       String* str = dynamic_cast<String*>(obj);
-      return new Integer(str->GetValue().size());
+      return NewInteger(str->Length());
     }
     case ObjectType::ARRAY_OBJ: {
       Array* arr = dynamic_cast<Array*>(obj);
-      return new Integer(arr->GetElements()->size());
+      return NewInteger(arr->Size());
     }
+    case ObjectType::VECTOR_OBJ:
+      return NewInteger(static_cast<PersistentVector*>(obj)->Size());
+    case ObjectType::MAP_OBJ:
+      return NewInteger(static_cast<PersistentMap*>(obj)->Size());
+    case ObjectType::PQUEUE_OBJ:
+      return NewInteger(static_cast<PriorityQueue*>(obj)->Size());
+    case ObjectType::DEQUE_OBJ:
+      return NewInteger(static_cast<Deque*>(obj)->Size());
     default: {
       std::string msg = "unrecognized type: " + Object::ObjectTypeStr(obj->Type());
       return new Error(msg);
@@ -61,25 +266,390 @@ Object* Length(std::vector<Object*> args) {
 
 }
 
-Object* Push(std::vector<Object*> args) {
-  if (args.size() != 2) {
-    return new Error(std::string("push function only takes 2 arguments"));
-  }
-
+Object* Push(BuiltInArgs args) {
   Array* arr = dynamic_cast<Array*>(args[0]);
   if (arr == nullptr) {
     return new Error(std::string("expecting array as first argument"));
   }
 
   Object* obj = args[1];
-  arr->GetElements()->push_back(obj);
-  obj->AddRef();
+  arr->AddObj(obj);
+
+  return nullptr;
+}
+
+Object* Slice(BuiltInArgs args) {
+  auto start = dynamic_cast<Integer*>(args[1]);
+  auto end = dynamic_cast<Integer*>(args[2]);
+  if (start == nullptr || end == nullptr) {
+    return new Error(std::string("expecting integers as start and end"));
+  }
+
+  Object* obj = args[0];
+  size_t length = 0;
+  switch(obj->Type()) {
+    case ObjectType::STRING_OBJ:
+      length = static_cast<String*>(obj)->Length();
+      break;
+    case ObjectType::ARRAY_OBJ:
+      length = static_cast<Array*>(obj)->Size();
+      break;
+    default: {
+      std::string msg = "unrecognized type: " + Object::ObjectTypeStr(obj->Type());
+      return new Error(msg);
+    }
+  }
+
+  auto clamp = [](long i, size_t min, size_t max) {
+    return i < static_cast<long>(min) ? min : std::min(static_cast<size_t>(i), max);
+  };
+  size_t from = clamp(start->GetValue(), 0, length);
+  size_t to = clamp(end->GetValue(), from, length);
+
+  if (obj->Type() == ObjectType::STRING_OBJ) {
+    return static_cast<String*>(obj)->Slice(from, to);
+  }
+  return static_cast<Array*>(obj)->Slice(from, to);
+}
+
+// the hash of a builtin's first argument, or the error to return instead;
+// the second argument has to be usable as a key when keyed is set
+static Object* HashArg(BuiltInArgs args, bool keyed, Hash*& hash) {
+  hash = dynamic_cast<Hash*>(args[0]);
+  if (hash == nullptr) {
+    return new Error(std::string("expecting hash as first argument"));
+  }
+  if (keyed && !Hash::IsHashable(args[1])) {
+    char buff[128];
+    snprintf(buff, sizeof(buff), "unusable as hash key: %s",
+        Object::ObjectTypeStr(args[1]->Type()).c_str());
+    return new Error(std::string(buff));
+  }
+
+  return nullptr;
+}
+
+static Object* ToArray(const std::vector<Object*>& objs) {
+  Array* arr = new Array();
+  for (Object* obj : objs) {
+    arr->AddObj(obj);
+  }
+  return arr;
+}
+
+Object* Keys(BuiltInArgs args) {
+  if (args[0]->Type() == ObjectType::MAP_OBJ) {
+    return ToArray(static_cast<PersistentMap*>(args[0])->Keys());
+  }
+
+  Hash* hash;
+  Object* err = HashArg(args, false, hash);
+  return err != nullptr ? err : ToArray(hash->Keys());
+}
+
+Object* Values(BuiltInArgs args) {
+  if (args[0]->Type() == ObjectType::MAP_OBJ) {
+    return ToArray(static_cast<PersistentMap*>(args[0])->Values());
+  }
+
+  Hash* hash;
+  Object* err = HashArg(args, false, hash);
+  return err != nullptr ? err : ToArray(hash->Values());
+}
+
+Object* Has(BuiltInArgs args) {
+  if (args[0]->Type() == ObjectType::MAP_OBJ && Hash::IsHashable(args[1])) {
+    return SharedBoolean(static_cast<PersistentMap*>(args[0])->Get(args[1]) != nullptr);
+  }
+
+  Hash* hash;
+  Object* err = HashArg(args, true, hash);
+  return err != nullptr ? err : SharedBoolean(hash->Get(args[1]) != nullptr);
+}
+
+Object* Set(BuiltInArgs args) {
+  Hash* hash;
+  Object* err = HashArg(args, true, hash);
+  if (err != nullptr) {
+    return err;
+  }
+
+  hash->Set(args[1], args[2]);
+  return nullptr;
+}
+
+Object* Delete(BuiltInArgs args) {
+  Hash* hash;
+  Object* err = HashArg(args, true, hash);
+  return err != nullptr ? err : SharedBoolean(hash->Delete(args[1]));
+}
+
+Object* Vec(BuiltInArgs args) {
+  PersistentVector* vec = new PersistentVector();
+  for (Object* obj : args) {
+    PersistentVector* next = vec->Conj(obj);
+    delete vec;
+    vec = next;
+  }
+  return vec;
+}
+
+// the error for an unusable key, nullptr if key is usable
+static Object* KeyError(const Object* key) {
+  if (Hash::IsHashable(key)) {
+    return nullptr;
+  }
+
+  char buff[128];
+  snprintf(buff, sizeof(buff), "unusable as hash key: %s", Object::ObjectTypeStr(key->Type()).c_str());
+  return new Error(std::string(buff));
+}
+
+Object* Map(BuiltInArgs args) {
+  if (args.size() % 2 != 0) {
+    return new Error(std::string("map function takes keys and values in pairs"));
+  }
+  for (size_t i = 0; i < args.size(); i += 2) {
+    Object* err = KeyError(args[i]);
+    if (err != nullptr) {
+      return err;
+    }
+  }
+
+  PersistentMap* map = new PersistentMap();
+  for (size_t i = 0; i < args.size(); i += 2) {
+    PersistentMap* next = map->Assoc(args[i], args[i + 1]);
+    delete map;
+    map = next;
+  }
+  return map;
+}
+
+Object* Conj(BuiltInArgs args) {
+  auto vec = dynamic_cast<PersistentVector*>(args[0]);
+  if (vec == nullptr) {
+    return new Error(std::string("expecting vector as first argument"));
+  }
+  return vec->Conj(args[1]);
+}
+
+Object* Assoc(BuiltInArgs args) {
+  if (auto map = dynamic_cast<PersistentMap*>(args[0])) {
+    Object* err = KeyError(args[1]);
+    return err != nullptr ? err : map->Assoc(args[1], args[2]);
+  }
 
+  auto vec = dynamic_cast<PersistentVector*>(args[0]);
+  if (vec == nullptr) {
+    return new Error(std::string("expecting vector or map as first argument"));
+  }
+  auto idx = dynamic_cast<Integer*>(args[1]);
+  if (idx == nullptr || idx->GetValue() < 0 || static_cast<size_t>(idx->GetValue()) > vec->Size()) {
+    char buff[128];
+    snprintf(buff, sizeof(buff), "index %s out of range for vector of %zu",
+        args[1]->Inspect().c_str(), vec->Size());
+    return new Error(std::string(buff));
+  }
+  return vec->Assoc(idx->GetValue(), args[2]);
+}
+
+Object* Dissoc(BuiltInArgs args) {
+  auto map = dynamic_cast<PersistentMap*>(args[0]);
+  if (map == nullptr) {
+    return new Error(std::string("expecting map as first argument"));
+  }
+  Object* err = KeyError(args[1]);
+  return err != nullptr ? err : map->Dissoc(args[1]);
+}
+
+// a new object a calling builtin returns, tracked as the evaluator would
+static Object* Tracked(Object* obj) {
+  GCollector::getGCollector().TrackObject(obj);
+  return obj;
+}
+
+Object* PQueue(BuiltInArgs args) {
+  if (args.size() == 1 && args[0]->Type() != ObjectType::FUNCTION_OBJ
+      && args[0]->Type() != ObjectType::BUILT_IN_OBJ) {
+    return new Error(std::string("expecting function as comparator"));
+  }
+  return new PriorityQueue(args.empty() ? nullptr : args[0]);
+}
+
+Object* PQPush(BuiltInArgs args, const BuiltInCallback& call) {
+  auto queue = dynamic_cast<PriorityQueue*>(args[0]);
+  if (queue == nullptr) {
+    return Tracked(new Error(std::string("expecting pqueue as first argument")));
+  }
+  return queue->Push(args[1], call);
+}
+
+Object* PQPop(BuiltInArgs args, const BuiltInCallback& call) {
+  auto queue = dynamic_cast<PriorityQueue*>(args[0]);
+  if (queue == nullptr) {
+    return Tracked(new Error(std::string("expecting pqueue as argument")));
+  }
+  Object* top = nullptr;
+  Object* err = queue->Pop(top, call);
+  return err != nullptr ? err : top;
+}
+
+Object* PQPeek(BuiltInArgs args, const BuiltInCallback&) {
+  auto queue = dynamic_cast<PriorityQueue*>(args[0]);
+  if (queue == nullptr) {
+    return Tracked(new Error(std::string("expecting pqueue as argument")));
+  }
+  return queue->Peek();
+}
+
+Object* MakeDeque(BuiltInArgs) {
+  return new Deque();
+}
+
+// the deque a deque builtin works on, nullptr after setting err
+static Deque* DequeArg(BuiltInArgs args, Object*& err) {
+  auto deque = dynamic_cast<Deque*>(args[0]);
+  if (deque == nullptr) {
+    err = new Error(std::string(args.size() == 1 ? "expecting deque as argument"
+        : "expecting deque as first argument"));
+  }
+  return deque;
+}
+
+Object* DQPushFront(BuiltInArgs args) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  if (deque == nullptr) {
+    return err;
+  }
+  deque->PushFront(args[1]);
+  return nullptr;
+}
+
+Object* DQPushBack(BuiltInArgs args) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  if (deque == nullptr) {
+    return err;
+  }
+  deque->PushBack(args[1]);
   return nullptr;
 }
 
+Object* DQPopFront(BuiltInArgs args, const BuiltInCallback&) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  return deque != nullptr ? deque->PopFront() : Tracked(err);
+}
+
+Object* DQPopBack(BuiltInArgs args, const BuiltInCallback&) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  return deque != nullptr ? deque->PopBack() : Tracked(err);
+}
+
+Object* DQPeekFront(BuiltInArgs args, const BuiltInCallback&) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  if (deque == nullptr) {
+    return Tracked(err);
+  }
+  return deque->Size() > 0 ? deque->Get(0) : nullptr;
+}
+
+Object* DQPeekBack(BuiltInArgs args, const BuiltInCallback&) {
+  Object* err = nullptr;
+  Deque* deque = DequeArg(args, err);
+  if (deque == nullptr) {
+    return Tracked(err);
+  }
+  return deque->Size() > 0 ? deque->Get(deque->Size() - 1) : nullptr;
+}
+
+// the integers of an array, in place when it is packed and copied into ints
+// when it is boxed; false after setting err unless every element is one
+static bool IntsArg(Object* obj, std::vector<long>& ints, const long*& data, size_t& size,
+    Object*& err) {
+  auto arr = dynamic_cast<Array*>(obj);
+  if (arr != nullptr && arr->IsPacked()) {
+    data = arr->Ints();
+    size = arr->Size();
+    return true;
+  }
+
+  if (arr != nullptr) {
+    ints.reserve(arr->Size());
+    for (size_t i = 0; i < arr->Size() && ints.size() == i; i++) {
+      if (arr->Get(i)->Type() == ObjectType::INTEGER_OBJ) {
+        ints.push_back(static_cast<Integer*>(arr->Get(i))->GetValue());
+      }
+    }
+    if (ints.size() == arr->Size()) {
+      data = ints.data();
+      size = ints.size();
+      return true;
+    }
+  }
+
+  err = new Error(std::string("expecting array of integers"));
+  return false;
+}
+
+Object* Sum(BuiltInArgs args) {
+  std::vector<long> ints;
+  const long* a = nullptr;
+  size_t size = 0;
+  Object* err = nullptr;
+  if (!IntsArg(args[0], ints, a, size, err)) {
+    return err;
+  }
+  return NewInteger(KernelSum(a, size));
+}
+
+// min or max, which an empty array has neither of
+static Object* Extreme(BuiltInArgs args, long (*kernel)(const long*, size_t)) {
+  std::vector<long> ints;
+  const long* a = nullptr;
+  size_t size = 0;
+  Object* err = nullptr;
+  if (!IntsArg(args[0], ints, a, size, err)) {
+    return err;
+  }
+  if (size == 0) {
+    return new Error(std::string("empty array"));
+  }
+  return NewInteger(kernel(a, size));
+}
+
+Object* Min(BuiltInArgs args) {
+  return Extreme(args, KernelMin);
+}
+
+Object* Max(BuiltInArgs args) {
+  return Extreme(args, KernelMax);
+}
+
+Object* Dot(BuiltInArgs args) {
+  std::vector<long> leftInts;
+  std::vector<long> rightInts;
+  const long* a = nullptr;
+  const long* b = nullptr;
+  size_t leftSize = 0;
+  size_t rightSize = 0;
+  Object* err = nullptr;
+  if (!IntsArg(args[0], leftInts, a, leftSize, err)
+      || !IntsArg(args[1], rightInts, b, rightSize, err)) {
+    return err;
+  }
+  if (leftSize != rightSize) {
+    char buff[128];
+    snprintf(buff, sizeof(buff), "array lengths differ: %zu and %zu", leftSize, rightSize);
+    return new Error(std::string(buff));
+  }
+  return NewInteger(KernelDot(a, b, leftSize));
+}
 
-Object* Print(std::vector<Object*> args) {
+Object* Print(BuiltInArgs args) {
   for (size_t i = 0; i < args.size(); i++) {
     Object* arg = args[i];
     if (arg != nullptr) {
@@ -99,25 +669,1017 @@ Object* Print(std::vector<Object*> args) {
 
 
 std::unordered_map<std::string, BuiltIn*> GetBuiltIns() {
+  const int ANY = BuiltIn::VARIADIC;
   std::unordered_map<std::string, BuiltIn*> result = {
-    {"len", new BuiltIn(Length)},
-    {"push", new BuiltIn(Push)},
-    {"print", new BuiltIn(Print)}
+    {"len", new BuiltIn("len", Length, 1, 1, true)},
+    {"push", new BuiltIn("push", Push, 2, 2, false)},
+    {"slice", new BuiltIn("slice", Slice, 3, 3, true)},
+    {"keys", new BuiltIn("keys", Keys, 1, 1, true)},
+    {"values", new BuiltIn("values", Values, 1, 1, true)},
+    {"has", new BuiltIn("has", Has, 2, 2, true)},
+    {"set", new BuiltIn("set", Set, 3, 3, false)},
+    {"delete", new BuiltIn("delete", Delete, 2, 2, false)},
+    {"vec", new BuiltIn("vec", Vec, 0, ANY, true)},
+    {"map", new BuiltIn("map", Map, 0, ANY, true)},
+    {"conj", new BuiltIn("conj", Conj, 2, 2, true)},
+    {"assoc", new BuiltIn("assoc", Assoc, 3, 3, true)},
+    {"dissoc", new BuiltIn("dissoc", Dissoc, 2, 2, true)},
+    {"pqueue", new BuiltIn("pqueue", PQueue, 0, 1, true)},
+    {"pq_push", new BuiltIn("pq_push", PQPush, 2, 2, false)},
+    {"pq_pop", new BuiltIn("pq_pop", PQPop, 1, 1, false)},
+    {"pq_peek", new BuiltIn("pq_peek", PQPeek, 1, 1, true)},
+    {"deque", new BuiltIn("deque", MakeDeque, 0, 0, true)},
+    {"dq_push_front", new BuiltIn("dq_push_front", DQPushFront, 2, 2, false)},
+    {"dq_push_back", new BuiltIn("dq_push_back", DQPushBack, 2, 2, false)},
+    {"dq_pop_front", new BuiltIn("dq_pop_front", DQPopFront, 1, 1, false)},
+    {"dq_pop_back", new BuiltIn("dq_pop_back", DQPopBack, 1, 1, false)},
+    {"dq_peek_front", new BuiltIn("dq_peek_front", DQPeekFront, 1, 1, true)},
+    {"dq_peek_back", new BuiltIn("dq_peek_back", DQPeekBack, 1, 1, true)},
+    {"sum", new BuiltIn("sum", Sum, 1, 1, true)},
+    {"min", new BuiltIn("min", Min, 1, 1, true)},
+    {"max", new BuiltIn("max", Max, 1, 1, true)},
+    {"dot", new BuiltIn("dot", Dot, 2, 2, true)},
+    {"print", new BuiltIn("print", Print, 0, ANY, false)}
   };
 
   return result;
 }
 
+const BuiltIn* FindBuiltIn(const std::string& name) {
+  static const std::unordered_map<std::string, BuiltIn*> builtIns = GetBuiltIns();
+  auto it = builtIns.find(name);
+  return it != builtIns.end() ? it->second : nullptr;
+}
+
+
+/*
+  arrays
+*/
+
+Array::Array(Array* source, size_t offset, size_t length) : ints_(source->ints_),
+    objs_(source->objs_), offset_(offset), length_(length), view_(true) {
+  // packed elements hold no references for anyone to keep
+  if (ints_ == nullptr) {
+    owner_ = source->view_ ? source->owner_ : source;
+    owner_->AddRef();
+  }
+}
+
+void Array::AddObj(Object* obj) {
+  if (view_) {
+    CopyOut_();
+  }
+
+  if (ints_ != nullptr) {
+    if (obj->Type() == ObjectType::INTEGER_OBJ) {
+      ints_->push_back(static_cast<Integer*>(obj)->GetValue());
+      return;
+    }
+    Box_();
+  }
+
+  obj->AddRef();
+  objs_->push_back(obj);
+}
+
+// before writing to a view: the storage past it is its source's
+void Array::CopyOut_() {
+  if (ints_ != nullptr) {
+    ints_ = std::make_shared<std::vector<long>>(ints_->begin() + offset_,
+        ints_->begin() + offset_ + length_);
+  } else {
+    auto objs = std::make_shared<std::vector<Object*>>(objs_->begin() + offset_,
+        objs_->begin() + offset_ + length_);
+    for (Object* elem : *objs) {
+      elem->AddRef();
+    }
+    ReleaseElements();
+    objs_ = std::move(objs);
+  }
+
+  offset_ = 0;
+  view_ = false;
+}
+
+// gives every element an Integer of its own, tracked like any other
+void Array::Box_() {
+  auto objs = std::make_shared<std::vector<Object*>>();
+  objs->reserve(ints_->size() + 1);
+  for (long value : *ints_) {
+    Integer* box = new Integer(value);
+    box->AddRef();
+    GCollector::getGCollector().TrackObject(box);
+    objs->push_back(box);
+  }
+
+  objs_ = std::move(objs);
+  ints_.reset();
+}
+
+Array* Array::Slice(size_t start, size_t end) {
+  size_t length = end - start;
+  size_t stored = ints_ != nullptr ? ints_->size() : objs_->size();
+  bool shared = ints_ != nullptr || !view_ || owner_ != nullptr;
+  if (shared && length > 0 && !(stored >= SLICE_COPY_MIN && length * SLICE_COPY_RATIO < stored)) {
+    return new Array(this, offset_ + start, length);
+  }
+
+  Array* arr = new Array();
+  if (ints_ != nullptr) {
+    arr->ints_->assign(ints_->begin() + offset_ + start, ints_->begin() + offset_ + end);
+    return arr;
+  }
+
+  for (size_t i = start; i < end; i++) {
+    arr->AddObj(Get(i));
+  }
+  return arr;
+}
+
+void Array::ReleaseElements() {
+  if (ints_ != nullptr) {
+    return;
+  }
+
+  if (!view_) {
+    for (Object* obj : *objs_) {
+      obj->SubtractRef();
+    }
+    return;
+  }
+
+  Array* owner = owner_;
+  ReleaseOwner();
+  if (owner != nullptr && owner->IsNotReferenced()) {
+    owner->ReleaseElements();
+  }
+}
+
+void Array::ReleaseOwner() {
+  if (owner_ != nullptr) {
+    owner_->SubtractRef();
+    owner_ = nullptr;
+  }
+}
 
 std::string Array::Inspect() const {
   std::string result = "[";
 
-  for (size_t i = 0; i < objs_->size(); i++) {
-    Object* obj = (*objs_)[i];
-    result.append(obj->Inspect());
-    if (i < objs_->size() - 1) {
+  for (size_t i = 0; i < Size(); i++) {
+    result.append(IsPacked() ? std::to_string(GetInt(i)) : Get(i)->Inspect());
+    if (i < Size() - 1) {
+      result.append(", ");
+    }
+  }
+
+  result.append("]");
+
+  return result;
+}
+
+
+/*
+  hashes
+*/
+
+// spreads the bits of an integer key over the whole word (splitmix64)
+static size_t MixBits(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static size_t KeyHash(const Object* key) {
+  switch (key->Type()) {
+    case ObjectType::INTEGER_OBJ:
+      return MixBits(static_cast<const Integer*>(key)->GetValue());
+    case ObjectType::BOOLEAN_OBJ:
+      return MixBits(static_cast<const Boolean*>(key)->GetValue() ? 0x9e3779b9 : 0x7f4a7c15);
+    default:
+      return static_cast<const String*>(key)->Hash();
+  }
+}
+
+static bool KeyEquals(const Object* left, const Object* right) {
+  if (left == right) {
+    return true;
+  }
+  if (left->Type() != right->Type()) {
+    return false;
+  }
+
+  switch (left->Type()) {
+    case ObjectType::INTEGER_OBJ:
+      return static_cast<const Integer*>(left)->GetValue()
+        == static_cast<const Integer*>(right)->GetValue();
+    case ObjectType::BOOLEAN_OBJ:
+      return static_cast<const Boolean*>(left)->GetValue()
+        == static_cast<const Boolean*>(right)->GetValue();
+    default:
+      return static_cast<const String*>(left)->Equals(*static_cast<const String*>(right));
+  }
+}
+
+bool Hash::IsHashable(const Object* obj) {
+  ObjectType type = obj->Type();
+  return type == ObjectType::INTEGER_OBJ || type == ObjectType::BOOLEAN_OBJ
+    || type == ObjectType::STRING_OBJ;
+}
+
+long Hash::Find_(const Object* key, size_t hash) const {
+  size_t mask = index_.size() - 1;
+  size_t slot = hash & mask;
+  for (size_t dist = 0; ; dist++, slot = (slot + 1) & mask) {
+    uint32_t entry = index_[slot];
+    if (entry == 0) {
+      return -1;
+    }
+
+    // every entry from here on is closer to its home slot than key would be
+    const Entry& e = entries_[entry - 1];
+    if (((slot - e.hash) & mask) < dist) {
+      return -1;
+    }
+    if (e.hash == hash && KeyEquals(e.key, key)) {
+      return slot;
+    }
+  }
+}
+
+// puts entry in the first slot along its probe sequence that is empty or
+// whose entry is closer to home, carrying that entry on in its place
+void Hash::Place_(uint32_t entry) {
+  size_t mask = index_.size() - 1;
+  uint32_t carried = entry + 1;
+  size_t slot = entries_[entry].hash & mask;
+  size_t dist = 0;
+  while (index_[slot] != 0) {
+    size_t other = (slot - entries_[index_[slot] - 1].hash) & mask;
+    if (other < dist) {
+      std::swap(carried, index_[slot]);
+      dist = other;
+    }
+    slot = (slot + 1) & mask;
+    dist++;
+  }
+  index_[slot] = carried;
+}
+
+// drops deleted entries and re-places the rest in a table of slots slots
+void Hash::Rebuild_(size_t slots) {
+  std::vector<Entry> entries;
+  entries.reserve(size_ + 1);
+  for (const Entry& e : entries_) {
+    if (e.key != nullptr) {
+      entries.push_back(e);
+    }
+  }
+
+  entries_ = std::move(entries);
+  index_.assign(slots, 0);
+  for (size_t i = 0; i < entries_.size(); i++) {
+    Place_(i);
+  }
+}
+
+Object* Hash::Get(const Object* key) const {
+  long slot = Find_(key, KeyHash(key));
+  return slot < 0 ? nullptr : entries_[index_[slot] - 1].value;
+}
+
+void Hash::Set(Object* key, Object* value) {
+  size_t hash = KeyHash(key);
+  value->AddRef();
+  long slot = Find_(key, hash);
+  if (slot >= 0) {
+    Entry& e = entries_[index_[slot] - 1];
+    e.value->SubtractRef();
+    e.value = value;
+    return;
+  }
+
+  // at most three quarters of the slots hold an entry, deleted ones included
+  if ((entries_.size() + 1) * 4 > index_.size() * 3) {
+    size_t slots = HASH_MIN_SLOTS;
+    while ((size_ + 1) * 2 > slots) {
+      slots *= 2;
+    }
+    Rebuild_(slots);
+  }
+
+  key->AddRef();
+  entries_.push_back({key, value, hash});
+  Place_(entries_.size() - 1);
+  size_++;
+}
+
+bool Hash::Delete(const Object* key) {
+  long found = Find_(key, KeyHash(key));
+  if (found < 0) {
+    return false;
+  }
+
+  Entry& e = entries_[index_[found] - 1];
+  e.key->SubtractRef();
+  e.value->SubtractRef();
+  e.key = nullptr;
+  e.value = nullptr;
+  size_--;
+
+  // shift the entries after it back a slot until one is already at home
+  size_t mask = index_.size() - 1;
+  size_t slot = found;
+  size_t next = (slot + 1) & mask;
+  while (index_[next] != 0 && ((next - entries_[index_[next] - 1].hash) & mask) != 0) {
+    index_[slot] = index_[next];
+    slot = next;
+    next = (next + 1) & mask;
+  }
+  index_[slot] = 0;
+
+  return true;
+}
+
+std::vector<Object*> Hash::Keys() const {
+  std::vector<Object*> keys;
+  keys.reserve(size_);
+  for (const Entry& e : entries_) {
+    if (e.key != nullptr) {
+      keys.push_back(e.key);
+    }
+  }
+  return keys;
+}
+
+std::vector<Object*> Hash::Values() const {
+  std::vector<Object*> values;
+  values.reserve(size_);
+  for (const Entry& e : entries_) {
+    if (e.key != nullptr) {
+      values.push_back(e.value);
+    }
+  }
+  return values;
+}
+
+void Hash::ReleaseElements() {
+  for (const Entry& e : entries_) {
+    if (e.key != nullptr) {
+      e.key->SubtractRef();
+      e.value->SubtractRef();
+    }
+  }
+}
+
+std::string Hash::Inspect() const {
+  std::string result = "{";
+
+  bool first = true;
+  for (const Entry& e : entries_) {
+    if (e.key == nullptr) {
+      continue;
+    }
+    if (!first) {
+      result.append(", ");
+    }
+    result.append(e.key->Inspect() + ": " + e.value->Inspect());
+    first = false;
+  }
+
+  result.append("}");
+
+  return result;
+}
+
+
+/*
+  records
+*/
+
+const Shape* Shape::Root() {
+  static const Shape* root = new Shape();
+  return root;
+}
+
+const Shape* Shape::Of(const std::vector<std::string>& names) {
+  const Shape* shape = Root();
+  for (const std::string& name : names) {
+    shape = shape->With(name);
+  }
+  return shape;
+}
+
+const Shape* Shape::With(const std::string& name) const {
+  if (Offset(name) >= 0) {
+    return this;
+  }
+
+  std::unique_ptr<Shape>& next = transitions_[name];
+  if (next == nullptr) {
+    next.reset(new Shape());
+    next->fields_ = fields_;
+    next->fields_.push_back(name);
+  }
+  return next.get();
+}
+
+// records have a handful of fields, and cached reads skip this anyway
+int Shape::Offset(const std::string& name) const {
+  for (size_t i = 0; i < fields_.size(); i++) {
+    if (fields_[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void Record::SetSlot(int offset, Object* value) {
+  value->AddRef();
+  if (slots_[offset] != nullptr) {
+    slots_[offset]->SubtractRef();
+  }
+  slots_[offset] = value;
+}
+
+void Record::ReleaseElements() {
+  for (Object* value : slots_) {
+    if (value != nullptr) {
+      value->SubtractRef();
+    }
+  }
+}
+
+std::string Record::Inspect() const {
+  std::string result = "{";
+
+  for (size_t i = 0; i < slots_.size(); i++) {
+    if (i > 0) {
+      result.append(", ");
+    }
+    result.append(shape_->GetField(i) + ": " + slots_[i]->Inspect());
+  }
+
+  result.append("}");
+
+  return result;
+}
+
+
+/*
+  persistent collections
+*/
+
+// a reference a shared node held, dropped unless every object is being freed
+static void ReleaseShared(Object* obj) {
+  if (!GCollector::getGCollector().IsCollectingAll()) {
+    obj->SubtractRef();
+  }
+}
+
+// an interior node holds children, a leaf the elements themselves
+struct VectorNode {
+  std::vector<std::shared_ptr<const VectorNode>> children;
+  std::vector<Object*> values;
+
+  VectorNode() = default;
+
+  explicit VectorNode(std::vector<std::shared_ptr<const VectorNode>> children) :
+    children(std::move(children)) {}
+
+  explicit VectorNode(std::vector<Object*> values) : values(std::move(values)) {
+    for (Object* obj : this->values) {
+      obj->AddRef();
+    }
+  }
+
+  ~VectorNode() {
+    for (Object* obj : values) {
+      ReleaseShared(obj);
+    }
+  }
+};
+
+// a copy of the subtree at node, whose level consumes bits from level up,
+// with element i set to obj or appended when i is one past its end
+static std::shared_ptr<const VectorNode> VectorSet(const VectorNode& node, int level,
+    size_t i, Object* obj) {
+  size_t slot = (i >> level) & (TRIE_WIDTH - 1);
+  if (level == 0) {
+    std::vector<Object*> values = node.values;
+    if (slot == values.size()) {
+      values.push_back(obj);
+    } else {
+      values[slot] = obj;
+    }
+    return std::make_shared<VectorNode>(std::move(values));
+  }
+
+  std::vector<std::shared_ptr<const VectorNode>> children = node.children;
+  if (slot == children.size()) {
+    children.push_back(VectorSet(VectorNode(), level - TRIE_BITS, i, obj));
+  } else {
+    children[slot] = VectorSet(*children[slot], level - TRIE_BITS, i, obj);
+  }
+  return std::make_shared<VectorNode>(std::move(children));
+}
+
+PersistentVector::PersistentVector() :
+  root_(std::make_shared<VectorNode>()), shift_(0), size_(0) {}
+
+Object* PersistentVector::Get(size_t i) const {
+  const VectorNode* node = root_.get();
+  for (int level = shift_; level > 0; level -= TRIE_BITS) {
+    node = node->children[(i >> level) & (TRIE_WIDTH - 1)].get();
+  }
+  return node->values[i & (TRIE_WIDTH - 1)];
+}
+
+PersistentVector* PersistentVector::Assoc(size_t i, Object* obj) const {
+  if (i == size_) {
+    return Conj(obj);
+  }
+  return new PersistentVector(VectorSet(*root_, shift_, i, obj), shift_, size_);
+}
+
+PersistentVector* PersistentVector::Conj(Object* obj) const {
+  // a full trie grows a level, the old root becoming the first child
+  if (size_ == TRIE_WIDTH << shift_) {
+    VectorNode root(std::vector<std::shared_ptr<const VectorNode>>{root_});
+    return new PersistentVector(VectorSet(root, shift_ + TRIE_BITS, size_, obj),
+        shift_ + TRIE_BITS, size_ + 1);
+  }
+  return new PersistentVector(VectorSet(*root_, shift_, size_, obj), shift_, size_ + 1);
+}
+
+std::string PersistentVector::Inspect() const {
+  std::string result = "[";
+
+  for (size_t i = 0; i < size_; i++) {
+    if (i > 0) {
+      result.append(", ");
+    }
+    result.append(Get(i)->Inspect());
+  }
+
+  result.append("]");
+
+  return result;
+}
+
+struct MapNode {
+  // a key and its value, or a child holding every key whose hash continues
+  // from this slot
+  struct Entry {
+    Object* key;
+    Object* value;
+    size_t hash;
+    std::shared_ptr<const MapNode> child;
+  };
+
+  // slots in use, an entry for each set bit in bit order; a collision node
+  // has no bitmap and only pairs, whose keys all share one hash
+  uint32_t bitmap;
+  bool collision;
+  std::vector<Entry> entries;
+
+  MapNode(uint32_t bitmap, bool collision, std::vector<Entry> entries) :
+    bitmap(bitmap), collision(collision), entries(std::move(entries)) {
+    for (const Entry& e : this->entries) {
+      if (e.child == nullptr) {
+        e.key->AddRef();
+        e.value->AddRef();
+      }
+    }
+  }
+
+  ~MapNode() {
+    for (const Entry& e : entries) {
+      if (e.child == nullptr) {
+        ReleaseShared(e.key);
+        ReleaseShared(e.value);
+      }
+    }
+  }
+
+  static inline uint32_t Bit(size_t hash, int shift) {
+    return 1u << ((hash >> shift) & (TRIE_WIDTH - 1));
+  }
+
+  inline size_t Index(uint32_t bit) const {
+    return __builtin_popcount(bitmap & (bit - 1));
+  }
+};
+
+// a node at shift holding the pairs a and b, whose keys differ
+static std::shared_ptr<const MapNode> MapPair(int shift, const MapNode::Entry& a,
+    const MapNode::Entry& b) {
+  if (a.hash == b.hash) {
+    return std::make_shared<MapNode>(0, true, std::vector<MapNode::Entry>{a, b});
+  }
+
+  size_t slotA = (a.hash >> shift) & (TRIE_WIDTH - 1);
+  size_t slotB = (b.hash >> shift) & (TRIE_WIDTH - 1);
+  if (slotA == slotB) {
+    MapNode::Entry child = {nullptr, nullptr, a.hash, MapPair(shift + TRIE_BITS, a, b)};
+    return std::make_shared<MapNode>(1u << slotA, false, std::vector<MapNode::Entry>{child});
+  }
+
+  std::vector<MapNode::Entry> entries = slotA < slotB
+    ? std::vector<MapNode::Entry>{a, b} : std::vector<MapNode::Entry>{b, a};
+  return std::make_shared<MapNode>((1u << slotA) | (1u << slotB), false, std::move(entries));
+}
+
+// a copy of the subtree at node with pair bound, added telling whether its
+// key is new
+static std::shared_ptr<const MapNode> MapAssoc(const std::shared_ptr<const MapNode>& node,
+    int shift, const MapNode::Entry& pair, bool& added) {
+  if (node->collision) {
+    if (node->entries[0].hash != pair.hash) {
+      // a key of another hash gets here: the colliding keys move a level down
+      MapNode::Entry child = {nullptr, nullptr, node->entries[0].hash, node};
+      uint32_t bit = MapNode::Bit(child.hash, shift);
+      auto parent = std::make_shared<MapNode>(bit, false, std::vector<MapNode::Entry>{child});
+      return MapAssoc(parent, shift, pair, added);
+    }
+
+    std::vector<MapNode::Entry> entries = node->entries;
+    for (MapNode::Entry& e : entries) {
+      if (KeyEquals(e.key, pair.key)) {
+        e.value = pair.value;
+        return std::make_shared<MapNode>(0, true, std::move(entries));
+      }
+    }
+    entries.push_back(pair);
+    added = true;
+    return std::make_shared<MapNode>(0, true, std::move(entries));
+  }
+
+  uint32_t bit = MapNode::Bit(pair.hash, shift);
+  size_t index = node->Index(bit);
+  std::vector<MapNode::Entry> entries = node->entries;
+  if ((node->bitmap & bit) == 0) {
+    entries.insert(entries.begin() + index, pair);
+    added = true;
+    return std::make_shared<MapNode>(node->bitmap | bit, false, std::move(entries));
+  }
+
+  MapNode::Entry& e = entries[index];
+  if (e.child != nullptr) {
+    e.child = MapAssoc(e.child, shift + TRIE_BITS, pair, added);
+  } else if (e.hash == pair.hash && KeyEquals(e.key, pair.key)) {
+    e.value = pair.value;
+  } else {
+    e = {nullptr, nullptr, e.hash, MapPair(shift + TRIE_BITS, e, pair)};
+    added = true;
+  }
+  return std::make_shared<MapNode>(node->bitmap, false, std::move(entries));
+}
+
+// a copy of the subtree at node without key, nullptr once it is empty;
+// node itself when key is not in it
+static std::shared_ptr<const MapNode> MapDissoc(const std::shared_ptr<const MapNode>& node,
+    int shift, const Object* key, size_t hash) {
+  std::vector<MapNode::Entry> entries = node->entries;
+  uint32_t bitmap = node->bitmap;
+  size_t index = 0;
+  if (node->collision) {
+    while (index < entries.size() && !KeyEquals(entries[index].key, key)) {
+      index++;
+    }
+    if (index == entries.size()) {
+      return node;
+    }
+  } else {
+    uint32_t bit = MapNode::Bit(hash, shift);
+    if ((bitmap & bit) == 0) {
+      return node;
+    }
+
+    index = node->Index(bit);
+    MapNode::Entry& e = entries[index];
+    if (e.child != nullptr) {
+      std::shared_ptr<const MapNode> child = MapDissoc(e.child, shift + TRIE_BITS, key, hash);
+      if (child == e.child) {
+        return node;
+      }
+      // a child left with one pair gives it back to this level
+      if (child != nullptr && child->entries.size() == 1 && child->entries[0].child == nullptr) {
+        e = child->entries[0];
+      } else {
+        e.child = child;
+      }
+      if (child != nullptr) {
+        return std::make_shared<MapNode>(bitmap, false, std::move(entries));
+      }
+    } else if (e.hash != hash || !KeyEquals(e.key, key)) {
+      return node;
+    }
+    bitmap &= ~bit;
+  }
+
+  entries.erase(entries.begin() + index);
+  if (entries.empty()) {
+    return nullptr;
+  }
+  return std::make_shared<MapNode>(bitmap, node->collision, std::move(entries));
+}
+
+// calls fn on every pair under node, in hash order
+static void MapEach(const MapNode* node, const std::function<void(const MapNode::Entry&)>& fn) {
+  for (const MapNode::Entry& e : node->entries) {
+    if (e.child != nullptr) {
+      MapEach(e.child.get(), fn);
+    } else {
+      fn(e);
+    }
+  }
+}
+
+Object* PersistentMap::Get(const Object* key) const {
+  size_t hash = KeyHash(key);
+  const MapNode* node = root_.get();
+  for (int shift = 0; node != nullptr; shift += TRIE_BITS) {
+    if (node->collision) {
+      for (const MapNode::Entry& e : node->entries) {
+        if (e.hash == hash && KeyEquals(e.key, key)) {
+          return e.value;
+        }
+      }
+      return nullptr;
+    }
+
+    uint32_t bit = MapNode::Bit(hash, shift);
+    if ((node->bitmap & bit) == 0) {
+      return nullptr;
+    }
+    const MapNode::Entry& e = node->entries[node->Index(bit)];
+    if (e.child == nullptr) {
+      return e.hash == hash && KeyEquals(e.key, key) ? e.value : nullptr;
+    }
+    node = e.child.get();
+  }
+  return nullptr;
+}
+
+PersistentMap* PersistentMap::Assoc(Object* key, Object* value) const {
+  MapNode::Entry pair = {key, value, KeyHash(key), nullptr};
+  if (root_ == nullptr) {
+    return new PersistentMap(std::make_shared<MapNode>(
+          MapNode::Bit(pair.hash, 0), false, std::vector<MapNode::Entry>{pair}), 1);
+  }
+
+  bool added = false;
+  std::shared_ptr<const MapNode> root = MapAssoc(root_, 0, pair, added);
+  return new PersistentMap(root, added ? size_ + 1 : size_);
+}
+
+PersistentMap* PersistentMap::Dissoc(const Object* key) const {
+  if (root_ == nullptr) {
+    return new PersistentMap();
+  }
+
+  std::shared_ptr<const MapNode> root = MapDissoc(root_, 0, key, KeyHash(key));
+  return new PersistentMap(root, root == root_ ? size_ : size_ - 1);
+}
+
+std::vector<Object*> PersistentMap::Keys() const {
+  std::vector<Object*> keys;
+  keys.reserve(size_);
+  if (root_ != nullptr) {
+    MapEach(root_.get(), [&keys](const MapNode::Entry& e) { keys.push_back(e.key); });
+  }
+  return keys;
+}
+
+std::vector<Object*> PersistentMap::Values() const {
+  std::vector<Object*> values;
+  values.reserve(size_);
+  if (root_ != nullptr) {
+    MapEach(root_.get(), [&values](const MapNode::Entry& e) { values.push_back(e.value); });
+  }
+  return values;
+}
+
+std::string PersistentMap::Inspect() const {
+  std::string result = "{";
+
+  bool first = true;
+  if (root_ != nullptr) {
+    MapEach(root_.get(), [&result, &first](const MapNode::Entry& e) {
+      if (!first) {
+        result.append(", ");
+      }
+      result.append(e.key->Inspect() + ": " + e.value->Inspect());
+      first = false;
+    });
+  }
+
+  result.append("}");
+
+  return result;
+}
+
+
+/*
+  queues
+*/
+
+PriorityQueue::PriorityQueue(Object* cmp) : cmp_(cmp), busy_(false) {
+  if (cmp_ != nullptr) {
+    cmp_->AddRef();
+  }
+}
+
+bool PriorityQueue::Before_(Object* a, Object* b, const BuiltInCallback& call, Object*& err) {
+  if (cmp_ != nullptr) {
+    Object* result = call(cmp_, {a, b});
+    if (result != nullptr && result->Type() == ObjectType::ERROR_OBJ) {
+      err = result;
+      return false;
+    }
+    if (result == nullptr || result->Type() == ObjectType::NULL_OBJ) {
+      return false;
+    }
+    return result->Type() != ObjectType::BOOLEAN_OBJ || static_cast<Boolean*>(result)->GetValue();
+  }
+
+  if (a->Type() == ObjectType::INTEGER_OBJ && b->Type() == ObjectType::INTEGER_OBJ) {
+    return static_cast<Integer*>(a)->GetValue() < static_cast<Integer*>(b)->GetValue();
+  }
+  if (a->Type() == ObjectType::STRING_OBJ && b->Type() == ObjectType::STRING_OBJ) {
+    return static_cast<String*>(a)->GetValue() < static_cast<String*>(b)->GetValue();
+  }
+
+  char buff[128];
+  snprintf(buff, sizeof(buff), "cannot order %s and %s without a comparator",
+      Object::ObjectTypeStr(a->Type()).c_str(), Object::ObjectTypeStr(b->Type()).c_str());
+  err = Tracked(new Error(std::string(buff)));
+  return false;
+}
+
+Object* PriorityQueue::SiftUp_(size_t i, const BuiltInCallback& call) {
+  Object* err = nullptr;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!Before_(heap_[i], heap_[parent], call, err)) {
+      break;
+    }
+    std::swap(heap_[i], heap_[parent]);
+    i = parent;
+  }
+  return err;
+}
+
+Object* PriorityQueue::SiftDown_(size_t i, const BuiltInCallback& call) {
+  Object* err = nullptr;
+  while (true) {
+    size_t least = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < heap_.size() && Before_(heap_[left], heap_[least], call, err)) {
+      least = left;
+    }
+    if (err == nullptr && right < heap_.size() && Before_(heap_[right], heap_[least], call, err)) {
+      least = right;
+    }
+    if (err != nullptr || least == i) {
+      break;
+    }
+    std::swap(heap_[i], heap_[least]);
+    i = least;
+  }
+  return err;
+}
+
+Object* PriorityQueue::Push(Object* obj, const BuiltInCallback& call) {
+  if (busy_) {
+    return Tracked(new Error(std::string("pqueue changed by its own comparator")));
+  }
+
+  obj->AddRef();
+  heap_.push_back(obj);
+  // the comparator may collect garbage, which must spare this queue even
+  // when nothing else references it
+  AddRef();
+  busy_ = true;
+  Object* err = SiftUp_(heap_.size() - 1, call);
+  busy_ = false;
+  SubtractRef();
+  return err;
+}
+
+Object* PriorityQueue::Pop(Object*& top, const BuiltInCallback& call) {
+  top = nullptr;
+  if (busy_) {
+    return Tracked(new Error(std::string("pqueue changed by its own comparator")));
+  }
+  if (heap_.empty()) {
+    return nullptr;
+  }
+
+  top = heap_[0];
+  heap_[0] = heap_.back();
+  heap_.pop_back();
+  // top keeps its reference until the comparator is done with the queue
+  AddRef();
+  busy_ = true;
+  Object* err = heap_.empty() ? nullptr : SiftDown_(0, call);
+  busy_ = false;
+  SubtractRef();
+  top->SubtractRef();
+  return err;
+}
+
+void PriorityQueue::ReleaseElements() {
+  for (Object* obj : heap_) {
+    obj->SubtractRef();
+  }
+  if (cmp_ != nullptr) {
+    cmp_->SubtractRef();
+  }
+}
+
+std::string PriorityQueue::Inspect() const {
+  std::string result = "pqueue[";
+
+  for (size_t i = 0; i < heap_.size(); i++) {
+    if (i > 0) {
+      result.append(", ");
+    }
+    result.append(heap_[i]->Inspect());
+  }
+
+  result.append("]");
+
+  return result;
+}
+
+void Deque::Grow_() {
+  std::vector<Object*> slots(slots_.size() * 2, nullptr);
+  for (size_t i = 0; i < size_; i++) {
+    slots[i] = Get(i);
+  }
+  slots_.swap(slots);
+  head_ = 0;
+}
+
+void Deque::PushFront(Object* obj) {
+  if (size_ == slots_.size()) {
+    Grow_();
+  }
+  obj->AddRef();
+  head_ = (head_ - 1) & (slots_.size() - 1);
+  slots_[head_] = obj;
+  size_++;
+}
+
+void Deque::PushBack(Object* obj) {
+  if (size_ == slots_.size()) {
+    Grow_();
+  }
+  obj->AddRef();
+  slots_[(head_ + size_) & (slots_.size() - 1)] = obj;
+  size_++;
+}
+
+Object* Deque::PopFront() {
+  if (size_ == 0) {
+    return nullptr;
+  }
+  Object* obj = slots_[head_];
+  slots_[head_] = nullptr;
+  head_ = (head_ + 1) & (slots_.size() - 1);
+  size_--;
+  obj->SubtractRef();
+  return obj;
+}
+
+Object* Deque::PopBack() {
+  if (size_ == 0) {
+    return nullptr;
+  }
+  size_t last = (head_ + size_ - 1) & (slots_.size() - 1);
+  Object* obj = slots_[last];
+  slots_[last] = nullptr;
+  size_--;
+  obj->SubtractRef();
+  return obj;
+}
+
+void Deque::ReleaseElements() {
+  for (size_t i = 0; i < size_; i++) {
+    Get(i)->SubtractRef();
+  }
+}
+
+std::string Deque::Inspect() const {
+  std::string result = "deque[";
+
+  for (size_t i = 0; i < size_; i++) {
+    if (i > 0) {
       result.append(", ");
     }
+    result.append(Get(i)->Inspect());
   }
 
   result.append("]");
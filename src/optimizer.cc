@@ -0,0 +1,1484 @@
+#include <optimizer.h>
+#include <object.h>
+#include <algorithm>
+#include <climits>
+
+Optimizer::Optimizer() : incremental_(false), hoistCount_(0), cseCount_(0) {
+  // empty
+}
+
+std::shared_ptr<Program> Optimizer::Optimize(std::shared_ptr<Program> program) {
+  declCounts_.clear();
+  assigned_.clear();
+  scopes_.clear();
+  hoistCount_ = 0;
+  cseCount_ = 0;
+  expanding_.clear();
+  inlineReport_.clear();
+  bound_.clear();
+
+  if (program == nullptr) {
+    return program;
+  }
+
+  CollectBindings_(program);
+  program->SetStatements(OptimizeStatements_(program->GetStatements()));
+
+  // last, so single expression functions are still whole when inlined
+  EliminateCommonIn_(program);
+
+  return program;
+}
+
+/*
+================================================
+PRIVATE METHODS
+================================================
+*/
+
+/*
+  binding analysis
+*/
+
+void Optimizer::CollectBindings_(std::shared_ptr<Node> node) {
+  if (node == nullptr) {
+    return;
+  }
+
+  if (auto program = std::dynamic_pointer_cast<Program>(node)) {
+    for (const auto& stmt : program->GetStatements()) {
+      CollectBindings_(stmt);
+    }
+  }
+  else if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      CollectBindings_(stmt);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    CollectBindings_(es->GetExpression());
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    if (vs->GetName() != nullptr) {
+      declCounts_[vs->GetName()->GetValue()]++;
+    }
+    CollectBindings_(vs->GetValue());
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    CollectBindings_(rs->GetReturnVal());
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(node)) {
+    CollectBindings_(fs->GetVarStmt());
+    CollectBindings_(fs->GetCondition());
+    CollectBindings_(fs->GetAfterAction());
+    CollectBindings_(fs->GetBlock());
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    CollectBindings_(pe->GetRight());
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    CollectBindings_(ie->GetLeft());
+    CollectBindings_(ie->GetRight());
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    CollectBindings_(ifExp->GetCondition());
+    CollectBindings_(ifExp->GetConsequence());
+    CollectBindings_(ifExp->GetAlternative());
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node)) {
+    for (const auto& param : fn->GetParameters()) {
+      declCounts_[param->GetValue()]++;
+    }
+    CollectBindings_(fn->GetBody());
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    CollectBindings_(call->GetFunc());
+    for (const auto& arg : call->GetArgs()) {
+      CollectBindings_(arg);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& exp : al->GetExps()) {
+      CollectBindings_(exp);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      CollectBindings_(hl->GetKeys()[i]);
+      CollectBindings_(hl->GetValues()[i]);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& exp : rl->GetValues()) {
+      CollectBindings_(exp);
+    }
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    CollectBindings_(fe->GetExp());
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    CollectBindings_(idx->GetExp());
+    CollectBindings_(idx->GetIdx());
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+    if (ident != nullptr) {
+      assigned_.insert(ident->GetValue());
+    } else {
+      CollectBindings_(ae->GetIdent());
+    }
+    CollectBindings_(ae->GetNewVal());
+  }
+}
+
+// a name can be propagated only if nothing else could ever be bound to it
+bool Optimizer::IsConstantName_(const std::string& name) const {
+  if (incremental_) {
+    return false;
+  }
+  auto it = declCounts_.find(name);
+  return it != declCounts_.end() && it->second == 1 && assigned_.count(name) == 0;
+}
+
+/*
+  statements
+*/
+
+std::vector<std::shared_ptr<Statement>> Optimizer::OptimizeStatements_(
+    const std::vector<std::shared_ptr<Statement>>& stmts) {
+  std::vector<std::shared_ptr<Statement>> out;
+  scopes_.emplace_back();
+
+  for (size_t i = 0; i < stmts.size(); i++) {
+    if (OptimizeStatement_(stmts[i], i + 1 == stmts.size(), out)) {
+      // everything after an unconditional return is unreachable
+      break;
+    }
+  }
+
+  scopes_.pop_back();
+  return out;
+}
+
+// appends the optimized form of stmt to out, returns true if stmt always returns
+bool Optimizer::OptimizeStatement_(std::shared_ptr<Statement> stmt, bool last,
+    std::vector<std::shared_ptr<Statement>>& out) {
+  if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    rs->SetReturnVal(Fold_(rs->GetReturnVal()));
+    if (std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal()) == nullptr) {
+      // the call in tail position may have been inlined away
+      rs->SetTailCall(false);
+    }
+    out.push_back(rs);
+    return true;
+  }
+
+  if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    OptimizeVarStatement_(vs);
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(stmt)) {
+    OptimizeForStatement_(fs);
+  }
+  else if (auto block = std::dynamic_pointer_cast<BlockStatement>(stmt)) {
+    OptimizeBlock_(block);
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    auto ie = std::dynamic_pointer_cast<IfExpression>(es->GetExpression());
+    if (ie != nullptr) {
+      ie->SetCondition(Fold_(ie->GetCondition()));
+    }
+
+    if (ie != nullptr && IsLiteral_(ie->GetCondition())) {
+      // if blocks share the enclosing scope, so the taken branch can be
+      // spliced straight into the surrounding statement list
+      std::shared_ptr<BlockStatement> taken = IsTruthyLiteral_(ie->GetCondition())
+        ? ie->GetConsequence() : ie->GetAlternative();
+      size_t before = out.size();
+
+      if (taken != nullptr) {
+        std::vector<std::shared_ptr<Statement>> inner = taken->GetStatements();
+        for (size_t i = 0; i < inner.size(); i++) {
+          if (OptimizeStatement_(inner[i], last && i + 1 == inner.size(), out)) {
+            return true;
+          }
+        }
+      }
+
+      // a trailing if still decides the value of its block when it yields nothing
+      if (out.size() > before || !last) {
+        return false;
+      }
+    } else {
+      es->SetExpression(Fold_(es->GetExpression()));
+    }
+  }
+
+  out.push_back(stmt);
+  return false;
+}
+
+void Optimizer::OptimizeBlock_(std::shared_ptr<BlockStatement> block) {
+  if (block == nullptr) {
+    return;
+  }
+
+  block->SetStatements(OptimizeStatements_(block->GetStatements()));
+}
+
+void Optimizer::OptimizeVarStatement_(std::shared_ptr<VarStatement> stmt) {
+  if (stmt == nullptr) {
+    return;
+  }
+
+  std::shared_ptr<Expression> value = Fold_(stmt->GetValue());
+  stmt->SetValue(value);
+
+  if (stmt->GetName() == nullptr) {
+    return;
+  }
+
+  const std::string& name = stmt->GetName()->GetValue();
+  OptimizerScope& scope = scopes_.back();
+  scope.declared.insert(name);
+
+  // later statements of this scope may use the literal or the body directly
+  if (!IsConstantName_(name)) {
+    return;
+  }
+
+  auto fn = std::dynamic_pointer_cast<FunctionLiteral>(value);
+  if (IsLiteral_(value)) {
+    scope.constants[name] = value;
+  } else if (fn != nullptr && IsInlinable_(name, fn)) {
+    scope.inlinable[name] = fn;
+  }
+}
+
+void Optimizer::OptimizeForStatement_(std::shared_ptr<ForStatement> fs) {
+  // the loop variable lives in its own scope around the condition and body
+  scopes_.emplace_back();
+
+  OptimizeVarStatement_(fs->GetVarStmt());
+  fs->SetCondition(Fold_(fs->GetCondition()));
+  fs->SetAfterAction(Fold_(fs->GetAfterAction()));
+  OptimizeBlock_(fs->GetBlock());
+
+  scopes_.pop_back();
+
+  // inner loops are done first, so their hoisted values can move further out
+  HoistInvariants_(fs);
+}
+
+/*
+  expressions
+*/
+
+std::shared_ptr<Expression> Optimizer::Fold_(std::shared_ptr<Expression> exp) {
+  if (exp == nullptr) {
+    return exp;
+  }
+
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    std::shared_ptr<Expression> constant = LookupConstant_(ident);
+    return constant != nullptr ? constant : exp;
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    pe->SetRight(Fold_(pe->GetRight()));
+    return FoldPrefix_(pe);
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    ie->SetLeft(Fold_(ie->GetLeft()));
+    ie->SetRight(Fold_(ie->GetRight()));
+    return FoldInfix_(ie);
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    // if blocks are treated as scopes: a var inside may never have been bound
+    ifExp->SetCondition(Fold_(ifExp->GetCondition()));
+    OptimizeBlock_(ifExp->GetConsequence());
+    OptimizeBlock_(ifExp->GetAlternative());
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(exp)) {
+    DeclareFunction_(fn);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    call->SetFunc(Fold_(call->GetFunc()));
+    std::vector<std::shared_ptr<Expression>> args = call->GetArgs();
+    for (auto& arg : args) {
+      arg = Fold_(arg);
+    }
+    call->SetArgs(args);
+    return Inline_(call);
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> exps = al->GetExps();
+    for (auto& elem : exps) {
+      elem = Fold_(elem);
+    }
+    al->SetExps(exps);
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> keys = hl->GetKeys();
+    std::vector<std::shared_ptr<Expression>> values = hl->GetValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+      keys[i] = Fold_(keys[i]);
+      values[i] = Fold_(values[i]);
+    }
+    hl->SetKeys(keys);
+    hl->SetValues(values);
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> values = rl->GetValues();
+    for (auto& value : values) {
+      value = Fold_(value);
+    }
+    rl->SetValues(values);
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    fe->SetExp(Fold_(fe->GetExp()));
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    idx->SetExp(Fold_(idx->GetExp()));
+    idx->SetIdx(Fold_(idx->GetIdx()));
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    ae->SetNewVal(Fold_(ae->GetNewVal()));
+  }
+
+  return exp;
+}
+
+std::shared_ptr<Expression> Optimizer::FoldPrefix_(std::shared_ptr<PrefixExpression> exp) {
+  std::string op = exp->TokenLiteral();
+  std::shared_ptr<Expression> right = exp->GetRight();
+
+  if (op.compare("!") == 0) {
+    if (auto boolean = std::dynamic_pointer_cast<BooleanExpression>(right)) {
+      return NewBoolean_(!boolean->GetValue());
+    }
+    if (IsLiteral_(right)) {
+      // integers and strings are always truthy
+      return NewBoolean_(false);
+    }
+  }
+  else if (op.compare("-") == 0) {
+    if (auto integer = std::dynamic_pointer_cast<IntegerLiteral>(right)) {
+      return NewInteger_(static_cast<long>(0UL - static_cast<unsigned long>(integer->GetValue())));
+    }
+  }
+
+  return exp;
+}
+
+std::shared_ptr<Expression> Optimizer::FoldInfix_(std::shared_ptr<InfixExpression> exp) {
+  std::string op = exp->GetOp();
+  std::shared_ptr<Expression> left = exp->GetLeft();
+  std::shared_ptr<Expression> right = exp->GetRight();
+
+  auto leftInt = std::dynamic_pointer_cast<IntegerLiteral>(left);
+  auto rightInt = std::dynamic_pointer_cast<IntegerLiteral>(right);
+  if (leftInt != nullptr && rightInt != nullptr) {
+    long l = leftInt->GetValue();
+    long r = rightInt->GetValue();
+    // wrap around like the evaluator's machine arithmetic does
+    unsigned long ul = static_cast<unsigned long>(l);
+    unsigned long ur = static_cast<unsigned long>(r);
+
+    if (op.compare("+") == 0) {
+      return NewInteger_(static_cast<long>(ul + ur));
+    } else if (op.compare("-") == 0) {
+      return NewInteger_(static_cast<long>(ul - ur));
+    } else if (op.compare("*") == 0) {
+      return NewInteger_(static_cast<long>(ul * ur));
+    } else if (op.compare("/") == 0) {
+      // leave traps to run time
+      if (r == 0 || (l == LONG_MIN && r == -1)) {
+        return exp;
+      }
+      return NewInteger_(l / r);
+    } else if (op.compare("<") == 0) {
+      return NewBoolean_(l < r);
+    } else if (op.compare(">") == 0) {
+      return NewBoolean_(l > r);
+    } else if (op.compare("==") == 0) {
+      return NewBoolean_(l == r);
+    } else if (op.compare("!=") == 0) {
+      return NewBoolean_(l != r);
+    }
+    return exp;
+  }
+
+  auto leftStr = std::dynamic_pointer_cast<StringLiteral>(left);
+  auto rightStr = std::dynamic_pointer_cast<StringLiteral>(right);
+  if (leftStr != nullptr && rightStr != nullptr) {
+    // every other string operator is a run time error
+    if (op.compare("+") == 0) {
+      return NewString_(leftStr->TokenLiteral() + rightStr->TokenLiteral());
+    }
+    return exp;
+  }
+
+  auto leftBool = std::dynamic_pointer_cast<BooleanExpression>(left);
+  auto rightBool = std::dynamic_pointer_cast<BooleanExpression>(right);
+  if (leftBool != nullptr && rightBool != nullptr) {
+    if (op.compare("==") == 0) {
+      return NewBoolean_(leftBool->GetValue() == rightBool->GetValue());
+    } else if (op.compare("!=") == 0) {
+      return NewBoolean_(leftBool->GetValue() != rightBool->GetValue());
+    }
+  }
+
+  return exp;
+}
+
+std::shared_ptr<Expression> Optimizer::LookupConstant_(std::shared_ptr<Identifier> ident) const {
+  for (auto it = scopes_.rbegin(); it != scopes_.rend(); it++) {
+    auto found = it->constants.find(ident->GetValue());
+    if (found != it->constants.end()) {
+      return CopyLiteral_(found->second);
+    }
+  }
+
+  return nullptr;
+}
+
+// the body of a function literal is a scope of its own, opened by its parameters
+void Optimizer::DeclareFunction_(std::shared_ptr<FunctionLiteral> fn) {
+  scopes_.emplace_back();
+  for (const auto& param : fn->GetParameters()) {
+    scopes_.back().declared.insert(param->GetValue());
+  }
+
+  OptimizeBlock_(fn->GetBody());
+  scopes_.pop_back();
+}
+
+bool Optimizer::IsVisible_(const std::string& name) const {
+  for (const auto& scope : scopes_) {
+    if (scope.declared.count(name) > 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+  inlining
+*/
+
+// the expression a single statement function evaluates to, or nullptr
+std::shared_ptr<Expression> Optimizer::InlineBody_(std::shared_ptr<FunctionLiteral> fn) const {
+  std::shared_ptr<BlockStatement> body = fn->GetBody();
+  if (body == nullptr || body->GetStatements().size() != 1) {
+    return nullptr;
+  }
+
+  std::shared_ptr<Statement> stmt = body->GetStatements()[0];
+  if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    return rs->GetReturnVal();
+  }
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    return es->GetExpression();
+  }
+
+  return nullptr;
+}
+
+bool Optimizer::IsInlinable_(const std::string& name, std::shared_ptr<FunctionLiteral> fn) const {
+  std::shared_ptr<Expression> body = InlineBody_(fn);
+  if (body == nullptr) {
+    return false;
+  }
+
+  std::unordered_set<std::string> params;
+  for (const auto& param : fn->GetParameters()) {
+    if (!params.insert(param->GetValue()).second) {
+      return false;
+    }
+  }
+
+  std::vector<std::string> names;
+  int nodes = 0;
+  if (!CollectInlineNames_(body, names, nodes) || nodes > INLINE_MAX_BODY_NODES) {
+    return false;
+  }
+
+  // free names must resolve to the same binding from any call site that can
+  // see the function, which holds if nothing can rebind or shadow them
+  for (const auto& free : names) {
+    if (params.count(free) > 0 || declCounts_.count(free) == 0) {
+      continue;
+    }
+    if (free.compare(name) == 0 || !IsConstantName_(free) || !IsVisible_(free)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::shared_ptr<FunctionLiteral> Optimizer::LookupInlinable_(std::shared_ptr<Expression> callee) const {
+  auto ident = std::dynamic_pointer_cast<Identifier>(callee);
+  if (ident == nullptr) {
+    return nullptr;
+  }
+
+  for (auto it = scopes_.rbegin(); it != scopes_.rend(); it++) {
+    auto found = it->inlinable.find(ident->GetValue());
+    if (found != it->inlinable.end()) {
+      return found->second;
+    }
+  }
+
+  return nullptr;
+}
+
+std::shared_ptr<Expression> Optimizer::Inline_(std::shared_ptr<CallExpression> call) {
+  std::shared_ptr<FunctionLiteral> fn = LookupInlinable_(call->GetFunc());
+  if (fn == nullptr || expanding_.count(fn.get()) > 0) {
+    return call;
+  }
+
+  const std::vector<std::shared_ptr<Expression>>& callArgs = call->GetArgs();
+  std::vector<std::shared_ptr<Identifier>> params = fn->GetParameters();
+  if (callArgs.size() != params.size()) {
+    return call;
+  }
+
+  std::shared_ptr<Expression> body = InlineBody_(fn);
+  std::vector<std::string> names;
+  int nodes = 0;
+  CollectInlineNames_(body, names, nodes);
+
+  // every argument has to be evaluated as it would have been for the call:
+  // pure ones may be repeated, but none may be dropped
+  std::unordered_map<std::string, std::shared_ptr<Expression>> args;
+  std::unordered_map<std::string, int> uses;
+  for (size_t i = 0; i < params.size(); i++) {
+    const std::string& param = params[i]->GetValue();
+    long count = std::count(names.begin(), names.end(), param);
+    if (count == 0 || !IsEffectFree_(callArgs[i])) {
+      return call;
+    }
+    if (count > 1 && !IsLiteral_(callArgs[i])
+        && std::dynamic_pointer_cast<Identifier>(callArgs[i]) == nullptr) {
+      return call;
+    }
+
+    args[param] = callArgs[i];
+    uses[param] = 0;
+  }
+
+  std::string line = call->String();
+  if (!line.empty() && line.back() == ';') {
+    line.pop_back();
+  }
+
+  expanding_.insert(fn.get());
+  std::shared_ptr<Expression> inlined = Fold_(Substitute_(body, args, uses));
+  expanding_.erase(fn.get());
+
+  line.append(" => ");
+  line.append(inlined->String());
+  inlineReport_.push_back(line);
+
+  return inlined;
+}
+
+// collects the identifiers of an inlinable body, false if it has a node that is not
+bool Optimizer::CollectInlineNames_(std::shared_ptr<Expression> exp, std::vector<std::string>& names,
+    int& nodes) const {
+  if (exp == nullptr) {
+    return false;
+  }
+
+  nodes++;
+  if (IsLiteral_(exp)) {
+    return true;
+  }
+
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    names.push_back(ident->GetValue());
+    return true;
+  }
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    return CollectInlineNames_(pe->GetRight(), names, nodes);
+  }
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    return CollectInlineNames_(ie->GetLeft(), names, nodes)
+      && CollectInlineNames_(ie->GetRight(), names, nodes);
+  }
+  if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    return CollectInlineNames_(idx->GetExp(), names, nodes)
+      && CollectInlineNames_(idx->GetIdx(), names, nodes);
+  }
+  if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    return CollectInlineNames_(fe->GetExp(), names, nodes);
+  }
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    bool ok = CollectInlineNames_(call->GetFunc(), names, nodes);
+    for (const auto& arg : call->GetArgs()) {
+      ok = ok && CollectInlineNames_(arg, names, nodes);
+    }
+    return ok;
+  }
+  if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    bool ok = true;
+    for (const auto& elem : al->GetExps()) {
+      ok = ok && CollectInlineNames_(elem, names, nodes);
+    }
+    return ok;
+  }
+
+  // anything that binds names or holds statements stays a call
+  return false;
+}
+
+// deep copy of an inlinable body with every parameter replaced by its argument
+std::shared_ptr<Expression> Optimizer::Substitute_(std::shared_ptr<Expression> exp,
+    std::unordered_map<std::string, std::shared_ptr<Expression>>& args,
+    std::unordered_map<std::string, int>& uses) const {
+  if (IsLiteral_(exp)) {
+    return CopyLiteral_(exp);
+  }
+
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    auto found = args.find(ident->GetValue());
+    if (found == args.end()) {
+      return std::make_shared<Identifier>(ident->GetValue(), ident->GetToken());
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<Expression>> none;
+    std::unordered_map<std::string, int> noUses;
+    return uses[ident->GetValue()]++ == 0 ? found->second : Substitute_(found->second, none, noUses);
+  }
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    auto copy = std::make_shared<PrefixExpression>(pe->GetToken(), pe->TokenLiteral());
+    copy->SetRight(Substitute_(pe->GetRight(), args, uses));
+    return copy;
+  }
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    auto copy = std::make_shared<InfixExpression>(ie->GetToken(), ie->GetOp(),
+        Substitute_(ie->GetLeft(), args, uses));
+    copy->SetRight(Substitute_(ie->GetRight(), args, uses));
+    return copy;
+  }
+  if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    auto copy = std::make_shared<IndexExpression>(Substitute_(idx->GetExp(), args, uses));
+    copy->SetIdx(Substitute_(idx->GetIdx(), args, uses));
+    return copy;
+  }
+  if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    // a copy starts with a cache of its own
+    auto copy = std::make_shared<FieldExpression>(fe->GetToken(),
+        Substitute_(fe->GetExp(), args, uses));
+    copy->SetName(fe->GetName());
+    return copy;
+  }
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    auto copy = std::make_shared<CallExpression>(call->GetToken(),
+        Substitute_(call->GetFunc(), args, uses));
+    std::vector<std::shared_ptr<Expression>> callArgs;
+    for (const auto& arg : call->GetArgs()) {
+      callArgs.push_back(Substitute_(arg, args, uses));
+    }
+    copy->SetArgs(callArgs);
+    return copy;
+  }
+  if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    auto copy = std::make_shared<ArrayLiteral>(al->GetToken());
+    std::vector<std::shared_ptr<Expression>> elems;
+    for (const auto& elem : al->GetExps()) {
+      elems.push_back(Substitute_(elem, args, uses));
+    }
+    copy->SetExps(elems);
+    return copy;
+  }
+
+  return exp;
+}
+
+// no side effects: what would be invariant in a loop that changes nothing.
+// Evaluating it may still fail, so it is not safe to move past anything else
+// that can fail or has effects
+bool Optimizer::IsEffectFree_(std::shared_ptr<Expression> exp) const {
+  return IsInvariant_(exp, SideEffects());
+}
+
+/*
+  loop invariant code motion
+*/
+
+void Optimizer::HoistInvariants_(std::shared_ptr<ForStatement> fs) {
+  // the loop variable itself is bound before the hoisted values, so it only
+  // counts against invariance when the loop assigns it
+  SideEffects effects;
+  ScanEffects_(fs->GetCondition(), effects);
+  ScanEffects_(fs->GetAfterAction(), effects);
+  ScanEffects_(fs->GetBlock(), effects);
+
+  // a user function could push to any array or never return
+  if (effects.callsUserCode) {
+    return;
+  }
+
+  hoisted_.clear();
+  fs->SetCondition(Hoist_(fs->GetCondition(), effects, fs));
+  fs->SetAfterAction(Hoist_(fs->GetAfterAction(), effects, fs));
+  HoistStatements_(fs->GetBlock(), effects, fs);
+}
+
+void Optimizer::ScanEffects_(std::shared_ptr<Node> node, SideEffects& effects) const {
+  if (node == nullptr) {
+    return;
+  }
+
+  if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      ScanEffects_(stmt, effects);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    ScanEffects_(es->GetExpression(), effects);
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    if (vs->GetName() != nullptr) {
+      effects.declared.insert(vs->GetName()->GetValue());
+    }
+    ScanEffects_(vs->GetValue(), effects);
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    ScanEffects_(rs->GetReturnVal(), effects);
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(node)) {
+    ScanEffects_(fs->GetVarStmt(), effects);
+    for (const auto& stmt : fs->GetHoisted()) {
+      ScanEffects_(stmt, effects);
+    }
+    ScanEffects_(fs->GetCondition(), effects);
+    ScanEffects_(fs->GetAfterAction(), effects);
+    ScanEffects_(fs->GetBlock(), effects);
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    ScanEffects_(pe->GetRight(), effects);
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    ScanEffects_(ie->GetLeft(), effects);
+    ScanEffects_(ie->GetRight(), effects);
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    ScanEffects_(ifExp->GetCondition(), effects);
+    ScanEffects_(ifExp->GetConsequence(), effects);
+    ScanEffects_(ifExp->GetAlternative(), effects);
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node)) {
+    for (const auto& param : fn->GetParameters()) {
+      effects.declared.insert(param->GetValue());
+    }
+    ScanEffects_(fn->GetBody(), effects);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    if (IsBuiltInName_(call->GetFunc(), "push") || IsBuiltInName_(call->GetFunc(), "set")
+        || IsBuiltInName_(call->GetFunc(), "delete")
+        || IsBuiltInName_(call->GetFunc(), "dq_push_front")
+        || IsBuiltInName_(call->GetFunc(), "dq_push_back")
+        || IsBuiltInName_(call->GetFunc(), "dq_pop_front")
+        || IsBuiltInName_(call->GetFunc(), "dq_pop_back")) {
+      effects.mutatesArrays = true;
+    } else if (IsBuiltInName_(call->GetFunc(), "pq_push")
+        || IsBuiltInName_(call->GetFunc(), "pq_pop")) {
+      // and run the queue's comparator, if it has one
+      effects.mutatesArrays = true;
+      effects.callsUserCode = true;
+    } else if (!IsPureBuiltIn_(call->GetFunc())) {
+      effects.callsUserCode = true;
+    }
+    ScanEffects_(call->GetFunc(), effects);
+    for (const auto& arg : call->GetArgs()) {
+      ScanEffects_(arg, effects);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& exp : al->GetExps()) {
+      ScanEffects_(exp, effects);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      ScanEffects_(hl->GetKeys()[i], effects);
+      ScanEffects_(hl->GetValues()[i], effects);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& exp : rl->GetValues()) {
+      ScanEffects_(exp, effects);
+    }
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    ScanEffects_(fe->GetExp(), effects);
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    ScanEffects_(idx->GetExp(), effects);
+    ScanEffects_(idx->GetIdx(), effects);
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    auto ident = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+    if (ident != nullptr) {
+      effects.assigned.insert(ident->GetValue());
+    } else {
+      ScanEffects_(ae->GetIdent(), effects);
+    }
+    ScanEffects_(ae->GetNewVal(), effects);
+  }
+}
+
+/*
+ * free of side effects and of the same value on every iteration of a loop
+ * with the given effects. It can still fail, on an unbound name or operands
+ * of the wrong type, which is harmless for hoisting only because a for loop
+ * drops the errors its parts produce, hoisted ones included; what it rules
+ * out is a division that could bring the whole process down
+ */
+bool Optimizer::IsInvariant_(std::shared_ptr<Expression> exp, const SideEffects& effects) const {
+  if (exp == nullptr) {
+    return false;
+  }
+
+  if (IsLiteral_(exp)) {
+    return true;
+  }
+
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    const std::string& name = ident->GetValue();
+    return effects.declared.count(name) == 0 && effects.assigned.count(name) == 0;
+  }
+
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    return pe->TokenLiteral().compare("!") == 0 && IsInvariant_(pe->GetRight(), effects);
+  }
+
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    if (ie->GetOp().compare("/") == 0) {
+      // integer division traps the process unless the divisor is known to be safe
+      auto divisor = std::dynamic_pointer_cast<IntegerLiteral>(ie->GetRight());
+      if (divisor == nullptr || divisor->GetValue() == 0 || divisor->GetValue() == -1) {
+        return false;
+      }
+    }
+    return IsInvariant_(ie->GetLeft(), effects) && IsInvariant_(ie->GetRight(), effects);
+  }
+
+  // array contents only stay put if nothing in the loop pushes
+  if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    return !effects.mutatesArrays && IsInvariant_(idx->GetExp(), effects)
+      && IsInvariant_(idx->GetIdx(), effects);
+  }
+
+  // records never change once built
+  if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    return IsInvariant_(fe->GetExp(), effects);
+  }
+
+  if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    return !effects.mutatesArrays && IsBuiltInName_(call->GetFunc(), "len")
+      && call->GetArgs().size() == 1 && IsInvariant_(call->GetArgs()[0], effects);
+  }
+
+  return false;
+}
+
+// true if exp names a builtin declared pure that nothing in the program rebinds
+bool Optimizer::IsPureBuiltIn_(std::shared_ptr<Expression> exp) const {
+  auto ident = std::dynamic_pointer_cast<Identifier>(exp);
+  if (ident == nullptr) {
+    return false;
+  }
+
+  const BuiltIn* builtIn = FindBuiltIn(ident->GetValue());
+  return builtIn != nullptr && builtIn->IsPure() && IsBuiltInName_(exp, ident->GetValue());
+}
+
+// true if exp names the builtin called name and nothing in the program rebinds it
+bool Optimizer::IsBuiltInName_(std::shared_ptr<Expression> exp, const std::string& name) const {
+  auto ident = std::dynamic_pointer_cast<Identifier>(exp);
+  return !incremental_ && ident != nullptr && ident->GetValue().compare(name) == 0
+    && declCounts_.count(name) == 0 && assigned_.count(name) == 0;
+}
+
+void Optimizer::HoistStatements_(std::shared_ptr<BlockStatement> block, const SideEffects& effects,
+    std::shared_ptr<ForStatement> fs) {
+  if (block == nullptr) {
+    return;
+  }
+
+  for (const auto& stmt : block->GetStatements()) {
+    HoistStatement_(stmt, effects, fs);
+  }
+}
+
+void Optimizer::HoistStatement_(std::shared_ptr<Statement> stmt, const SideEffects& effects,
+    std::shared_ptr<ForStatement> fs) {
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    es->SetExpression(Hoist_(es->GetExpression(), effects, fs));
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    vs->SetValue(Hoist_(vs->GetValue(), effects, fs));
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    rs->SetReturnVal(Hoist_(rs->GetReturnVal(), effects, fs));
+  }
+  else if (auto block = std::dynamic_pointer_cast<BlockStatement>(stmt)) {
+    HoistStatements_(block, effects, fs);
+  }
+  else if (auto inner = std::dynamic_pointer_cast<ForStatement>(stmt)) {
+    HoistStatement_(inner->GetVarStmt(), effects, fs);
+    for (const auto& hoisted : inner->GetHoisted()) {
+      HoistStatement_(hoisted, effects, fs);
+    }
+    inner->SetCondition(Hoist_(inner->GetCondition(), effects, fs));
+    inner->SetAfterAction(Hoist_(inner->GetAfterAction(), effects, fs));
+    HoistStatements_(inner->GetBlock(), effects, fs);
+  }
+}
+
+// replaces the largest invariant subexpressions of exp with loop temporaries
+std::shared_ptr<Expression> Optimizer::Hoist_(std::shared_ptr<Expression> exp,
+    const SideEffects& effects, std::shared_ptr<ForStatement> fs) {
+  if (exp == nullptr || IsLiteral_(exp) || std::dynamic_pointer_cast<Identifier>(exp) != nullptr) {
+    return exp;
+  }
+
+  if (IsInvariant_(exp, effects)) {
+    // structurally equal invariants of one loop share a temporary
+    std::string key = Key_(exp);
+    auto found = key.empty() ? hoisted_.end() : hoisted_.find(key);
+    if (found != hoisted_.end()) {
+      return std::make_shared<Identifier>(found->second,
+          std::make_shared<Token>(TokenType::IDENT, found->second));
+    }
+
+    // '$' cannot start an identifier in source, so temporaries never collide
+    std::string name = "$licm" + std::to_string(hoistCount_++);
+    auto stmt = std::make_shared<VarStatement>(std::make_shared<Token>(TokenType::VAR, "var"));
+    stmt->SetName(std::make_shared<Identifier>(name, std::make_shared<Token>(TokenType::IDENT, name)));
+    stmt->SetValue(exp);
+    fs->AddHoisted(stmt);
+    if (!key.empty()) {
+      hoisted_[key] = name;
+    }
+
+    return std::make_shared<Identifier>(name, std::make_shared<Token>(TokenType::IDENT, name));
+  }
+
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    pe->SetRight(Hoist_(pe->GetRight(), effects, fs));
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    ie->SetLeft(Hoist_(ie->GetLeft(), effects, fs));
+    ie->SetRight(Hoist_(ie->GetRight(), effects, fs));
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    ifExp->SetCondition(Hoist_(ifExp->GetCondition(), effects, fs));
+    HoistStatements_(ifExp->GetConsequence(), effects, fs);
+    HoistStatements_(ifExp->GetAlternative(), effects, fs);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    std::vector<std::shared_ptr<Expression>> args = call->GetArgs();
+    for (auto& arg : args) {
+      arg = Hoist_(arg, effects, fs);
+    }
+    call->SetArgs(args);
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> exps = al->GetExps();
+    for (auto& elem : exps) {
+      elem = Hoist_(elem, effects, fs);
+    }
+    al->SetExps(exps);
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> keys = hl->GetKeys();
+    std::vector<std::shared_ptr<Expression>> values = hl->GetValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+      keys[i] = Hoist_(keys[i], effects, fs);
+      values[i] = Hoist_(values[i], effects, fs);
+    }
+    hl->SetKeys(keys);
+    hl->SetValues(values);
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> values = rl->GetValues();
+    for (auto& value : values) {
+      value = Hoist_(value, effects, fs);
+    }
+    rl->SetValues(values);
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    fe->SetExp(Hoist_(fe->GetExp(), effects, fs));
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    idx->SetExp(Hoist_(idx->GetExp(), effects, fs));
+    idx->SetIdx(Hoist_(idx->GetIdx(), effects, fs));
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    ae->SetNewVal(Hoist_(ae->GetNewVal(), effects, fs));
+  }
+
+  // function bodies only run when called, which a hoisted loop never does
+  return exp;
+}
+
+/*
+  common subexpression elimination
+*/
+
+// rewrites every statement list under node
+void Optimizer::EliminateCommonIn_(std::shared_ptr<Node> node) {
+  if (node == nullptr) {
+    return;
+  }
+
+  auto program = std::dynamic_pointer_cast<Program>(node);
+  auto block = std::dynamic_pointer_cast<BlockStatement>(node);
+  if (program != nullptr || block != nullptr) {
+    std::vector<std::shared_ptr<Statement>> stmts =
+      program != nullptr ? program->GetStatements() : block->GetStatements();
+    std::vector<std::shared_ptr<Statement>> out;
+    std::unordered_set<std::string> outerBound = bound_;
+
+    for (const auto& stmt : stmts) {
+      // a function bound by a var can only run once the var has it
+      auto vs = std::dynamic_pointer_cast<VarStatement>(stmt);
+      if (vs != nullptr && vs->GetName() == nullptr) {
+        vs = nullptr;
+      }
+      bool fn = vs != nullptr && std::dynamic_pointer_cast<FunctionLiteral>(vs->GetValue()) != nullptr;
+      if (fn) {
+        bound_.insert(vs->GetName()->GetValue());
+      }
+      EliminateCommonIn_(stmt);
+      for (const auto& temp : EliminateCommon_(stmt)) {
+        out.push_back(temp);
+        bound_.insert(std::static_pointer_cast<VarStatement>(temp)->GetName()->GetValue());
+      }
+      out.push_back(stmt);
+      // the statements after a var only run if it bound its name
+      if (vs != nullptr && !fn) {
+        bound_.insert(vs->GetName()->GetValue());
+      }
+    }
+
+    bound_ = std::move(outerBound);
+    if (program != nullptr) {
+      program->SetStatements(out);
+    } else {
+      block->SetStatements(out);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    EliminateCommonIn_(es->GetExpression());
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    EliminateCommonIn_(vs->GetValue());
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    EliminateCommonIn_(rs->GetReturnVal());
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(node)) {
+    std::unordered_set<std::string> outerBound = bound_;
+    bound_.insert(fs->GetVarStmt()->GetName()->GetValue());
+    for (const auto& hoisted : fs->GetHoisted()) {
+      bound_.insert(hoisted->GetName()->GetValue());
+    }
+    EliminateCommonIn_(fs->GetBlock());
+    bound_ = std::move(outerBound);
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    EliminateCommonIn_(pe->GetRight());
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    EliminateCommonIn_(ie->GetLeft());
+    EliminateCommonIn_(ie->GetRight());
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    EliminateCommonIn_(ifExp->GetCondition());
+    EliminateCommonIn_(ifExp->GetConsequence());
+    EliminateCommonIn_(ifExp->GetAlternative());
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node)) {
+    EliminateCommonIn_(fn->GetBody());
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    EliminateCommonIn_(call->GetFunc());
+    for (const auto& arg : call->GetArgs()) {
+      EliminateCommonIn_(arg);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& elem : al->GetExps()) {
+      EliminateCommonIn_(elem);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      EliminateCommonIn_(hl->GetKeys()[i]);
+      EliminateCommonIn_(hl->GetValues()[i]);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& value : rl->GetValues()) {
+      EliminateCommonIn_(value);
+    }
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    EliminateCommonIn_(fe->GetExp());
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    EliminateCommonIn_(idx->GetExp());
+    EliminateCommonIn_(idx->GetIdx());
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    EliminateCommonIn_(ae->GetNewVal());
+  }
+}
+
+// temporaries to run before stmt so that each repeated pure subtree in it is
+// evaluated once; stmt is rewritten to use them
+std::vector<std::shared_ptr<Statement>> Optimizer::EliminateCommon_(std::shared_ptr<Statement> stmt) {
+  std::vector<std::shared_ptr<Statement>> out;
+
+  std::shared_ptr<Expression> exp;
+  auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt);
+  auto vs = std::dynamic_pointer_cast<VarStatement>(stmt);
+  auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt);
+  if (es != nullptr) {
+    exp = es->GetExpression();
+  } else if (vs != nullptr) {
+    exp = vs->GetValue();
+  } else if (rs != nullptr) {
+    exp = rs->GetReturnVal();
+  }
+
+  if (exp == nullptr) {
+    return out;
+  }
+
+  // subtrees must not straddle an assignment, and anything a call can reach
+  // may have its array contents changed by it
+  SideEffects effects;
+  ScanEffects_(stmt, effects);
+  effects.mutatesArrays = effects.mutatesArrays || effects.callsUserCode;
+
+  std::unordered_map<std::string, int> counts;
+  std::unordered_set<std::string> movable;
+  bool clean = true;
+  CountCommon_(exp, effects, counts, clean, movable);
+  // a temporary runs before the whole statement: one that can fail must not
+  // overtake anything that could fail first or has effects
+  for (auto& count : counts) {
+    if (movable.count(count.first) == 0) {
+      count.second = 1;
+    }
+  }
+
+  std::unordered_map<std::string, std::string> temps;
+  exp = ReplaceCommon_(exp, effects, counts, temps, out);
+
+  if (es != nullptr) {
+    es->SetExpression(exp);
+  } else if (vs != nullptr) {
+    vs->SetValue(exp);
+  } else {
+    rs->SetReturnVal(exp);
+  }
+
+  return out;
+}
+
+// structural key of a subtree, empty if it is not worth sharing
+std::string Optimizer::Key_(std::shared_ptr<Expression> exp) const {
+  if (auto integer = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    return "i" + std::to_string(integer->GetValue());
+  }
+  if (auto str = std::dynamic_pointer_cast<StringLiteral>(exp)) {
+    return "s" + std::to_string(str->TokenLiteral().size()) + ":" + str->TokenLiteral();
+  }
+  if (auto boolean = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    return boolean->GetValue() ? "t" : "f";
+  }
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    return "n" + std::to_string(ident->GetValue().size()) + ":" + ident->GetValue();
+  }
+
+  std::string left;
+  std::string right;
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    left = Key_(ie->GetLeft());
+    right = Key_(ie->GetRight());
+    return left.empty() || right.empty() ? "" : "(" + left + ie->GetOp() + right + ")";
+  }
+  if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    left = Key_(idx->GetExp());
+    right = Key_(idx->GetIdx());
+    return left.empty() || right.empty() ? "" : "[" + left + "," + right + "]";
+  }
+  if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    left = Key_(fe->GetExp());
+    return left.empty() ? "" : "(" + left + "." + fe->GetName() + ")";
+  }
+
+  return "";
+}
+
+/*
+ * counts the shareable subtrees of exp, walking it in evaluation order; clean
+ * says whether everything evaluated so far can neither fail nor have effects,
+ * and movable collects the keys whose temporary could run first anyway
+ */
+void Optimizer::CountCommon_(std::shared_ptr<Expression> exp, const SideEffects& effects,
+    std::unordered_map<std::string, int>& counts, bool& clean,
+    std::unordered_set<std::string>& movable) const {
+  if (exp == nullptr) {
+    return;
+  }
+
+  bool shareable = std::dynamic_pointer_cast<InfixExpression>(exp) != nullptr
+    || std::dynamic_pointer_cast<IndexExpression>(exp) != nullptr
+    || std::dynamic_pointer_cast<FieldExpression>(exp) != nullptr;
+  if (shareable && IsInvariant_(exp, effects)) {
+    std::string key = Key_(exp);
+    if (!key.empty() && counts[key]++ == 0 && (clean || CannotFail_(exp))) {
+      movable.insert(key);
+    }
+  }
+
+  // only subtrees every evaluation of the statement reaches are counted
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    CountCommon_(pe->GetRight(), effects, counts, clean, movable);
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    CountCommon_(ie->GetLeft(), effects, counts, clean, movable);
+    CountCommon_(ie->GetRight(), effects, counts, clean, movable);
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    CountCommon_(idx->GetExp(), effects, counts, clean, movable);
+    CountCommon_(idx->GetIdx(), effects, counts, clean, movable);
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    CountCommon_(fe->GetExp(), effects, counts, clean, movable);
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    CountCommon_(ifExp->GetCondition(), effects, counts, clean, movable);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    CountCommon_(call->GetFunc(), effects, counts, clean, movable);
+    for (const auto& arg : call->GetArgs()) {
+      CountCommon_(arg, effects, counts, clean, movable);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    for (const auto& elem : al->GetExps()) {
+      CountCommon_(elem, effects, counts, clean, movable);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      CountCommon_(hl->GetKeys()[i], effects, counts, clean, movable);
+      CountCommon_(hl->GetValues()[i], effects, counts, clean, movable);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    for (const auto& value : rl->GetValues()) {
+      CountCommon_(value, effects, counts, clean, movable);
+    }
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    CountCommon_(ae->GetNewVal(), effects, counts, clean, movable);
+  }
+
+  clean = clean && CannotFail_(exp);
+}
+
+// evaluating exp cannot fail and has no effects
+bool Optimizer::CannotFail_(std::shared_ptr<Expression> exp) const {
+  if (IsLiteral_(exp) || IsSafeInteger_(exp)) {
+    return true;
+  }
+
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    const std::string& name = ident->GetValue();
+    return bound_.count(name) > 0 || (FindBuiltIn(name) != nullptr && IsBuiltInName_(exp, name));
+  }
+
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    return pe->TokenLiteral().compare("!") == 0 && CannotFail_(pe->GetRight());
+  }
+
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    const std::string& op = ie->GetOp();
+    // any two objects can be compared for equality
+    if (op.compare("==") == 0 || op.compare("!=") == 0) {
+      return CannotFail_(ie->GetLeft()) && CannotFail_(ie->GetRight());
+    }
+    if (op.compare("<") == 0 || op.compare(">") == 0) {
+      return IsSafeInteger_(ie->GetLeft()) && IsSafeInteger_(ie->GetRight());
+    }
+  }
+
+  return false;
+}
+
+// an integer computed from literals alone, without dividing by 0 or -1
+bool Optimizer::IsSafeInteger_(std::shared_ptr<Expression> exp) {
+  if (std::dynamic_pointer_cast<IntegerLiteral>(exp) != nullptr) {
+    return true;
+  }
+
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    return pe->TokenLiteral().compare("-") == 0 && IsSafeInteger_(pe->GetRight());
+  }
+
+  if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    const std::string& op = ie->GetOp();
+    if (op.compare("/") == 0) {
+      auto divisor = std::dynamic_pointer_cast<IntegerLiteral>(ie->GetRight());
+      return divisor != nullptr && divisor->GetValue() != 0 && divisor->GetValue() != -1
+        && IsSafeInteger_(ie->GetLeft());
+    }
+    return (op.compare("+") == 0 || op.compare("-") == 0 || op.compare("*") == 0)
+      && IsSafeInteger_(ie->GetLeft()) && IsSafeInteger_(ie->GetRight());
+  }
+
+  return false;
+}
+
+// replaces the largest repeated subtrees with temporaries bound by statements in out
+std::shared_ptr<Expression> Optimizer::ReplaceCommon_(std::shared_ptr<Expression> exp,
+    const SideEffects& effects, const std::unordered_map<std::string, int>& counts,
+    std::unordered_map<std::string, std::string>& temps,
+    std::vector<std::shared_ptr<Statement>>& out) {
+  if (exp == nullptr) {
+    return exp;
+  }
+
+  std::string key = Key_(exp);
+  auto count = counts.find(key);
+  if (!key.empty() && count != counts.end() && count->second > 1) {
+    auto temp = temps.find(key);
+    if (temp == temps.end()) {
+      // '$' cannot start an identifier in source, so temporaries never collide
+      std::string name = "$cse" + std::to_string(cseCount_++);
+      auto stmt = std::make_shared<VarStatement>(std::make_shared<Token>(TokenType::VAR, "var"));
+      stmt->SetName(std::make_shared<Identifier>(name, std::make_shared<Token>(TokenType::IDENT, name)));
+      stmt->SetValue(exp);
+      out.push_back(stmt);
+      temp = temps.emplace(key, name).first;
+    }
+
+    return std::make_shared<Identifier>(temp->second,
+        std::make_shared<Token>(TokenType::IDENT, temp->second));
+  }
+
+  if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    pe->SetRight(ReplaceCommon_(pe->GetRight(), effects, counts, temps, out));
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    ie->SetLeft(ReplaceCommon_(ie->GetLeft(), effects, counts, temps, out));
+    ie->SetRight(ReplaceCommon_(ie->GetRight(), effects, counts, temps, out));
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    idx->SetExp(ReplaceCommon_(idx->GetExp(), effects, counts, temps, out));
+    idx->SetIdx(ReplaceCommon_(idx->GetIdx(), effects, counts, temps, out));
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    fe->SetExp(ReplaceCommon_(fe->GetExp(), effects, counts, temps, out));
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    ifExp->SetCondition(ReplaceCommon_(ifExp->GetCondition(), effects, counts, temps, out));
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    call->SetFunc(ReplaceCommon_(call->GetFunc(), effects, counts, temps, out));
+    std::vector<std::shared_ptr<Expression>> args = call->GetArgs();
+    for (auto& arg : args) {
+      arg = ReplaceCommon_(arg, effects, counts, temps, out);
+    }
+    call->SetArgs(args);
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> elems = al->GetExps();
+    for (auto& elem : elems) {
+      elem = ReplaceCommon_(elem, effects, counts, temps, out);
+    }
+    al->SetExps(elems);
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> keys = hl->GetKeys();
+    std::vector<std::shared_ptr<Expression>> values = hl->GetValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+      keys[i] = ReplaceCommon_(keys[i], effects, counts, temps, out);
+      values[i] = ReplaceCommon_(values[i], effects, counts, temps, out);
+    }
+    hl->SetKeys(keys);
+    hl->SetValues(values);
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> values = rl->GetValues();
+    for (auto& value : values) {
+      value = ReplaceCommon_(value, effects, counts, temps, out);
+    }
+    rl->SetValues(values);
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp)) {
+    ae->SetNewVal(ReplaceCommon_(ae->GetNewVal(), effects, counts, temps, out));
+  }
+
+  return exp;
+}
+
+/*
+  literal helpers
+*/
+
+bool Optimizer::IsLiteral_(std::shared_ptr<Expression> exp) {
+  return std::dynamic_pointer_cast<IntegerLiteral>(exp) != nullptr
+    || std::dynamic_pointer_cast<StringLiteral>(exp) != nullptr
+    || std::dynamic_pointer_cast<BooleanExpression>(exp) != nullptr;
+}
+
+bool Optimizer::IsTruthyLiteral_(std::shared_ptr<Expression> exp) {
+  auto boolean = std::dynamic_pointer_cast<BooleanExpression>(exp);
+  return boolean == nullptr || boolean->GetValue();
+}
+
+std::shared_ptr<Expression> Optimizer::CopyLiteral_(std::shared_ptr<Expression> exp) {
+  if (auto integer = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    return NewInteger_(integer->GetValue());
+  }
+  if (auto str = std::dynamic_pointer_cast<StringLiteral>(exp)) {
+    return NewString_(str->TokenLiteral());
+  }
+  if (auto boolean = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    return NewBoolean_(boolean->GetValue());
+  }
+
+  return exp;
+}
+
+std::shared_ptr<Expression> Optimizer::NewInteger_(long value) {
+  auto tok = std::make_shared<Token>(TokenType::INT, std::to_string(value));
+  auto il = std::make_shared<IntegerLiteral>(tok);
+  il->SetValue(value);
+
+  return il;
+}
+
+std::shared_ptr<Expression> Optimizer::NewString_(const std::string& value) {
+  auto tok = std::make_shared<Token>(TokenType::STRING, value);
+  return std::make_shared<StringLiteral>(tok, value);
+}
+
+std::shared_ptr<Expression> Optimizer::NewBoolean_(bool value) {
+  auto tok = std::make_shared<Token>(value ? TokenType::TRUE : TokenType::FALSE,
+      value ? "true" : "false");
+  return std::make_shared<BooleanExpression>(tok, value);
+}
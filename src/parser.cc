@@ -26,6 +26,7 @@ Parser::Parser(std::shared_ptr<Lexer> l) {
   RegisterPrefixFns_(GetParseFunctionLiteralFn_(), TokenType::FUNCTION);
   RegisterPrefixFns_(GetParseStringLiteralFn_(), TokenType::STRING);
   RegisterPrefixFns_(GetParseArrayLiteralFn_(), TokenType::LBRACKET);
+  RegisterPrefixFns_(GetParseHashLiteralFn_(), TokenType::LBRACE);
 
   RegisterInfixFns_(GetInfixExpressionFn_(), TokenType::PLUS);
   RegisterInfixFns_(GetInfixExpressionFn_(), TokenType::MINUS);
@@ -37,6 +38,7 @@ Parser::Parser(std::shared_ptr<Lexer> l) {
   RegisterInfixFns_(GetInfixExpressionFn_(), TokenType::NOT_EQ);
   RegisterInfixFns_(GetParseCallExpressionFn_(), TokenType::LPAREN);
   RegisterInfixFns_(GetParseIndexExpression_(), TokenType::LBRACKET);
+  RegisterInfixFns_(GetParseFieldExpressionFn_(), TokenType::DOT);
   RegisterInfixFns_(GetParseAssignExpressionFn_(), TokenType::ASSIGN);
 
 
@@ -288,6 +290,21 @@ std::shared_ptr<IndexExpression> Parser::ParseIndexExpression_(std::shared_ptr<E
   return exp;
 }
 
+std::shared_ptr<FieldExpression> Parser::ParseFieldExpression_(std::shared_ptr<Expression> left) {
+  auto exp = std::make_shared<FieldExpression>(curr_token_, left);
+  if (!ExpectPeek_(TokenType::IDENT)) {
+    return nullptr;
+  }
+
+  exp->SetName(curr_token_->GetLiteral());
+  return exp;
+}
+
+infixParseFn Parser::GetParseFieldExpressionFn_() {
+  infixParseFn fn = std::bind(&Parser::ParseFieldExpression_, this, std::placeholders::_1);
+  return fn;
+}
+
 infixParseFn Parser::GetParseIndexExpression_() {
   infixParseFn fn = std::bind(&Parser::ParseIndexExpression_, this, std::placeholders::_1);
   return fn;
@@ -304,6 +321,53 @@ prefixParseFn Parser::GetParseArrayLiteralFn_() {
   return fn;
 }
 
+// a record literal when every key is a bare name, a hash literal when none
+// is: a name that should be evaluated as a key goes in parentheses
+std::shared_ptr<Expression> Parser::ParseHashLiteral_() {
+  auto hash = std::make_shared<HashLiteral>(curr_token_);
+  auto record = std::make_shared<RecordLiteral>(curr_token_);
+
+  while (!PeekTokenIs_(TokenType::RBRACE)) {
+    NextToken_();
+    bool field = CurrTokenIs_(TokenType::IDENT) && PeekTokenIs_(TokenType::COLON);
+    std::string name = curr_token_->GetLiteral();
+    std::shared_ptr<Expression> key = ParseExpression_(Precedence::LOWEST);
+    if (!ExpectPeek_(TokenType::COLON)) {
+      return nullptr;
+    }
+
+    if (field ? !hash->GetKeys().empty() : !record->GetNames().empty()) {
+      errors_.push_back("record fields and hash keys cannot be mixed in one literal");
+      return nullptr;
+    }
+
+    NextToken_();
+    std::shared_ptr<Expression> value = ParseExpression_(Precedence::LOWEST);
+    if (field) {
+      record->AddField(name, value);
+    } else {
+      hash->AddPair(key, value);
+    }
+    if (!PeekTokenIs_(TokenType::RBRACE) && !ExpectPeek_(TokenType::COMMA)) {
+      return nullptr;
+    }
+  }
+
+  if (!ExpectPeek_(TokenType::RBRACE)) {
+    return nullptr;
+  }
+
+  if (!record->GetNames().empty()) {
+    return record;
+  }
+  return hash;
+}
+
+prefixParseFn Parser::GetParseHashLiteralFn_() {
+  prefixParseFn fn = std::bind(&Parser::ParseHashLiteral_, this);
+  return fn;
+}
+
 
 std::vector<std::shared_ptr<Expression>> Parser::ParseExpressionList_(TokenType end) {
   std::vector<std::shared_ptr<Expression>> args = {};
@@ -383,10 +447,40 @@ std::shared_ptr<FunctionLiteral> Parser::ParseFunctionLiteral_() {
   }
 
   function->SetBody(ParseBlockStatement_());
+  MarkTailCalls_(function->GetBody());
 
   return function;
 }
 
+/*
+  flags every `return f(...)` that ends the function, i.e. one reached only
+  through the body block and the branches of if expressions
+*/
+void Parser::MarkTailCalls_(std::shared_ptr<BlockStatement> block) {
+  if (block == nullptr) {
+    return;
+  }
+
+  for (const auto& stmt : block->GetStatements()) {
+    auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt);
+    if (rs != nullptr) {
+      rs->SetTailCall(std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal()) != nullptr);
+      continue;
+    }
+
+    auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt);
+    if (es == nullptr) {
+      continue;
+    }
+
+    auto ie = std::dynamic_pointer_cast<IfExpression>(es->GetExpression());
+    if (ie != nullptr) {
+      MarkTailCalls_(ie->GetConsequence());
+      MarkTailCalls_(ie->GetAlternative());
+    }
+  }
+}
+
 prefixParseFn Parser::GetParseFunctionLiteralFn_() {
   prefixParseFn fn = std::bind(&Parser::ParseFunctionLiteral_, this);
   return fn;
@@ -0,0 +1,248 @@
+#include <resolver.h>
+
+Resolver::Resolver() : index_(0) {
+  // empty
+}
+
+void Resolver::Resolve(std::shared_ptr<Program> program) {
+  scopes_.clear();
+  stack_.clear();
+  closures_.clear();
+  index_ = 0;
+
+  ResolverScope* global = PushScope_();
+  global->global = true;
+  for (const auto& stmt : program->GetStatements()) {
+    Resolve_(stmt);
+  }
+  stack_.pop_back();
+
+  // inlining may have put the same literal in several places: it can only
+  // copy its variables if it may do so everywhere
+  std::unordered_map<const FunctionLiteral*, bool> flat;
+  for (const auto& closure : closures_) {
+    bool copies = true;
+    for (const auto& name : closure.free) {
+      if (IsShared_(closure, name)) {
+        copies = false;
+        break;
+      }
+    }
+
+    auto it = flat.emplace(closure.fn.get(), true).first;
+    it->second = it->second && copies;
+  }
+
+  for (const auto& closure : closures_) {
+    if (flat.at(closure.fn.get())) {
+      closure.fn->SetCapture(ScopeEscape::LOCAL,
+          std::vector<std::string>(closure.free.begin(), closure.free.end()));
+    } else {
+      closure.fn->SetCapture(ScopeEscape::ESCAPES, {});
+    }
+  }
+
+  program->SetResolved();
+}
+
+/*
+  walk
+*/
+
+void Resolver::Resolve_(std::shared_ptr<Node> node) {
+  if (node == nullptr) {
+    return;
+  }
+
+  index_++;
+
+  if (auto block = std::dynamic_pointer_cast<BlockStatement>(node)) {
+    for (const auto& stmt : block->GetStatements()) {
+      Resolve_(stmt);
+    }
+  }
+  else if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(node)) {
+    Resolve_(es->GetExpression());
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(node)) {
+    Resolve_(vs->GetValue());
+    if (vs->GetName() != nullptr) {
+      Bind_(vs->GetName()->GetValue());
+    }
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(node)) {
+    Resolve_(rs->GetReturnVal());
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(node)) {
+    ResolveFor_(fs);
+  }
+  else if (auto ident = std::dynamic_pointer_cast<Identifier>(node)) {
+    Reference_(ident->GetValue());
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(node)) {
+    Resolve_(pe->GetRight());
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(node)) {
+    Resolve_(ie->GetLeft());
+    Resolve_(ie->GetRight());
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(node)) {
+    // if blocks run in the enclosing scope, but only on some paths
+    Resolve_(ifExp->GetCondition());
+    stack_.back()->conditional++;
+    Resolve_(ifExp->GetConsequence());
+    Resolve_(ifExp->GetAlternative());
+    stack_.back()->conditional--;
+  }
+  else if (auto fn = std::dynamic_pointer_cast<FunctionLiteral>(node)) {
+    ResolveFunction_(fn);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(node)) {
+    Resolve_(call->GetFunc());
+    for (const auto& arg : call->GetArgs()) {
+      Resolve_(arg);
+    }
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(node)) {
+    for (const auto& exp : al->GetExps()) {
+      Resolve_(exp);
+    }
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(node)) {
+    for (size_t i = 0; i < hl->GetKeys().size(); i++) {
+      Resolve_(hl->GetKeys()[i]);
+      Resolve_(hl->GetValues()[i]);
+    }
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(node)) {
+    for (const auto& exp : rl->GetValues()) {
+      Resolve_(exp);
+    }
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(node)) {
+    Resolve_(fe->GetExp());
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(node)) {
+    Resolve_(idx->GetExp());
+    Resolve_(idx->GetIdx());
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(node)) {
+    Resolve_(ae->GetNewVal());
+    // an assignment reads the old value, then binds the name in the
+    // scope it runs in
+    auto target = std::dynamic_pointer_cast<Identifier>(ae->GetIdent());
+    if (target != nullptr) {
+      Reference_(target->GetValue());
+      Bind_(target->GetValue());
+    } else {
+      Resolve_(ae->GetIdent());
+    }
+  }
+}
+
+void Resolver::ResolveFunction_(std::shared_ptr<FunctionLiteral> fn) {
+  ResolverClosure closure;
+  closure.fn = fn;
+  closure.index = index_;
+  for (auto it = stack_.rbegin(); it != stack_.rend(); it++) {
+    if (!(*it)->global) {
+      closure.chain.push_back(*it);
+    }
+  }
+
+  closures_.push_back(closure);
+  ResolverScope* scope = PushScope_();
+  scope->closure = static_cast<int>(closures_.size()) - 1;
+
+  for (const auto& param : fn->GetParameters()) {
+    Bind_(param->GetValue());
+  }
+  Resolve_(fn->GetBody());
+
+  stack_.pop_back();
+}
+
+void Resolver::ResolveFor_(std::shared_ptr<ForStatement> fs) {
+  ResolverScope* scope = PushScope_();
+
+  Resolve_(fs->GetVarStmt());
+  for (const auto& stmt : fs->GetHoisted()) {
+    Resolve_(stmt);
+  }
+
+  // everything from here on runs once per iteration
+  scope->inLoop = true;
+  Resolve_(fs->GetCondition());
+  Resolve_(fs->GetBlock());
+  Resolve_(fs->GetAfterAction());
+
+  stack_.pop_back();
+}
+
+/*
+  bindings
+*/
+
+// makes name free in every function literal it is looked up through
+void Resolver::Reference_(const std::string& name) {
+  for (auto it = stack_.rbegin(); it != stack_.rend(); it++) {
+    ResolverScope* scope = *it;
+    if (scope->global) {
+      return;
+    }
+
+    auto found = scope->bindings.find(name);
+    if (found != scope->bindings.end()) {
+      for (const auto& binding : found->second) {
+        if (binding.index < index_ && !binding.conditional) {
+          return;
+        }
+      }
+    }
+
+    if (scope->closure >= 0) {
+      closures_[scope->closure].free.insert(name);
+    }
+  }
+}
+
+void Resolver::Bind_(const std::string& name) {
+  ResolverScope* scope = stack_.back();
+  scope->bindings[name].push_back(
+      (ResolverBinding){.index = index_++, .conditional = scope->conditional > 0,
+      .repeated = scope->inLoop});
+}
+
+ResolverScope* Resolver::PushScope_() {
+  scopes_.emplace_back();
+  stack_.push_back(&scopes_.back());
+  return stack_.back();
+}
+
+/*
+ * a copy taken when the closure is created could differ from what a lookup
+ * at call time would find when the name is (re)bound after the literal or
+ * on every iteration of a loop around it, in any scope the lookup can reach
+ */
+bool Resolver::IsShared_(const ResolverClosure& closure, const std::string& name) const {
+  for (const ResolverScope* scope : closure.chain) {
+    auto found = scope->bindings.find(name);
+    if (found == scope->bindings.end()) {
+      continue;
+    }
+
+    bool bound = false;
+    for (const auto& binding : found->second) {
+      if (binding.index > closure.index || binding.repeated) {
+        return true;
+      }
+      bound = bound || !binding.conditional;
+    }
+
+    if (bound) {
+      return false;
+    }
+  }
+
+  return false;
+}
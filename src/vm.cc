@@ -0,0 +1,662 @@
+#include <vm.h>
+#include <stdio.h>
+
+/*
+================================================
+CHUNK
+================================================
+*/
+
+static const char* const OP_NAMES[] = {
+  "NIL", "NULL_T", "INT", "STRING", "BOOL", "NAME", "FUNCTION", "BANG", "MINUS",
+  "PREFIX", "INFIX", "ARRAY", "HASH", "RECORD", "CHECK_INDEX", "INDEX", "FIELD", "CALL",
+  "TAIL_CALL", "SET_VAR", "ASSIGN", "JUMP", "JUMP_FALSE", "JUMP_NOT_TRUE", "LOOP_ENTER",
+  "HOIST", "LOOP_EXIT", "EVAL", "RETURN", "NAME_INT", "NAME_NAME", "BRANCH_NAME_INT", "BRANCH_NAME_NAME",
+  "INC_NAME", "INC_BRANCH"
+};
+
+static_assert(sizeof(OP_NAMES) / sizeof(OP_NAMES[0]) == static_cast<size_t>(VmOp::NUM_OPS),
+    "every VmOp needs a name");
+
+// operators of the integer kinds, by InfixKind
+static const char* const KIND_OPS[] = {
+  "?", "?", "+", "-", "*", "/", "<", ">", "==", "!="
+};
+
+// "ident op operand" for a superinstruction
+static std::string FusedString(const VmInstr& instr, InfixKind kind, bool name) {
+  std::string out = " ";
+  out.append(instr.ident->GetValue()).append(" ").append(KIND_OPS[static_cast<int>(kind)]);
+  out.append(" ").append(name ? instr.ident2->GetValue() : std::to_string(instr.imm));
+  return out;
+}
+
+std::string VmChunk::String() const {
+  std::string out;
+  for (size_t i = 0; i < code_.size(); i++) {
+    const VmInstr& instr = code_[i];
+    char buff[160];
+    snprintf(buff, sizeof(buff), "%4zu %-13s dst=%d a=%d b=%d count=%d target=%d fail=%d/r%d",
+        i, OP_NAMES[static_cast<int>(instr.op)], instr.dst, instr.a, instr.b, instr.count,
+        instr.target, instr.fail, instr.failReg);
+    out.append(buff);
+    if (instr.op == VmOp::INT || instr.op == VmOp::BOOL) {
+      out.append(" ").append(std::to_string(instr.imm));
+    }
+    if (!instr.name.empty()) {
+      out.append(" ").append(instr.name);
+    }
+    if (instr.op == VmOp::NAME_INT || instr.op == VmOp::BRANCH_NAME_INT
+        || instr.op == VmOp::INC_NAME || instr.op == VmOp::INC_BRANCH) {
+      out.append(FusedString(instr, instr.kind, false));
+    } else if (instr.op == VmOp::NAME_NAME || instr.op == VmOp::BRANCH_NAME_NAME) {
+      out.append(FusedString(instr, instr.kind, true));
+    }
+    if (instr.op == VmOp::INC_BRANCH) {
+      out.append(", ").append(instr.name).append(" ").append(KIND_OPS[static_cast<int>(instr.cmp)]);
+      out.append(" ").append(instr.ident2 != nullptr ? instr.ident2->GetValue()
+          : std::to_string(instr.limit));
+      out.append(" else ").append(std::to_string(instr.alt));
+    }
+    out.append("\n");
+  }
+
+  return out;
+}
+
+/*
+================================================
+COMPILER
+================================================
+*/
+
+std::shared_ptr<VmChunk> VmCompiler::CompileBody(std::shared_ptr<BlockStatement> body) {
+  chunk_ = std::make_shared<VmChunk>();
+  int result = NewReg_();
+  int exit = NewLabel_();
+
+  boundaries_.push_back({exit, result});
+  Block_(body, result);
+  boundaries_.pop_back();
+  Bind_(exit);
+
+  return Finish_(result);
+}
+
+std::shared_ptr<VmChunk> VmCompiler::CompileFor(std::shared_ptr<ForStatement> fs) {
+  chunk_ = std::make_shared<VmChunk>();
+  int result = NewReg_();
+
+  For_(fs, result);
+
+  return Finish_(result);
+}
+
+/*
+  statements
+*/
+
+// like EvalBlockStatement_: the last statement's result, an error stops it
+void VmCompiler::Block_(std::shared_ptr<BlockStatement> block, int dst) {
+  std::vector<std::shared_ptr<Statement>> stmts = block->GetStatements();
+  if (stmts.empty()) {
+    Emit_(VmOp::NIL, dst);
+    return;
+  }
+
+  for (size_t i = 0; i < stmts.size(); i++) {
+    Statement_(stmts[i], dst, i + 1 == stmts.size());
+  }
+}
+
+void VmCompiler::Statement_(std::shared_ptr<Statement> stmt, int dst, bool last) {
+  if (auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt)) {
+    Expression_(es->GetExpression(), dst, true);
+  }
+  else if (auto vs = std::dynamic_pointer_cast<VarStatement>(stmt)) {
+    Expression_(vs->GetValue(), dst);
+    Emit_(VmOp::SET_VAR, 0, dst).name = vs->GetName()->GetValue();
+    if (last) {
+      Emit_(VmOp::NIL, dst);
+    }
+  }
+  else if (auto rs = std::dynamic_pointer_cast<ReturnStatement>(stmt)) {
+    Return_(rs);
+  }
+  else if (auto fs = std::dynamic_pointer_cast<ForStatement>(stmt)) {
+    For_(fs, dst);
+  }
+  else if (auto block = std::dynamic_pointer_cast<BlockStatement>(stmt)) {
+    Block_(block, dst);
+  }
+  else {
+    Emit_(VmOp::EVAL, dst).node = stmt;
+  }
+}
+
+/*
+ * a return leaves the chunk, unless it is in a loop body, which only stops
+ * for it (EvalForStatement_ ignores what its body evaluates to)
+ */
+void VmCompiler::Return_(std::shared_ptr<ReturnStatement> rs) {
+  int saved = regs_;
+  int reg = NewReg_();
+
+  if (!continues_.empty()) {
+    Expression_(rs->GetReturnVal(), reg);
+    Emit_(VmOp::JUMP).target = continues_.back();
+  } else if (auto call = std::dynamic_pointer_cast<CallExpression>(rs->GetReturnVal());
+      call != nullptr && rs->IsTailCall()) {
+    Call_(call, reg, true);
+    Emit_(VmOp::RETURN, 0, reg);
+  } else {
+    Expression_(rs->GetReturnVal(), reg);
+    Emit_(VmOp::RETURN, 0, reg);
+  }
+
+  regs_ = saved;
+}
+
+/*
+ * EvalForStatement_ flattened: failures in the var statement, a hoisted
+ * value, the body or the after action end just that part; a failing
+ * condition ends the loop
+ */
+void VmCompiler::For_(std::shared_ptr<ForStatement> fs, int dst) {
+  if (loopDepth_ >= VM_MAX_LOOP_DEPTH || fs->GetVarStmt() == nullptr
+      || fs->GetCondition() == nullptr || fs->GetAfterAction() == nullptr
+      || fs->GetBlock() == nullptr) {
+    Emit_(VmOp::EVAL, dst).node = fs;
+    return;
+  }
+
+  VmInstr& enter = Emit_(VmOp::LOOP_ENTER);
+  enter.imm = loopDepth_;
+  enter.loop = fs.get();
+  loopDepth_++;
+
+  int saved = regs_;
+  int scratch = NewReg_();
+
+  int afterVar = NewLabel_();
+  boundaries_.push_back({afterVar, scratch});
+  Statement_(fs->GetVarStmt(), scratch, false);
+  boundaries_.pop_back();
+  Bind_(afterVar);
+
+  for (const auto& stmt : fs->GetHoisted()) {
+    Caught_(stmt->GetValue(), scratch);
+    Emit_(VmOp::HOIST, 0, scratch).name = stmt->GetName()->GetValue();
+  }
+
+  int top = NewLabel_();
+  int exit = NewLabel_();
+  int next = NewLabel_();
+  Bind_(top);
+
+  // the loop goes on only while its condition is TRUE; a comparison of
+  // arrays makes an array, which an if would take as true
+  boundaries_.push_back({exit, scratch});
+  if (!FusedBranch_(fs->GetCondition(), exit, true)) {
+    Expression_(fs->GetCondition(), scratch);
+    Emit_(VmOp::JUMP_NOT_TRUE, 0, scratch).target = exit;
+  }
+  boundaries_.pop_back();
+
+  int body = NewLabel_();
+  Bind_(body);
+  boundaries_.push_back({next, scratch});
+  continues_.push_back(next);
+  Block_(fs->GetBlock(), scratch);
+  continues_.pop_back();
+  boundaries_.pop_back();
+  Bind_(next);
+
+  boundaries_.push_back({top, scratch});
+  if (!FusedLatch_(fs->GetAfterAction(), fs->GetCondition(), body, top, scratch)) {
+    Expression_(fs->GetAfterAction(), scratch);
+    Emit_(VmOp::JUMP).target = top;
+  }
+  boundaries_.pop_back();
+
+  Bind_(exit);
+  regs_ = saved;
+  loopDepth_--;
+  Emit_(VmOp::LOOP_EXIT, dst).imm = loopDepth_;
+}
+
+/*
+  expressions
+*/
+
+/*
+ * stmtPos is set for the expression of an expression statement, where an
+ * if's block may return from the function; everywhere else a return in an
+ * if makes a ReturnValue that is carried along as a value
+ */
+void VmCompiler::Expression_(std::shared_ptr<Expression> exp, int dst, bool stmtPos) {
+  int saved = regs_;
+
+  if (auto il = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    VmInstr& instr = Emit_(VmOp::INT, dst);
+    instr.imm = il->GetValue();
+    instr.constant = il->GetConstant();
+  }
+  else if (auto be = std::dynamic_pointer_cast<BooleanExpression>(exp)) {
+    Emit_(VmOp::BOOL, dst).imm = be->GetValue() ? 1 : 0;
+  }
+  else if (auto sl = std::dynamic_pointer_cast<StringLiteral>(exp)) {
+    VmInstr& instr = Emit_(VmOp::STRING, dst);
+    instr.name = sl->TokenLiteral();
+    instr.constant = sl->GetConstant();
+  }
+  else if (std::dynamic_pointer_cast<Identifier>(exp) != nullptr) {
+    Emit_(VmOp::NAME, dst).node = exp;
+  }
+  else if (std::dynamic_pointer_cast<FunctionLiteral>(exp) != nullptr) {
+    Emit_(VmOp::FUNCTION, dst).node = exp;
+  }
+  else if (auto pe = std::dynamic_pointer_cast<PrefixExpression>(exp)) {
+    Expression_(pe->GetRight(), dst);
+    std::string op = pe->TokenLiteral();
+    if (op == "!") {
+      Emit_(VmOp::BANG, dst, dst);
+    } else if (op == "-") {
+      Emit_(VmOp::MINUS, dst, dst);
+    } else {
+      Emit_(VmOp::PREFIX, dst, dst).node = exp;
+    }
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp);
+      ie != nullptr && FusedInfix_(ie, dst)) {
+    // emitted
+  }
+  else if (auto ie = std::dynamic_pointer_cast<InfixExpression>(exp)) {
+    Expression_(ie->GetLeft(), dst);
+    int right = NewReg_();
+    Expression_(ie->GetRight(), right);
+    Emit_(VmOp::INFIX, dst, dst, right).node = exp;
+  }
+  else if (auto ifExp = std::dynamic_pointer_cast<IfExpression>(exp)) {
+    If_(ifExp, dst, stmtPos);
+  }
+  else if (auto call = std::dynamic_pointer_cast<CallExpression>(exp)) {
+    Call_(call, dst, false);
+  }
+  else if (auto al = std::dynamic_pointer_cast<ArrayLiteral>(exp)) {
+    std::vector<std::shared_ptr<Expression>> exps = al->GetExps();
+    int base = regs_;
+    for (size_t i = 0; i < exps.size(); i++) {
+      NewReg_();
+    }
+    for (size_t i = 0; i < exps.size(); i++) {
+      Expression_(exps[i], base + i);
+    }
+    Emit_(VmOp::ARRAY, dst, base).count = exps.size();
+  }
+  else if (auto hl = std::dynamic_pointer_cast<HashLiteral>(exp)) {
+    const std::vector<std::shared_ptr<Expression>>& keys = hl->GetKeys();
+    const std::vector<std::shared_ptr<Expression>>& values = hl->GetValues();
+    int base = regs_;
+    for (size_t i = 0; i < keys.size() * 2; i++) {
+      NewReg_();
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+      Expression_(keys[i], base + 2 * i);
+      Expression_(values[i], base + 2 * i + 1);
+    }
+    Emit_(VmOp::HASH, dst, base).count = keys.size();
+  }
+  else if (auto rl = std::dynamic_pointer_cast<RecordLiteral>(exp)) {
+    const std::vector<std::shared_ptr<Expression>>& values = rl->GetValues();
+    int base = regs_;
+    for (size_t i = 0; i < values.size(); i++) {
+      NewReg_();
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      Expression_(values[i], base + i);
+    }
+    VmInstr& instr = Emit_(VmOp::RECORD, dst, base);
+    instr.count = values.size();
+    instr.node = rl;
+  }
+  else if (auto fe = std::dynamic_pointer_cast<FieldExpression>(exp)) {
+    Expression_(fe->GetExp(), dst);
+    Emit_(VmOp::FIELD, dst, dst).node = fe;
+  }
+  else if (auto idx = std::dynamic_pointer_cast<IndexExpression>(exp)) {
+    // an error in the array is not checked: EvalIndex turns it into nullptr
+    Expression_(idx->GetIdx(), dst);
+    Emit_(VmOp::CHECK_INDEX, 0, dst);
+    int arr = NewReg_();
+    Caught_(idx->GetExp(), arr);
+    Emit_(VmOp::INDEX, dst, dst, arr);
+  }
+  else if (FusedIncrement_(exp, dst)) {
+    // emitted
+  }
+  else if (auto ae = std::dynamic_pointer_cast<AssignExpression>(exp);
+      ae != nullptr && std::dynamic_pointer_cast<Identifier>(ae->GetIdent()) != nullptr) {
+    Expression_(ae->GetNewVal(), dst);
+    Emit_(VmOp::ASSIGN, dst, dst).name = std::dynamic_pointer_cast<Identifier>(ae->GetIdent())->GetValue();
+  }
+  else {
+    Emit_(VmOp::EVAL, dst).node = exp;
+  }
+
+  regs_ = saved;
+}
+
+void VmCompiler::If_(std::shared_ptr<IfExpression> ie, int dst, bool stmtPos) {
+  if (!stmtPos && (HasReturn_(ie->GetConsequence()) || HasReturn_(ie->GetAlternative()))) {
+    Emit_(VmOp::EVAL, dst).node = ie;
+    return;
+  }
+
+  int otherwise = NewLabel_();
+  int end = NewLabel_();
+
+  if (!FusedBranch_(ie->GetCondition(), otherwise, false)) {
+    Expression_(ie->GetCondition(), dst);
+    Emit_(VmOp::JUMP_FALSE, 0, dst).target = otherwise;
+  }
+  Block_(ie->GetConsequence(), dst);
+  Emit_(VmOp::JUMP).target = end;
+
+  Bind_(otherwise);
+  if (ie->GetAlternative() != nullptr) {
+    Block_(ie->GetAlternative(), dst);
+  } else {
+    Emit_(VmOp::NULL_T, dst);
+  }
+  Bind_(end);
+}
+
+// every argument is evaluated before the first failed one is reported
+void VmCompiler::Call_(std::shared_ptr<CallExpression> call, int dst, bool tail) {
+  int saved = regs_;
+  int fn = NewReg_();
+  Expression_(call->GetFunc(), fn);
+
+  std::vector<std::shared_ptr<Expression>> args = call->GetArgs();
+  int base = regs_;
+  for (size_t i = 0; i < args.size(); i++) {
+    NewReg_();
+  }
+  for (size_t i = 0; i < args.size(); i++) {
+    Caught_(args[i], base + i);
+  }
+
+  VmInstr& instr = Emit_(tail ? VmOp::TAIL_CALL : VmOp::CALL, dst, fn, base);
+  instr.count = args.size();
+  instr.node = call;
+  regs_ = saved;
+}
+
+// evaluates exp into reg, leaving an error there instead of passing it on
+void VmCompiler::Caught_(std::shared_ptr<Expression> exp, int reg) {
+  int after = NewLabel_();
+  boundaries_.push_back({after, reg});
+  Expression_(exp, reg);
+  boundaries_.pop_back();
+  Bind_(after);
+}
+
+// a return that would end the block, directly or through if statements in it
+bool VmCompiler::HasReturn_(std::shared_ptr<BlockStatement> block) {
+  if (block == nullptr) {
+    return false;
+  }
+
+  for (const auto& stmt : block->GetStatements()) {
+    if (std::dynamic_pointer_cast<ReturnStatement>(stmt) != nullptr) {
+      return true;
+    }
+    if (auto nested = std::dynamic_pointer_cast<BlockStatement>(stmt); nested != nullptr
+        && HasReturn_(nested)) {
+      return true;
+    }
+    auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt);
+    auto ie = es != nullptr ? std::dynamic_pointer_cast<IfExpression>(es->GetExpression()) : nullptr;
+    if (ie != nullptr && (HasReturn_(ie->GetConsequence()) || HasReturn_(ie->GetAlternative()))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+  superinstructions
+*/
+
+// the integer kind a superinstruction runs op as, GENERIC when there is none
+static InfixKind FusedKind(const std::string& op) {
+  // division is left to INFIX, which has the tree walker's checks
+  static const char* const ops[] = {"+", "-", "*", "<", ">", "==", "!="};
+  static const InfixKind kinds[] = {
+    InfixKind::INT_ADD, InfixKind::INT_SUB, InfixKind::INT_MUL, InfixKind::INT_LT,
+    InfixKind::INT_GT, InfixKind::INT_EQ, InfixKind::INT_NOT_EQ
+  };
+
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    if (op == ops[i]) {
+      return kinds[i];
+    }
+  }
+
+  return InfixKind::GENERIC;
+}
+
+static bool IsComparison(InfixKind kind) {
+  return kind == InfixKind::INT_LT || kind == InfixKind::INT_GT || kind == InfixKind::INT_EQ
+      || kind == InfixKind::INT_NOT_EQ;
+}
+
+// the operand of ident op operand: an integer literal into imm and constant
+// or a name into ident2
+static bool FusedOperand(std::shared_ptr<Expression> exp, long& imm, Object*& constant,
+    Identifier*& ident2) {
+  if (auto il = std::dynamic_pointer_cast<IntegerLiteral>(exp)) {
+    imm = il->GetValue();
+    constant = il->GetConstant();
+    return true;
+  }
+  if (auto ident = std::dynamic_pointer_cast<Identifier>(exp)) {
+    ident2 = ident.get();
+    return true;
+  }
+
+  return false;
+}
+
+// name op operand with an operator the superinstructions know
+static bool FusedShape(std::shared_ptr<Expression> exp, InfixKind& kind, Identifier*& ident,
+    long& imm, Object*& constant, Identifier*& ident2) {
+  auto ie = std::dynamic_pointer_cast<InfixExpression>(exp);
+  if (ie == nullptr) {
+    return false;
+  }
+  auto left = std::dynamic_pointer_cast<Identifier>(ie->GetLeft());
+  kind = FusedKind(ie->GetOp());
+  if (left == nullptr || kind == InfixKind::GENERIC
+      || !FusedOperand(ie->GetRight(), imm, constant, ident2)) {
+    return false;
+  }
+
+  ident = left.get();
+  return true;
+}
+
+// name = name op literal, an assignment that only steps an integer
+static bool IncrementShape(std::shared_ptr<Expression> exp, std::string& name,
+    InfixKind& kind, Identifier*& ident, long& imm, Object*& constant) {
+  auto ae = std::dynamic_pointer_cast<AssignExpression>(exp);
+  auto target = ae != nullptr ? std::dynamic_pointer_cast<Identifier>(ae->GetIdent()) : nullptr;
+  Identifier* ident2 = nullptr;
+  if (target == nullptr || !FusedShape(ae->GetNewVal(), kind, ident, imm, constant, ident2)
+      || ident2 != nullptr || IsComparison(kind) || ident->GetValue() != target->GetValue()) {
+    return false;
+  }
+
+  name = target->GetValue();
+  return true;
+}
+
+bool VmCompiler::FusedInfix_(std::shared_ptr<InfixExpression> ie, int dst) {
+  InfixKind kind;
+  Identifier* ident = nullptr;
+  Identifier* ident2 = nullptr;
+  long imm = 0;
+  Object* constant = nullptr;
+  if (!FusedShape(ie, kind, ident, imm, constant, ident2)) {
+    return false;
+  }
+
+  VmInstr& instr = Emit_(ident2 != nullptr ? VmOp::NAME_NAME : VmOp::NAME_INT, dst);
+  instr.node = ie;
+  instr.kind = kind;
+  instr.ident = ident;
+  instr.ident2 = ident2;
+  instr.imm = imm;
+  instr.constant = constant;
+  return true;
+}
+
+bool VmCompiler::FusedBranch_(std::shared_ptr<Expression> cond, int target, bool loop) {
+  InfixKind kind;
+  Identifier* ident = nullptr;
+  Identifier* ident2 = nullptr;
+  long imm = 0;
+  Object* constant = nullptr;
+  if (!FusedShape(cond, kind, ident, imm, constant, ident2) || !IsComparison(kind)) {
+    return false;
+  }
+
+  VmInstr& instr = Emit_(ident2 != nullptr ? VmOp::BRANCH_NAME_NAME : VmOp::BRANCH_NAME_INT);
+  instr.node = cond;
+  instr.target = target;
+  instr.kind = kind;
+  instr.ident = ident;
+  instr.ident2 = ident2;
+  instr.imm = imm;
+  instr.constant = constant;
+  instr.loopCond = loop;
+  return true;
+}
+
+bool VmCompiler::FusedIncrement_(std::shared_ptr<Expression> exp, int dst) {
+  std::string name;
+  InfixKind kind;
+  Identifier* ident = nullptr;
+  long imm = 0;
+  Object* constant = nullptr;
+  if (!IncrementShape(exp, name, kind, ident, imm, constant)) {
+    return false;
+  }
+
+  VmInstr& instr = Emit_(VmOp::INC_NAME, dst);
+  instr.node = std::static_pointer_cast<AssignExpression>(exp)->GetNewVal();
+  instr.name = name;
+  instr.kind = kind;
+  instr.ident = ident;
+  instr.imm = imm;
+  instr.constant = constant;
+  return true;
+}
+
+/*
+ * the after action of a loop stepping its variable, fused with the test of
+ * the condition that follows it: the loop's back edge becomes one instruction
+ */
+bool VmCompiler::FusedLatch_(std::shared_ptr<Expression> after, std::shared_ptr<Expression> cond,
+    int body, int top, int dst) {
+  std::string name;
+  InfixKind kind;
+  Identifier* ident = nullptr;
+  long imm = 0;
+  Object* constant = nullptr;
+  InfixKind cmp;
+  Identifier* condIdent = nullptr;
+  Identifier* limitIdent = nullptr;
+  long limit = 0;
+  Object* limitConstant = nullptr;
+  if (!IncrementShape(after, name, kind, ident, imm, constant)
+      || !FusedShape(cond, cmp, condIdent, limit, limitConstant, limitIdent) || !IsComparison(cmp)
+      || condIdent->GetValue() != name) {
+    return false;
+  }
+
+  VmInstr& instr = Emit_(VmOp::INC_BRANCH, dst);
+  instr.node = std::static_pointer_cast<AssignExpression>(after)->GetNewVal();
+  instr.name = name;
+  instr.kind = kind;
+  instr.ident = ident;
+  instr.imm = imm;
+  instr.constant = constant;
+  instr.cmp = cmp;
+  instr.ident2 = limitIdent;
+  instr.limit = limit;
+  instr.target = body;
+  instr.alt = top;
+  return true;
+}
+
+/*
+  output
+*/
+
+VmInstr& VmCompiler::Emit_(VmOp op, int dst, int a, int b) {
+  std::vector<VmInstr>& code = chunk_->GetCode();
+  code.emplace_back();
+
+  VmInstr& instr = code.back();
+  instr.op = op;
+  instr.dst = dst;
+  instr.a = a;
+  instr.b = b;
+  if (!boundaries_.empty()) {
+    instr.fail = boundaries_.back().label;
+    instr.failReg = boundaries_.back().reg;
+  }
+
+  return instr;
+}
+
+int VmCompiler::NewLabel_() {
+  labels_.push_back(-1);
+  return labels_.size() - 1;
+}
+
+void VmCompiler::Bind_(int label) {
+  labels_[label] = chunk_->GetCode().size();
+}
+
+int VmCompiler::NewReg_() {
+  regs_++;
+  if (regs_ > maxRegs_) {
+    maxRegs_ = regs_;
+  }
+
+  return regs_ - 1;
+}
+
+// ends the chunk with a return of result and turns labels into offsets
+std::shared_ptr<VmChunk> VmCompiler::Finish_(int result) {
+  Emit_(VmOp::RETURN, 0, result);
+
+  for (VmInstr& instr : chunk_->GetCode()) {
+    if (instr.target >= 0) {
+      instr.target = labels_[instr.target];
+    }
+    if (instr.fail >= 0) {
+      instr.fail = labels_[instr.fail];
+    }
+    if (instr.alt >= 0) {
+      instr.alt = labels_[instr.alt];
+    }
+  }
+  chunk_->SetNumRegs(maxRegs_);
+
+  return chunk_;
+}
@@ -0,0 +1,30 @@
+#ifndef MCSCRIPT_V3_AOT_TEST_H
+#define MCSCRIPT_V3_AOT_TEST_H
+
+#include <string>
+
+struct ParityTest {
+  std::string name;
+  std::string input;
+};
+
+// runs programs through bin/main --emit-cpp and g++, against bin/main itself
+class AotTest {
+  public:
+    void Run();
+
+  private:
+    // methods
+    void TestParity_();
+    void TestTypedFunctions_();
+
+    // helpers
+    bool Emit_(const std::string& name, const std::string& input, std::string& cpp);
+    bool Translate_(const std::string& name, const std::string& input, std::string& output);
+    bool Interpret_(const std::string& name, const std::string& input, std::string& output);
+    std::string Write_(const std::string& name, const std::string& input);
+    bool Shell_(const std::string& command, std::string& output);
+};
+
+
+#endif //MCSCRIPT_V3_AOT_TEST_H
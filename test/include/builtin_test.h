@@ -22,6 +22,13 @@ class BuiltInTest {
     // methods
     void TestLen_();
     void TestPush_();
+    void TestSlice_();
+    void TestHashBuiltIns_();
+    void TestPersistent_();
+    void TestQueues_();
+    void TestArity_();
+    void TestAggregates_();
+    void TestSharedResults_();
     Object* TestEval_(std::string input);
 
     // helpers
@@ -64,14 +64,31 @@ class EvaluatorTest {
     void TestFunctionCalls_();
     void TestClosures_();
     void TestGCollector_();
+    void TestLiteralConstants_();
     void TestStrings_();
     void TestStringConcat_();
+    void TestStringComparison_();
     void TestArrays_();
+    void TestPackedArrays_();
+    void TestArrayOperators_();
+    void TestHashes_();
+    void TestRecords_();
     void TestIndexEval_();
     void TestAssignEval_();
+    void TestTailCalls_();
+    void TestStackOverflow_();
+    void TestQuickening_();
+    void TestCallSiteCache_();
+    void TestSlotCache_();
+    void TestEscapeAnalysis_();
+    void TestFlatClosures_();
+    void TestJit_();
+    void TestVm_();
+    void TestSuperinstructions_();
 
     // helper methods
     Object* TestEval_(std::string input);
+    Object* TestRun_(std::string input);
     bool TestBooleanObject_(Object* obj, bool expected);
     bool TestIntegerObject_(Object* obj, long expected);
     bool TestNullObject_(Object* obj);
@@ -0,0 +1,42 @@
+#ifndef MCSCRIPT_V3_OPTIMIZER_TEST_H
+#define MCSCRIPT_V3_OPTIMIZER_TEST_H
+
+#include <evaluator.h>
+#include <optimizer.h>
+
+struct OptimizerCase {
+  std::string input;
+  std::string expected;
+};
+
+class OptimizerTest {
+  public:
+    OptimizerTest(Evaluator& evaluator) : evaluator_(evaluator) {
+      // empty
+    }
+
+    void Run();
+
+  private:
+    Evaluator& evaluator_;
+
+    // methods
+    void TestFolding_();
+    void TestPropagation_();
+    void TestBranchPruning_();
+    void TestDeadCode_();
+    void TestLoopInvariants_();
+    void TestInlining_();
+    void TestCommonSubexpressions_();
+    void TestEvalParity_();
+    void TestErrorParity_();
+    void TestIncremental_();
+
+    // helpers
+    std::shared_ptr<Program> Parse_(std::string input);
+    bool TestCases_(const std::vector<OptimizerCase>& cases);
+    Object* TestEval_(std::string input, bool optimize);
+};
+
+
+#endif //MCSCRIPT_V3_OPTIMIZER_TEST_H
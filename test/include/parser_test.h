@@ -67,6 +67,8 @@ class ParserTest {
 
     // main test methods
     void TestArrayLiterals_();
+    void TestHashLiterals_();
+    void TestRecords_();
     void TestInfixExpressions_();
     void TestPrefixExpressions_();
     void TestIntegerLiterals_();
@@ -0,0 +1,213 @@
+#include <aot_test.h>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// where translated programs and their binaries are written
+static const char* AOT_TEST_DIR = "build/aot_test";
+
+void AotTest::Run() {
+  TestParity_();
+  TestTypedFunctions_();
+}
+
+/*
+  main test methods
+*/
+
+void AotTest::TestParity_() {
+  std::vector<ParityTest> tests = {
+    // typed functions wrap on overflow as the interpreter does
+    (ParityTest){.name = "overflow", .input =
+      "var f = function(a) { if (a + 1 > a) { return 1; } return 0; };"
+      "var g = function(a) { a * 2 / 2 == a }; var h = function(a) { if (-a < 0) { return 1; } 0 };"
+      "var max = 9223372036854775807; print(f(max)); print(g(max)); print(h(0 - max - 1));"},
+    (ParityTest){.name = "arithmetic", .input =
+      "print(5 + 5 * 2 - 10 / 2); print(-50 + 100 + -50); print((5 + 10 * 2 + 15 / 3) * 2 + -10);"
+      "print(1 < 2 == true); print(!true); print(!!5); print(1 != 1);"},
+    (ParityTest){.name = "conditionals", .input =
+      "var x = 10; if (x > 5) { print(\"big\"); } else { print(\"small\"); }"
+      "print(if (1 > 2) { 10 });"
+      "var y = if (x < 5) { 1 } else { 2 }; print(y);"},
+    (ParityTest){.name = "functions", .input =
+      "var add = function(a, b) { return a + b; };"
+      "var apply = function(f, a, b) { f(a, b) };"
+      "print(apply(add, 3, 4)); print(add(add(1, 2), add(3, 4)));"
+      "print(function(x) { x * 2; }(21)); print(add);"},
+    (ParityTest){.name = "closures", .input =
+      "var newAdder = function(x) { function(y) { x + y }; };"
+      "var addTwo = newAdder(2); print(addTwo(3));"
+      "var counter = function() { var seen = []; function(x) { push(seen, x); len(seen) } };"
+      "var c = counter(); c(1); print(c(2));"},
+    (ParityTest){.name = "recursion", .input =
+      "var fib = function(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); };"
+      "print(fib(20));"
+      "var count = function(n, acc) { if (n == 0) { return acc; } return count(n - 1, acc + 1); };"
+      "print(count(100000, 0));"
+      "var even = function(n) { if (n == 0) { return true; } return odd(n - 1); };"
+      "var odd = function(n) { if (n == 0) { return false; } return even(n - 1); };"
+      "print(even(1001));"},
+    (ParityTest){.name = "loops", .input =
+      "var sum = 0; for (var i = 0; i < 10; i = i + 1) { sum = sum + i; print(sum); }"
+      "var total = function(n) { var s = 0; for (var i = 0; i < n; i = i + 1) { s = s + i; } s };"
+      "print(total(100));"},
+    (ParityTest){.name = "arrays", .input =
+      "var arr = [1, 2 * 2, 3 + 3]; print(arr); print(arr[1]); print(len(arr));"
+      "push(arr, 10); print(arr[3]); print(arr[5]); print([[1, 2], [3]][0][1]);"},
+    (ParityTest){.name = "hashes", .input =
+      "var h = {\"a\": 1, 2: [3], true: \"yes\"}; print(h); print(h[\"a\"]); print(h[2][0]);"
+      "set(h, \"b\", 4); print(delete(h, \"a\")); print(has(h, \"a\")); print(keys(h));"
+      "print(values(h)); print(h[\"missing\"]); print({[1]: 2});"},
+    (ParityTest){.name = "records", .input =
+      "var p = {x: 1, y: [2]}; print(p); print(p.x + p.y[0]); var get = function(r) { r.x };"
+      "print(get({x: 3})); print(get({y: 1, x: 4})); print({x: 1, x: 5}); print(p.z);"},
+    (ParityTest){.name = "persistent", .input =
+      "var v = vec(1, 2); var w = conj(assoc(v, 0, 5), 3); print(v); print(w); print(w[2]);"
+      "var m = map(\"a\", 1); var n = dissoc(assoc(m, 2, v), \"a\"); print(m); print(n[2][1]);"
+      "print(len(n)); print(assoc(v, 9, 1));"},
+    (ParityTest){.name = "queues", .input =
+      "var q = pqueue(function(a, b) { a > b }); pq_push(q, 2); pq_push(q, 7); pq_push(q, 4);"
+      "print(pq_pop(q)); print(pq_peek(q)); print(len(q)); var d = deque(); dq_push_back(d, 1);"
+      "dq_push_front(d, 0); print(d); print(d[1]); print(dq_pop_back(d)); print(dq_pop_back(d));"
+      "print(dq_pop_back(d)); var e = pqueue(); pq_push(e, 1); print(pq_push(e, \"a\"));"},
+    (ParityTest){.name = "vectors", .input =
+      "var a = [1, 2, 3, 4, 5]; var b = a * a - 1; print(b); print(a < 3); print(10 / a);"
+      "print(sum(b)); print(min(b)); print(max(a)); print(dot(a, b)); print(a + [1]);"},
+    (ParityTest){.name = "strings", .input =
+      "var s = \"hello\" + \" \" + \"world\"; print(s); print(len(s));"
+      "print(\"a\" == \"a\"); print(\"it's\");"},
+    (ParityTest){.name = "errors", .input =
+      "print(1); var f = function() { 5 + true; }; print(f()); print(2);"},
+    (ParityTest){.name = "unknown", .input =
+      "print(\"before\"); print(missing);"},
+    (ParityTest){.name = "failures", .input =
+      "var fib = function(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); };"
+      "print(fib(\"x\")); print(fib(10) + 1); print([1][\"a\"]);"}
+  };
+
+  for (const auto& test : tests) {
+    std::string expected;
+    std::string got;
+    if (!Interpret_(test.name, test.input, expected) || !Translate_(test.name, test.input, got)) {
+      return;
+    }
+
+    if (got != expected) {
+      std::cerr << "translated " << test.name << " printed:\n" << got
+          << "expected:\n" << expected;
+      return;
+    }
+  }
+
+  std::cout << "TestParity_() passed\n";
+}
+
+void AotTest::TestTypedFunctions_() {
+  std::string input =
+    "var fib = function(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); };"
+    "var isEven = function(n) { n / 2 * 2 == n };"
+    "var greet = function(name) { \"hi \" + name };"
+    "print(fib(25)); print(isEven(fib(10))); print(greet(\"you\"));";
+
+  std::string cpp;
+  if (!Emit_("typed", input, cpp)) {
+    return;
+  }
+
+  // fib and isEven get plain long versions, greet does not
+  for (const char* want : {"static long typed_0(", "static long typed_1("}) {
+    if (cpp.find(want) == std::string::npos) {
+      std::cerr << "no " << want << " in the translation\n";
+      return;
+    }
+  }
+  if (cpp.find("typed_2") != std::string::npos) {
+    std::cerr << "a function over strings was typed\n";
+    return;
+  }
+
+  std::string expected;
+  std::string got;
+  if (!Interpret_("typed", input, expected) || !Translate_("typed", input, got)) {
+    return;
+  }
+  if (got != expected) {
+    std::cerr << "typed functions printed:\n" << got << "expected:\n" << expected;
+    return;
+  }
+
+  std::cout << "TestTypedFunctions_() passed\n";
+}
+
+/*
+  helpers
+*/
+
+bool AotTest::Emit_(const std::string& name, const std::string& input, std::string& cpp) {
+  std::string source = Write_(name, input);
+  return Shell_("bin/main --emit-cpp " + source, cpp);
+}
+
+bool AotTest::Translate_(const std::string& name, const std::string& input, std::string& output) {
+  std::string cpp;
+  if (!Emit_(name, input, cpp)) {
+    return false;
+  }
+
+  std::string base = std::string(AOT_TEST_DIR) + "/" + name;
+  std::ofstream(base + ".cc") << cpp;
+
+  std::string compiled;
+  if (!Shell_("g++ -std=c++17 -O1 -I include " + base + ".cc build/libmcscript.a -o " + base
+      + " 2>&1", compiled)) {
+    std::cerr << "could not compile the translation of " << name << ":\n" << compiled;
+    return false;
+  }
+
+  return Shell_(base + " 2>&1", output);
+}
+
+bool AotTest::Interpret_(const std::string& name, const std::string& input, std::string& output) {
+  return Shell_("bin/main " + Write_(name, input) + " 2>&1", output);
+}
+
+std::string AotTest::Write_(const std::string& name, const std::string& input) {
+  std::string path = std::string(AOT_TEST_DIR) + "/" + name + ".mcs";
+  std::ofstream(path) << input;
+  return path;
+}
+
+bool AotTest::Shell_(const std::string& command, std::string& output) {
+  FILE* pipe = popen(command.c_str(), "r");
+  if (pipe == nullptr) {
+    std::cerr << "could not run " << command << "\n";
+    return false;
+  }
+
+  output.clear();
+  char buff[4096];
+  size_t n;
+  while ((n = fread(buff, 1, sizeof(buff), pipe)) > 0) {
+    output.append(buff, n);
+  }
+
+  if (pclose(pipe) != 0) {
+    std::cerr << command << " failed\n";
+    return false;
+  }
+
+  return true;
+}
+
+int main() {
+  if (system((std::string("mkdir -p ") + AOT_TEST_DIR).c_str()) != 0) {
+    std::cerr << "could not create " << AOT_TEST_DIR << "\n";
+    return 1;
+  }
+
+  AotTest test;
+  test.Run();
+
+  return 0;
+}
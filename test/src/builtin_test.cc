@@ -3,10 +3,39 @@
 #include <lexer.h>
 #include <parser.h>
 #include <iostream>
+#include <new>
+#include <stdlib.h>
+
+// every allocation the test binary makes, so a test can tell a call made none
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
 
 void BuiltInTest::Run() {
   TestLen_();
   TestPush_();
+  TestSlice_();
+  TestHashBuiltIns_();
+  TestPersistent_();
+  TestQueues_();
+  TestArity_();
+  TestAggregates_();
+  TestSharedResults_();
 }
 
 /*
@@ -27,6 +56,407 @@ void BuiltInTest::TestPush_() {
 
 }
 
+void BuiltInTest::TestSlice_() {
+  std::string text = "var s = \"abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz\"; ";
+  std::string big = "var a = []; for (var i = 0; i < 2000; i = i + 1) { push(a, i); } ";
+  std::vector<IntegerTest> tests = {
+    (IntegerTest){.input = "len(slice(\"hello world\", 6, 11));", .expected = 5},
+    (IntegerTest){.input = "if (slice(\"hello world\", 6, 100) == \"world\") { 1 } else { 0 }",
+      .expected = 1},
+    (IntegerTest){.input = "len(slice(\"abc\", -5, 2));", .expected = 2},
+    (IntegerTest){.input = "len(slice(\"abc\", 2, 1));", .expected = 0},
+    // slices of slices read from the first string
+    (IntegerTest){.input = text + "if (slice(slice(s, 10, 60), 26, 50) == slice(s, 36, 60)) { 1 } else { 0 }",
+      .expected = 1},
+    (IntegerTest){.input = text + "len(slice(s, 3, 60) + slice(s, 0, 10));", .expected = 67},
+    (IntegerTest){.input = "slice([1, 2, 3, 4], 1, 3)[1];", .expected = 3},
+    (IntegerTest){.input = "len(slice([1, 2, 3], 1, 10));", .expected = 2},
+    (IntegerTest){.input = "slice(slice([1, 2, 3, 4, 5], 1, 5), 1, 3)[0];", .expected = 3},
+    // pushing copies a view out instead of writing over its array
+    (IntegerTest){.input = "var a = [1, 2, 3, 4]; var v = slice(a, 1, 3); push(v, 9); a[3];",
+      .expected = 4},
+    (IntegerTest){.input = "var a = [1, 2, 3, 4]; var v = slice(a, 1, 3); push(v, 9); v[2];",
+      .expected = 9},
+    (IntegerTest){.input = "var a = [1, 2, 3]; var v = slice(a, 0, 2); push(a, 7); len(v);",
+      .expected = 2},
+    // a view outlives the scope of its array
+    (IntegerTest){.input = "var f = function() { var a = [1, 2, 3]; slice(a, 1, 3) }; var v = f(); v[1];",
+      .expected = 3}
+  };
+
+  for (const auto& test : tests) {
+    Object* obj = TestEval_(test.input);
+
+    if (!TestIntegerObject_(obj, test.expected)) {
+      return;
+    }
+  }
+
+  auto view = dynamic_cast<Array*>(TestEval_(big + "slice(a, 0, 1500)"));
+  if (view == nullptr || !view->IsView() || view->GetInt(1499) != 1499) {
+    std::cerr << "slice of most of an array is not a view of it\n";
+    return;
+  }
+
+  auto copy = dynamic_cast<Array*>(TestEval_(big + "slice(a, 5, 10)"));
+  if (copy == nullptr || copy->IsView() || copy->Size() != 5) {
+    std::cerr << "short slice of a long array is not a copy\n";
+    return;
+  }
+
+  std::vector<std::string> errors = {"slice(1, 0, 1)", "slice(\"abc\", \"a\", 1)", "slice([1])"};
+  for (const auto& input : errors) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ) {
+      std::cerr << input << " is not an error\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestSlice_() passed\n";
+}
+
+void BuiltInTest::TestHashBuiltIns_() {
+  std::string h = "var h = {\"a\": 1, \"b\": 2, 3: 4}; ";
+  std::vector<IntegerTest> tests = {
+    {h + "len(keys(h))", 3},
+    {h + "keys(h)[2]", 3},
+    {h + "values(h)[1]", 2},
+    {h + "if (has(h, \"a\")) { 1 } else { 0 }", 1},
+    {h + "if (has(h, \"c\")) { 1 } else { 0 }", 0},
+    {h + "set(h, \"c\", 9); h[\"c\"]", 9},
+    {h + "set(h, \"a\", 5); h[\"a\"] + len(keys(h))", 8},
+    {h + "if (delete(h, \"a\")) { len(keys(h)) } else { 0 }", 2},
+    {h + "delete(h, \"a\"); if (delete(h, \"a\")) { 1 } else { 0 }", 0},
+    // re-added keys go to the end
+    {h + "delete(h, \"a\"); set(h, \"a\", 7); values(h)[2]", 7},
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expected)) {
+      return;
+    }
+  }
+
+  Object* obj = TestEval_(h + "var r = set(h, \"d\", 1); r");
+  if (obj == nullptr || obj->Type() != ObjectType::NULL_OBJ) {
+    std::cerr << "set does not give null\n";
+    return;
+  }
+
+  std::vector<std::string> errors = {"keys([1])", "has({}, [1])", "set({}, 1)", "delete(1, 1)",
+    "values()", "var x = 1; x + set({}, 1, 2)"};
+  for (const auto& input : errors) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ) {
+      std::cerr << input << " is not an error\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestHashBuiltIns_() passed\n";
+}
+
+void BuiltInTest::TestPersistent_() {
+  std::string build = "var build = function(v, i, n) { if (i == n) { return v; }"
+      " return build(conj(v, i * 2), i + 1, n); }; var v = build(vec(), 0, 5000); ";
+  std::string fill = "var fill = function(m, i, n) { if (i == n) { return m; }"
+      " return fill(assoc(m, i, i * 3), i + 1, n); }; var m = fill(map(), 0, 5000);"
+      " var strip = function(m, i, n) { if (i == n) { return m; } return strip(dissoc(m, i * 2), i + 1, n); };"
+      " var s = strip(m, 0, 2500); ";
+  std::vector<IntegerTest> tests = {
+    {"len(vec(1, 2, 3))", 3},
+    {"vec(1, 2, 3)[2]", 3},
+    // updates leave the version they started from as it was
+    {"var a = vec(1, 2, 3); var b = assoc(a, 0, 9); a[0] * 10 + b[0]", 19},
+    {"var a = vec(1); var b = conj(a, 2); len(a) * 10 + len(b)", 12},
+    {build + "v[4999]", 9998},
+    {build + "v[1057]", 2114},
+    {build + "assoc(v, 3000, 7)[3000] + v[3000]", 6007},
+    {build + "len(assoc(v, 5000, 1))", 5001},
+    {"var m = map(\"a\", 1, \"b\", 2, 3, 4); m[\"b\"] + m[3]", 6},
+    {"var m = map(\"a\", 1); var n = assoc(m, \"c\", 5); len(m) * 10 + len(n)", 12},
+    {"var m = map(\"a\", 1); assoc(m, \"a\", 7)[\"a\"] + m[\"a\"]", 8},
+    {"var m = map(\"a\", 1); if (has(dissoc(m, \"a\"), \"a\")) { 0 } else { len(keys(m)) }", 1},
+    {fill + "len(s)", 2500},
+    {fill + "s[2997]", 8991},
+    {fill + "m[2998]", 8994},
+    {fill + "if (has(s, 2998)) { 0 } else { len(values(s)) }", 2500},
+    // an element only a vector holds survives collections
+    {"var v = vec(\"x\" + \"y\"); for (var i = 0; i < 100; i = i + 1) { \"a\" + \"b\"; }"
+      " if (v[0] == \"xy\") { len(v) } else { 0 }", 1},
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expected)) {
+      std::cerr << "input: " << test.input << "\n";
+      return;
+    }
+  }
+
+  Object* obj = TestEval_("vec(1, [2], \"s\", map(1, 2))");
+  if (obj->Inspect() != "[1, [2], s, {1: 2}]") {
+    std::cerr << "vector inspected wrong: " << obj->Inspect() << "\n";
+    return;
+  }
+
+  std::vector<std::string> errors = {"conj(map(), 1)", "assoc(vec(), 1, 1)", "dissoc(vec(), 0)",
+    "map(1)", "map([1], 2)", "assoc(map(), [1], 2)", "vec(1)[\"a\"]"};
+  for (const auto& input : errors) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ) {
+      std::cerr << input << " is not an error\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestPersistent_() passed\n";
+}
+
+void BuiltInTest::TestQueues_() {
+  std::string fill = "var fill = function(q, i, n) { if (i == n) { return q; }"
+      " pq_push(q, i * 7919 - (i * 7919 / n) * n); return fill(q, i + 1, n); }; ";
+  std::string drain = "var drain = function(q, last) { if (len(q) == 0) { return true; }"
+      " var x = pq_pop(q); if (x < last) { return false; } return drain(q, x); }; ";
+  std::string ring = "var ring = function(d, i, n) { if (i == n) { return d; }"
+      " dq_push_back(d, i); dq_push_front(d, 0 - i); dq_pop_front(d); return ring(d, i + 1, n); }; ";
+  std::vector<IntegerTest> tests = {
+    {"var q = pqueue(); pq_push(q, 5); pq_push(q, 1); pq_push(q, 3); pq_pop(q) * 10 + pq_peek(q)", 13},
+    {"var q = pqueue(); pq_push(q, \"b\"); pq_push(q, \"a\"); if (pq_pop(q) == \"a\") { len(q) } else { 0 }",
+      1},
+    // a comparator saying which goes first turns it into a max-heap
+    {"var q = pqueue(function(a, b) { a > b }); pq_push(q, 2); pq_push(q, 9); pq_push(q, 4);"
+      " pq_pop(q) * 10 + pq_pop(q)", 94},
+    {"var q = pqueue(function(a, b) { a[1] < b[1] }); pq_push(q, [\"x\", 3]); pq_push(q, [\"y\", 1]);"
+      " pq_pop(q)[1]", 1},
+    {fill + drain + "var q = pqueue(); fill(q, 0, 3000); if (drain(q, -1)) { len(q) } else { 1 }", 0},
+    {fill + drain + "var q = pqueue(function(a, b) { a < b }); fill(q, 0, 500); len(q) + pq_peek(q)", 500},
+    {"var d = deque(); dq_push_back(d, 1); dq_push_back(d, 2); dq_push_front(d, 0); d[0] * 100 + d[1] * 10 + d[2]",
+      12},
+    {"var d = deque(); dq_push_back(d, 1); dq_push_back(d, 2); dq_pop_back(d) * 10 + dq_pop_front(d)", 21},
+    // growing past the first ring keeps the order across the wrap
+    {ring + "var d = deque(); ring(d, 0, 100); d[0] * 1000 + len(d) + d[99]", 199},
+    {ring + "var d = deque(); ring(d, 0, 100); dq_peek_back(d) * 1000 + dq_peek_front(d)", 99000},
+    // an element only a queue holds survives collections
+    {"var q = pqueue(); pq_push(q, \"x\" + \"y\"); var d = deque(); dq_push_back(d, \"a\" + \"b\");"
+      " for (var i = 0; i < 100; i = i + 1) { \"c\" + \"d\"; }"
+      " if (pq_peek(q) == \"xy\") { if (dq_peek_front(d) == \"ab\") { 1 } else { 0 } } else { 0 }", 1},
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expected)) {
+      std::cerr << "input: " << test.input << "\n";
+      return;
+    }
+  }
+
+  // taking from an empty queue gives null
+  std::vector<std::string> empty = {"pq_pop(pqueue())", "pq_peek(pqueue())", "dq_pop_front(deque())",
+    "dq_pop_back(deque())", "dq_peek_back(deque())", "deque()[0]"};
+  for (const auto& input : empty) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::NULL_OBJ) {
+      std::cerr << input << " is not null\n";
+      return;
+    }
+  }
+
+  // as does adding to a deque, like adding to a pqueue
+  std::vector<std::string> pushed = {"var d = deque(); var r = dq_push_back(d, 1); r",
+    "var d = deque(); var f = function(x) { x }; f(dq_push_front(d, 1))",
+    "var q = pqueue(); var r = pq_push(q, 1); r"};
+  for (const auto& input : pushed) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::NULL_OBJ) {
+      std::cerr << input << " is not null\n";
+      return;
+    }
+  }
+
+  Object* obj = TestEval_("var d = deque(); dq_push_back(d, 1); dq_push_front(d, [2]); d");
+  if (obj->Inspect() != "deque[[2], 1]") {
+    std::cerr << "deque inspected wrong: " << obj->Inspect() << "\n";
+    return;
+  }
+
+  std::vector<std::string> errors = {"pqueue(1)", "pq_push(deque(), 1)", "dq_pop_front(pqueue())",
+    "var q = pqueue(); pq_push(q, 1); pq_push(q, \"a\")",
+    "var q = pqueue(function(a, b) { a + b }); pq_push(q, 1); pq_push(q, \"a\")",
+    "var q = pqueue(function(a, b) { pq_push(q, a) }); pq_push(q, 1); pq_push(q, 2)",
+    "deque()[\"a\"]"};
+  for (const auto& input : errors) {
+    Object* obj = TestEval_(input);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ) {
+      std::cerr << input << " is not an error\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestQueues_() passed\n";
+}
+
+void BuiltInTest::TestArity_() {
+  std::vector<IntegerTest> tests = {
+    {"var f = len; f(\"abc\")", 3},
+    // more arguments than are evaluated on the stack
+    {"len(vec(1, 2, 3, 4, 5, 6, 7, 8, 9, 10))", 10},
+    {"var f = function(a) { push(a, 4); len(a) }; f([1, 2, 3])", 4},
+    {"var f = function(n) { len(map(n, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11)) }; f(0)", 6},
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expected)) {
+      std::cerr << "input: " << test.input << "\n";
+      return;
+    }
+  }
+
+  // checked before the builtin runs, in the tree walker and the VM alike
+  std::vector<std::pair<std::string, std::string>> errors = {
+    {"len(1, 2)", "wrong number of arguments to len: want 1, got 2"},
+    {"len()", "wrong number of arguments to len: want 1, got 0"},
+    {"var f = function() { push([1]) }; f()", "wrong number of arguments to push: want 2, got 1"},
+    {"pqueue(1, 2)", "wrong number of arguments to pqueue: want 0 to 1, got 2"},
+    {"var f = function(q) { dq_pop_back(q, 1) }; f(deque())",
+      "wrong number of arguments to dq_pop_back: want 1, got 2"},
+  };
+  for (const auto& test : errors) {
+    Object* obj = TestEval_(test.first);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ) {
+      std::cerr << test.first << " is not an error\n";
+      return;
+    }
+    if (static_cast<Error*>(obj)->GetMessage() != test.second) {
+      std::cerr << "wrong error for " << test.first << ": " << obj->Inspect() << "\n";
+      return;
+    }
+  }
+
+  const BuiltIn* print = FindBuiltIn("print");
+  if (print == nullptr || !print->Accepts(0) || !print->Accepts(20)) {
+    std::cerr << "print does not take any number of arguments\n";
+    return;
+  }
+  // its output is an effect the optimizer must keep in order
+  if (print->IsPure()) {
+    std::cerr << "print found pure\n";
+    return;
+  }
+  const BuiltIn* push = FindBuiltIn("push");
+  if (push == nullptr || push->IsPure() || FindBuiltIn("missing") != nullptr) {
+    std::cerr << "push found pure\n";
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestArity_() passed\n";
+}
+
+void BuiltInTest::TestAggregates_() {
+  std::string big = "var a = []; for (var i = 0; i < 13; i = i + 1) { push(a, i * 7 - 40); } ";
+  std::vector<IntegerTest> tests = {
+    {"sum([1, 2, 3])", 6},
+    {"sum([])", 0},
+    {"min([4, -2, 9])", -2},
+    {"max([4, -2, 9])", 9},
+    {"dot([1, 2, 3], [4, 5, 6])", 32},
+    {"dot([], [])", 0},
+    // boxed arrays of integers are read the same way
+    {"var a = [1, 2]; push(a, \"x\"); sum(slice(a, 0, 2))", 3},
+    {"var f = function(a) { sum(a * a) }; f([1, 2, 3])", 14},
+    // odd lengths and views, for the elements past the last whole vector
+    {big + "sum(a)", 26},
+    {big + "min(slice(a, 3, 12))", -19},
+    {big + "max(slice(a, 1, 12))", 37},
+    {big + "dot(a, slice(a, 0, 13))", 8970},
+    {big + "sum(slice(a, 2, 11) * 3 + 1)", 63},
+    {"max([-9223372036854775807 - 1, -9223372036854775807, -5, -9223372036854775807])", -5},
+  };
+
+  // every level the CPU has gives the same answers
+  KernelLevel best = GetKernelLevel();
+  for (KernelLevel level : {KernelLevel::SCALAR, KernelLevel::SSE2, KernelLevel::AVX2}) {
+    SetKernelLevel(level);
+    for (const auto& test : tests) {
+      if (!TestIntegerObject_(TestEval_(test.input), test.expected)) {
+        std::cerr << "input: " << test.input << " at level " << static_cast<int>(level) << "\n";
+        SetKernelLevel(best);
+        return;
+      }
+    }
+  }
+  SetKernelLevel(best);
+
+  std::vector<std::pair<std::string, std::string>> errors = {
+    {"min([])", "empty array"},
+    {"sum([1, true])", "expecting array of integers"},
+    {"max(3)", "expecting array of integers"},
+    {"dot([1, 2], [1])", "array lengths differ: 2 and 1"},
+  };
+  for (const auto& test : errors) {
+    Object* obj = TestEval_(test.first);
+    if (obj == nullptr || obj->Type() != ObjectType::ERROR_OBJ
+        || static_cast<Error*>(obj)->GetMessage() != test.second) {
+      std::cerr << "wrong error for " << test.first << ": "
+          << (obj != nullptr ? obj->Inspect() : "nullptr") << "\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestAggregates_() passed\n";
+}
+
+void BuiltInTest::TestSharedResults_() {
+  Array arr;
+  Object* argv[] = {&arr};
+  const BuiltIn* len = FindBuiltIn("len");
+  Object* first = len->GetFunc()(BuiltInArgs(argv, 1));
+  size_t before = allocations;
+  for (int i = 0; i < 1000; i++) {
+    if (len->GetFunc()(BuiltInArgs(argv, 1)) != first) {
+      std::cerr << "len gave a different Integer\n";
+      return;
+    }
+  }
+  if (allocations != before || !IsShared(first)) {
+    std::cerr << "len allocated " << allocations - before << " times\n";
+    return;
+  }
+
+  // has and delete give back the evaluator's own booleans
+  Object* obj = TestEval_("var h = {1: 2}; has(h, 1)");
+  Object* obj2 = TestEval_("delete({}, 1)");
+  if (obj != evaluator_.TRUE() || obj2 != evaluator_.FALSE()) {
+    std::cerr << "has or delete made a Boolean\n";
+    return;
+  }
+
+  // nor does a loop of len calls leave anything for the collector
+  auto l = std::make_shared<Lexer>("var a = [1, 2, 3]; var s = \"abc\";");
+  auto env = std::make_shared<Environment<Object*>>();
+  evaluator_.Eval(std::make_shared<Parser>(l)->ParseProgram(), env);
+  std::string calls;
+  for (int i = 0; i < 200; i++) {
+    calls += "len(a); len(s);";
+  }
+  GCollector& gCollector = GCollector::getGCollector();
+  size_t tracked = gCollector.GetNumObjects();
+  l = std::make_shared<Lexer>(calls.c_str());
+  obj = evaluator_.Eval(std::make_shared<Parser>(l)->ParseProgram(), env);
+  if (!TestIntegerObject_(obj, 3) || gCollector.GetNumObjects() != tracked) {
+    std::cerr << "len calls tracked " << gCollector.GetNumObjects() - tracked << " objects\n";
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestSharedResults_() passed\n";
+}
+
 Object* BuiltInTest::TestEval_(std::string input) {
   auto l = std::make_shared<Lexer>(input.c_str());
   auto p = std::make_shared<Parser>(l);
@@ -2,6 +2,7 @@
 #include <memory>
 #include <parser.h>
 #include <evaluator.h>
+#include <chrono>
 #include <iostream>
 #include <unordered_map>
 
@@ -23,11 +24,27 @@ void EvaluatorTest::Run() {
   TestFunctionCalls_();
   TestClosures_();
   TestGCollector_();
+  TestLiteralConstants_();
   TestStrings_();
   TestStringConcat_();
+  TestStringComparison_();
   TestArrays_();
+  TestPackedArrays_();
+  TestArrayOperators_();
+  TestHashes_();
+  TestRecords_();
   TestIndexEval_();
   TestAssignEval_();
+  TestTailCalls_();
+  TestStackOverflow_();
+  TestQuickening_();
+  TestCallSiteCache_();
+  TestSlotCache_();
+  TestEscapeAnalysis_();
+  TestFlatClosures_();
+  TestJit_();
+  TestVm_();
+  TestSuperinstructions_();
 }
 
 /*
@@ -68,10 +85,559 @@ Object* EvaluatorTest::TestEval_(std::string input) {
     return obj;
 }
 
+Object* EvaluatorTest::TestRun_(std::string input) {
+    auto l = std::make_shared<Lexer>(input.c_str());
+    auto p = std::make_shared<Parser>(l);
+    std::shared_ptr<Program> program = p->ParseProgram();
+    auto env = std::make_shared<Environment<Object*>>();
+
+    return evaluator_.Run(program, env);
+}
+
 /*
   main test methods
 */
 
+void EvaluatorTest::TestVm_() {
+  // each program must give the same result run by the VM and by the tree walker
+  std::vector<std::string> tests = {
+    "var fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(15)",
+    "var count = function(n, acc) { if (n == 0) { return acc; } return count(n - 1, acc + 1); };"
+    "count(10000, 0)",
+    "var f = function(x) { var y = -x; if (!(y < 0)) { \"neg\" } else { \"pos\" + \"!\" } }; f(3)",
+    "var f = function(a) { [a, a * 2, [a]][1] + len([1, 2, 3]) }; f(4)",
+    "var f = function() { var x = 1; }; f()",
+    "var f = function() { if (false) { 1 } }; f()",
+    "var f = function() { 1 + true; 2 }; f()",
+    "var f = function() { x = 5; }; f()",
+    "var f = function() { missing }; f()",
+    "var f = function() { [1, 2][\"a\"] }; f()",
+    "var f = function() { 5(1) }; f()",
+    // a return in a loop body only ends the iteration, and so does an error
+    "var f = function() { var out = []; for (var i = 0; i < 3; i = i + 1) { push(out, i); return 9; push(out, 7); }"
+    " len(out) }; f()",
+    "var f = function() { var out = []; for (var i = 0; i < 3; i = i + 1) { push(out, i); i + true; push(out, 7); }"
+    " out[3] }; f()",
+    "var f = function() { var out = []; for (var i = 0; i < 3; i = i + 1) { if (i == 1) { return 0; } push(out, i); }"
+    " len(out) }; f()",
+    // an error in the condition ends the loop
+    "var f = function() { var out = []; for (var i = 0; i < 5 + (i == 2); i = i + 1) { push(out, i); } len(out) }; f()",
+    // a return in an if in value position becomes the if's value
+    "var f = function() { var x = if (true) { return 3; }; 7 }; f()",
+    "var f = function() { if (true) { if (true) { return 3; } }; 7 }; f()",
+    // every argument is evaluated before a failed one is reported
+    "var out = []; var g = function(a, b) { a }; var f = function() { g(missing, push(out, 1)) }; f(); len(out)",
+    // loops nested deeper than a chunk keeps
+    "var f = function() { var out = []; for (var a = 0; a < 2; a = a + 1) { for (var b = 0; b < 2; b = b + 1) {"
+    " for (var c = 0; c < 2; c = c + 1) { for (var d = 0; d < 2; d = d + 1) { for (var e = 0; e < 2; e = e + 1) {"
+    " push(out, a + b + c + d + e); } } } } } out[31] + len(out) }; f()",
+    "var fs = []; for (var i = 0; i < 3; i = i + 1) { push(fs, function() { i * 10 }); } fs[1]() + fs[2]()",
+    "var adder = function(x) { function(y) { x + y } }; var add2 = adder(2); add2(40)",
+  };
+
+  for (const auto& input : tests) {
+    std::string results[2];
+    for (int vm = 0; vm < 2; vm++) {
+      evaluator_.SetVmEnabled(vm == 1);
+      Object* obj = TestEval_(input);
+      results[vm] = obj != nullptr ? obj->Inspect() : "nullptr";
+      evaluator_.FinalCleanup();
+    }
+    evaluator_.SetVmEnabled(true);
+
+    if (results[0] != results[1]) {
+      std::cerr << "VM gave " << results[1] << ", tree walker " << results[0]
+          << " for: " << input << "\n";
+      return;
+    }
+  }
+
+  // function bodies run through chunks (strings keep this one from the JIT)
+  std::string input = "var greet = function(x) { \"hi \" + x }; len(greet(\"you\"))";
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  if (!TestIntegerObject_(evaluator_.Eval(program, env), 6)) {
+    return;
+  }
+
+  auto greet = dynamic_cast<Function*>(env->Get("greet"));
+  if (greet == nullptr || greet->GetBody()->GetChunk() == nullptr) {
+    std::cerr << "greet did not run as a chunk\n";
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestVm_() passed\n";
+}
+
+void EvaluatorTest::TestSuperinstructions_() {
+  // the fused instructions and the ones they replace must agree, operands
+  // that are not integers included
+  std::vector<std::string> tests = {
+    "var f = function(n) { var out = []; for (var i = 0; i < n; i = i + 1) { push(out, i * 2 - 1); } out }; f(6)",
+    "var f = function(n) { var out = []; for (var i = 10; i > n; i = i - 3) { push(out, i); } out }; f(0)",
+    "var f = function(n) { var out = []; for (var i = 1; i != n; i = i * 2) { push(out, i); } out }; f(64)",
+    "var f = function(n) { var out = []; for (var i = 0; i < n; i = i + 1) { push(out, i); } out }; f(\"x\")",
+    "var f = function(n) { var out = []; for (var i = 0; i < n; i = i + 1) { push(out, i); } out }; f(missing)",
+    // the loop variable stops being an integer half way
+    "var f = function() { var out = []; for (var i = 0; i < 3; i = i + 1) { i = \"s\"; push(out, i); } out }; f()",
+    "var f = function(x) { if (x == 1) { \"one\" } else { \"other\" } }; [f(1), f(true), f(2)]",
+    "var f = function(x, y) { if (x < y) { x } else { y } }; [f(1, 2), f(5, 3)]",
+    "var f = function(x, y) { if (x < y) { x } else { y } }; f(\"a\", 1)",
+    "var f = function(x) { [x + 1, x - 1, x * 3, x < 2, x > 2, x == 2, x != 2] }; f(2)",
+    "var f = function(x) { x + 1 }; f(\"a\")",
+    "var f = function() { nothing == 1 }; f()",
+    "var f = function() { len == 1 }; f()",
+    // assigning a name bound further out binds it in this scope
+    "var n = 5; var f = function() { n = n + 1; n = n + 1; n }; [f(), n]",
+    "var f = function() { var t = 0; t = t + 5; t = t * 3; t = t - 1 }; f()",
+  };
+
+  for (const auto& input : tests) {
+    std::string results[2];
+    for (int vm = 0; vm < 2; vm++) {
+      evaluator_.SetVmEnabled(vm == 1);
+      Object* obj = TestEval_(input);
+      results[vm] = obj != nullptr ? obj->Inspect() : "nullptr";
+      evaluator_.FinalCleanup();
+    }
+    evaluator_.SetVmEnabled(true);
+
+    if (results[0] != results[1]) {
+      std::cerr << "VM gave " << results[1] << ", tree walker " << results[0]
+          << " for: " << input << "\n";
+      return;
+    }
+  }
+
+  // a counting loop is entered with one fused test and closed with another
+  std::string input = "var f = function(n) { var out = []; for (var i = 0; i < n; i = i + 1) {"
+      " if (i == 2) { push(out, \"two\"); } } len(out) }; f(4)";
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  if (!TestIntegerObject_(evaluator_.Eval(program, env), 1)) {
+    return;
+  }
+
+  auto f = dynamic_cast<Function*>(env->Get("f"));
+  std::shared_ptr<VmChunk> chunk = f != nullptr ? f->GetBody()->GetChunk() : nullptr;
+  if (chunk == nullptr) {
+    std::cerr << "f did not run as a chunk\n";
+    return;
+  }
+
+  std::string code = chunk->String();
+  for (const char* op : {"BRANCH_NAME_NAME", "BRANCH_NAME_INT", "INC_BRANCH"}) {
+    if (code.find(op) == std::string::npos) {
+      std::cerr << "no " << op << " in:\n" << code;
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestSuperinstructions_() passed\n";
+}
+
+void EvaluatorTest::TestJit_() {
+  struct Test {
+    std::string input;
+    int64_t expected;
+  };
+
+  // each function is called often enough to be compiled part way through
+  std::vector<Test> tests = {
+    {"var fib = function(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(20)", 6765},
+    {"var count = function(n, acc) { if (n == 0) { return acc; } return count(n - 1, acc + n); };"
+     "count(100000, 0)", 5000050000},
+    // assignments in a loop bind in the loop's scope
+    {"var f = function(n) { var r = 7; for (var i = 0; i < n; i = i + 1) { r = i * 2; } r };"
+     "for (var i = 0; i < 200; i = i + 1) { f(i) } f(5)", 7},
+    {"var f = function(n) { var q = n / 3; if (q > 5) { -(q - 5) } else { q * 2 } };"
+     "for (var i = 0; i < 200; i = i + 1) { f(i) } f(30) + f(9)", 1},
+    // a callee rebound after compiling sends calls back to the interpreter
+    {"var g = function(x) { x + 1 }; var f = function(x) { g(x) * 2 };"
+     "for (var i = 0; i < 200; i = i + 1) { f(i) } g = function(x) { x + 2 }; f(1)", 6},
+    // non integer arguments are interpreted
+    {"var id = function(x) { x }; for (var i = 0; i < 200; i = i + 1) { id(i) } len(id(\"abc\"))", 3},
+  };
+
+  for (auto tt : tests) {
+    if (!TestIntegerObject_(TestEval_(tt.input), tt.expected)) {
+      std::cerr << "input: " << tt.input << "\n";
+      return;
+    }
+  }
+
+  std::string input =
+    "var even = function(n) { if (n == 0) { return true; } !even(n - 1) };"
+    "for (var i = 0; i < 200; i = i + 1) { even(i) } even(51)";
+
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  if (!TestBooleanObject_(evaluator_.Eval(program, env), false)) {
+    return;
+  }
+
+  auto even = dynamic_cast<Function*>(env->Get("even"));
+  if (even == nullptr || even->GetBody()->GetJit().code == nullptr) {
+    std::cerr << "even was not compiled\n";
+    return;
+  }
+
+  if (even->GetBody()->GetJit().code->GetType() != JitType::BOOL) {
+    std::cerr << "even should be compiled to return a boolean\n";
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestJit_() passed\n";
+}
+
+void EvaluatorTest::TestFlatClosures_() {
+  struct Test {
+    std::string input;
+    int64_t expected;
+  };
+
+  std::vector<Test> tests = {
+    {"var add = function(a) { function(b) { function(c) { a + b + c } } }; add(1)(2)(3)", 6},
+    // rebound after the closure is created: it has to see the new value
+    {"var f = function() { var a = 1; var g = function() { a }; a = 5; g() }; f()", 5},
+    {"var f = function(n) {"
+     "  var r = function(k) { if (k < 1) { return 0; } k + r(k - 1) };"
+     "  r(n)"
+     "}; f(4)", 10},
+    {"var fs = []; for (var i = 0; i < 3; i = i + 1) { push(fs, function() { i }) } fs[0]()", 3},
+    // globals are looked up when called, not copied
+    {"var f = function() { function() { z } }; var h = f(); var z = 9; h()", 9},
+  };
+
+  for (auto tt : tests) {
+    if (!TestIntegerObject_(TestEval_(tt.input), tt.expected)) {
+      std::cerr << "input: " << tt.input << "\n";
+      return;
+    }
+  }
+
+  // the closure keeps y, not the array or the parameter next to it
+  std::string input =
+    "var mk = function(x) { var big = [1, 2, 3]; var y = x + 1; function() { y } };"
+    "var g = mk(1); g()";
+
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  if (!TestIntegerObject_(evaluator_.Eval(program, env), 2)) {
+    return;
+  }
+
+  auto g = dynamic_cast<Function*>(env->Get("g"));
+  if (g == nullptr) {
+    std::cerr << "g is not a Function\n";
+    return;
+  }
+
+  std::unordered_map<std::string, Object*> captured = g->GetEnv()->GetStore();
+  if (captured.size() != 1 || captured.count("y") == 0 || g->GetEnv()->GetOuter() != env) {
+    std::cerr << "closure should capture only y in front of the global scope, got "
+      << captured.size() << " variables\n";
+    return;
+  }
+
+  std::cout << "TestFlatClosures_() passed\n";
+}
+
+void EvaluatorTest::TestEscapeAnalysis_() {
+  struct Test {
+    std::string input;
+    int64_t expected;
+    size_t objects; // objects still tracked once the input has run
+  };
+
+  std::vector<Test> tests = {
+    // no closure: the call's temporaries are gone as soon as it returns,
+    // leaving the function and its result (the argument is a literal)
+    {"var f = function(x) { var y = x * 2; var z = y + 1; z }; f(3);", 7, 2},
+    // the loop leaves the two values t was rebound over (s is a literal)
+    {"var s = 0; for (var i = 0; i < 3; i = i + 1) { var t = i * i; } s", 0, 2},
+    // a closure captures the scope: nothing may be freed from under it
+    {"var mk = function(x) { var y = x + 1; function() { y } }; mk(1)()", 2, 3},
+    // tail calls switching between local and captured scopes
+    {"var get = function(f) { f() };"
+     "var mk = function(n) { var m = n * 10; get(function() { m }) };"
+     "var go = function(n) { mk(n) };"
+     "go(4)", 40, 5},
+    // arrays passed in keep what is pushed into them
+    {"var arr = []; var f = function(a) { push(a, 1 + 2); 0 }; f(arr); arr[0]", 3, 3},
+  };
+
+  for (auto tt : tests) {
+    size_t before = evaluator_.GetNumObjects();
+    if (!TestIntegerObject_(TestEval_(tt.input), tt.expected)) {
+      std::cerr << "input: " << tt.input << "\n";
+      return;
+    }
+    size_t objects = evaluator_.GetNumObjects() - before;
+    if (objects != tt.objects) {
+      std::cerr << "objects left wrong. expected: " << tt.objects
+        << ", got: " << objects << "\ninput: " << tt.input << "\n";
+      return;
+    }
+  }
+
+  std::cout << "TestEscapeAnalysis_() passed\n";
+}
+
+void EvaluatorTest::TestCallSiteCache_() {
+  struct Test {
+    std::string input;
+    int64_t expected;
+  };
+
+  std::vector<Test> tests = {
+    // one call site, several callees: the cache has to follow the callee
+    {"var inc = function(x) { return x + 1; };"
+     "var dec = function(x) { return x - 1; };"
+     "var apply = function(f, x) { return f(x); };"
+     "apply(inc, 1) + apply(dec, 10) + apply(inc, 100);", 112},
+    {"var inc = function(x) { x + 1 };"
+     "var dec = function(x) { x - 1 };"
+     "var apply = function(f, x) { var r = f(x); r };"
+     "apply(inc, 1) + apply(dec, 10) + apply(inc, 100);", 112},
+    // user function and builtin through the same site
+    {"var five = function(s) { 5 };"
+     "var apply = function(f) { return f(\"hello\"); };"
+     "apply(five) + apply(len) + apply(five);", 15},
+  };
+
+  for (auto tt : tests) {
+    if (!TestIntegerObject_(TestEval_(tt.input), tt.expected)) {
+      std::cerr << "input: " << tt.input << "\n";
+      return;
+    }
+  }
+
+  std::string input =
+    "var sq = function(x) { x * x };"
+    "sq(2); sq(3);";
+
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  auto es = std::dynamic_pointer_cast<ExpressionStatement>(program->GetStatements()[2]);
+  auto call = std::dynamic_pointer_cast<CallExpression>(es->GetExpression());
+
+  if (!TestIntegerObject_(evaluator_.Eval(program, env), 9)) {
+    return;
+  }
+
+  const CallSiteCache& cache = call->GetCache();
+  if (cache.callee == nullptr || cache.builtIn || cache.params == nullptr
+      || cache.params->size() != 1 || cache.body == nullptr) {
+    std::cerr << "call site cache was not filled\n";
+    return;
+  }
+
+  std::cout << "TestCallSiteCache_() passed\n";
+}
+
+void EvaluatorTest::TestQuickening_() {
+  std::string input =
+    "var add = function(a, b) { return a + b; };"
+    "add(1, 2); add(3, 4); add(5, 6);";
+
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  auto vs = std::dynamic_pointer_cast<VarStatement>(program->GetStatements()[0]);
+  auto fn = std::dynamic_pointer_cast<FunctionLiteral>(vs->GetValue());
+  auto rs = std::dynamic_pointer_cast<ReturnStatement>(fn->GetBody()->GetStatements()[0]);
+  auto infix = std::dynamic_pointer_cast<InfixExpression>(rs->GetReturnVal());
+
+  // what is checked is the tree walker specializing: add must neither be
+  // compiled nor run by the VM, whose superinstructions skip the node
+  evaluator_.SetJitEnabled(false);
+  evaluator_.SetVmEnabled(false);
+  Object* result = evaluator_.Eval(program, env);
+  evaluator_.SetJitEnabled(true);
+  if (!TestIntegerObject_(result, 11)) {
+    return;
+  }
+
+  if (infix->GetKind() != InfixKind::INT_ADD) {
+    std::cerr << "infix did not specialize to INT_ADD. got="
+      << static_cast<int>(infix->GetKind()) << "\n";
+    return;
+  }
+
+  // strings fail the integer guard and must take the generic path
+  auto call = std::make_shared<Lexer>("add(\"foo\", \"bar\");");
+  Object* obj = evaluator_.Eval(std::make_shared<Parser>(call)->ParseProgram(), env);
+  auto str = dynamic_cast<String*>(obj);
+  if (str == nullptr || str->GetValue().compare("foobar") != 0) {
+    std::cerr << "deoptimized add returned wrong value\n";
+    return;
+  }
+
+  evaluator_.SetVmEnabled(true);
+  if (infix->GetKind() != InfixKind::GENERIC) {
+    std::cerr << "infix did not deoptimize to GENERIC. got="
+      << static_cast<int>(infix->GetKind()) << "\n";
+    return;
+  }
+
+  std::vector<IntegerTest> tests = {
+    (IntegerTest){.input =
+      "var x = 10; var f = function() { var a = x; var x = 5; return a + x; };"
+      "f(); f();", .expectedVal = 15},
+    (IntegerTest){.input =
+      "var x = 1; var f = function() { return x; }; var g = function(x) { return f(); };"
+      "g(5);", .expectedVal = 1}
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expectedVal)) {
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestQuickening_() passed\n";
+}
+
+void EvaluatorTest::TestSlotCache_() {
+  // the calls build scopes of their own, which must not cost the loop its
+  // cached slots; only a binding on the way to a slot may
+  std::string input =
+    "var f = function(x) { 1 }; var n = 2;"
+    "for (var i = 0; i < 1000; i = i + 1) { f(i) * n; } f(0) + n;";
+  std::string shadowed =
+    "var x = 1; var g = function() { var s = x; var x = 2; s + x }; g() + g();";
+
+  evaluator_.SetJitEnabled(false);
+  for (bool vm : {false, true}) {
+    evaluator_.SetVmEnabled(vm);
+    size_t misses = evaluator_.GetSlotMisses();
+    Object* obj = TestEval_(input);
+    misses = evaluator_.GetSlotMisses() - misses;
+    if (!TestIntegerObject_(obj, 3) || !TestIntegerObject_(TestEval_(shadowed), 6)) {
+      evaluator_.SetVmEnabled(true);
+      evaluator_.SetJitEnabled(true);
+      return;
+    }
+
+    if (misses > 100) {
+      std::cerr << "slot caches missed " << misses << " times over 1000 calls"
+        << (vm ? " in the vm" : "") << "\n";
+      evaluator_.SetVmEnabled(true);
+      evaluator_.SetJitEnabled(true);
+      return;
+    }
+  }
+  evaluator_.SetVmEnabled(true);
+  evaluator_.SetJitEnabled(true);
+
+  std::cout << "TestSlotCache_() passed\n";
+}
+
+void EvaluatorTest::TestStackOverflow_() {
+  std::string deep =
+    "var sum = function(n) { if (n == 0) { return 0; } return 1 + sum(n - 1); };"
+    "sum(5000);";
+  std::string endless = "var f = function(n) { return 1 + f(n); }; f(0);";
+  std::string expected = "stack overflow: maximum recursion depth exceeded";
+
+  if (!TestIntegerObject_(TestRun_(deep), 5000)) {
+    return;
+  }
+
+  // native code that runs out of stack is not entered again while the
+  // interpreter redoes the call: one pass down the stack, not one per level
+  std::string deeper =
+    "var deep = function(n) { if (n == 0) { return 0; } return 1 + deep(n - 1); };"
+    "deep(100000000);";
+
+  size_t maxStack = evaluator_.GetMaxStackSize();
+  evaluator_.SetMaxStackSize(16 * 1024 * 1024);
+  std::vector<Object*> results = {TestRun_(endless), TestEval_(endless)};
+  evaluator_.SetMaxStackSize(64 * 1024 * 1024);
+  auto start = std::chrono::steady_clock::now();
+  results.push_back(TestRun_(deeper));
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  evaluator_.SetMaxStackSize(maxStack);
+
+  if (elapsed.count() > 10) {
+    std::cerr << "overflowing a 64 MB stack took " << elapsed.count() << " s\n";
+    return;
+  }
+
+  for (const auto& obj : results) {
+    auto err = dynamic_cast<Error*>(obj);
+    if (err == nullptr) {
+      std::cerr << "obj is not an Error*\n";
+      return;
+    }
+
+    if (err->GetMessage().compare(expected) != 0) {
+      std::cerr << "wrong message. expected: " << expected
+        << ", got: " << err->GetMessage() << "\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestStackOverflow_() passed\n";
+}
+
+void EvaluatorTest::TestTailCalls_() {
+  std::vector<IntegerTest> tests = {
+    (IntegerTest){.input =
+      "var loop = function(n, acc) {"
+        "if (n == 0) { return acc; }"
+        "return loop(n - 1, acc + 1);"
+      "};"
+      "loop(200000, 0);", .expectedVal = 200000},
+    (IntegerTest){.input =
+      "var count = function(n, acc) {"
+        "if (n == 0) { return acc; } else { return count(n - 1, acc + 2); }"
+      "};"
+      "count(100000, 0);", .expectedVal = 200000},
+    (IntegerTest){.input =
+      "var isEven = function(n) { if (n == 0) { return 1; } return isOdd(n - 1); };"
+      "var isOdd = function(n) { if (n == 0) { return 0; } return isEven(n - 1); };"
+      "isEven(100001);", .expectedVal = 0},
+    (IntegerTest){.input =
+      "var twice = function(x) { return x * 2; };"
+      "var apply = function(f, x) { return f(x); };"
+      "apply(twice, 21);", .expectedVal = 42}
+  };
+
+  for (const auto& test : tests) {
+    Object* obj = TestEval_(test.input);
+    if (!TestIntegerObject_(obj, test.expectedVal)) {
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestTailCalls_() passed\n";
+}
+
 void EvaluatorTest::TestAssignEval_() {
   std::vector<IntegerTest> tests = {
     (IntegerTest){.input = "var x = 10; x = 11;", .expectedVal = 11},
@@ -138,9 +704,10 @@ void EvaluatorTest::TestArrays_() {
       return;
     }
 
-    std::shared_ptr<std::vector<Object*>> elements = arr->GetElements();
     for (size_t i = 0; i < test.expected.size(); i++) {
-      if (!TestIntegerObject_((*elements)[i], test.expected[i])) {
+      if (!arr->IsPacked() || arr->GetInt(i) != test.expected[i]) {
+        std::cerr << "array element " << i << " wrong. expected: " << test.expected[i]
+            << ", got: " << arr->Inspect() << "\n";
         return;
       }
     }
@@ -150,6 +717,224 @@ void EvaluatorTest::TestArrays_() {
   std::cout << "TestArrays_() passed\n";
 }
 
+void EvaluatorTest::TestPackedArrays_() {
+  struct Test {
+    std::string input;
+    std::string expected;
+    bool packed;
+  };
+  std::vector<Test> tests = {
+    {"var a = []; for (var i = 0; i < 4; i = i + 1) { push(a, i * i); } a", "[0, 1, 4, 9]", true},
+    {"[1, -2, 3]", "[1, -2, 3]", true},
+    // anything but an integer boxes what is already there
+    {"var a = [1, 2]; push(a, true); a", "[1, 2, true]", false},
+    {"var a = [1, 2]; push(a, [3]); push(a, 4); a", "[1, 2, [3], 4]", false},
+    {"[\"x\", 1]", "[x, 1]", false},
+    // a view keeps what it saw when its array is boxed
+    {"var a = [1, 2, 3]; var v = slice(a, 0, 2); push(a, \"x\"); v", "[1, 2]", true},
+    {"var a = [1, 2, 3]; var v = slice(a, 1, 3); push(v, false); v", "[2, 3, false]", false},
+  };
+
+  for (const auto& test : tests) {
+    auto arr = dynamic_cast<Array*>(TestEval_(test.input));
+    if (arr == nullptr) {
+      std::cerr << test.input << " is not an Array\n";
+      return;
+    }
+
+    if (arr->Inspect() != test.expected || arr->IsPacked() != test.packed) {
+      std::cerr << test.input << " wrong. expected: " << test.expected
+          << (test.packed ? " packed" : " boxed") << ", got: " << arr->Inspect()
+          << (arr->IsPacked() ? " packed" : " boxed") << "\n";
+      return;
+    }
+  }
+
+  std::vector<IntegerTest> reads = {
+    {"var a = [5, 6, 7]; a[0] + a[2]", 12},
+    {"var a = [5, 6]; push(a, \"x\"); a[1]", 6},
+    {"var sum = function(a, i, acc) { if (i == len(a)) { return acc; } sum(a, i + 1, acc + a[i]) };"
+      " var a = []; for (var i = 0; i < 1000; i = i + 1) { push(a, i); } sum(a, 0, 0)", 499500},
+  };
+  for (const auto& test : reads) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expectedVal)) {
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestPackedArrays_() passed\n";
+}
+
+void EvaluatorTest::TestArrayOperators_() {
+  struct Test {
+    std::string input;
+    std::string expected;
+  };
+  std::string big = "var a = []; for (var i = 0; i < 11; i = i + 1) { push(a, i); } ";
+  std::vector<Test> tests = {
+    {"[1, 2, 3] + [10, 20, 30]", "[11, 22, 33]"},
+    {"[1, 2, 3] * 2 - 1", "[1, 3, 5]"},
+    {"10 - [1, 2, 3]", "[9, 8, 7]"},
+    {"[7, -7, 9] / 2", "[3, -3, 4]"},
+    {"[1, 5, 3] < [2, 2, 3]", "[true, false, false]"},
+    {"2 > [1, 2, 3]", "[true, false, false]"},
+    {"[] + []", "[]"},
+    // lengths the vector loops leave a tail on, and views into the middle
+    {big + "a * a", "[0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100]"},
+    {big + "slice(a, 3, 10) - slice(a, 1, 8)", "[2, 2, 2, 2, 2, 2, 2]"},
+    {big + "a > 7", "[false, false, false, false, false, false, false, false, true, true, true]"},
+    {"[-9223372036854775807 - 1] / -1", "[-9223372036854775808]"},
+    // boxed elements go one at a time, arrays in arrays included
+    {"[\"a\", 1] + [\"b\", 2]", "[ab, 3]"},
+    {"[[1, 2], [3]] * 2", "[[2, 4], [6]]"},
+    {"var f = function(a, b) { a * b + a }; f([1, 2], [3, 4])", "[4, 10]"},
+    // == and != still ask whether both sides are the same array
+    {"var a = [1]; a == a", "true"},
+    {"[1] == [1]", "false"},
+    {"[1, 2] + [1]", "ERROR: array lengths differ: 2 + 1"},
+    {"[1, 2] / [1, 0]", "ERROR: division by zero"},
+    {"[1, true] + 1", "ERROR: unknown operator: BOOLEAN + INTEGER"},
+    {"[1] + \"a\"", "ERROR: unknown operator: INTEGER + STRING"},
+  };
+
+  for (const auto& test : tests) {
+    Object* obj = TestEval_(test.input);
+    if (obj == nullptr || obj->Inspect() != test.expected) {
+      std::cerr << test.input << " wrong. expected: " << test.expected << ", got: "
+          << (obj != nullptr ? obj->Inspect() : "nullptr") << "\n";
+      return;
+    }
+  }
+
+  // arithmetic keeps integers packed
+  auto arr = dynamic_cast<Array*>(TestEval_("var a = [1, 2]; var b = slice([5, 6, 7], 1, 3); a * b"));
+  if (arr == nullptr || !arr->IsPacked() || arr->Inspect() != "[6, 14]") {
+    std::cerr << "array product is not packed\n";
+    return;
+  }
+
+  // a comparison that makes an array ends a for loop, as any other value
+  // but true does, in the VM's fused branch as in the tree walker
+  std::string loop =
+    "var f = function(a) { for (var i = 0; i < a; i = i + 1) { if (i > 3) { return 1; } } 0 };"
+    "f([5]) + f([5]);";
+  if (!TestIntegerObject_(TestEval_(loop), 0) || !TestIntegerObject_(TestRun_(loop), 0)) {
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestArrayOperators_() passed\n";
+}
+
+void EvaluatorTest::TestHashes_() {
+  struct Test {
+    std::string input;
+    std::string expected;
+  };
+  std::vector<Test> tests = {
+    {"{\"one\": 1, 2: \"two\", true: [3], false: {}}", "{one: 1, 2: two, true: [3], false: {}}"},
+    {"var k = \"a\"; {k + \"b\": 1 + 1, (k): 3}", "{ab: 2, a: 3}"},
+    // a later pair rebinds a key in place
+    {"{1: 1, 2: 2, 1: 3}", "{1: 3, 2: 2}"},
+    {"{\"a\": 1}[\"a\"]", "1"},
+    {"{\"a\": 1}[\"b\"]", "null"},
+    {"{1: 2}[true]", "null"},
+    {"var f = function(k) { var h = {(k): k * 2}; h[k] }; f(21)", "42"},
+    {"var h = {}; for (var i = 0; i < 100; i = i + 1) { set(h, \"k\" + \"\", i); } h", "{k: 99}"},
+    {"{[1]: 2}", "unusable as hash key: ARRAY"},
+    {"{1: 2}[[1]]", "object [1] is not an integer"},
+    {"[1, 2][\"a\"]", "object a is not an integer"},
+    {"{1: missing}", "unexpected identifier: missing"},
+  };
+
+  for (const auto& test : tests) {
+    Object* obj = TestEval_(test.input);
+    auto err = dynamic_cast<Error*>(obj);
+    std::string got = err != nullptr ? err->GetMessage() : obj->Inspect();
+    if (got != test.expected) {
+      std::cerr << test.input << " wrong. expected: " << test.expected << ", got: " << got << "\n";
+      return;
+    }
+  }
+
+  // keys survive deletes and the table growing around them
+  std::string churn = "var h = {}; for (var i = 0; i < 5000; i = i + 1) { set(h, i, i * 3); } "
+      "for (var i = 0; i < 5000; i = i + 1) { if (i / 3 * 3 != i) { delete(h, i); } } ";
+  std::vector<IntegerTest> reads = {
+    {churn + "len(keys(h))", 1667},
+    {churn + "h[2997]", 8991},
+    {churn + "set(h, 1, 7); h[1] + len(values(h))", 7 + 1668},
+    {churn + "keys(h)[1]", 3},
+  };
+  for (const auto& test : reads) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expectedVal)) {
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestHashes_() passed\n";
+}
+
+void EvaluatorTest::TestRecords_() {
+  struct Test {
+    std::string input;
+    std::string expected;
+  };
+  std::vector<Test> tests = {
+    {"var p = {x: 1, y: 2}; p.x + p.y * 10", "21"},
+    {"{x: 1, y: \"a\" + \"b\", z: [3]}", "{x: 1, y: ab, z: [3]}"},
+    // a repeated field keeps its first slot and takes the last value
+    {"{x: 1, y: 2, x: 3}", "{x: 3, y: 2}"},
+    {"{a: {b: {c: 7}}}.a.b.c", "7"},
+    {"var get = function(r) { r.x }; get({x: 1}) + get({y: 2, x: 20}) + get({x: 300, y: 3})", "321"},
+    {"var f = function(n) { var r = {v: n}; r.v * 2 }; f(21)", "42"},
+    {"{x: 1}.y", "record has no field y"},
+    {"[1].x", "object [1] is not a record"},
+    {"{x: missing}", "unexpected identifier: missing"},
+  };
+
+  for (const auto& test : tests) {
+    for (bool vm : {false, true}) {
+      Object* obj = vm ? TestRun_(test.input) : TestEval_(test.input);
+      auto err = dynamic_cast<Error*>(obj);
+      std::string got = err != nullptr ? err->GetMessage() : obj->Inspect();
+      if (got != test.expected) {
+        std::cerr << test.input << " wrong. expected: " << test.expected << ", got: " << got << "\n";
+        return;
+      }
+    }
+  }
+
+  // records built the same way share a shape, whichever literal built them
+  auto pair = dynamic_cast<Array*>(TestEval_("var mk = function(a) { {x: a, y: a} }; [mk(1), {x: 2, y: 3}]"));
+  if (pair == nullptr || static_cast<Record*>(pair->Get(0))->GetShape()
+      != static_cast<Record*>(pair->Get(1))->GetShape()) {
+    std::cerr << "records of one layout do not share a shape\n";
+    return;
+  }
+
+  // a field read fills its cache with the shape it saw
+  std::string input = "var p = {y: 1, x: 2}; p.x";
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  auto es = std::dynamic_pointer_cast<ExpressionStatement>(program->GetStatements()[1]);
+  auto field = std::dynamic_pointer_cast<FieldExpression>(es->GetExpression());
+  auto env = std::make_shared<Environment<Object*>>();
+  if (!TestIntegerObject_(evaluator_.Eval(program, env), 2)) {
+    return;
+  }
+  if (field->GetCache().shape != Shape::Of({"y", "x"}) || field->GetCache().offset != 1) {
+    std::cerr << "field cache was not filled\n";
+    return;
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestRecords_() passed\n";
+}
+
 void EvaluatorTest::TestStringConcat_() {
   std::string input = "\"hello\" + \" world\"";
 
@@ -165,11 +950,89 @@ void EvaluatorTest::TestStringConcat_() {
         << ", got: " << str->GetValue() << "\n";
     return;
   }
+  evaluator_.FinalCleanup();
+
+  // long concatenations are ropes, spelled out only once they are read
+  std::string wrap = "var wrap = function(s, n) { if (n == 0) { return s; }"
+      " return wrap(\"<\" + s + \">\" + s, n - 1); }; ";
+  std::string build = "var build = function(s, n) { if (n == 0) { return s; }"
+      " return build(s + \"ab\", n - 1); }; ";
+  std::string expected = "x";
+  for (int i = 0; i < 10; i++) {
+    expected = "<" + expected + ">" + expected;
+  }
+
+  struct Test {
+    std::string input;
+    std::string expected;
+  };
+  std::vector<Test> tests = {
+    {wrap + "wrap(\"x\", 10)", expected},
+    {build + "var s = build(\"\", 15000); s + \"!\"", std::string(30000, ' ') + "!"},
+  };
+  for (size_t i = 0; i < 30000; i++) {
+    tests[1].expected[i] = i % 2 == 0 ? 'a' : 'b';
+  }
+
+  for (const auto& tt : tests) {
+    auto rope = dynamic_cast<String*>(TestEval_(tt.input));
+    if (rope == nullptr || rope->Length() != tt.expected.size()
+        || rope->GetValue() != tt.expected) {
+      std::cerr << "rope spelled wrong for: " << tt.input << "\n";
+      return;
+    }
+    evaluator_.FinalCleanup();
+  }
+
+  // len counts a rope without spelling it out
+  if (!TestIntegerObject_(TestEval_(build + "len(build(\"\", 100000))"), 200000)) {
+    return;
+  }
 
   evaluator_.FinalCleanup();
   std::cout << "TestStringConat_() passed\n";
 }
 
+void EvaluatorTest::TestStringComparison_() {
+  std::string repeat = "var repeat = function(s, n) { if (n == 0) { return \"\"; }"
+      " return s + repeat(s, n - 1); }; ";
+  std::vector<BooleanTest> tests = {
+    {"\"abc\" == \"abc\"", true},
+    {"\"abc\" == \"abd\"", false},
+    {"\"abc\" != \"abd\"", true},
+    {"\"abc\" < \"abd\"", true},
+    {"\"b\" > \"abc\"", true},
+    {"\"ab\" < \"abc\"", true},
+    {"\"\" == \"\"", true},
+    {"\"a\" < \"a\"", false},
+    // computed strings against literals and each other
+    {"var x = \"ab\"; x + \"c\" == \"abc\"", true},
+    {repeat + "repeat(\"0123456789\", 10) == repeat(\"0123456789\", 10)", true},
+    {repeat + "repeat(\"0123456789\", 10) != repeat(\"0123456789\", 9) + \"0123456780\"", true},
+    {repeat + "repeat(\"0123456789\", 10) < repeat(\"0123456789\", 10) + \"a\"", true},
+  };
+
+  for (const auto& tt : tests) {
+    if (!TestBooleanObject_(TestEval_(tt.input), tt.expectedVal)) {
+      std::cerr << "input: " << tt.input << "\n";
+      return;
+    }
+    evaluator_.FinalCleanup();
+  }
+
+  // literals and short strings are interned, long computed ones are not
+  String literal("hello", true);
+  String joined(String("hel"), String("lo"));
+  String rope(String(std::string(40, 'a')), String(std::string(40, 'b')));
+  if (!literal.IsInterned() || !joined.IsInterned() || rope.IsInterned()
+      || !literal.Equals(joined) || literal.Hash() != joined.Hash() || rope.Length() != 80) {
+    std::cerr << "strings interned wrong\n";
+    return;
+  }
+
+  std::cout << "TestStringComparison_() passed\n";
+}
+
 void EvaluatorTest::TestStrings_() {
   StringTest test = {.input = "\"Hello World!\"", .expectedVal = "Hello World!"};
   Object* obj = TestEval_(test.input);
@@ -192,13 +1055,14 @@ void EvaluatorTest::TestStrings_() {
 
 void EvaluatorTest::TestGCollector_() {
   std::vector<CollectorTest> tests = {
-    (CollectorTest){.input = "var x = 1 + 2;", .before = 3, .after = 1},
-    (CollectorTest){.input = "var a = 3; var b = 5 + a;", .before = 3, .after = 2},
-    (CollectorTest){.input = "var a = 3; var b = 1 + 2 + a;", .before = 5, .after = 2},
-    (CollectorTest){.input = "var add = function(a, b) { a + b; }; var sum = add(1, 2)", .before = 4, .after = 2},
-    (CollectorTest){.input = "var str = \"something\"; var foobar = str + \"hello\";", .before = 3, .after = 2},
-    (CollectorTest){.input = "var arr = [1, 2, 3]", .before = 4, .after = 4},
-    (CollectorTest){.input = "var x = 10 + 11; x = 20;", .before = 4, .after = 1}
+    // literals are pinned constants, only computed values are collected
+    (CollectorTest){.input = "var x = 1 + 2;", .before = 1, .after = 1},
+    (CollectorTest){.input = "var a = 3; var b = 5 + a;", .before = 1, .after = 1},
+    (CollectorTest){.input = "var a = 3; var b = 1 + 2 + a;", .before = 2, .after = 1},
+    (CollectorTest){.input = "var add = function(a, b) { a + b; }; var sum = add(1, 2)", .before = 2, .after = 2},
+    (CollectorTest){.input = "var str = \"something\"; var foobar = str + \"hello\";", .before = 1, .after = 1},
+    (CollectorTest){.input = "var arr = [1, 2, 3]", .before = 1, .after = 1},
+    (CollectorTest){.input = "var x = 10 + 11; x = 20;", .before = 1, .after = 0}
   };
 
   for (const auto& test : tests) {
@@ -225,6 +1089,49 @@ void EvaluatorTest::TestGCollector_() {
 }
 
 
+void EvaluatorTest::TestLiteralConstants_() {
+  // a literal gives the same untracked object every time it is evaluated
+  auto l = std::make_shared<Lexer>("var f = function() { \"hi\" }; 42");
+  std::shared_ptr<Program> program = std::make_shared<Parser>(l)->ParseProgram();
+  auto env = std::make_shared<Environment<Object*>>();
+
+  Object* first = evaluator_.Eval(program, env);
+  Object* second = evaluator_.Eval(program, env);
+  size_t objects = evaluator_.GetNumObjects();
+  if (!TestIntegerObject_(first, 42) || first != second) {
+    std::cerr << "integer literal not a constant\n";
+    return;
+  }
+
+  auto call = std::make_shared<Lexer>("f()");
+  std::shared_ptr<Program> calls = std::make_shared<Parser>(call)->ParseProgram();
+  Object* hi = evaluator_.Eval(calls, env);
+  if (hi == nullptr || hi->Inspect() != "hi" || evaluator_.Eval(calls, env) != hi
+      || evaluator_.GetNumObjects() != objects) {
+    std::cerr << "string literal not a constant\n";
+    return;
+  }
+  evaluator_.FinalCleanup();
+
+  // so nothing may change a value: negating makes a new Integer
+  std::vector<IntegerTest> tests = {
+    (IntegerTest){.input = "var n = 7; -n; n", .expectedVal = 7},
+    (IntegerTest){.input = "var f = function(x) { -x }; var a = 5; f(a) + a", .expectedVal = 0},
+    (IntegerTest){.input = "var f = function() { var out = []; for (var i = 0; i < 3; i = i + 1) {"
+      " push(out, -(4)); } out[0] + out[1] }; f()", .expectedVal = -8},
+  };
+
+  for (const auto& test : tests) {
+    if (!TestIntegerObject_(TestEval_(test.input), test.expectedVal)) {
+      std::cerr << "input: " << test.input << "\n";
+      return;
+    }
+    evaluator_.FinalCleanup();
+  }
+
+  std::cout << "TestLiteralConstants_() passed\n";
+}
+
 void EvaluatorTest::TestClosures_() {
   std::string input = 
   "var newAdder = function(x) {"
@@ -16,6 +16,8 @@ void TestNextToken() {
                       "\"foobar\""
                       "\"foo bar\""
                       "[1, 2, 3];"
+                      "{\"a\": 1};"
+                      "p.x;"
                       "for(){}";
 
   struct Test {
@@ -93,6 +95,16 @@ void TestNextToken() {
       {.expected_type = TokenType::INT, .expected_literal = "3"},
       {.expected_type = TokenType::RBRACKET, .expected_literal = "]"},
       {.expected_type = TokenType::SEMICOLON, .expected_literal = ";"},
+      {.expected_type = TokenType::LBRACE, .expected_literal = "{"},
+      {.expected_type = TokenType::STRING, .expected_literal = "a"},
+      {.expected_type = TokenType::COLON, .expected_literal = ":"},
+      {.expected_type = TokenType::INT, .expected_literal = "1"},
+      {.expected_type = TokenType::RBRACE, .expected_literal = "}"},
+      {.expected_type = TokenType::SEMICOLON, .expected_literal = ";"},
+      {.expected_type = TokenType::IDENT, .expected_literal = "p"},
+      {.expected_type = TokenType::DOT, .expected_literal = "."},
+      {.expected_type = TokenType::IDENT, .expected_literal = "x"},
+      {.expected_type = TokenType::SEMICOLON, .expected_literal = ";"},
       {.expected_type = TokenType::FOR, .expected_literal = "for"},
       {.expected_type= TokenType::LPAREN, .expected_literal = "("},
       {.expected_type = TokenType::RPAREN, .expected_literal = ")"},
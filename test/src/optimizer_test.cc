@@ -0,0 +1,403 @@
+#include <optimizer_test.h>
+#include <object.h>
+#include <lexer.h>
+#include <parser.h>
+#include <iostream>
+
+void OptimizerTest::Run() {
+  TestFolding_();
+  TestPropagation_();
+  TestBranchPruning_();
+  TestDeadCode_();
+  TestLoopInvariants_();
+  TestInlining_();
+  TestCommonSubexpressions_();
+  TestEvalParity_();
+  TestErrorParity_();
+  TestIncremental_();
+}
+
+/*
+  main test methods
+*/
+
+void OptimizerTest::TestFolding_() {
+  std::vector<OptimizerCase> tests = {
+    {"1 + 2 * 3;", "7"},
+    {"(10 - 4) / 2 < 4;", "true"},
+    {"\"foo\" + \"bar\";", "foobar"},
+    {"!true; -5; !5; true == false; true != false;", "false-5falsefalsetrue"},
+    // run time errors stay run time errors
+    {"10 / 0;", "(10 / 0)"},
+    {"\"a\" == \"a\";", "(a == a)"},
+    {"-\"a\";", "(-a)"},
+    {"x + 1 * 2;", "(x + 2)"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  std::cout << "TestFolding_() passed\n";
+}
+
+void OptimizerTest::TestPropagation_() {
+  std::vector<OptimizerCase> tests = {
+    {"var x = 5; var y = x * 2; y + 1;", "var x = 5;var y = 10;11"},
+    {"var s = \"a\"; s + \"b\";", "var s = a;ab"},
+    // assigned or declared more than once: never propagated
+    {"var x = 5; x = 6; x;", "var x = 5;x = 6x"},
+    {"var x = 1; var x = 2; x;", "var x = 1;var x = 2;x"},
+    {"var f = function(x) { x }; var x = 3; x;", "var f = function(x) { x };;var x = 3;x"},
+    // only after the declaration, only inside its scope
+    {"x; var x = 1; x;", "xvar x = 1;1"},
+    {"var f = function() { var k = 2; k }; k;", "var f = function({ var k = 2;2 };;k"},
+    {"if (c) { var z = 1; z; }; z;", "if c{ var z = 1;1 }z"},
+    {"for (var i = 0; i < 2 + 3; i = i + 1) { var k = 2; k * i; }",
+     "for(var i = 0;; (i < 5); i = (i + 1)) {\nvar k = 2;(2 * i)\n}"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  std::cout << "TestPropagation_() passed\n";
+}
+
+void OptimizerTest::TestBranchPruning_() {
+  std::vector<OptimizerCase> tests = {
+    {"if (true) { 1; } else { 2; }; 3;", "13"},
+    {"if (1 > 2) { 1; }; 3;", "3"},
+    {"if (0) { 1; } else { 2; }; 3;", "13"},
+    // the taken branch shares the enclosing scope
+    {"if (true) { var z = 1; }; z;", "var z = 1;1"},
+    // a trailing if that yields nothing still decides the program's value
+    {"3; if (false) { 1; };", "3if false{ 1 }"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  std::cout << "TestBranchPruning_() passed\n";
+}
+
+void OptimizerTest::TestDeadCode_() {
+  std::vector<OptimizerCase> tests = {
+    {"var g = function() { return 1; 2; 3; };", "var g = function({ return 1; };;"},
+    {"var g = function() { if (false) { 1 }; if (true) { return 5; }; 7; };",
+     "var g = function({ return 5; };;"},
+    {"var g = function(a) { if (a) { return 1; 2; }; 3; };",
+     "var g = function(a) { if a{ return 1; }3 };;"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  std::cout << "TestDeadCode_() passed\n";
+}
+
+void OptimizerTest::TestLoopInvariants_() {
+  struct Test {
+    std::string input;
+    std::vector<std::string> hoisted;
+    std::string condition;
+  };
+
+  std::vector<Test> tests = {
+    {"var g = function(arr) { for (var i = 0; i < len(arr); i = i + 1) { i * 2; } };",
+     {"len(arr);"}, "(i < $licm0)"},
+    {"var g = function(a, b) { for (var i = 0; i < 3; i = i + 1) { !(a < b); a / 2; a / b; } };",
+     {"(!(a < b))", "(a / 2)"}, "(i < 3)"},
+    // the loop variable is invariant too when nothing assigns it
+    {"var g = function(a) { for (var i = a; i < a + 1; a) { i * 2; } };",
+     {"(i < (a + 1))", "(i * 2)"}, "$licm0"},
+    // push can change what len and index see
+    {"var g = function(arr) { for (var i = 0; i < len(arr); i = i + 1) { push(arr, arr[0]); } };",
+     {}, "(i < len(arr);)"},
+    // user calls, assignments and declarations inside the loop block hoisting
+    {"var g = function(a, b, f) { for (var i = 0; i < 3; i = i + 1) { f(a * b); } };",
+     {}, "(i < 3)"},
+    {"var g = function(a, b) { for (var i = 0; i < 3; i = i + 1) { a = a + b; } };",
+     {}, "(i < 3)"},
+    {"var g = function(a, b) { for (var i = 0; i < 3; i = i + 1) { a * b; var b = 1; } };",
+     {}, "(i < 3)"},
+    // values are never changed in place, so a negation elsewhere is harmless
+    {"var g = function(a, b) { for (var i = 0; i < 3; i = i + 1) { a * b; }; -a; };",
+     {"(a * b)"}, "(i < 3)"},
+  };
+
+  for (const auto& tt : tests) {
+    std::shared_ptr<Program> program = Optimizer().Optimize(Parse_(tt.input));
+    auto vs = std::dynamic_pointer_cast<VarStatement>(program->GetStatements()[0]);
+    auto fn = std::dynamic_pointer_cast<FunctionLiteral>(vs->GetValue());
+    auto fs = std::dynamic_pointer_cast<ForStatement>(fn->GetBody()->GetStatements()[0]);
+
+    std::vector<std::string> hoisted;
+    for (const auto& stmt : fs->GetHoisted()) {
+      hoisted.push_back(stmt->GetValue()->String());
+    }
+
+    if (hoisted != tt.hoisted || fs->GetCondition()->String().compare(tt.condition) != 0) {
+      std::cerr << "wrong invariants hoisted. input: " << tt.input
+        << ", got " << hoisted.size() << " hoisted, condition: "
+        << fs->GetCondition()->String() << "\n";
+      return;
+    }
+  }
+
+  // an invariant of the inner loop moves on out of the outer loop
+  std::shared_ptr<Program> program = Optimizer().Optimize(Parse_(
+    "var g = function(a, b) { for (var i = 0; i < 3; i = i + 1) {"
+    " for (var j = 0; j < a * b; j = j + 1) { j; } } };"));
+  auto vs = std::dynamic_pointer_cast<VarStatement>(program->GetStatements()[0]);
+  auto fn = std::dynamic_pointer_cast<FunctionLiteral>(vs->GetValue());
+  auto outer = std::dynamic_pointer_cast<ForStatement>(fn->GetBody()->GetStatements()[0]);
+  auto inner = std::dynamic_pointer_cast<ForStatement>(outer->GetBlock()->GetStatements()[0]);
+
+  if (outer->GetHoisted().size() != 1 || inner->GetHoisted().size() != 1
+      || outer->GetHoisted()[0]->GetValue()->String().compare("(a * b)") != 0
+      || inner->GetHoisted()[0]->GetValue()->String().compare("$licm1") != 0) {
+    std::cerr << "nested invariant not hoisted out of the outer loop\n";
+    return;
+  }
+
+  std::cout << "TestLoopInvariants_() passed\n";
+}
+
+void OptimizerTest::TestInlining_() {
+  std::vector<OptimizerCase> tests = {
+    {"var add = function(a, b) { return a + b; }; var x = 3; add(1, 2); add(x, x * 2);",
+     "var add = function(a, b) { return (a + b); };;var x = 3;39"},
+    {"var sq = function(a) { a * a }; sq(y); sq(y[0]);",
+     "var sq = function(a) { (a * a) };;(y * y)sq(y[0]);"},
+    // calls through a parameter resolve once the argument is known
+    {"var apply = function(h, x) { h(x) }; var inc = function(x) { x + 1 }; apply(inc, z);",
+     "var apply = function(h, x) { h(x); };;var inc = function(x) { (x + 1) };;(z + 1)"},
+    // recursive, unused parameter, wrong arity, not yet declared or reassigned
+    {"var f = function(n) { f(n) }; f(1);", "var f = function(n) { f(n); };;f(1);"},
+    {"var one = function(x) { 1 }; one(5);", "var one = function(x) { 1 };;one(5);"},
+    {"var id = function(x) { x }; id(1, 2);", "var id = function(x) { x };;id(1, 2);"},
+    {"id(1); var id = function(x) { x };", "id(1);var id = function(x) { x };;"},
+    {"var id = function(x) { x }; id = 5; id(1);", "var id = function(x) { x };;id = 5id(1);"},
+    // free names must mean the same thing at every call site
+    {"var k = 1; var g = function(x) { x + k }; var h = function(k) { g(k) }; h(5);",
+     "var k = 1;var g = function(x) { (x + k) };;var h = function(k) { g(k); };;g(5);"},
+    {"var w = function(h) { h(h) }; w(w);", "var w = function(h) { h(h); };;w(w);"},
+    // an inlined tail call is no longer a tail call
+    {"var q = function(x) { return x; }; var r = function(y) { return q(y); };",
+     "var q = function(x) { return x; };;var r = function(y) { return y; };;"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  auto program = Parse_("var r = function(y) { return q(y); };");
+  auto rs = std::dynamic_pointer_cast<ReturnStatement>(
+      std::dynamic_pointer_cast<FunctionLiteral>(
+        std::dynamic_pointer_cast<VarStatement>(program->GetStatements()[0])->GetValue())
+      ->GetBody()->GetStatements()[0]);
+  if (!rs->IsTailCall()) {
+    std::cerr << "parser did not mark the tail call\n";
+    return;
+  }
+
+  Optimizer optimizer;
+  optimizer.Optimize(Parse_("var q = function(x) { return x; };" + program->String()));
+  std::vector<std::string> expected = {"q(y) => y"};
+  if (optimizer.GetInlineReport() != expected) {
+    std::cerr << "wrong inline report. got " << optimizer.GetInlineReport().size() << " lines\n";
+    return;
+  }
+
+  std::cout << "TestInlining_() passed\n";
+}
+
+void OptimizerTest::TestCommonSubexpressions_() {
+  std::vector<OptimizerCase> tests = {
+    {"arr[i] + arr[i] * arr[i];", "var $cse0 = arr[i];($cse0 + ($cse0 * $cse0))"},
+    {"var y = (a + b) * (a + b) + c * (a + b);",
+     "var $cse0 = (a + b);var y = (($cse0 * $cse0) + (c * $cse0));"},
+    // only the largest repeated tree gets a temporary
+    {"var x = (a + b + c) - (a + b + c);", "var $cse0 = ((a + b) + c);var x = ($cse0 - $cse0);"},
+    {"print(a + b, a + b);", "var $cse0 = (a + b);print($cse0, $cse0);"},
+    // the string "1" and the integer 1 are different trees
+    {"(\"1\" + x) + (1 + x);", "((1 + x) + (1 + x))"},
+    // assignments, pushes and user calls end what may be shared
+    {"x = (x + 1) * (x + 1);", "x = ((x + 1) * (x + 1))"},
+    {"push(arr, arr[i] + arr[i]);", "push(arr, (arr[i] + arr[i]));"},
+    {"f(arr[i]) + arr[i];", "(f(arr[i]); + arr[i])"},
+    // branches and divisions that may trap are left alone
+    {"if (a + b > 3) { a + b } else { 1 };", "if ((a + b) > 3){ (a + b) } else { 1 }"},
+    {"a / b + a / b;", "((a / b) + (a / b))"},
+    {"var g = function(a, b) { return len(a * b - a * b); };",
+     "var g = function(a, b) { var $cse0 = (a * b);return len(($cse0 - $cse0));; };;"},
+    // a temporary would run before whatever may fail or has effects ahead of it
+    {"f(a + b, a + b);", "f((a + b), (a + b));"},
+    {"var r = print(\"in\") + (a - 1) + (a - 1);", "var r = ((print(in); + (a - 1)) + (a - 1));"},
+    {"var g = function(a) { return (print(\"in\") == x) + (a * 2) + (a * 2); };",
+     "var g = function(a) { return (((print(in); == x) + (a * 2)) + (a * 2)); };;"},
+    // inlining sees the single statement body before it is split
+    {"var sq = function(a) { return (a + 1) * (a + 1); }; sq(x);",
+     "var sq = function(a) { var $cse0 = (a + 1);return ($cse0 * $cse0); };;"
+     "var $cse1 = (x + 1);($cse1 * $cse1)"},
+  };
+
+  if (!TestCases_(tests)) {
+    return;
+  }
+
+  std::cout << "TestCommonSubexpressions_() passed\n";
+}
+
+void OptimizerTest::TestEvalParity_() {
+  std::vector<std::string> tests = {
+    "var a = 2; var b = a * 21; b;",
+    "var f = function(n) { if (n < 2) { return n; }; return f(n - 1) + f(n - 2); }; f(10);",
+    "var x = 1; var f = function() { if (true) { return x + 1; }; 100; }; f();",
+    "var total = 0; for (var i = 0; i < 3 + 2; i = i + 1) { var k = 2; push([], k); } 7 * 6;",
+    "var g = function(a) { if (a > 1) { return 10; 20; }; 30; }; g(2) + g(0);",
+    "if (!false) { var z = 40; }; z + 2;",
+    "var g = function(a, b) { var out = []; for (var i = 0; i < 5; i = i + 1) { push(out, a * b + i); }"
+    " out }; var r = g(3, 4); r[0] + r[4];",
+    "var g = function(a, b) { var out = []; for (var i = 0; i < a; i = i + 1) {"
+    " for (var j = 0; j < a * b; j = j + 1) { push(out, j); } } len(out) }; g(3, 2);",
+    "var g = function(a) { var out = []; for (var i = 0; i < 3; i = i + 1) { push(out, i); a - \"x\"; }"
+    " len(out) }; g(1);",
+    "var g = function(a) { var out = []; for (var i = 0; i < 3; i = i + 1) { push(out, a - \"x\"); }"
+    " len(out) }; g(1);",
+    "var add = function(a, b) { return a + b; }; var r = function(y) { return add(y, 1); }; r(41);",
+    "var apply = function(h, x) { h(x) }; var dbl = function(x) { x * 2 };"
+    " var out = []; for (var i = 0; i < 4; i = i + 1) { push(out, apply(dbl, i)); } out[3] + len(out);",
+    "var first = function(a) { a[0] }; var arr = [5, 6]; first(arr) + first([7]);",
+    "var arr = [2, 3]; var i = 1; arr[i] + arr[i] * arr[i];",
+    "var g = function(a, b) { var o = []; for (var i = 0; i < 3; i = i + 1) {"
+    " push(o, (a * b + i) * (a * b + i)); } o[2] }; g(2, 3);",
+  };
+
+  for (const auto& input : tests) {
+    auto plain = dynamic_cast<Integer*>(TestEval_(input, false));
+    auto optimized = dynamic_cast<Integer*>(TestEval_(input, true));
+    if (plain == nullptr || optimized == nullptr) {
+      std::cerr << "result is not an Integer. input: " << input << "\n";
+      return;
+    }
+
+    if (plain->GetValue() != optimized->GetValue()) {
+      std::cerr << "optimized result differs. input: " << input
+        << ", expected: " << plain->GetValue() << ", got: " << optimized->GetValue() << "\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestEvalParity_() passed\n";
+}
+
+void OptimizerTest::TestErrorParity_() {
+  std::vector<std::string> tests = {
+    "var a = \"s\"; var r = len(x) + (a - 1) + (a - 1);",
+    "var a = \"s\"; var r = (len([]) == null) + (a * 2) + (a * 2);",
+    "var g = function(a) { (len([]) == null) + (a * 2) + (a * 2) }; g(\"s\");",
+    "var g = function(a) { var r = f(a) + (a - 1) + (a - 1); r }; g(\"s\");",
+  };
+
+  for (const auto& input : tests) {
+    auto plain = dynamic_cast<Error*>(TestEval_(input, false));
+    auto optimized = dynamic_cast<Error*>(TestEval_(input, true));
+    if (plain == nullptr || optimized == nullptr) {
+      std::cerr << "result is not an Error. input: " << input << "\n";
+      return;
+    }
+
+    if (plain->Inspect() != optimized->Inspect()) {
+      std::cerr << "optimized error differs. input: " << input
+        << ", expected: " << plain->Inspect() << ", got: " << optimized->Inspect() << "\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestErrorParity_() passed\n";
+}
+
+void OptimizerTest::TestIncremental_() {
+  // REPL lines run one after another in the same environment
+  std::vector<std::pair<std::string, std::string>> tests = {
+    {"var x = 1; var f = function() { return x; };", "x = 2; f();"},
+    {"var y = 1; var g = function(a) { a + y }; var h = function() { g(1) };", "y = 5; h();"},
+    {"var z = 1; var k = function() { z };", "var z = 3; k();"},
+  };
+
+  for (const auto& test : tests) {
+    auto env = std::make_shared<Environment<Object*>>();
+    Optimizer optimizer;
+    optimizer.SetIncremental(true);
+    evaluator_.Eval(optimizer.Optimize(Parse_(test.first)), env);
+    auto optimized = dynamic_cast<Integer*>(
+        evaluator_.Eval(optimizer.Optimize(Parse_(test.second)), env));
+
+    env = std::make_shared<Environment<Object*>>();
+    evaluator_.Eval(Parse_(test.first), env);
+    auto plain = dynamic_cast<Integer*>(evaluator_.Eval(Parse_(test.second), env));
+    if (plain == nullptr || optimized == nullptr || plain->GetValue() != optimized->GetValue()) {
+      std::cerr << "optimized REPL lines differ. input: " << test.first << " then "
+        << test.second << "\n";
+      return;
+    }
+  }
+
+  evaluator_.FinalCleanup();
+  std::cout << "TestIncremental_() passed\n";
+}
+
+/*
+  helpers
+*/
+
+std::shared_ptr<Program> OptimizerTest::Parse_(std::string input) {
+  auto l = std::make_shared<Lexer>(input.c_str());
+  auto p = std::make_shared<Parser>(l);
+  return p->ParseProgram();
+}
+
+bool OptimizerTest::TestCases_(const std::vector<OptimizerCase>& cases) {
+  for (const auto& test : cases) {
+    std::shared_ptr<Program> program = Optimizer().Optimize(Parse_(test.input));
+    if (program->String().compare(test.expected) != 0) {
+      std::cerr << "optimized program wrong. input: " << test.input
+        << ", expected: " << test.expected << ", got: " << program->String() << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Object* OptimizerTest::TestEval_(std::string input, bool optimize) {
+  std::shared_ptr<Program> program = Parse_(input);
+  if (optimize) {
+    Optimizer().Optimize(program);
+  }
+
+  auto env = std::make_shared<Environment<Object*>>();
+  return evaluator_.Eval(program, env);
+}
+
+int main() {
+  GCollector& gCollector = GCollector::getGCollector();
+  Boolean* TRUE = new Boolean(true);
+  Boolean* FALSE = new Boolean(false);
+  Null* NULL_T = new Null();
+  std::unordered_map<std::string, BuiltIn*> builtInFuncs = GetBuiltIns();
+
+  Evaluator evaluator(gCollector, TRUE, FALSE, NULL_T, builtInFuncs, true);
+
+  OptimizerTest test(evaluator);
+
+  test.Run();
+
+  return 0;
+}
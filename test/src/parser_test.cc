@@ -27,6 +27,8 @@ void ParserTest::Run() {
     TestCallExpressions_();
     TestStringLiteral_();
     TestArrayLiterals_();
+    TestHashLiterals_();
+    TestRecords_();
     TestIndexExpressions_();
     TestAssignExpressions_();
     TestForStatements_();
@@ -399,6 +401,97 @@ void ParserTest::TestArrayLiterals_() {
 }
 
 
+void ParserTest::TestHashLiterals_() {
+  std::vector<std::pair<std::string, std::string>> tests = {
+    {"{\"one\": 1, 2: 3 * 5, true: [a]};", "{one:1,2:(3 * 5),true:[a]}"},
+    {"{};", "{}"},
+    {"var h = {1: {2: 3},};", "var h = {1:{2:3}};"},
+    {"{(k): 1};", "{(k):1}"},
+  };
+
+  for (const auto& test : tests) {
+    auto l = std::make_shared<Lexer>(test.first.c_str());
+    auto p = std::make_shared<Parser>(l);
+    std::shared_ptr<Program> program = p->ParseProgram();
+    if (CheckParserErrors_(p)) {
+      return;
+    }
+
+    if (program->String() != test.second) {
+      std::cerr << "hash literal wrong. expected: " << test.second
+          << ", got: " << program->String() << "\n";
+      return;
+    }
+  }
+
+  std::vector<std::string> invalid = {"{1 2};", "{1: 2 3: 4};"};
+  for (const auto& input : invalid) {
+    auto l = std::make_shared<Lexer>(input.c_str());
+    auto p = std::make_shared<Parser>(l);
+    p->ParseProgram();
+    if (p->GetErrors().empty()) {
+      std::cerr << input << " parsed without errors\n";
+      return;
+    }
+  }
+
+  std::cout << "TestHashLiterals_() passed\n";
+}
+
+void ParserTest::TestRecords_() {
+  std::vector<std::pair<std::string, std::string>> tests = {
+    {"{x: 1, y: a + 2};", "{x:1,y:(a + 2)}"},
+    {"p.x;", "p.x"},
+    {"a.b.c + p.x[1] * 2;", "(a.b.c + (p.x[1] * 2))"},
+    {"-p.x;", "(-p.x)"},
+  };
+
+  for (const auto& test : tests) {
+    auto l = std::make_shared<Lexer>(test.first.c_str());
+    auto p = std::make_shared<Parser>(l);
+    std::shared_ptr<Program> program = p->ParseProgram();
+    if (CheckParserErrors_(p)) {
+      return;
+    }
+
+    if (program->String() != test.second) {
+      std::cerr << "record wrong. expected: " << test.second
+          << ", got: " << program->String() << "\n";
+      return;
+    }
+  }
+
+  // literals naming the same fields in the same order share a shape
+  auto l = std::make_shared<Lexer>("{x: 1, y: 2}; {x: 3, y: 4}; {y: 5, x: 6}; {x: 7, y: 8, x: 9};");
+  auto p = std::make_shared<Parser>(l);
+  std::shared_ptr<Program> program = p->ParseProgram();
+  std::vector<std::shared_ptr<RecordLiteral>> records;
+  for (const auto& stmt : program->GetStatements()) {
+    auto es = std::dynamic_pointer_cast<ExpressionStatement>(stmt);
+    records.push_back(std::dynamic_pointer_cast<RecordLiteral>(es->GetExpression()));
+  }
+  if (records[0]->GetShape() != records[1]->GetShape()
+      || records[0]->GetShape() == records[2]->GetShape()
+      || records[0]->GetShape() != records[3]->GetShape()
+      || records[3]->GetOffsets() != std::vector<int>({0, 1, 0})) {
+    std::cerr << "record shapes not shared\n";
+    return;
+  }
+
+  std::vector<std::string> invalid = {"{x: 1, 2: 3};", "{1: 2, x: 3};", "p.1;", "p.;"};
+  for (const auto& input : invalid) {
+    auto l = std::make_shared<Lexer>(input.c_str());
+    auto p = std::make_shared<Parser>(l);
+    p->ParseProgram();
+    if (p->GetErrors().empty()) {
+      std::cerr << input << " parsed without errors\n";
+      return;
+    }
+  }
+
+  std::cout << "TestRecords_() passed\n";
+}
+
 void ParserTest::TestStringLiteral_() {
   std::string input = "\"hello world\"";
 